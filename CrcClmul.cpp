@@ -0,0 +1,196 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+/*
+* CRC16 by carry-less multiplication folding (x86 PCLMULQDQ) and the batch
+* frame validation API. The kernel is picked at run time; CPUs without
+* PCLMULQDQ and the other architectures use CRC16Slice8.
+*
+* The reflected CRC of a block is folded 16 bytes at a time: a 128-bit block
+* A followed by 128 bits of data is replaced by A_hi * (x^192 mod P) ^
+* A_lo * (x^128 mod P), which is congruent modulo P, so the CRC of the
+* folded residue plus the tail equals the CRC of the whole frame. A CRC
+* seed enters the same way as the 0xFFFF initial value: XOR-ed into the
+* first two bytes.
+*/
+
+#include <CrcFsm.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MB_CRC_HAVE_CLMUL 1
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+// below this size the clmul setup costs more than it saves
+const size_t cbClmulMin = 112;
+// frames shorter than this are validated four at a time by CRC16TableX4
+const size_t cbBatchInterleaveMax = 64;
+
+#ifdef MB_CRC_HAVE_CLMUL
+
+// x^n mod P, P = 0x18005, bit-reflected into the top 16 bits of a qword;
+// the extra x introduced by the reflected multiply is accounted in n
+#define MB_XMOD( n ) MB_XMOD_##n
+#define MB_XMOD_127 0xC100000000000000ULL
+#define MB_XMOD_191 0xCCD0000000000000ULL
+#define MB_XMOD_255 0x5001000000000000ULL
+#define MB_XMOD_319 0xC991000000000000ULL
+#define MB_XMOD_383 0xAC91000000000000ULL
+#define MB_XMOD_447 0xAAA4000000000000ULL
+#define MB_XMOD_511 0x8101000000000000ULL
+#define MB_XMOD_575 0xC450000000000000ULL
+
+__attribute__((target("pclmul,sse2")))
+static inline __m128i
+Fold( __m128i xmmIn, __m128i xmmK )
+{
+    return _mm_xor_si128( _mm_clmulepi64_si128( xmmIn, xmmK, 0x00 ),
+                          _mm_clmulepi64_si128( xmmIn, xmmK, 0x11 ) );
+}
+
+__attribute__((target("pclmul,sse2")))
+static uint16_t
+CRC16ClmulKernel( uint16_t uCWord, const uint8_t* pbIn, size_t nIn )
+{
+    const __m128i xmmK128 = _mm_set_epi64x( MB_XMOD( 127 ), MB_XMOD( 191 ) );
+    const __m128i xmmInit = _mm_cvtsi32_si128( uCWord );
+    const __m128i xmmFFFF = _mm_cvtsi32_si128( 0xFFFF );
+    __m128i xmmR;
+
+    if( nIn >= 64 )
+    {
+        const __m128i xmmK512 = _mm_set_epi64x( MB_XMOD( 511 ), MB_XMOD( 575 ) );
+        const __m128i xmmK384 = _mm_set_epi64x( MB_XMOD( 383 ), MB_XMOD( 447 ) );
+        const __m128i xmmK256 = _mm_set_epi64x( MB_XMOD( 255 ), MB_XMOD( 319 ) );
+        __m128i xmm0 = _mm_xor_si128( _mm_loadu_si128( (const __m128i*)pbIn ), xmmInit );
+        __m128i xmm1 = _mm_loadu_si128( (const __m128i*)( pbIn + 16 ) );
+        __m128i xmm2 = _mm_loadu_si128( (const __m128i*)( pbIn + 32 ) );
+        __m128i xmm3 = _mm_loadu_si128( (const __m128i*)( pbIn + 48 ) );
+        for( pbIn += 64, nIn -= 64; nIn >= 64; pbIn += 64, nIn -= 64 )
+        {
+            xmm0 = _mm_xor_si128( Fold( xmm0, xmmK512 ), _mm_loadu_si128( (const __m128i*)pbIn ) );
+            xmm1 = _mm_xor_si128( Fold( xmm1, xmmK512 ), _mm_loadu_si128( (const __m128i*)( pbIn + 16 ) ) );
+            xmm2 = _mm_xor_si128( Fold( xmm2, xmmK512 ), _mm_loadu_si128( (const __m128i*)( pbIn + 32 ) ) );
+            xmm3 = _mm_xor_si128( Fold( xmm3, xmmK512 ), _mm_loadu_si128( (const __m128i*)( pbIn + 48 ) ) );
+        }
+        xmmR = _mm_xor_si128( _mm_xor_si128( Fold( xmm0, xmmK384 ), Fold( xmm1, xmmK256 ) ),
+                              _mm_xor_si128( Fold( xmm2, xmmK128 ), xmm3 ) );
+    }
+    else
+    {
+        xmmR = _mm_xor_si128( _mm_loadu_si128( (const __m128i*)pbIn ), xmmInit );
+        pbIn += 16;
+        nIn -= 16;
+    }
+
+    for( ; nIn >= 16; pbIn += 16, nIn -= 16 )
+        xmmR = _mm_xor_si128( Fold( xmmR, xmmK128 ), _mm_loadu_si128( (const __m128i*)pbIn ) );
+
+    // the residue has a zero initial value, so undo the 0xFFFF the scalar engine starts with
+    uint8_t arrbTail[32];
+    _mm_storeu_si128( (__m128i*)arrbTail, _mm_xor_si128( xmmR, xmmFFFF ) );
+    memcpy( arrbTail + 16, pbIn, nIn );
+    return CRC16Slice8( arrbTail, 16 + nIn );
+}
+
+static bool
+HasClmul()
+{
+    static const bool bClmul = __builtin_cpu_supports( "pclmul" ) && __builtin_cpu_supports( "sse2" );
+    return bClmul;
+}
+
+#endif // MB_CRC_HAVE_CLMUL
+
+uint16_t
+CRC16Clmul( const uint8_t* pbIn, size_t nIn )
+{
+    return CRC16ClmulUpdate( 0xFFFF, pbIn, nIn );
+}
+
+uint16_t
+CRC16ClmulUpdate( uint16_t uCWord, const uint8_t* pbIn, size_t nIn )
+{
+#ifdef MB_CRC_HAVE_CLMUL
+    if( nIn >= cbClmulMin && HasClmul() )
+        return CRC16ClmulKernel( uCWord, pbIn, nIn );
+#endif
+    return CRC16Slice8Update( uCWord, pbIn, nIn );
+}
+
+size_t
+CRC16CheckBatch(
+              const uint8_t* const* ppbFrames,
+              const size_t* pnFrames,
+              size_t nFrames,
+              uint8_t* pbValid )
+{
+    size_t nValid = 0;
+    const uint8_t* arrpbLane[4];
+    size_t arrnLane[4];
+    size_t arrnIndex[4];
+    size_t nLanes = 0;
+
+    for( size_t cFrame = 0; cFrame <= nFrames; cFrame ++ )
+    {
+        if( cFrame < nFrames && pnFrames[ cFrame ] >= cbBatchInterleaveMax )
+        {
+            bool bOK = CRC16Clmul( ppbFrames[ cFrame ], pnFrames[ cFrame ] ) == 0;
+            nValid += bOK;
+            if( pbValid )
+                pbValid[ cFrame ] = bOK;
+            continue;
+        }
+        if( cFrame < nFrames )
+        {
+            arrpbLane[ nLanes ] = ppbFrames[ cFrame ];
+            arrnLane[ nLanes ] = pnFrames[ cFrame ];
+            arrnIndex[ nLanes ] = cFrame;
+            nLanes ++;
+        }
+        if( nLanes == 4 || ( cFrame == nFrames && nLanes > 0 ) )
+        {
+            // idle lanes run over an empty frame
+            for( size_t cLane = nLanes; cLane < 4; cLane ++ )
+            {
+                arrpbLane[ cLane ] = arrpbLane[ 0 ];
+                arrnLane[ cLane ] = 0;
+            }
+            uint16_t arruCRC[4];
+            CRC16TableX4( arrpbLane, arrnLane, arruCRC );
+            for( size_t cLane = 0; cLane < nLanes; cLane ++ )
+            {
+                bool bOK = arruCRC[ cLane ] == 0;
+                nValid += bOK;
+                if( pbValid )
+                    pbValid[ arrnIndex[ cLane ] ] = bOK;
+            }
+            nLanes = 0;
+        }
+    }
+    return nValid;
+}
@@ -30,9 +30,8 @@
 	break;
 
 uint16_t
-CRC16Fsm( const uint8_t* pbIn, size_t nIn )
+CRC16FsmUpdate( uint16_t uCWord, const uint8_t* pbIn, size_t nIn )
 {
-	uint16_t uCWord = 0xFFFF;
         for( ; nIn > 0; nIn -- )
 	{
 		uint8_t uSwitch = *pbIn++ ^ uCWord;
@@ -300,6 +299,12 @@ CRC16Fsm( const uint8_t* pbIn, size_t nIn )
 	return uCWord;
 }
 
+uint16_t
+CRC16Fsm( const uint8_t* pbIn, size_t nIn )
+{
+	return CRC16FsmUpdate( 0xFFFF, pbIn, nIn );
+}
+
 /*
 
 main( )
@@ -29,7 +29,141 @@
 #include <stdint.h>
 
 uint16_t
-CRC16Fsm( const uint8_t* pbIn, size_t nIn );
+CRC16Fsm( const uint8_t* pbIn, size_t nIn );     //!< code-based FSM; no tables, the smallest RAM footprint
+
+uint16_t
+CRC16Table( const uint8_t* pbIn, size_t nIn );   //!< 512 bytes table, in PROGMEM on AVR
+
+uint16_t
+CRC16Slice4( const uint8_t* pbIn, size_t nIn );  //!< slice-by-4, 2KB of tables, for 32-bit parts
+
+uint16_t
+CRC16Slice8( const uint8_t* pbIn, size_t nIn );  //!< slice-by-8, 4KB of tables, for 64-bit hosts
+
+uint16_t
+CRC16Nibble( const uint8_t* pbIn, size_t nIn );  //!< 32 bytes nibble table, for tiny parts
+
+uint16_t
+CRC16Clmul( const uint8_t* pbIn, size_t nIn );   //!< carry-less multiply folding on x86 PCLMULQDQ, CRC16Slice8 o.w.; dispatched at run time
+
+/*! @brief CRC16TableX4 - CRC16 of four independent buffers, interleaved to overlap the table lookups
+*   @param ppbIn  - the four buffers
+*   @param pnIn   - the four buffer sizes
+*   @param puCRC  - receives the four CRCs
+*/
+void
+CRC16TableX4( const uint8_t* const* ppbIn, const size_t* pnIn, uint16_t* puCRC );
+
+/*! @brief CRC16CheckBatch - validates the trailing CRC of many independent RTU frames in one call
+*   @param ppbFrames  - the frames, each including its CRC
+*   @param pnFrames   - the frame sizes
+*   @param nFrames    - the number of frames
+*   @param pbValid    - receives 1 for each valid frame and 0 o.w.; may be NULL
+*   @returns          - the number of valid frames
+*/
+size_t
+CRC16CheckBatch(
+              const uint8_t* const* ppbFrames,
+              const size_t* pnFrames,
+              size_t nFrames,
+              uint8_t* pbValid );
+
+// the same engines resuming from a CRC computed over the preceding data
+uint16_t CRC16FsmUpdate( uint16_t uCRC, const uint8_t* pbIn, size_t nIn );
+uint16_t CRC16TableUpdate( uint16_t uCRC, const uint8_t* pbIn, size_t nIn );
+uint16_t CRC16Slice4Update( uint16_t uCRC, const uint8_t* pbIn, size_t nIn );
+uint16_t CRC16Slice8Update( uint16_t uCRC, const uint8_t* pbIn, size_t nIn );
+uint16_t CRC16NibbleUpdate( uint16_t uCRC, const uint8_t* pbIn, size_t nIn );
+uint16_t CRC16ClmulUpdate( uint16_t uCRC, const uint8_t* pbIn, size_t nIn );
+
+/*! @brief CRC16Patch - the CRC of a frame some bytes of which have changed, from its CRC before the change
+*   @param uCRC   - the CRC of the frame before the change
+*   @param pbOld  - the changed bytes as they were
+*   @param pbNew  - the changed bytes as they are now
+*   @param nPatch - the number of changed bytes
+*   @param nTail  - the number of frame bytes after them
+*   @returns      - the CRC of the frame as it is now; the work grows with nPatch, not with the frame
+*/
+uint16_t CRC16Patch( uint16_t uCRC, const uint8_t* pbOld, const uint8_t* pbNew, size_t nPatch, size_t nTail );
+
+// CRC engine selection; define MB_CRC_ENGINE in the build flags to override the default
+#define MB_CRC_ENGINE_FSM    0
+#define MB_CRC_ENGINE_TABLE  1
+#define MB_CRC_ENGINE_SLICE4 2
+#define MB_CRC_ENGINE_SLICE8 3
+#define MB_CRC_ENGINE_NIBBLE 4
+#define MB_CRC_ENGINE_CLMUL  5
+
+#ifndef MB_CRC_ENGINE
+#if defined(__AVR__)
+#define MB_CRC_ENGINE MB_CRC_ENGINE_FSM
+#elif defined(__x86_64__)
+#define MB_CRC_ENGINE MB_CRC_ENGINE_CLMUL
+#elif defined(__aarch64__)
+#define MB_CRC_ENGINE MB_CRC_ENGINE_SLICE8
+#else
+#define MB_CRC_ENGINE MB_CRC_ENGINE_TABLE
+#endif
+#endif
+
+/*! @brief CRC16 - Modbus CRC16 using the engine selected by MB_CRC_ENGINE
+*   @param pbIn   - the data
+*   @param nIn    - the size of the data
+*   @returns      - the CRC; 0 when computed over a frame with a valid trailing CRC
+*/
+inline uint16_t
+CRC16( const uint8_t* pbIn, size_t nIn )
+{
+#if MB_CRC_ENGINE == MB_CRC_ENGINE_TABLE
+    return CRC16Table( pbIn, nIn );
+#elif MB_CRC_ENGINE == MB_CRC_ENGINE_SLICE4
+    return CRC16Slice4( pbIn, nIn );
+#elif MB_CRC_ENGINE == MB_CRC_ENGINE_SLICE8
+    return CRC16Slice8( pbIn, nIn );
+#elif MB_CRC_ENGINE == MB_CRC_ENGINE_NIBBLE
+    return CRC16Nibble( pbIn, nIn );
+#elif MB_CRC_ENGINE == MB_CRC_ENGINE_CLMUL
+    return CRC16Clmul( pbIn, nIn );
+#else
+    return CRC16Fsm( pbIn, nIn );
+#endif
+}
+
+/*! @brief CRC16Update - continues a Modbus CRC16 over the next piece of data, selected engine
+*   @param uCRC   - the CRC of the preceding data, 0xFFFF for none
+*   @param pbIn   - the data
+*   @param nIn    - the size of the data
+*   @returns      - the CRC of the preceding data and pbIn
+*/
+inline uint16_t
+CRC16Update( uint16_t uCRC, const uint8_t* pbIn, size_t nIn )
+{
+#if MB_CRC_ENGINE == MB_CRC_ENGINE_TABLE
+    return CRC16TableUpdate( uCRC, pbIn, nIn );
+#elif MB_CRC_ENGINE == MB_CRC_ENGINE_SLICE4
+    return CRC16Slice4Update( uCRC, pbIn, nIn );
+#elif MB_CRC_ENGINE == MB_CRC_ENGINE_SLICE8
+    return CRC16Slice8Update( uCRC, pbIn, nIn );
+#elif MB_CRC_ENGINE == MB_CRC_ENGINE_NIBBLE
+    return CRC16NibbleUpdate( uCRC, pbIn, nIn );
+#elif MB_CRC_ENGINE == MB_CRC_ENGINE_CLMUL
+    return CRC16ClmulUpdate( uCRC, pbIn, nIn );
+#else
+    return CRC16FsmUpdate( uCRC, pbIn, nIn );
+#endif
+}
+
+/*! @brief class CRC16Stream - resumable Modbus CRC16 for frames that arrive or leave in pieces */
+class CRC16Stream
+{
+protected:
+    uint16_t m_uCRC; //!< the CRC of the data seen so far
+public:
+    CRC16Stream() : m_uCRC( 0xFFFF ) {}  //!< default constructor, starts a new frame
+    void Init() { m_uCRC = 0xFFFF; }     //!< starts a new frame
+    void Update( const uint8_t* pbIn, size_t nIn ) { m_uCRC = CRC16Update( m_uCRC, pbIn, nIn ); } //!< folds in the next piece
+    uint16_t Final() const { return m_uCRC; } //!< the CRC so far; 0 once a frame and its valid CRC are folded in
+};
 
 
 #endif
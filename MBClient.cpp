@@ -0,0 +1,224 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "MBusTiny.h"
+#include "MBClient.h"
+
+static void
+PutBE16( uint8_t* pb, uint16_t u )
+{
+    pb[0] = u >> 8;
+    pb[1] = u & 0xFF;
+}
+
+static uint16_t
+GetBE16( const uint8_t* pb )
+{
+    return (uint16_t)( ( pb[0] << 8 ) | pb[1] );
+}
+
+size_t
+MBClient::EncodeRead( uint8_t* pbPDU, uint8_t uDeviceID, uint8_t uFC, uint16_t uAddress, uint16_t uCount )
+{
+    uint16_t uMax = 0;
+    switch( uFC )
+    {
+    case MBUSDevice::fcReadCoils:
+    case MBUSDevice::fcReadDiscreteInputs:
+        uMax = 0x7D0;
+        break;
+    case MBUSDevice::fcReadMultipleHoldingRegisters:
+    case MBUSDevice::fcReadInputRegisters:
+        uMax = 0x7D;
+        break;
+    default:
+        return 0;
+    }
+    if( uCount < 1 || uCount > uMax )
+        return 0;
+    pbPDU[0] = uDeviceID;
+    pbPDU[1] = uFC;
+    PutBE16( pbPDU + 2, uAddress );
+    PutBE16( pbPDU + 4, uCount );
+    return 6;
+}
+
+size_t
+MBClient::EncodeWriteCoil( uint8_t* pbPDU, uint8_t uDeviceID, uint16_t uAddress, bool bValue )
+{
+    pbPDU[0] = uDeviceID;
+    pbPDU[1] = MBUSDevice::fcWriteSingleCoil;
+    PutBE16( pbPDU + 2, uAddress );
+    PutBE16( pbPDU + 4, bValue ? 0xFF00 : 0x0000 );
+    return 6;
+}
+
+size_t
+MBClient::EncodeWriteRegister( uint8_t* pbPDU, uint8_t uDeviceID, uint16_t uAddress, uint16_t uValue )
+{
+    pbPDU[0] = uDeviceID;
+    pbPDU[1] = MBUSDevice::fcWriteSingleHoldingRegister;
+    PutBE16( pbPDU + 2, uAddress );
+    PutBE16( pbPDU + 4, uValue );
+    return 6;
+}
+
+size_t
+MBClient::EncodeWriteCoils( uint8_t* pbPDU, uint8_t uDeviceID, uint16_t uAddress, uint16_t uCount, const uint8_t* pbBits )
+{
+    if( uCount < 1 || uCount > 0x7B0 )
+        return 0;
+    size_t nBytes = ( uCount + 7 ) / 8;
+    pbPDU[0] = uDeviceID;
+    pbPDU[1] = MBUSDevice::fcWriteMultipleCoils;
+    PutBE16( pbPDU + 2, uAddress );
+    PutBE16( pbPDU + 4, uCount );
+    pbPDU[6] = nBytes;
+    memcpy( pbPDU + 7, pbBits, nBytes );
+    if( uCount % 8 )
+        pbPDU[ 6 + nBytes ] &= 0xFF >> ( 8 - uCount % 8 ); // the padding bits go out as zeros
+    return 7 + nBytes;
+}
+
+size_t
+MBClient::EncodeWriteRegisters( uint8_t* pbPDU, uint8_t uDeviceID, uint16_t uAddress, uint16_t uCount, const uint16_t* puValues )
+{
+    if( uCount < 1 || uCount > 0x7B )
+        return 0;
+    pbPDU[0] = uDeviceID;
+    pbPDU[1] = MBUSDevice::fcWriteMultipleHoldingRegisters;
+    PutBE16( pbPDU + 2, uAddress );
+    PutBE16( pbPDU + 4, uCount );
+    pbPDU[6] = uCount * 2;
+    MBUSDevice::StoreRegs( pbPDU + 7, puValues, uCount );
+    return 7 + uCount * 2;
+}
+
+size_t
+MBClient::EncodeReadWriteRegisters( uint8_t* pbPDU, uint8_t uDeviceID,
+                                    uint16_t uReadAddress, uint16_t uReadCount,
+                                    uint16_t uWriteAddress, uint16_t uWriteCount, const uint16_t* puValues )
+{
+    if( uReadCount < 1 || uReadCount > 0x7D || uWriteCount < 1 || uWriteCount > 0x79 )
+        return 0;
+    pbPDU[0] = uDeviceID;
+    pbPDU[1] = MBUSDevice::fcReadWriteMultipleRegisters;
+    PutBE16( pbPDU + 2, uReadAddress );
+    PutBE16( pbPDU + 4, uReadCount );
+    PutBE16( pbPDU + 6, uWriteAddress );
+    PutBE16( pbPDU + 8, uWriteCount );
+    pbPDU[10] = uWriteCount * 2;
+    MBUSDevice::StoreRegs( pbPDU + 11, puValues, uWriteCount );
+    return 11 + uWriteCount * 2;
+}
+
+size_t
+MBClient::ResponseSize( const uint8_t* pbHead )
+{
+    if( pbHead[1] & 0x80 )
+        return 3; // device address, function code, exception code
+    switch( pbHead[1] )
+    {
+    case MBUSDevice::fcReadCoils:
+    case MBUSDevice::fcReadDiscreteInputs:
+    case MBUSDevice::fcReadMultipleHoldingRegisters:
+    case MBUSDevice::fcReadInputRegisters:
+    case MBUSDevice::fcReadWriteMultipleRegisters:
+        return 3 + pbHead[2];
+    default:
+        return 6; // the writes echo an address and a value or a count
+    }
+}
+
+uint16_t
+MBClient::ReadCount( const uint8_t* pbRequest )
+{
+    switch( pbRequest[1] )
+    {
+    case MBUSDevice::fcReadCoils:
+    case MBUSDevice::fcReadDiscreteInputs:
+    case MBUSDevice::fcReadMultipleHoldingRegisters:
+    case MBUSDevice::fcReadInputRegisters:
+    case MBUSDevice::fcReadWriteMultipleRegisters:
+        return GetBE16( pbRequest + 4 );
+    default:
+        return 0;
+    }
+}
+
+MBClient::eStatus
+MBClient::Decode( const uint8_t* pbRequest, const uint8_t* pbResponse, size_t nResponse, MBResponse& rResp )
+{
+    if( nResponse < 3 || pbResponse[0] != pbRequest[0] || ( pbResponse[1] & 0x7F ) != pbRequest[1] )
+        return stBadResponse;
+    rResp.uDeviceID = pbResponse[0];
+    rResp.uFC = pbRequest[1];
+    rResp.exRV = MBUSDevice::exOK;
+    rResp.pbData = pbResponse + 2;
+    rResp.nData = 0;
+    rResp.nCount = 0;
+
+    if( pbResponse[1] & 0x80 )
+    {
+        if( nResponse != 3 || pbResponse[2] == MBUSDevice::exOK )
+            return stBadResponse;
+        rResp.exRV = static_cast<MBUSDevice::exCode>( pbResponse[2] );
+        return stException;
+    }
+
+    uint16_t uCount = ReadCount( pbRequest );
+    switch( pbRequest[1] )
+    {
+    case MBUSDevice::fcReadCoils:
+    case MBUSDevice::fcReadDiscreteInputs:
+        if( pbResponse[2] != ( uCount + 7 ) / 8 )
+            return stBadResponse;
+        break;
+    case MBUSDevice::fcReadMultipleHoldingRegisters:
+    case MBUSDevice::fcReadInputRegisters:
+    case MBUSDevice::fcReadWriteMultipleRegisters:
+        if( pbResponse[2] != uCount * 2 )
+            return stBadResponse;
+        break;
+    case MBUSDevice::fcWriteSingleCoil:
+    case MBUSDevice::fcWriteSingleHoldingRegister:
+    case MBUSDevice::fcWriteMultipleCoils:
+    case MBUSDevice::fcWriteMultipleHoldingRegisters:
+        // the single writes echo the request, the multiple ones its address and count
+        if( nResponse != 6 || memcmp( pbResponse + 2, pbRequest + 2, 4 ) != 0 )
+            return stBadResponse;
+        rResp.nData = 4;
+        rResp.nCount = GetBE16( pbResponse + 4 );
+        return stOK;
+    default:
+        return stBadResponse;
+    }
+
+    if( nResponse != 3 + (size_t)pbResponse[2] )
+        return stBadResponse;
+    rResp.pbData = pbResponse + 3;
+    rResp.nData = pbResponse[2];
+    rResp.nCount = uCount;
+    return stOK;
+}
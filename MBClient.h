@@ -0,0 +1,142 @@
+#ifndef _MBCLIENT_H_
+#define _MBCLIENT_H_
+
+/*
+* MIT License
+* 
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "MBusTiny.h"
+
+/*! @brief MBRegView - the registers of a response, read big-endian in place from the receive buffer */
+struct MBRegView
+{
+    const uint8_t* pbData;  //!< the first register, high byte first
+    size_t         nRegs;   //!< the number of registers
+
+    uint16_t operator[]( size_t nIndex ) const { return (uint16_t)( ( pbData[ 2 * nIndex ] << 8 ) | pbData[ 2 * nIndex + 1 ] ); }
+    size_t Size() const { return nRegs; }                                      //!< the number of registers
+    void Load( uint16_t* puOut ) const { MBUSDevice::LoadRegs( puOut, pbData, nRegs ); } //!< copies all registers out in host order
+};
+
+/*! @brief MBBitView - the coils or inputs of a response, read in place from the packed bytes, bit 0 first */
+struct MBBitView
+{
+    const uint8_t* pbData;  //!< the packed bits, LSB first
+    size_t         nBits;   //!< the number of bits
+
+    bool operator[]( size_t nIndex ) const { return ( pbData[ nIndex / 8 ] >> ( nIndex % 8 ) ) & 1; }
+    size_t Size() const { return nBits; }                                      //!< the number of bits
+};
+
+/*! @brief MBResponse - a decoded response; the data stays where it was received and is valid until the next receive */
+struct MBResponse
+{
+    uint8_t            uDeviceID; //!< the responding device address or unit identifier
+    uint8_t            uFC;       //!< the function code, without the exception bit
+    MBUSDevice::exCode exRV;      //!< the exception the device answered, exOK for a normal response
+    const uint8_t*     pbData;    //!< the data after the byte count of a read, the echoed address and value of a write
+    size_t             nData;     //!< the number of data bytes
+    size_t             nCount;    //!< the registers or bits read, the echoed value or count of a write
+
+    MBRegView Regs() const { MBRegView view = { pbData, nCount }; return view; } //!< the registers of FC3, FC4 and FC23
+    MBBitView Bits() const { MBBitView view = { pbData, nCount }; return view; } //!< the coils or inputs of FC1 and FC2
+};
+
+/*! @brief class MBClient - the master side of the protocol: request encoding and response decoding
+*
+*   Requests are built in a PDU buffer with the device address first, [dev][fc][data], the layout
+*   the adapters carry, so the same request goes to an RTU bus or a TCP connection. A response is
+*   checked against the request it answers and decoded in place: MBResponse points into the
+*   receive buffer and its views read the big-endian registers or packed bits without a copy:
+*
+*       uint8_t arrbReq[nPDU];
+*       size_t nReq = MBClient::EncodeRead( arrbReq, 7, MBUSDevice::fcReadMultipleHoldingRegisters, 100, 10 );
+*       MBResponse resp;
+*       if( rtu.Transact( arrbReq, nReq, resp ) == MBClient::stOK )
+*           uValue = resp.Regs()[3];
+*
+*   The encoders return the request size, device address included, or 0 for out of range arguments.
+*/
+class MBClient
+{
+public:
+    /*! @brief eStatus - the outcome of a transaction */
+    enum eStatus
+    {
+        stOK,           //!< a normal response, decoded
+        stException,    //!< the device answered an exception, in MBResponse::exRV
+        stTimeout,      //!< no response in time
+        stBadResponse,  //!< a response that does not answer the request: CRC, address, function code or size
+        stFailed,       //!< the request could not be sent
+        stSkipped       //!< the request was not sent, its slave is held off after repeated timeouts
+    };
+
+    /*! @brief EncodeRead - FC1 to FC4: reads coils, discrete inputs, holding or input registers
+    *   @param uCount - 1 to 2000 bits or 1 to 125 registers
+    */
+    static size_t EncodeRead( uint8_t* pbPDU, uint8_t uDeviceID, uint8_t uFC, uint16_t uAddress, uint16_t uCount );
+    static size_t EncodeWriteCoil( uint8_t* pbPDU, uint8_t uDeviceID, uint16_t uAddress, bool bValue );           //!< FC5
+    static size_t EncodeWriteRegister( uint8_t* pbPDU, uint8_t uDeviceID, uint16_t uAddress, uint16_t uValue );   //!< FC6
+
+    /*! @brief EncodeWriteCoils - FC15
+    *   @param uCount - 1 to 1968 coils
+    *   @param pbBits - the coil states packed LSB first, as the request carries them
+    */
+    static size_t EncodeWriteCoils( uint8_t* pbPDU, uint8_t uDeviceID, uint16_t uAddress, uint16_t uCount, const uint8_t* pbBits );
+
+    /*! @brief EncodeWriteRegisters - FC16
+    *   @param uCount   - 1 to 123 registers
+    *   @param puValues - the values in host order
+    */
+    static size_t EncodeWriteRegisters( uint8_t* pbPDU, uint8_t uDeviceID, uint16_t uAddress, uint16_t uCount, const uint16_t* puValues );
+
+    /*! @brief EncodeReadWriteRegisters - FC23, the write is done before the read
+    *   @param uReadCount  - 1 to 125 registers
+    *   @param uWriteCount - 1 to 121 registers
+    *   @param puValues    - the values to write in host order
+    */
+    static size_t EncodeReadWriteRegisters( uint8_t* pbPDU, uint8_t uDeviceID,
+                                            uint16_t uReadAddress, uint16_t uReadCount,
+                                            uint16_t uWriteAddress, uint16_t uWriteCount, const uint16_t* puValues );
+
+    /*! @brief ResponseSize - the size of a response frame from its first three bytes
+    *   @param pbHead - device address, function code and the byte count or the first data byte
+    *   @returns      - the size, device address included and CRC excluded
+    */
+    static size_t ResponseSize( const uint8_t* pbHead );
+
+    /*! @brief Decode - checks a response against its request and decodes it in place
+    *   @param pbRequest  - the request, at least its first six bytes
+    *   @param pbResponse - the response, device address first, CRC or MBAP header excluded
+    *   @param nResponse  - the size of the response
+    *   @param rResp      - the decoded response, pointing into pbResponse
+    *   @returns          - stOK, stException or stBadResponse
+    */
+    static eStatus Decode( const uint8_t* pbRequest, const uint8_t* pbResponse, size_t nResponse, MBResponse& rResp );
+
+    /*! @brief ReadCount - the registers or bits a request reads, 0 for a write */
+    static uint16_t ReadCount( const uint8_t* pbRequest );
+};
+
+
+#endif
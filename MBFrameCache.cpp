@@ -0,0 +1,254 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "MBusTiny.h"
+#include "MBFrameCache.h"
+#include "CrcFsm.h"
+
+const size_t cbRequestKey = 6;   // device, function code, address and count of a read
+const size_t nRunCost = 16;      // table lookups a patched run costs over its own bytes, for the carry over the tail
+const size_t nMaxRuns = 8;       // runs a frame is patched in at most; one with more is built again
+
+// what a full pass over a frame byte costs the selected engine, in sixteenths of a table lookup, as
+// bench_frames measures them on an x86-64 host: the frame is patched only if its runs cost less
+#if MB_CRC_ENGINE == MB_CRC_ENGINE_FSM
+const size_t nPassSixteenths = 95;
+#elif MB_CRC_ENGINE == MB_CRC_ENGINE_NIBBLE
+const size_t nPassSixteenths = 30;
+#elif MB_CRC_ENGINE == MB_CRC_ENGINE_TABLE
+const size_t nPassSixteenths = 16;
+#elif MB_CRC_ENGINE == MB_CRC_ENGINE_SLICE4
+const size_t nPassSixteenths = 5;
+#elif MB_CRC_ENGINE == MB_CRC_ENGINE_SLICE8
+const size_t nPassSixteenths = 3;
+#else
+const size_t nPassSixteenths = 1;
+#endif
+// CLMUL runs a full pass about as fast as one patched run carries its change over the tail, and as the cache
+// compares and copies a frame: there a changed frame is always built again, and without TrackChanges() reads
+// go straight through
+const bool bPatchPays = nPassSixteenths > 1;
+
+// the number of leading bytes two buffers have in common, compared a word at a time
+static size_t
+MatchLength( const uint8_t* pbA, const uint8_t* pbB, size_t nBytes )
+{
+    size_t cByte = 0;
+    for( ; cByte + sizeof( size_t ) <= nBytes; cByte += sizeof( size_t ) )
+    {
+        size_t uA, uB;
+        memcpy( &uA, pbA + cByte, sizeof( size_t ) );
+        memcpy( &uB, pbB + cByte, sizeof( size_t ) );
+        if( uA != uB )
+            break;
+    }
+    while( cByte < nBytes && pbA[ cByte ] == pbB[ cByte ] )
+        cByte ++;
+    return cByte;
+}
+
+// the end of the run of changed bytes starting at cByte, which differs; the run takes in the stretches of
+// unchanged bytes shorter than a run costs, and rcNext is the first changed byte after it, or nResponse.
+// The scan gives up at cLimit and returns 0: a run that long is over the budget anyway
+static size_t
+RunEnd( const uint8_t* pbFrame, const uint8_t* pbResponse, size_t nResponse, size_t cByte, size_t cLimit, size_t& rcNext )
+{
+    if( cLimit > nResponse )
+        cLimit = nResponse;
+    size_t cEnd = cByte + 1;
+    size_t nSame = 0;
+    for( size_t cScan = cEnd; cScan < cLimit; cScan ++ )
+    {
+        if( pbFrame[ cScan ] != pbResponse[ cScan ] )
+        {
+            cEnd = cScan + 1;
+            nSame = 0;
+        }
+        else if( ++ nSame == nRunCost )
+            break;
+    }
+    if( nSame < nRunCost && cLimit < nResponse )
+        return 0;
+    rcNext = cEnd + MatchLength( pbFrame + cEnd, pbResponse + cEnd, nResponse - cEnd );
+    return cEnd;
+}
+
+MBFrameCache::MBFrameCache( MBFrameEntry* pEntries, size_t nEntries )
+{
+    m_pEntries = pEntries;
+    m_nEntries = nEntries;
+    m_uVersion = 0;
+    m_bTrackChanges = false;
+    m_nReads = 0;
+    m_nUnchanged = 0;
+    m_nPatched = 0;
+    m_nBuilt = 0;
+    m_nBypassed = 0;
+    Clear();
+}
+
+void
+MBFrameCache::Clear()
+{
+    for( size_t cEntry = 0; cEntry < m_nEntries; cEntry ++ )
+    {
+        m_pEntries[ cEntry ].nFrame = 0;
+        m_pEntries[ cEntry ].uLastUsed = 0;
+    }
+}
+
+bool
+MBFrameCache::Serve( MBUSDevice* pDevice, IPDUAdapter* pAdapter, uint8_t uDeviceID, uint8_t* pbPDU, size_t nRequest )
+{
+    uint8_t uFC = pbPDU[1];
+    if( nRequest != cbRequestKey || uFC < MBUSDevice::fcReadCoils || uFC > MBUSDevice::fcReadInputRegisters || m_nEntries == 0 )
+    {
+        // anything but a read may change what the kept frames hold
+        if( uFC < MBUSDevice::fcReadCoils || uFC > MBUSDevice::fcReadInputRegisters )
+            Changed();
+        return pAdapter->TransmitPDU( uDeviceID, pbPDU, pDevice->ServePDU( pbPDU ) );
+    }
+    if( ! bPatchPays && ! m_bTrackChanges )
+    {
+        m_nBypassed ++;
+        return pAdapter->TransmitPDU( uDeviceID, pbPDU, pDevice->ServePDU( pbPDU ) );
+    }
+
+    m_nReads ++;
+    MBFrameEntry* pEntry = Find( pbPDU );
+    if( pEntry && m_bTrackChanges && pEntry->uVersion == m_uVersion )
+    {
+        m_nUnchanged ++;
+        pEntry->uLastUsed = m_nReads;
+        return pAdapter->TransmitFrame( uDeviceID, pEntry->arrbFrame, pEntry->nFrame );
+    }
+
+    uint8_t arrbRequest[ cbRequestKey ];
+    memcpy( arrbRequest, pbPDU, cbRequestKey );
+    size_t nResponse = pDevice->ServePDU( pbPDU );
+    if( ( pbPDU[1] & 0x80 ) || nResponse + 2 > nPDU )
+    {
+        // exceptions are not kept; the frame they replace is stale
+        if( pEntry )
+            pEntry->nFrame = 0;
+        return pAdapter->TransmitPDU( uDeviceID, pbPDU, nResponse );
+    }
+    if( ! pEntry )
+    {
+        pEntry = Victim();
+        memcpy( pEntry->arrbRequest, arrbRequest, cbRequestKey );
+        pEntry->nFrame = 0;
+    }
+    Update( pEntry, pbPDU, nResponse );
+    pEntry->uVersion = m_uVersion;
+    pEntry->uLastUsed = m_nReads;
+    return pAdapter->TransmitFrame( uDeviceID, pEntry->arrbFrame, pEntry->nFrame );
+}
+
+void
+MBFrameCache::Update( MBFrameEntry* pEntry, const uint8_t* pbResponse, size_t nResponse )
+{
+    uint8_t* pbFrame = pEntry->arrbFrame;
+    if( pEntry->nFrame == nResponse + 2 )
+    {
+        size_t cFirst = MatchLength( pbFrame, pbResponse, nResponse );
+        if( cFirst == nResponse )
+        {
+            m_nUnchanged ++;
+            return;
+        }
+        // the runs are costed before any is patched, so a frame that changed too much costs a bounded
+        // compare, not a patch thrown away; in sixteenths of a lookup, as the full pass. The patches may
+        // take half a pass: the other half goes to the scan, which reads both buffers a byte at a time
+        size_t nBudget = bPatchPays ? nResponse * nPassSixteenths / 2 : 0;
+        size_t nCost = 0;
+        size_t arrcStart[ nMaxRuns ];
+        size_t arrcEnd[ nMaxRuns ];
+        size_t nRuns = 0;
+        size_t cNext;
+        for( size_t cByte = cFirst; cByte < nResponse && nCost < nBudget; cByte = cNext )
+        {
+            // the scan stops at the longest run the rest of the budget pays for
+            size_t nLeft = ( nBudget - nCost ) / 16;
+            size_t cEnd = nLeft > nRunCost && nRuns < nMaxRuns ? RunEnd( pbFrame, pbResponse, nResponse, cByte, cByte + nLeft - nRunCost, cNext ) : 0;
+            if( cEnd == 0 )
+            {
+                nCost = nBudget;
+                break;
+            }
+            arrcStart[ nRuns ] = cByte;
+            arrcEnd[ nRuns ++ ] = cEnd;
+            nCost += 16 * ( cEnd - cByte + nRunCost );
+        }
+        if( nCost < nBudget )
+        {
+            m_nPatched ++;
+            uint16_t uCRC = pbFrame[ nResponse ] | ( pbFrame[ nResponse + 1 ] << 8 );
+            for( size_t cRun = 0; cRun < nRuns; cRun ++ )
+            {
+                size_t cByte = arrcStart[ cRun ];
+                size_t cEnd = arrcEnd[ cRun ];
+                uCRC = CRC16Patch( uCRC, pbFrame + cByte, pbResponse + cByte, cEnd - cByte, nResponse - cEnd );
+                memcpy( pbFrame + cByte, pbResponse + cByte, cEnd - cByte );
+            }
+            pbFrame[ nResponse ] = (uint8_t)uCRC;
+            pbFrame[ nResponse + 1 ] = (uint8_t)( uCRC >> 8 );
+            return;
+        }
+        // so much has changed that one pass over the whole frame is cheaper
+    }
+    m_nBuilt ++;
+    memcpy( pbFrame, pbResponse, nResponse );
+    uint16_t uCRC = CRC16( pbFrame, nResponse );
+    pbFrame[ nResponse ] = (uint8_t)uCRC;
+    pbFrame[ nResponse + 1 ] = (uint8_t)( uCRC >> 8 );
+    pEntry->nFrame = nResponse + 2;
+}
+
+MBFrameEntry*
+MBFrameCache::Find( const uint8_t* pbRequest )
+{
+    for( size_t cEntry = 0; cEntry < m_nEntries; cEntry ++ )
+    {
+        MBFrameEntry* pEntry = m_pEntries + cEntry;
+        if( pEntry->nFrame != 0 && memcmp( pEntry->arrbRequest, pbRequest, cbRequestKey ) == 0 )
+            return pEntry;
+    }
+    return NULL;
+}
+
+MBFrameEntry*
+MBFrameCache::Victim()
+{
+    MBFrameEntry* pVictim = m_pEntries;
+    for( size_t cEntry = 0; cEntry < m_nEntries; cEntry ++ )
+    {
+        MBFrameEntry* pEntry = m_pEntries + cEntry;
+        if( pEntry->nFrame == 0 )
+            return pEntry;
+        if( m_nReads - pEntry->uLastUsed > m_nReads - pVictim->uLastUsed )
+            pVictim = pEntry;
+    }
+    return pVictim;
+}
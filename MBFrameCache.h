@@ -0,0 +1,107 @@
+#ifndef _MBFRAMECACHE_H_
+#define _MBFRAMECACHE_H_
+
+/*
+* MIT License
+* 
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#include "MBusTiny.h"
+
+/*! @brief MBFrameEntry - the response frame kept for a repeated read */
+struct MBFrameEntry
+{
+    uint8_t  arrbRequest[6];      //!< the request it answers: device, function code, address and count
+    uint8_t  arrbFrame[nPDU];     //!< the response as last sent, CRC included
+    uint16_t nFrame;              //!< the size of the frame, 0 for a free entry
+    uint16_t uVersion;            //!< the cache version when the frame was last checked against the device; the cache clears when it wraps
+    uint32_t uLastUsed;           //!< the cache's read count when the frame was last sent
+};
+
+/*! @brief class MBFrameCache - keeps the response frames of repeated reads, CRC and all
+*
+*   A master polling the same block every cycle gets the same frame back but for the values that
+*   changed. The cache keeps the last frame of each hot read, least recently used out, and serves
+*   the read into the PDU buffer as usual; only the bytes that differ from the kept frame are then
+*   copied over, and the CRC is patched for them with CRC16Patch() rather than run over the whole
+*   frame again. An unchanged response goes out as the kept frame through
+*   IPDUAdapter::TransmitFrame(), so the RTU adapter computes nothing:
+*
+*       MBFrameEntry arrFrames[2];
+*       MBFrameCache frames( arrFrames, 2 );
+*       mb.SetFrameCache( &frames );
+*
+*   With TrackChanges(), the device is not even asked while nothing has changed: the application
+*   calls Changed() whenever it updates a value, and until then a kept frame is sent as it is.
+*   Writes served through the cache count as a change.
+*
+*   Whether a changed frame is patched or built again follows the cost of a full pass on the CRC
+*   engine. With CLMUL a pass costs about what comparing and keeping the frame does, so there the
+*   cache pays only with TrackChanges(); without it, reads go straight through and count as Bypassed().
+*/
+class MBFrameCache
+{
+protected:
+    MBFrameEntry* m_pEntries;       //!< the kept frames
+    size_t        m_nEntries;       //!< the number of entries
+    uint16_t      m_uVersion;       //!< advanced by Changed()
+    bool          m_bTrackChanges;  //!< a frame checked since the last Changed() is sent without asking the device
+    uint32_t      m_nReads;         //!< reads served through the cache
+    uint32_t      m_nUnchanged;     //!< frames sent as kept
+    uint32_t      m_nPatched;       //!< frames sent with some bytes and the CRC patched
+    uint32_t      m_nBuilt;         //!< frames built and CRC'd in full
+    uint32_t      m_nBypassed;      //!< reads sent straight through, where the cache cannot win
+
+public:
+    MBFrameCache( MBFrameEntry* pEntries, size_t nEntries ); //!< Constructor with the entries to keep the frames in
+    virtual ~MBFrameCache() {}
+
+    void TrackChanges( bool bTrack ) { m_bTrackChanges = bTrack; } //!< sends a checked frame without asking the device until Changed()
+    void Changed() { if( ++ m_uVersion == 0 ) Clear(); }           //!< the values the device reads have changed; a wrapped version must not match an old frame
+    void Clear();                                                  //!< forgets all frames
+
+    /*! @brief Serve - serves a received request and transmits the response
+    *   @param pDevice    - the device the request is for
+    *   @param pAdapter   - the adapter the request came from
+    *   @param uDeviceID  - the device address
+    *   @param pbPDU      - the request; receives the response unless a kept frame went out as it was
+    *   @param nRequest   - the size of the request
+    *   @returns          - the result of the transmission
+    *
+    *   Virtual, so MBUSTiny calls it without linking the cache and its CRC tables into sketches that use none.
+    */
+    virtual bool Serve( MBUSDevice* pDevice, IPDUAdapter* pAdapter, uint8_t uDeviceID, uint8_t* pbPDU, size_t nRequest );
+
+    uint32_t Reads() const { return m_nReads; }           //!< reads served through the cache
+    uint32_t Unchanged() const { return m_nUnchanged; }   //!< frames sent as kept
+    uint32_t Patched() const { return m_nPatched; }       //!< frames sent with some bytes and the CRC patched
+    uint32_t Built() const { return m_nBuilt; }           //!< frames built and CRC'd in full
+    uint32_t Bypassed() const { return m_nBypassed; }     //!< reads sent straight through, where the cache cannot win
+
+protected:
+    MBFrameEntry* Find( const uint8_t* pbRequest );       //!< the entry kept for a request, NULL if none
+    MBFrameEntry* Victim();                               //!< a free entry, or the least recently used
+    void Update( MBFrameEntry* pEntry, const uint8_t* pbResponse, size_t nResponse ); //!< brings the kept frame up to a fresh response
+};
+
+#endif
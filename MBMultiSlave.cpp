@@ -0,0 +1,70 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "MBusTiny.h"
+#include "MBRTUAdapter.h"
+
+#include "MBMultiSlave.h"
+
+MBMultiSlave::MBMultiSlave( IPDUAdapter* pAdapter )
+{
+    m_pAdapter = pAdapter;
+    for( size_t cDev = 0; cDev < 256; cDev ++ )
+        m_arrpDevices[ cDev ] = NULL;
+    m_exUnhosted = MBUSDevice::exOK;
+    m_nUnhosted = 0;
+}
+
+bool
+MBMultiSlave::Attach( uint8_t uDeviceID, MBUSDevice* pDevice )
+{
+    if( uDeviceID == uAnyDeviceID )
+        return false;
+    m_arrpDevices[ uDeviceID ] = pDevice;
+    return true;
+}
+
+bool
+MBMultiSlave::TranscievePDU()
+{
+    if( ! m_pAdapter->AvailableIn() )
+        return false;
+
+    size_t nRX = 0;
+    if( ! m_pAdapter->ReceivePDU( uAnyDeviceID, m_arrbPDU, nPDU, nRX ) )
+        return false;
+
+    uint8_t uDeviceID = m_arrbPDU[0];
+    MBUSDevice* pDevice = m_arrpDevices[ uDeviceID ];
+    if( ! pDevice )
+    {
+        m_nUnhosted ++;
+        if( m_exUnhosted == MBUSDevice::exOK )
+            return false;
+        m_arrbPDU[1] |= 0x80;
+        m_arrbPDU[2] = static_cast<uint8_t>( m_exUnhosted );
+        return m_pAdapter->TransmitPDU( uDeviceID, m_arrbPDU, 3 );
+    }
+    return m_pAdapter->TransmitPDU( uDeviceID, m_arrbPDU, pDevice->ServePDU( m_arrbPDU ) );
+}
@@ -0,0 +1,74 @@
+#ifndef _MBMULTISLAVE_H_
+#define _MBMULTISLAVE_H_
+
+/*
+* MIT License
+* 
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#include "MBusTiny.h"
+
+/*! @brief class MBMultiSlave - hosts many devices, each with its own address and register map, on one adapter
+*
+*   Every frame is received once, into the one PDU buffer, with any address accepted; the address
+*   indexes a table of 256 device pointers and the device found serves the request in place. The
+*   devices derive from MBUSDevice and need no buffer of their own:
+*
+*       MBMultiSlave multi( &rtu );
+*       for( int cDev = 0; cDev < 100; cDev ++ )
+*           multi.Attach( cDev + 1, &arrDevices[cDev] );
+*       for( ;; )
+*           multi.TranscievePDU();
+*
+*   The table costs 256 pointers of RAM, the buffer nPDU bytes.
+*/
+class MBMultiSlave
+{
+protected:
+    uint8_t              m_arrbPDU[nPDU];    //!< the PDU transfer buffer all devices share
+    IPDUAdapter*         m_pAdapter;         //!< the PDU adapter to use
+    MBUSDevice*          m_arrpDevices[256]; //!< the device hosted at each address, NULL for none
+    MBUSDevice::exCode   m_exUnhosted;       //!< the reply to a request for an address nobody hosts, exOK for none
+    uint32_t             m_nUnhosted;        //!< requests for addresses nobody hosts
+public:
+    MBMultiSlave( IPDUAdapter* pAdapter ); //!< adapter constructor
+
+    /*! @brief Attach - hosts a device at an address
+    *   @param uDeviceID - the address, not uAnyDeviceID
+    *   @param pDevice   - the device, NULL to stop hosting the address
+    *   @returns         - true on success, false o.w.
+    */
+    bool Attach( uint8_t uDeviceID, MBUSDevice* pDevice );
+    MBUSDevice* Device( uint8_t uDeviceID ) const { return m_arrpDevices[ uDeviceID ]; } //!< the device at an address, NULL for none
+
+    /*! @brief SetUnhostedReply - how requests for addresses nobody hosts are answered
+    *   @param exReply - exOK stays silent, as a missing RTU slave does; a TCP gateway answers exGWPathUnavailable
+    */
+    void SetUnhostedReply( MBUSDevice::exCode exReply ) { m_exUnhosted = exReply; }
+    uint32_t Unhosted() const { return m_nUnhosted; } //!< requests for addresses nobody hosts
+
+    bool TranscievePDU();            //!< receives a PDU, dispatches it to the addressed device and sends the response; called in loop()
+};
+
+
+#endif
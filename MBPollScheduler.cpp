@@ -0,0 +1,264 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "MBusTiny.h"
+#include "MBPollScheduler.h"
+#include <Arduino.h>
+
+const uint16_t uMaxRegs = 125;  // the registers one FC3/FC4 request reads
+const uint16_t uMaxBits = 2000; // the bits one FC1/FC2 request reads
+
+static bool
+IsBitTable( uint8_t uTable )
+{
+    return uTable == MBUSDevice::fcReadCoils || uTable == MBUSDevice::fcReadDiscreteInputs;
+}
+
+static size_t
+DataBytes( uint8_t uFC, size_t nCount )
+{
+    return IsBitTable( uFC ) ? ( nCount + 7 ) / 8 : nCount * 2;
+}
+
+static int
+ComparePoints( const void* pvLeft, const void* pvRight )
+{
+    const MBPollPoint* pLeft = (const MBPollPoint*)pvLeft;
+    const MBPollPoint* pRight = (const MBPollPoint*)pvRight;
+    if( pLeft->uDeviceID != pRight->uDeviceID )
+        return pLeft->uDeviceID < pRight->uDeviceID ? -1 : 1;
+    if( pLeft->uTable != pRight->uTable )
+        return pLeft->uTable < pRight->uTable ? -1 : 1;
+    if( pLeft->uPeriodUS != pRight->uPeriodUS )
+        return pLeft->uPeriodUS < pRight->uPeriodUS ? -1 : 1;
+    if( pLeft->uAddress != pRight->uAddress )
+        return pLeft->uAddress < pRight->uAddress ? -1 : 1;
+    return 0;
+}
+
+MBPollScheduler::MBPollScheduler( MBRTUClient* pClient, MBPollBlock* pBlocks, size_t nMaxBlocks )
+{
+    m_pClient = pClient;
+    m_pPoints = NULL;
+    m_nPoints = 0;
+    m_pBlocks = pBlocks;
+    m_nMaxBlocks = nMaxBlocks;
+    m_nBlocks = 0;
+    m_nGapBytes = 20;
+    ResetStats();
+}
+
+bool
+MBPollScheduler::Build( MBPollPoint* pPoints, size_t nPoints )
+{
+    m_nBlocks = 0;
+    m_pPoints = pPoints;
+    m_nPoints = 0;
+    for( size_t cPoint = 0; cPoint < nPoints; cPoint ++ )
+        if( pPoints[ cPoint ].uTable < MBUSDevice::fcReadCoils || pPoints[ cPoint ].uTable > MBUSDevice::fcReadInputRegisters )
+            return false;
+    qsort( pPoints, nPoints, sizeof( MBPollPoint ), ComparePoints );
+
+    uint32_t uNowUS = micros();
+    MBPollBlock* pBlock = NULL;
+    for( size_t cPoint = 0; cPoint < nPoints; cPoint ++ )
+    {
+        MBPollPoint& rPoint = pPoints[ cPoint ];
+        rPoint.uValue = 0;
+        rPoint.stLast = MBClient::stFailed;
+        if( pBlock && pBlock->uDeviceID == rPoint.uDeviceID && pBlock->uFC == rPoint.uTable && pBlock->uPeriodUS == rPoint.uPeriodUS )
+        {
+            // the point joins the run if the request stays in its limit and the gap read along is cheap enough
+            size_t nSpan = (size_t)rPoint.uAddress - pBlock->uAddress + 1;
+            if( nSpan <= pBlock->uCount )
+            {
+                pBlock->nPoints ++; // the same address twice
+                continue;
+            }
+            size_t nGapBytes = DataBytes( pBlock->uFC, nSpan - 1 ) - DataBytes( pBlock->uFC, pBlock->uCount );
+            if( nSpan <= ( IsBitTable( pBlock->uFC ) ? uMaxBits : uMaxRegs ) && nGapBytes <= m_nGapBytes )
+            {
+                pBlock->uCount = nSpan;
+                pBlock->nPoints ++;
+                continue;
+            }
+        }
+        if( m_nBlocks == m_nMaxBlocks )
+            return false;
+        pBlock = m_pBlocks + m_nBlocks ++;
+        pBlock->uDeviceID = rPoint.uDeviceID;
+        pBlock->uFC = rPoint.uTable;
+        pBlock->uAddress = rPoint.uAddress;
+        pBlock->uCount = 1;
+        pBlock->nFirstPoint = cPoint;
+        pBlock->nPoints = 1;
+        pBlock->uPeriodUS = rPoint.uPeriodUS;
+    }
+    // the first deadlines spread over the periods, so the schedule does not start with a burst
+    for( size_t cBlock = 0; cBlock < m_nBlocks; cBlock ++ )
+        m_pBlocks[ cBlock ].uDueUS = uNowUS + (uint32_t)( (uint64_t)m_pBlocks[ cBlock ].uPeriodUS * cBlock / m_nBlocks );
+    for( size_t cBlock = m_nBlocks / 2; cBlock > 0; cBlock -- )
+        SiftDown( cBlock - 1 );
+    m_nPoints = nPoints;
+    return true;
+}
+
+bool
+MBPollScheduler::Poll()
+{
+    Tick();
+    if( m_nBlocks == 0 || (int32_t)( m_uLastUS - m_pBlocks[0].uDueUS ) < 0 )
+        return false;
+
+    MBPollBlock& rBlock = m_pBlocks[0];
+    size_t nRequest = MBClient::EncodeRead( m_arrbRequest, rBlock.uDeviceID, rBlock.uFC, rBlock.uAddress, rBlock.uCount );
+    MBResponse resp;
+    uint32_t uStartUS = micros();
+    MBClient::eStatus stRV = m_pClient->Transact( m_arrbRequest, nRequest, resp );
+    m_uBusyUS += (uint32_t)micros() - uStartUS;
+    m_nPolls ++;
+
+    uint16_t uCharUS = m_pClient->Transport()->CharUS();
+    MBPollPoint* pPoint = m_pPoints + rBlock.nFirstPoint;
+    if( stRV == MBClient::stOK )
+    {
+        m_uWireUS += WireUS( rBlock.uFC, rBlock.uCount, uCharUS );
+        MBRegView regs = resp.Regs();
+        MBBitView bits = resp.Bits();
+        for( size_t cPoint = 0; cPoint < rBlock.nPoints; cPoint ++, pPoint ++ )
+        {
+            size_t nOffset = pPoint->uAddress - rBlock.uAddress;
+            pPoint->uValue = IsBitTable( rBlock.uFC ) ? bits[ nOffset ] : regs[ nOffset ];
+            pPoint->stLast = stRV;
+        }
+    }
+    else
+    {
+        if( stRV == MBClient::stSkipped )
+            m_nSkipped ++; // the slave is held off, the bus stays free
+        else
+        {
+            m_uWireUS += ( 8 + 7 ) * (uint32_t)uCharUS; // the request and its gaps went out all the same
+            m_nErrors ++;
+        }
+        for( size_t cPoint = 0; cPoint < rBlock.nPoints; cPoint ++, pPoint ++ )
+            pPoint->stLast = stRV;
+    }
+    Polled( rBlock, stRV, resp );
+
+    // the next deadline keeps the phase; a request a whole period behind starts over from now
+    uint32_t uNowUS = micros();
+    rBlock.uDueUS += rBlock.uPeriodUS;
+    if( (int32_t)( uNowUS - rBlock.uDueUS ) >= 0 )
+    {
+        m_nOverruns ++;
+        rBlock.uDueUS = uNowUS;
+    }
+    SiftDown( 0 );
+    return true;
+}
+
+uint32_t
+MBPollScheduler::NextDueUS() const
+{
+    if( m_nBlocks == 0 )
+        return UINT32_MAX;
+    int32_t nLeftUS = (int32_t)( m_pBlocks[0].uDueUS - (uint32_t)micros() );
+    return nLeftUS > 0 ? nLeftUS : 0;
+}
+
+const MBPollPoint*
+MBPollScheduler::Find( uint8_t uDeviceID, uint8_t uTable, uint16_t uAddress ) const
+{
+    // the points are sorted by period before address, so a slave's table is scanned
+    for( size_t cPoint = 0; cPoint < m_nPoints; cPoint ++ )
+    {
+        const MBPollPoint& rPoint = m_pPoints[ cPoint ];
+        if( rPoint.uDeviceID == uDeviceID && rPoint.uTable == uTable && rPoint.uAddress == uAddress )
+            return &rPoint;
+    }
+    return NULL;
+}
+
+uint32_t
+MBPollScheduler::WireUS( uint8_t uFC, uint16_t uCount, uint16_t uCharUS )
+{
+    // request: address, function, start, count, CRC; response: address, function, byte count, data, CRC;
+    // a t3.5 gap after each
+    return ( 8 + 5 + DataBytes( uFC, uCount ) + 7 ) * (uint32_t)uCharUS;
+}
+
+uint32_t
+MBPollScheduler::DemandUS() const
+{
+    uint16_t uCharUS = m_pClient->Transport()->CharUS();
+    uint64_t uDemandUS = 0;
+    for( size_t cBlock = 0; cBlock < m_nBlocks; cBlock ++ )
+    {
+        const MBPollBlock& rBlock = m_pBlocks[ cBlock ];
+        if( rBlock.uPeriodUS )
+            uDemandUS += (uint64_t)WireUS( rBlock.uFC, rBlock.uCount, uCharUS ) * 1000000 / rBlock.uPeriodUS;
+    }
+    return uDemandUS > UINT32_MAX ? UINT32_MAX : (uint32_t)uDemandUS;
+}
+
+void
+MBPollScheduler::ResetStats()
+{
+    m_uLastUS = micros();
+    m_uElapsedUS = 0;
+    m_uBusyUS = 0;
+    m_uWireUS = 0;
+    m_nPolls = 0;
+    m_nErrors = 0;
+    m_nOverruns = 0;
+    m_nSkipped = 0;
+}
+
+void
+MBPollScheduler::Tick()
+{
+    uint32_t uNowUS = micros();
+    m_uElapsedUS += uNowUS - m_uLastUS;
+    m_uLastUS = uNowUS;
+}
+
+void
+MBPollScheduler::SiftDown( size_t nIndex )
+{
+    MBPollBlock blockMoved = m_pBlocks[ nIndex ];
+    for( ;; )
+    {
+        size_t nChild = 2 * nIndex + 1;
+        if( nChild >= m_nBlocks )
+            break;
+        if( nChild + 1 < m_nBlocks && (int32_t)( m_pBlocks[ nChild + 1 ].uDueUS - m_pBlocks[ nChild ].uDueUS ) < 0 )
+            nChild ++;
+        if( (int32_t)( m_pBlocks[ nChild ].uDueUS - blockMoved.uDueUS ) >= 0 )
+            break;
+        m_pBlocks[ nIndex ] = m_pBlocks[ nChild ];
+        nIndex = nChild;
+    }
+    m_pBlocks[ nIndex ] = blockMoved;
+}
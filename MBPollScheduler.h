@@ -0,0 +1,141 @@
+#ifndef _MBPOLLSCHEDULER_H_
+#define _MBPOLLSCHEDULER_H_
+
+/*
+* MIT License
+* 
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#include "MBusTiny.h"
+#include "MBClient.h"
+#include "MBRTUClient.h"
+
+/*! @brief MBPollPoint - a value the master keeps up to date */
+struct MBPollPoint
+{
+    uint8_t  uDeviceID;  //!< the slave
+    uint8_t  uTable;     //!< the function code reading its table: 1 coils, 2 discrete inputs, 3 holding, 4 input registers
+    uint16_t uAddress;   //!< the zero based address
+    uint32_t uPeriodUS;  //!< how often it is read
+    uint16_t uTag;       //!< the caller's identifier, kept when the points are sorted
+    uint16_t uValue;     //!< the last value read, 0 or 1 for a bit
+    uint8_t  stLast;     //!< the MBClient::eStatus of the last read, stFailed before the first
+};
+
+/*! @brief MBPollBlock - the one request that reads a run of points */
+struct MBPollBlock
+{
+    uint8_t  uDeviceID;   //!< the slave
+    uint8_t  uFC;         //!< the reading function code
+    uint16_t uAddress;    //!< the first address read
+    uint16_t uCount;      //!< the registers or bits read
+    uint16_t nFirstPoint; //!< its first point in the sorted point list
+    uint16_t nPoints;     //!< its points
+    uint32_t uPeriodUS;   //!< the period of its points
+    uint32_t uDueUS;      //!< micros() when it is next due
+};
+
+/*! @brief class MBPollScheduler - polls a point list with the fewest requests, earliest deadline first
+*
+*   Build() sorts the points by slave, table, period and address and merges each run into one
+*   request, up to 125 registers or 2000 bits. A gap of unwanted addresses is read along when it
+*   costs fewer response bytes than the gap fill threshold; the default, 20 bytes, is about what a
+*   request of its own costs on the wire. The requests wait in a min-heap on their deadlines and
+*   Poll() runs the most overdue one:
+*
+*       MBPollPoint arrPoints[] = { { 7, 3, 100, 1000000 }, { 7, 3, 104, 1000000 }, { 9, 4, 0, 250000 } };
+*       MBPollBlock arrBlocks[8];
+*       MBPollScheduler poll( &rtu, arrBlocks, 8 );
+*       poll.Build( arrPoints, 3 );
+*       for( ;; )
+*           poll.Poll();
+*
+*   The scheduler keeps the wire time, the bus time and the elapsed time, so the utilization
+*   achieved can be compared with what the schedule needs at the transport's CharUS().
+*/
+class MBPollScheduler
+{
+protected:
+    MBRTUClient*  m_pClient;        //!< the master the requests go through
+    MBPollPoint*  m_pPoints;        //!< the points, sorted
+    size_t        m_nPoints;        //!< the number of points
+    MBPollBlock*  m_pBlocks;        //!< the requests, a min-heap on uDueUS
+    size_t        m_nMaxBlocks;     //!< the room in m_pBlocks
+    size_t        m_nBlocks;        //!< the number of requests
+    size_t        m_nGapBytes;      //!< the most response bytes spent on unwanted addresses to save a request
+    uint8_t       m_arrbRequest[8]; //!< the request being sent
+    uint32_t      m_uLastUS;        //!< micros() when the elapsed time was last taken
+    uint64_t      m_uElapsedUS;     //!< time since the statistics were reset
+    uint64_t      m_uBusyUS;        //!< request start to response end, summed
+    uint64_t      m_uWireUS;        //!< transmission time of the frames and their t3.5 gaps, summed
+    uint32_t      m_nPolls;         //!< requests sent
+    uint32_t      m_nErrors;        //!< requests without a normal response
+    uint32_t      m_nSkipped;       //!< requests not sent because their slave was held off
+    uint32_t      m_nOverruns;      //!< requests that fell a whole period behind
+public:
+    MBPollScheduler( MBRTUClient* pClient, MBPollBlock* pBlocks, size_t nMaxBlocks ); //!< constructor with the master and the room for the requests
+    virtual ~MBPollScheduler() {}
+
+    void SetGapFill( size_t nGapBytes ) { m_nGapBytes = nGapBytes; } //!< the gap fill threshold in response bytes, takes effect on Build()
+
+    /*! @brief Build - sorts the points in place and merges them into requests, first due spread over their periods
+    *   @param pPoints - the points; they stay the caller's and are updated by Poll()
+    *   @param nPoints - the number of points
+    *   @returns       - false if a point has no reading table or the requests do not fit the blocks
+    */
+    bool Build( MBPollPoint* pPoints, size_t nPoints );
+
+    /*! @brief Poll - sends the most overdue request if one is due
+    *   @returns - true if a request was sent
+    */
+    bool Poll();
+
+    /*! @brief NextDueUS - microseconds until the next request is due, 0 if one is */
+    uint32_t NextDueUS() const;
+
+    const MBPollPoint* Find( uint8_t uDeviceID, uint8_t uTable, uint16_t uAddress ) const; //!< a point by its slave, table and address, NULL if none
+    size_t Points() const { return m_nPoints; }    //!< the number of points
+    size_t Blocks() const { return m_nBlocks; }    //!< the number of requests the points merged into
+    const MBPollBlock& Block( size_t nIndex ) const { return m_pBlocks[ nIndex ]; } //!< a request, in heap order
+
+    /*! @brief WireUS - the bus time of a read request and its response: the frames and two t3.5 gaps */
+    static uint32_t WireUS( uint8_t uFC, uint16_t uCount, uint16_t uCharUS );
+    uint32_t DemandUS() const;                     //!< the bus time one second of the schedule needs, by WireUS()
+    uint64_t ElapsedUS() const { return m_uElapsedUS; } //!< time since the statistics were reset
+    uint64_t BusyUS() const { return m_uBusyUS; }  //!< bus time taken, the slaves' turnaround included
+    uint64_t WireUS() const { return m_uWireUS; }  //!< bus time the frames needed at the line speed
+    uint32_t Polls() const { return m_nPolls; }    //!< requests sent
+    uint32_t Errors() const { return m_nErrors; }  //!< requests sent without a normal response
+    uint32_t Skipped() const { return m_nSkipped; } //!< requests not sent because their slave was held off
+    uint32_t Overruns() const { return m_nOverruns; } //!< requests that fell a whole period behind
+    void ResetStats();                             //!< restarts the statistics
+
+protected:
+    /*! @brief Polled - called after each request with its outcome, once the points are updated */
+    virtual void Polled( const MBPollBlock& /* rBlock */, MBClient::eStatus /* stRV */, const MBResponse& /* rResp */ ) {}
+    void SiftDown( size_t nIndex );                //!< restores the heap below an entry whose deadline moved later
+    void Tick();                                   //!< takes the elapsed time
+};
+
+
+#endif
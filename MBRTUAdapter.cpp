@@ -30,11 +30,17 @@
 MBRTUAdapter::MBRTUAdapter()
 {
     m_pTransport = NULL;
+    m_bEarlyReject = false;
+    m_nForeignFrames = 0;
+    m_nForeignBytes = 0;
 }
 
 MBRTUAdapter::MBRTUAdapter( IRTUTransport* pTrans )
 {
     m_pTransport =  pTrans ;
+    m_bEarlyReject = false;
+    m_nForeignFrames = 0;
+    m_nForeignBytes = 0;
 }
 
 bool
@@ -51,36 +57,65 @@ MBRTUAdapter::ReceivePDU(
                       size_t nBuffer,
                       size_t& nBufferOut )
 {
+    // the CRC is folded in as each piece arrives, so only the last piece is left when it does
+    CRC16Stream crcRX;
     bool bRV = false;
-    bRV = m_pTransport->ReceiveBuffer( pbBuffer, 6 ); // station ID + function code + ARG 0 + ARG 1
+    if( m_bEarlyReject )
+    {
+        bRV = m_pTransport->ReceiveBuffer( pbBuffer, 1 ); // station ID
+        if( ! bRV )
+            return false;
+        if( pbBuffer[0] != uSDeviceID && uSDeviceID != uAnyDeviceID )
+        {
+            m_nForeignFrames ++;
+            m_nForeignBytes ++;
+            if( ! SkipSized( pbBuffer, nBuffer ) )
+                SkipFrame( pbBuffer, nBuffer );
+            return false;
+        }
+        bRV = m_pTransport->ReceiveBuffer( pbBuffer + 1, 5 ); // function code + ARG 0 + ARG 1
+    }
+    else
+        bRV = m_pTransport->ReceiveBuffer( pbBuffer, 6 ); // station ID + function code + ARG 0 + ARG 1
     if( ! bRV )
         return false;
+    crcRX.Update( pbBuffer, 6 );
 
     nBufferOut = 6;
 
     if( MBUSTiny::HasTrailing(pbBuffer[1]) )
     {
-        nBufferOut += 1;
-        bRV = m_pTransport->ReceiveBuffer( pbBuffer + 6, 1 ); // Trailing payload in bytes
+        size_t nHeader = MBUSTiny::HeaderSize( pbBuffer[1] ); // the byte count follows the header
+        bRV = m_pTransport->ReceiveBuffer( pbBuffer + 6, nHeader - 6 + 1 ); // rest of the header + trailing payload in bytes
         if( ! bRV )
             return false;
+        crcRX.Update( pbBuffer + 6, nHeader - 6 + 1 );
 
-        nBufferOut += pbBuffer[ 6 ];
+        nBufferOut = nHeader + 1 + pbBuffer[ nHeader ];
+        if( nBufferOut + 2 > nBuffer )
+        {
+            SkipBytes( pbBuffer, nBuffer, pbBuffer[ nHeader ] + 2 ); // the payload would not fit, drop it unread
+            return false;
+        }
 
-        bRV = m_pTransport->ReceiveBuffer( pbBuffer + 7, pbBuffer[ 6 ]  + 2  ); // Trailing payload + CRC
+        bRV = m_pTransport->ReceiveBuffer( pbBuffer + nHeader + 1, pbBuffer[ nHeader ]  + 2  ); // Trailing payload + CRC
         if( ! bRV )
             return false;
+        crcRX.Update( pbBuffer + nHeader + 1, pbBuffer[ nHeader ] + 2 );
 
     }
     else
+    {
         bRV = m_pTransport->ReceiveBuffer( pbBuffer + 6,  2  ); // CRC
+        if( ! bRV )
+            return false;
+        crcRX.Update( pbBuffer + 6, 2 );
+    }
 
-    uint16_t uCRC = CRC16Fsm( pbBuffer, nBufferOut + 2 );
-
-    if( uCRC != 0 )
+    if( crcRX.Final() != 0 )
         return false;
 
-    if( pbBuffer[0] != uSDeviceID )
+    if( pbBuffer[0] != uSDeviceID && uSDeviceID != uAnyDeviceID )
         return false;
     // wait for the transmission gap
     delayMicroseconds( ((uint32_t)36 * m_pTransport->CharUS())/10);
@@ -88,15 +123,179 @@ MBRTUAdapter::ReceivePDU(
 
 }
 
+// the sizes a foreign frame with the function code uFC may have, as a request and as the response to one;
+// each is a fixed part plus the byte count at an offset, when there is one
+static size_t
+ForeignSizes( uint8_t uFC, size_t* parrnFixed, size_t* parrnCountAt )
+{
+    if( uFC & 0x80 ) // exception response
+    {
+        parrnFixed[0] = 5;
+        parrnCountAt[0] = 0;
+        return 1;
+    }
+    if( MBUSTiny::HasTrailing( uFC ) )
+    {
+        parrnFixed[0] = MBUSTiny::HeaderSize( uFC ) + 1 + 2;
+        parrnCountAt[0] = MBUSTiny::HeaderSize( uFC );
+        parrnFixed[1] = uFC == 23 ? 5 : 8; // FC23 answers with the registers read, FC15/16 with the address and quantity
+        parrnCountAt[1] = uFC == 23 ? 2 : 0;
+        return 2;
+    }
+    if( uFC >= 1 && uFC <= 6 )
+    {
+        parrnFixed[0] = 8;
+        parrnCountAt[0] = 0;
+        if( uFC >= 5 ) // the single writes are echoed as they are
+            return 1;
+        parrnFixed[1] = 5; // the reads answer with a byte count
+        parrnCountAt[1] = 2;
+        return 2;
+    }
+    return 0;
+}
+
+bool
+MBRTUAdapter::SkipSized( uint8_t* pbFrame, size_t nBuffer )
+{
+    // the CRC tells a request from a response at the shorter of their sizes,
+    // the one size left is drained unchecked
+    if( ! m_pTransport->ReceiveBuffer( pbFrame + 1, 1 ) ) // function code
+        return true;
+    m_nForeignBytes ++;
+    size_t nFrame = 2;
+    CRC16Stream crcSkip;
+    crcSkip.Update( pbFrame, nFrame );
+
+    size_t arrnFixed[2];
+    size_t arrnCountAt[2]; // 0 once the size is known
+    size_t nSizes = ForeignSizes( pbFrame[1], arrnFixed, arrnCountAt );
+    while( nSizes > 0 )
+    {
+        if( nSizes == 1 && arrnCountAt[0] == 0 )
+        {
+            m_nForeignBytes += arrnFixed[0] - nFrame;
+            SkipBytes( pbFrame, nBuffer, arrnFixed[0] - nFrame );
+            return true;
+        }
+        // the nearest point to read up to: a byte count, or a size to check
+        size_t arrnNeed[2];
+        for( size_t c = 0; c < nSizes; c ++ )
+            arrnNeed[c] = arrnCountAt[c] != 0 ? arrnCountAt[c] + 1 : arrnFixed[c];
+        size_t cNext = nSizes > 1 && arrnNeed[1] < arrnNeed[0] ? 1 : 0;
+        size_t nNeed = arrnNeed[ cNext ];
+        if( nNeed > nBuffer )
+            return false;
+        if( nNeed > nFrame )
+        {
+            if( ! m_pTransport->ReceiveBuffer( pbFrame + nFrame, nNeed - nFrame ) )
+                return true;
+            crcSkip.Update( pbFrame + nFrame, nNeed - nFrame );
+            m_nForeignBytes += nNeed - nFrame;
+            nFrame = nNeed;
+        }
+
+        if( arrnCountAt[ cNext ] != 0 )
+        {
+            arrnFixed[ cNext ] += pbFrame[ arrnCountAt[ cNext ] ];
+            arrnCountAt[ cNext ] = 0;
+        }
+        else if( crcSkip.Final() == 0 )
+            return true;
+        else
+        {
+            nSizes --;
+            arrnFixed[ cNext ] = arrnFixed[ nSizes ];
+            arrnCountAt[ cNext ] = arrnCountAt[ nSizes ];
+        }
+    }
+    return false;
+}
+
+void
+MBRTUAdapter::SkipFrame( uint8_t* pbScratch, size_t nScratch )
+{
+    // the function code gives no size, or not one that fits pbScratch;
+    // the frame ends with the t3.5 silence instead
+    uint32_t uGapUS = FrameGapUS( m_pTransport->CharUS() );
+    uint32_t uLastUS = 0;
+    bool bDrained = true; // the silence timer starts lazily, only once the input runs dry
+    for( ;; )
+    {
+        // whatever the transport holds goes in one read, the clock is read only when it runs dry
+        size_t nAvailable = m_pTransport->Available();
+        if( nAvailable > 0 )
+        {
+            if( nAvailable > nScratch )
+                nAvailable = nScratch;
+            if( ! m_pTransport->ReceiveBuffer( pbScratch, nAvailable ) )
+                return;
+            m_nForeignBytes += nAvailable;
+            bDrained = true;
+        }
+        else if( bDrained )
+        {
+            uLastUS = micros();
+            bDrained = false;
+        }
+        else if( (uint32_t)micros() - uLastUS >= uGapUS )
+            return;
+    }
+}
+
+bool
+MBRTUAdapter::SkipBytes( uint8_t* pbScratch, size_t nScratch, size_t nSkip )
+{
+    while( nSkip > 0 )
+    {
+        size_t nBlock = nSkip < nScratch ? nSkip : nScratch;
+        if( ! m_pTransport->ReceiveBuffer( pbScratch, nBlock ) )
+            return false;
+        nSkip -= nBlock;
+    }
+    return true;
+}
+
 bool
 MBRTUAdapter::TransmitPDU(
                       uint8_t uSDeviceID,
                       uint8_t* pbBuffer,
                       size_t nBuffer)
 {
-    uint16_t uCRCLocal  = CRC16Fsm(pbBuffer, nBuffer);
-    pbBuffer[ nBuffer ] = uCRCLocal % 256;
-    pbBuffer[ nBuffer + 1 ] = uCRCLocal / 256;
-    // test wrong CRC pbBuffer[ nBuffer + 1 ] ++;
-    return m_pTransport->TransmitBuffer( pbBuffer, nBuffer + 2 );
+    MBSegment segPDU = { pbBuffer, nBuffer };
+    return TransmitSegments( uSDeviceID, &segPDU, 1 );
+}
+
+bool
+MBRTUAdapter::TransmitSegments(
+                      uint8_t /* uSDeviceID */,
+                      const MBSegment* pSegments,
+                      size_t nSegments)
+{
+    if( nSegments > nMaxSegments )
+        return false;
+    // the CRC is a segment of its own, so the caller's buffers stay untouched and may be constant
+    MBSegment arrSegments[ nMaxSegments + 1 ];
+    CRC16Stream crcTX;
+    for( size_t cSeg = 0; cSeg < nSegments; cSeg ++ )
+    {
+        crcTX.Update( pSegments[cSeg].pbData, pSegments[cSeg].nData );
+        arrSegments[cSeg] = pSegments[cSeg];
+    }
+    uint16_t uCRCLocal  = crcTX.Final();
+    uint8_t arrbCRC[2] = { (uint8_t)( uCRCLocal % 256 ), (uint8_t)( uCRCLocal / 256 ) };
+    // test wrong CRC arrbCRC[1] ++;
+    arrSegments[nSegments].pbData = arrbCRC;
+    arrSegments[nSegments].nData = 2;
+    return m_pTransport->TransmitSegments( arrSegments, nSegments + 1 );
+}
+
+bool
+MBRTUAdapter::TransmitFrame(
+                      uint8_t /* uSDeviceID */,
+                      const uint8_t* pbFrame,
+                      size_t nFrame)
+{
+    MBSegment segFrame = { pbFrame, nFrame };
+    return m_pTransport->TransmitSegments( &segFrame, 1 );
 }
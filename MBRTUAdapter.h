@@ -33,6 +33,11 @@ class IRTUTransport
 public:
     virtual bool AvailableIn() = 0; //!< returns true on data available for read
 
+    /*!  @brief Available - the number of bytes ReceiveBuffer() returns without waiting
+    *    @returns          - the default knows of one byte at most; buffering transports tell all they hold
+    */
+    virtual size_t Available() { return AvailableIn() ? 1 : 0; }
+
     /*!  @brief ReceiveBuffer - receives a block of data from transport
     *    @param pbBuffer   - the buffer that should receive data
     *    @param nBuffer    - the size of the buffer
@@ -56,6 +61,24 @@ public:
     */     
     virtual uint16_t CharUS() = 0;
 
+    /*!  @brief TransmitSegments - transmits the segments back to back as one block
+    *    @param pSegments  - the segments, in order
+    *    @param nSegments  - the number of segments
+    *    @returns          - true on success, false o.w.
+    *
+    *    The default calls TransmitBuffer() for each segment; transports that can gather, with writev() or
+    *    chained DMA descriptors, override it.
+    */
+    virtual bool TransmitSegments(
+                          const MBSegment* pSegments,
+                          size_t nSegments)
+    {
+        for( size_t cSeg = 0; cSeg < nSegments; cSeg ++ )
+            if( ! TransmitBuffer( pSegments[cSeg].pbData, pSegments[cSeg].nData ) )
+                return false;
+        return true;
+    }
+
 };
 
 /*! @brief class MBRTUAdapter - Modbus RTU implementation that uses an IRTUTransport implementation for data trancieve */
@@ -63,9 +86,24 @@ class MBRTUAdapter : public IPDUAdapter
 {
 protected:
     IRTUTransport* m_pTransport;    //!< transport instance pointer
+    bool           m_bEarlyReject;  //!< check the address byte before reading the rest of the frame
+    uint32_t       m_nForeignFrames;//!< frames for other devices skipped without a CRC check
+    uint32_t       m_nForeignBytes; //!< bytes of the skipped frames
 public:
     MBRTUAdapter();                 //!< defaut constructor
     MBRTUAdapter( IRTUTransport* ); //!< transport instance pointer constructor
+
+    /*! @brief SetEarlyReject - enables the early device address check
+    *   @param bEnable - when true, a frame for another device is discarded right after its address byte:
+    *                    the rest is drained up to the t3.5 inter-frame gap without a CRC check
+    */
+    void SetEarlyReject( bool bEnable ) { m_bEarlyReject = bEnable; }
+    uint32_t ForeignFrames() const { return m_nForeignFrames; } //!< frames for other devices skipped so far
+    uint32_t ForeignBytes() const { return m_nForeignBytes; }   //!< bytes of the frames skipped so far
+
+    /*! @brief FrameGapUS - the t3.5 inter-frame gap; no response can start sooner after its request */
+    static uint32_t FrameGapUS( uint16_t uCharUS ) { return ((uint32_t)35 * uCharUS)/10; }
+
     virtual bool AvailableIn();     //!< overides base class method
     virtual bool ReceivePDU(
                           uint8_t uSDeviceID,
@@ -76,7 +114,19 @@ public:
     virtual bool TransmitPDU(
                           uint8_t uSDeviceID,
                           uint8_t* pbBuffer,
-                          size_t nBuffer) ; //!< overides base class method
+                          size_t nBuffer) ; //!< overides base class method, leaves the buffer as it is
+    virtual bool TransmitSegments(
+                          uint8_t uSDeviceID,
+                          const MBSegment* pSegments,
+                          size_t nSegments) ; //!< overides base class method, the CRC goes out as one more segment
+    virtual bool TransmitFrame(
+                          uint8_t uSDeviceID,
+                          const uint8_t* pbFrame,
+                          size_t nFrame) ; //!< overides base class method, the frame goes out with its CRC as it is
+protected:
+    bool SkipSized( uint8_t* pbFrame, size_t nBuffer ); //!< drains the rest of a foreign frame by the sizes its function code gives, false if it gives none
+    void SkipFrame( uint8_t* pbScratch, size_t nScratch ); //!< drains a frame of unknown size up to the t3.5 inter-frame gap, in blocks through pbScratch
+    bool SkipBytes( uint8_t* pbScratch, size_t nScratch, size_t nSkip ); //!< drains the nSkip bytes left of a frame of known size
 };
 
 
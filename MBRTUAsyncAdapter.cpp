@@ -0,0 +1,198 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#include "MBRTUAsyncAdapter.h"
+#include <string.h>
+#include <Arduino.h>
+
+MBRTUAsyncAdapter::MBRTUAsyncAdapter( IRTUTransport* pTrans, uint8_t uDeviceID )
+    : MBRTUAdapter( pTrans )
+{
+    m_uState = rxIdle;
+    m_nFrame = 0;
+    m_uLastUS = micros();
+    m_uDeviceID = uDeviceID;
+    m_nFrameErrors = 0;
+    m_nOverruns = 0;
+    SetTimers();
+}
+
+void
+MBRTUAsyncAdapter::SetTimers()
+{
+    uint32_t uCharUS = m_pTransport->CharUS();
+    // above 19200 bps the timers are fixed to 750us and 1750us
+    uint32_t uT15US = ((uint32_t)15 * uCharUS)/10;
+    uint32_t uT35US = ((uint32_t)35 * uCharUS)/10;
+    uint32_t uTurnaroundUS = ((uint32_t)36 * uCharUS)/10;
+    noInterrupts();
+    m_uT15US = uT15US > 750 ? uT15US : 750;
+    m_uT35US = uT35US > 1750 ? uT35US : 1750;
+    m_uTurnaroundUS = uTurnaroundUS;
+    interrupts();
+}
+
+void
+MBRTUAsyncAdapter::PushByte( uint8_t uByte, uint32_t uNowUS )
+{
+    uint32_t uGapUS = uNowUS - m_uLastUS;
+
+    // the silence may have passed unnoticed when nobody polled in between
+    if( ( m_uState == rxReceiving || m_uState == rxDiscard ) && uGapUS >= m_uT35US )
+        EndFrame();
+
+    // a waiting frame takes no bytes, and they do not move its turnaround deadline
+    if( m_uState == rxReady )
+    {
+        m_nOverruns ++;
+        return;
+    }
+    m_uLastUS = uNowUS;
+
+    switch( m_uState )
+    {
+    case rxIdle:
+        m_nFrame = 0;
+        m_crcRX.Init();
+        if( m_bEarlyReject && uByte != m_uDeviceID && m_uDeviceID != uAnyDeviceID )
+        {
+            m_nForeignFrames ++;
+            m_nForeignBytes ++;
+            m_uState = rxDiscard;
+            return;
+        }
+        m_uState = rxReceiving;
+        // fall through
+    case rxReceiving:
+        if( uGapUS > m_uT15US && m_nFrame > 0 )
+        {
+            m_nFrameErrors ++;
+            m_uState = rxDiscard;
+            return;
+        }
+        if( m_nFrame >= sizeof( m_arrbFrame ) )
+        {
+            m_nFrameErrors ++;
+            m_uState = rxDiscard;
+            return;
+        }
+        m_arrbFrame[ m_nFrame ] = uByte;
+        m_crcRX.Update( m_arrbFrame + m_nFrame, 1 );
+        m_nFrame = m_nFrame + 1;
+        return;
+    case rxDiscard:
+        if( m_bEarlyReject )
+            m_nForeignBytes ++;
+        return;
+    }
+}
+
+void
+MBRTUAsyncAdapter::EndFrame()
+{
+    if( m_uState != rxReceiving )
+    {
+        m_uState = rxIdle;
+        return;
+    }
+    // address + function code + CRC at least
+    if( m_nFrame < 4 || m_crcRX.Final() != 0 )
+    {
+        m_nFrameErrors ++;
+        m_uState = rxIdle;
+        return;
+    }
+    m_uState = rxReady;
+}
+
+void
+MBRTUAsyncAdapter::Snapshot( uint8_t& ruState, uint32_t& ruLastUS )
+{
+    noInterrupts();
+    ruState = m_uState;
+    ruLastUS = m_uLastUS;
+    interrupts();
+}
+
+void
+MBRTUAsyncAdapter::Poll( uint32_t uNowUS )
+{
+    // a byte pushed between the check and EndFrame() would be lost with the frame it belongs to
+    noInterrupts();
+    if( ( m_uState == rxReceiving || m_uState == rxDiscard ) && uNowUS - m_uLastUS >= m_uT35US )
+        EndFrame();
+    interrupts();
+}
+
+bool
+MBRTUAsyncAdapter::AvailableIn()
+{
+    uint8_t uByte;
+    uint8_t uState;
+    uint32_t uLastUS;
+    Snapshot( uState, uLastUS );
+    while( uState != rxReady && m_pTransport->AvailableIn() )
+    {
+        if( ! m_pTransport->ReceiveBuffer( &uByte, 1 ) )
+            break;
+        PushByte( uByte, micros() );
+        uState = m_uState; // no ISR pushes while the transport is polled
+    }
+
+    uint32_t uNowUS = micros();
+    Poll( uNowUS );
+    return TurnaroundReady( uNowUS );
+}
+
+bool
+MBRTUAsyncAdapter::TurnaroundReady( uint32_t uNowUS )
+{
+    uint8_t uState;
+    uint32_t uLastUS;
+    Snapshot( uState, uLastUS );
+    // the turnaround is a deadline from the last byte of the frame, nothing spins on it
+    return uState == rxReady && uNowUS - uLastUS >= m_uTurnaroundUS;
+}
+
+bool
+MBRTUAsyncAdapter::ReceivePDU(
+                      uint8_t uSDeviceID,
+                      uint8_t* pbBuffer,
+                      size_t nBuffer,
+                      size_t& nBufferOut )
+{
+    if( m_uState != rxReady ) // a single byte, read in one load
+        return false;
+
+    // the ISR only counts overruns while a frame is ready, the frame and its size hold still
+    bool bRV = ( m_arrbFrame[0] == uSDeviceID || uSDeviceID == uAnyDeviceID ) && m_nFrame - 2 <= nBuffer;
+    if( bRV )
+    {
+        nBufferOut = m_nFrame - 2;
+        memcpy( pbBuffer, m_arrbFrame, nBufferOut );
+    }
+    m_uState = rxIdle;
+    return bRV;
+}
@@ -0,0 +1,112 @@
+#ifndef _MBRTUASYNCADAPTER_H_
+#define _MBRTUASYNCADAPTER_H_
+
+/*
+* MIT License
+* 
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#include "MBusTiny.h"
+#include "MBRTUAdapter.h"
+#include "CrcFsm.h"
+
+/*! @brief class MBRTUAsyncAdapter - event-driven Modbus RTU framer
+*
+*   Bytes are taken one at a time, either polled from the transport in AvailableIn()
+*   or pushed from a UART ISR with PushByte(). Frames end on t3.5 silence, a gap longer
+*   than t1.5 inside a frame discards it, and the reply turnaround is a deadline checked
+*   by AvailableIn() instead of a busy wait, so MBUSTiny::TranscievePDU() returns at once
+*   while no complete frame is ready. The frame buffer adds nPDU + 2 bytes of RAM.
+*
+*   With PushByte() in the ISR, the main loop reads the framer state only with interrupts
+*   masked: the 32-bit arrival time and the frame size take several loads on 8-bit parts,
+*   and the t3.5 check in Poll() must not interleave with a byte. Once a frame is ready
+*   the ISR leaves it alone, so ReceivePDU() copies it out unmasked.
+*/
+class MBRTUAsyncAdapter : public MBRTUAdapter
+{
+protected:
+    /*! @brief eRXState - the framer states */
+    enum eRXState
+    {
+        rxIdle,      //!< t3.5 silence seen, waiting for the first byte
+        rxReceiving, //!< storing the frame
+        rxDiscard,   //!< dropping a broken or foreign frame up to the next t3.5 silence
+        rxReady      //!< a valid frame waits for ReceivePDU()
+    };
+
+    uint8_t           m_arrbFrame[nPDU + 2]; //!< the frame being received, CRC included
+    volatile uint8_t  m_uState;              //!< eRXState
+    volatile size_t   m_nFrame;              //!< bytes stored so far
+    volatile uint32_t m_uLastUS;             //!< the time the last byte of the current frame arrived; overruns do not count
+    uint8_t           m_uDeviceID;           //!< the address used by the early rejection
+    uint32_t          m_uT15US;              //!< the inter-character timeout, from the transport's character time
+    uint32_t          m_uT35US;              //!< the inter-frame silence
+    uint32_t          m_uTurnaroundUS;       //!< the wait from the last request byte to the reply
+    CRC16Stream       m_crcRX;               //!< the CRC folded in as the bytes arrive
+    uint32_t          m_nFrameErrors;        //!< frames dropped on t1.5 gaps, overflow or CRC errors
+    uint32_t          m_nOverruns;           //!< bytes that arrived while a frame waited for processing
+public:
+    MBRTUAsyncAdapter( IRTUTransport* pTrans, uint8_t uDeviceID ); //!< transport instance pointer and device address constructor
+
+    /*! @brief PushByte - feeds one received byte; may be called from the UART ISR
+    *   @param uByte   - the byte
+    *   @param uNowUS  - the arrival time, micros()
+    */
+    void PushByte( uint8_t uByte, uint32_t uNowUS );
+
+    /*! @brief Poll - runs the silence timers; called by AvailableIn(), masks interrupts while it does
+    *   @param uNowUS  - the current time, micros()
+    */
+    void Poll( uint32_t uNowUS );
+
+    uint32_t FrameErrors() const { return m_nFrameErrors; } //!< frames dropped so far
+    uint32_t Overruns() const { return m_nOverruns; }       //!< bytes dropped while busy
+    uint32_t T15US() const { return m_uT15US; }  //!< the inter-character timeout
+    uint32_t T35US() const { return m_uT35US; }  //!< the inter-frame silence
+
+    /*! @brief SetTimers - takes t1.5, t3.5 and the turnaround from the transport's CharUS(); called by the
+    *   constructor, and to be called again after the baud rate changes. PushByte() compares against the
+    *   stored times, so the ISR makes no virtual call and no division
+    */
+    void SetTimers();
+
+    /*! @brief TurnaroundReady - true once a frame is ready and the turnaround since its last byte has passed
+    *   @param uNowUS  - the current time, micros()
+    */
+    bool TurnaroundReady( uint32_t uNowUS );
+
+    virtual bool AvailableIn();     //!< overides base class method, true once a frame is ready and the turnaround elapsed
+    virtual bool ReceivePDU(
+                          uint8_t uSDeviceID,
+                          uint8_t* pbBuffer,
+                          size_t nBuffer,
+                          size_t& nBufferOut ); //!< overides base class method, never blocks
+protected:
+    void EndFrame();                //!< t3.5 silence: validates the frame
+    /*! @brief Snapshot - reads the state and the last arrival time together, with interrupts masked */
+    void Snapshot( uint8_t& ruState, uint32_t& ruLastUS );
+};
+
+
+#endif
@@ -0,0 +1,169 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "MBusTiny.h"
+#include "MBRTUClient.h"
+#include "MBSlaveTimeouts.h"
+#include "CrcFsm.h"
+#include <Arduino.h>
+
+MBRTUClient::MBRTUClient( IRTUTransport* pTransport )
+{
+    m_pTransport = pTransport;
+    m_uTimeoutUS = 1000000;
+    m_uLastUS = micros();
+    m_uRTTUS = 0;
+    m_uDelayUS = 0;
+    m_nFrame = 0;
+    m_pTimeouts = NULL;
+    m_nTransactions = 0;
+    m_nTimeouts = 0;
+    m_nBadResponses = 0;
+    m_nSkipped = 0;
+    m_nDropped = 0;
+}
+
+MBClient::eStatus
+MBRTUClient::Transact( const uint8_t* pbRequest, size_t nRequest, MBResponse& rResp, uint32_t uTimeoutUS )
+{
+    m_nFrame = 0;
+    if( nRequest < 2 || nRequest > nPDU - 2 )
+        return MBClient::stFailed;
+    uint8_t uDeviceID = pbRequest[0];
+    if( m_pTimeouts && uDeviceID != 0 )
+    {
+        // a slave that keeps timing out is left alone until its hold-off is over
+        if( ! m_pTimeouts->Ready( uDeviceID, micros() ) )
+        {
+            m_nSkipped ++;
+            return MBClient::stSkipped;
+        }
+        if( uTimeoutUS == 0 )
+            uTimeoutUS = m_pTimeouts->TimeoutUS( uDeviceID );
+    }
+    if( uTimeoutUS == 0 )
+        uTimeoutUS = m_uTimeoutUS;
+    m_nTransactions ++;
+
+    // the bus needs t3.5 of silence between frames, counted from the end of the last one; a late
+    // response still coming in is dropped with it, so it cannot pass for the answer to this request
+    Drain( m_uLastUS );
+
+    CRC16Stream crcTX;
+    crcTX.Update( pbRequest, nRequest );
+    uint16_t uCRCLocal = crcTX.Final();
+    uint8_t arrbCRC[2] = { (uint8_t)( uCRCLocal % 256 ), (uint8_t)( uCRCLocal / 256 ) };
+    MBSegment arrSegments[2] = { { pbRequest, nRequest }, { arrbCRC, 2 } };
+
+    uint32_t uStartUS = micros();
+    bool bSent = m_pTransport->TransmitSegments( arrSegments, 2 );
+    m_uLastUS = micros();
+    if( ! bSent )
+        return MBClient::stFailed;
+
+    if( uDeviceID == 0 )
+    {
+        // nobody answers a broadcast
+        memset( &rResp, 0, sizeof( rResp ) );
+        m_uRTTUS = 0;
+        return MBClient::stOK;
+    }
+    // the response is due once the request is out, which the transport may still be sending
+    MBClient::eStatus stRV = Receive( pbRequest, rResp, uStartUS, ( nRequest + 2 ) * (uint32_t)m_pTransport->CharUS(), uTimeoutUS );
+    if( m_pTimeouts )
+        m_pTimeouts->Record( uDeviceID, stRV, m_uDelayUS, m_uLastUS );
+    return stRV;
+}
+
+MBClient::eStatus
+MBRTUClient::Receive( const uint8_t* pbRequest, MBResponse& rResp, uint32_t uStartUS, uint32_t uRequestUS, uint32_t uTimeoutUS )
+{
+    uint32_t uWaitUS;
+    while( ! m_pTransport->AvailableIn() )
+    {
+        uWaitUS = (uint32_t)micros() - uStartUS;
+        if( uWaitUS >= uRequestUS + uTimeoutUS && ! m_pTransport->AvailableIn() ) // may have been preempted since the check
+        {
+            m_nTimeouts ++;
+            m_uDelayUS = uWaitUS - uRequestUS;
+            Drain( micros() ); // a response starting just too late is dropped here, not taken by the next request
+            return MBClient::stTimeout;
+        }
+    }
+    uWaitUS = (uint32_t)micros() - uStartUS;
+    m_uDelayUS = uWaitUS > uRequestUS ? uWaitUS - uRequestUS : 0;
+
+    // device address, function code and the byte count or the first data byte tell the size
+    CRC16Stream crcRX;
+    if( ! m_pTransport->ReceiveBuffer( m_arrbFrame, 3 ) )
+    {
+        Drain( micros() );
+        m_nBadResponses ++;
+        return MBClient::stBadResponse;
+    }
+    crcRX.Update( m_arrbFrame, 3 );
+    size_t nFrame = MBClient::ResponseSize( m_arrbFrame );
+    if( nFrame + 2 > nPDU || ! m_pTransport->ReceiveBuffer( m_arrbFrame + 3, nFrame - 3 + 2 ) )
+    {
+        Drain( micros() );
+        m_nBadResponses ++;
+        return MBClient::stBadResponse;
+    }
+    crcRX.Update( m_arrbFrame + 3, nFrame - 3 + 2 );
+    m_uLastUS = micros();
+    m_uRTTUS = m_uLastUS - uStartUS;
+
+    if( crcRX.Final() != 0 )
+    {
+        Drain( micros() ); // a corrupted header may have sized the frame wrong
+        m_nBadResponses ++;
+        return MBClient::stBadResponse;
+    }
+    MBClient::eStatus stRV = MBClient::Decode( pbRequest, m_arrbFrame, nFrame, rResp );
+    if( stRV == MBClient::stBadResponse )
+        m_nBadResponses ++;
+    else
+        m_nFrame = nFrame;
+    return stRV;
+}
+
+void
+MBRTUClient::Drain( uint32_t uLastUS )
+{
+    uint32_t uGapUS = MBRTUAdapter::FrameGapUS( m_pTransport->CharUS() );
+    uint8_t bDrain;
+    for( ;; )
+    {
+        if( m_pTransport->AvailableIn() )
+        {
+            if( ! m_pTransport->ReceiveBuffer( &bDrain, 1 ) )
+                break;
+            m_nDropped ++;
+            uLastUS = micros();
+        }
+        else if( (uint32_t)micros() - uLastUS >= uGapUS )
+            break;
+    }
+    m_uLastUS = micros();
+}
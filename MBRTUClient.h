@@ -0,0 +1,100 @@
+#ifndef _MBRTUCLIENT_H_
+#define _MBRTUCLIENT_H_
+
+/*
+* MIT License
+* 
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "MBusTiny.h"
+#include "MBRTUAdapter.h"
+#include "MBClient.h"
+
+class MBSlaveTimeouts;
+
+/*! @brief class MBRTUClient - Modbus RTU master on an IRTUTransport
+*
+*   One transaction at a time, as the bus allows: the request goes out with its CRC as a segment
+*   of its own, so the caller's buffer may be constant; the response is framed from its first three
+*   bytes, checked as it arrives and decoded in place into the client's buffer, where MBResponse
+*   points until the next transaction:
+*
+*       MBRTUClient rtu( &serial );
+*       rtu.SetTimeout( 200000 );
+*       size_t nReq = MBClient::EncodeRead( arrbReq, 7, MBUSDevice::fcReadInputRegisters, 0, 4 );
+*       MBResponse resp;
+*       if( rtu.Transact( arrbReq, nReq, resp ) == MBClient::stOK )
+*           resp.Regs().Load( arruInputs );
+*/
+class MBRTUClient
+{
+protected:
+    IRTUTransport*   m_pTransport;        //!< transport instance pointer
+    uint8_t          m_arrbFrame[nPDU];   //!< the response frame, CRC included
+    size_t           m_nFrame;            //!< the size of the last response that answered its request, CRC excluded; 0 if none
+    uint32_t         m_uTimeoutUS;        //!< how long a response may take to start
+    uint32_t         m_uLastUS;           //!< micros() at the end of the last frame on the bus
+    uint32_t         m_uRTTUS;            //!< request start to response end of the last transaction
+    uint32_t         m_uDelayUS;          //!< request end to response start of the last transaction
+    MBSlaveTimeouts* m_pTimeouts;         //!< per slave timeouts and hold-offs, NULL for the fixed timeout
+    uint32_t         m_nTransactions;     //!< transactions attempted
+    uint32_t         m_nTimeouts;         //!< transactions without a response
+    uint32_t         m_nBadResponses;     //!< responses dropped for CRC, address, function code or size
+    uint32_t         m_nSkipped;          //!< requests not sent because their slave was held off
+    uint32_t         m_nDropped;          //!< bytes dropped outside a response: late ones and the rest of bad ones
+public:
+    MBRTUClient( IRTUTransport* pTransport ); //!< transport instance pointer constructor
+
+    void SetTimeout( uint32_t uTimeoutUS ) { m_uTimeoutUS = uTimeoutUS; } //!< the default response timeout
+    uint32_t Timeout() const { return m_uTimeoutUS; }                     //!< the default response timeout
+
+    /*! @brief SetTimeouts - takes the timeouts from measured response delays
+    *   @param pTimeouts - records every outcome, gives the timeout of each slave and holds off the failing ones; NULL for the fixed timeout
+    */
+    void SetTimeouts( MBSlaveTimeouts* pTimeouts ) { m_pTimeouts = pTimeouts; }
+    IRTUTransport* Transport() const { return m_pTransport; }             //!< the transport
+    uint32_t LastRTT() const { return m_uRTTUS; }                         //!< microseconds from the request start to the response end of the last transaction
+    uint32_t LastDelay() const { return m_uDelayUS; }                     //!< microseconds from the request end to the response start of the last transaction
+    uint32_t Transactions() const { return m_nTransactions; }             //!< transactions attempted
+    uint32_t Timeouts() const { return m_nTimeouts; }                     //!< transactions without a response
+    uint32_t BadResponses() const { return m_nBadResponses; }             //!< responses that did not answer their request
+    uint32_t Skipped() const { return m_nSkipped; }                       //!< requests not sent because their slave was held off
+    uint32_t Dropped() const { return m_nDropped; }                       //!< bytes dropped outside a response: late ones and the rest of bad ones
+    const uint8_t* Frame() const { return m_arrbFrame; }                  //!< the last response as received, device address first
+    size_t FrameSize() const { return m_nFrame; }                         //!< the size of Frame() without CRC if the last transaction was answered, 0 o.w.
+
+    /*! @brief Transact - sends a request and receives its response
+    *   @param pbRequest  - the request, device address first and without CRC
+    *   @param nRequest   - the size of the request
+    *   @param rResp      - the decoded response, valid until the next transaction
+    *   @param uTimeoutUS - how long the response may take to start once the request is out, 0 for the default
+    *   @returns          - the outcome; a broadcast to address 0 is stOK once sent, a held off slave stSkipped
+    */
+    MBClient::eStatus Transact( const uint8_t* pbRequest, size_t nRequest, MBResponse& rResp, uint32_t uTimeoutUS = 0 );
+
+protected:
+    MBClient::eStatus Receive( const uint8_t* pbRequest, MBResponse& rResp, uint32_t uStartUS, uint32_t uRequestUS, uint32_t uTimeoutUS ); //!< receives and decodes the response
+    void Drain( uint32_t uLastUS );     //!< drops the input until t3.5 of silence has passed since uLastUS or the last byte dropped
+};
+
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef _MBRINGTRANSPORT_H_
+#define _MBRINGTRANSPORT_H_
+
+/*
+* MIT License
+* 
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#include "MBusTiny.h"
+#include "MBRTUAdapter.h"
+#include <Arduino.h>
+#include <string.h>
+
+/*! @brief class MBRingTransport - IRTUTransport decorator receiving through a lock-free single producer, single consumer ring
+*
+*   The UART interrupt, or the DMA complete handler, is the only producer: it calls Push() or PushBuffer()
+*   and never waits; a full ring drops the bytes and counts them. MBRTUAdapter, or MBRTUAsyncAdapter, is the
+*   only consumer and drains the ring with AvailableIn()/ReceiveBuffer(). Each side writes its own index only,
+*   published with a release store, so no lock and no interrupt masking is needed. Transmission and the
+*   character time are the decorated transport's:
+*
+*       MAXTransport transMax( 9600, 9 );
+*       MBRingTransport< 256 > ring( &transMax );
+*       void onUartRX( uint8_t uByte ) { ring.Push( uByte ); }
+*       MBRTUAdapter rtu( &ring );
+*
+*   cbCapacity must be a power of two. The indices run free in TIndex, so cbCapacity must also be at most half
+*   its range; on 8-bit parts pick uint8_t and up to 128 bytes, where loads and stores of the index are atomic.
+*   The ring costs cbCapacity bytes plus the indices, no heap.
+*/
+template< size_t cbCapacity, typename TIndex = size_t >
+class MBRingTransport: public IRTUTransport
+{
+    static_assert( ( cbCapacity & ( cbCapacity - 1 ) ) == 0, "cbCapacity must be a power of two" );
+    static_assert( cbCapacity <= ( (TIndex)~(TIndex)0 ) / 2 + 1, "cbCapacity must be at most half the index range" );
+protected:
+    IRTUTransport* m_pTransport;            //!< the decorated transport
+    uint8_t        m_arrbRing[cbCapacity];  //!< received bytes
+    TIndex         m_nHead;                 //!< the write position, written by the producer only
+    TIndex         m_nTail;                 //!< the read position, written by the consumer only
+    volatile uint32_t m_nDropped;           //!< bytes dropped on a full ring, written by the producer only
+public:
+    MBRingTransport( IRTUTransport* pTransport )  //!< Constructor with the transport that transmits and tells the character time
+    {
+        m_pTransport = pTransport;
+        m_nHead = 0;
+        m_nTail = 0;
+        m_nDropped = 0;
+    }
+
+    /*! @brief Push - appends a received byte; for the producer only, never blocks
+    *   @returns  - true on success, false if the ring was full and the byte was dropped
+    */
+    bool Push( uint8_t uByte )
+    {
+        TIndex nHead = m_nHead;
+        if( (TIndex)( nHead - __atomic_load_n( &m_nTail, __ATOMIC_ACQUIRE ) ) == cbCapacity )
+        {
+            m_nDropped ++;
+            return false;
+        }
+        m_arrbRing[ nHead & ( cbCapacity - 1 ) ] = uByte;
+        __atomic_store_n( &m_nHead, (TIndex)( nHead + 1 ), __ATOMIC_RELEASE );
+        return true;
+    }
+
+    /*! @brief PushBuffer - appends a block of received bytes, e.g. from a DMA complete handler; for the producer only
+    *   @returns  - the number of bytes taken, the rest is dropped
+    */
+    size_t PushBuffer( const uint8_t* pbBuffer, size_t nBuffer )
+    {
+        TIndex nHead = m_nHead;
+        size_t nFree = cbCapacity - (TIndex)( nHead - __atomic_load_n( &m_nTail, __ATOMIC_ACQUIRE ) );
+        if( nBuffer > nFree )
+        {
+            m_nDropped += nBuffer - nFree;
+            nBuffer = nFree;
+        }
+        size_t nPos = nHead & ( cbCapacity - 1 );
+        size_t nFirst = cbCapacity - nPos;
+        if( nFirst > nBuffer )
+            nFirst = nBuffer;
+        memcpy( m_arrbRing + nPos, pbBuffer, nFirst );
+        memcpy( m_arrbRing, pbBuffer + nFirst, nBuffer - nFirst );
+        // one release store publishes the whole block
+        __atomic_store_n( &m_nHead, (TIndex)( nHead + nBuffer ), __ATOMIC_RELEASE );
+        return nBuffer;
+    }
+
+    /*! @brief Pump - moves what the decorated transport has into the ring; a polling producer for transports without an interrupt
+    *   @returns  - the number of bytes moved
+    */
+    size_t Pump()
+    {
+        size_t nMoved = 0;
+        uint8_t uByte;
+        while( Free() > 0 && m_pTransport->AvailableIn() && m_pTransport->ReceiveBuffer( &uByte, 1 ) )
+        {
+            Push( uByte );
+            nMoved ++;
+        }
+        return nMoved;
+    }
+
+    size_t Pending() const { return (TIndex)( __atomic_load_n( &m_nHead, __ATOMIC_ACQUIRE ) - m_nTail ); } //!< bytes to take; for the consumer
+    size_t Free() const { return cbCapacity - (TIndex)( m_nHead - __atomic_load_n( &m_nTail, __ATOMIC_ACQUIRE ) ); } //!< room left; for the producer
+    uint32_t Dropped() const { return m_nDropped; } //!< bytes dropped on a full ring, a statistic
+
+    virtual bool AvailableIn() //!< overrides base class method, never blocks
+    {
+        return Pending() != 0;
+    }
+
+    virtual size_t Available() //!< overrides base class method, never blocks
+    {
+        return Pending();
+    }
+
+    /*! @brief ReceiveBuffer - overrides base class method
+    *
+    *   Returns at once when the ring holds nBuffer bytes. Otherwise it waits for the producer no longer than the
+    *   missing bytes take on the line plus t3.5, so a broken frame cannot stall the consumer.
+    */
+    virtual bool ReceiveBuffer(
+                          uint8_t* pbBuffer,
+                          size_t nBuffer)
+    {
+        if( nBuffer > cbCapacity )
+            return false;
+        size_t nPending = Pending();
+        if( nPending < nBuffer )
+        {
+            uint32_t uCharUS = m_pTransport->CharUS();
+            uint32_t uWaitUS = ( nBuffer - nPending ) * uCharUS + ( (uint32_t)35 * uCharUS ) / 10;
+            uint32_t uStartUS = micros();
+            while( ( nPending = Pending() ) < nBuffer )
+                if( (uint32_t)micros() - uStartUS > uWaitUS )
+                    return false;
+        }
+        TIndex nTail = m_nTail;
+        size_t nPos = nTail & ( cbCapacity - 1 );
+        size_t nFirst = cbCapacity - nPos;
+        if( nFirst > nBuffer )
+            nFirst = nBuffer;
+        memcpy( pbBuffer, m_arrbRing + nPos, nFirst );
+        memcpy( pbBuffer + nFirst, m_arrbRing, nBuffer - nFirst );
+        // the producer may reuse the room only after the bytes are copied out
+        __atomic_store_n( &m_nTail, (TIndex)( nTail + nBuffer ), __ATOMIC_RELEASE );
+        return true;
+    }
+
+    virtual bool TransmitBuffer(
+                          const uint8_t* pbBuffer,
+                          size_t nBuffer) //!< overrides base class method, passed on to the decorated transport
+    {
+        return m_pTransport->TransmitBuffer( pbBuffer, nBuffer );
+    }
+
+    virtual bool TransmitSegments(
+                          const MBSegment* pSegments,
+                          size_t nSegments) //!< overrides base class method, passed on to the decorated transport
+    {
+        return m_pTransport->TransmitSegments( pSegments, nSegments );
+    }
+
+    virtual uint16_t CharUS() //!< overrides base class method, the decorated transport's
+    {
+        return m_pTransport->CharUS();
+    }
+};
+
+
+#endif
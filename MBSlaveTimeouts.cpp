@@ -0,0 +1,108 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "MBusTiny.h"
+#include "MBSlaveTimeouts.h"
+
+void
+MBRTTEstimator::Reset()
+{
+    m_uSRTT8 = 0;
+    m_uRTTVar4 = 0;
+    m_uRetryUS = 0;
+    m_nFailures = 0;
+    m_bSampled = false;
+}
+
+void
+MBRTTEstimator::Sample( uint32_t uDelayUS )
+{
+    m_nFailures = 0;
+    if( ! m_bSampled )
+    {
+        // the first sample: the delay itself, half of it as the deviation
+        m_uSRTT8 = uDelayUS << 3;
+        m_uRTTVar4 = uDelayUS << 1;
+        m_bSampled = true;
+        return;
+    }
+    // SRTT += ( delay - SRTT ) / 8, RTTVAR += ( |delay - SRTT| - RTTVAR ) / 4, in the scaled values
+    int32_t nErr = (int32_t)( uDelayUS - ( m_uSRTT8 >> 3 ) );
+    m_uSRTT8 += nErr;
+    if( nErr < 0 )
+        nErr = -nErr;
+    m_uRTTVar4 += nErr - (int32_t)( m_uRTTVar4 >> 2 );
+}
+
+void
+MBRTTEstimator::Failure( uint32_t uNowUS, uint32_t uBackoffUS, uint32_t uMaxBackoffUS )
+{
+    if( m_nFailures < 255 )
+        m_nFailures ++;
+    if( m_nFailures < 2 )
+        return; // one timeout may be noise on the line, the next poll goes out as usual
+    uint8_t nShift = m_nFailures - 2 < 16 ? m_nFailures - 2 : 16;
+    uint64_t uHoldUS = (uint64_t)uBackoffUS << nShift;
+    m_uRetryUS = uNowUS + (uint32_t)( uHoldUS < uMaxBackoffUS ? uHoldUS : uMaxBackoffUS );
+}
+
+uint32_t
+MBRTTEstimator::TimeoutUS( uint32_t uFloorUS, uint32_t uMaxUS, uint32_t uMarginUS ) const
+{
+    if( ! m_bSampled )
+        return uMaxUS;
+    // the deviation allowance never drops below the floor or the margin, or a steady slave would time out on any jitter
+    uint32_t uAllowUS = uFloorUS > uMarginUS ? uFloorUS : uMarginUS;
+    uint64_t uTimeoutUS = ( m_uSRTT8 >> 3 ) + ( m_uRTTVar4 > uAllowUS ? m_uRTTVar4 : uAllowUS );
+    uTimeoutUS <<= m_nFailures < 6 ? m_nFailures : 6;
+    if( uTimeoutUS < uFloorUS )
+        uTimeoutUS = uFloorUS;
+    return uTimeoutUS < uMaxUS ? (uint32_t)uTimeoutUS : uMaxUS;
+}
+
+MBSlaveTimeouts::MBSlaveTimeouts( uint32_t uMaxUS )
+{
+    m_uFloorUS = 0;
+    m_uMarginUS = nDefaultMarginUS;
+    m_uMaxUS = uMaxUS;
+    m_uBackoffUS = 1000000;
+    m_uMaxBackoffUS = 60000000;
+}
+
+void
+MBSlaveTimeouts::Record( uint8_t uDeviceID, MBClient::eStatus stRV, uint32_t uDelayUS, uint32_t uNowUS )
+{
+    switch( stRV )
+    {
+    case MBClient::stOK:
+    case MBClient::stException:
+        m_arrSlaves[ uDeviceID ].Sample( uDelayUS );
+        break;
+    case MBClient::stTimeout:
+        m_arrSlaves[ uDeviceID ].Failure( uNowUS, m_uBackoffUS, m_uMaxBackoffUS );
+        break;
+    default:
+        break; // a garbled response says little about the delay, a request not sent nothing
+    }
+}
@@ -0,0 +1,123 @@
+#ifndef _MBSLAVETIMEOUTS_H_
+#define _MBSLAVETIMEOUTS_H_
+
+/*
+* MIT License
+* 
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#include "MBusTiny.h"
+#include "MBClient.h"
+
+/*! @brief class MBRTTEstimator - the response delay of one slave, its deviation and its failures
+*
+*   The smoothed delay and its mean deviation follow the TCP retransmission timer (RFC 6298):
+*   gains of 1/8 and 1/4, kept scaled in integers. The timeout is the smoothed delay plus four
+*   deviations, but at least plus a margin, doubled for each consecutive timeout. After the second timeout in a row the slave is
+*   held off, for a time that doubles with every further one, so a dead slave costs one probe per
+*   hold-off instead of a full timeout on every poll.
+*/
+class MBRTTEstimator
+{
+protected:
+    uint32_t m_uSRTT8;      //!< the smoothed delay in microseconds, times 8
+    uint32_t m_uRTTVar4;    //!< its mean deviation in microseconds, times 4
+    uint32_t m_uRetryUS;    //!< micros() before which a failing slave is not asked
+    uint8_t  m_nFailures;   //!< consecutive timeouts
+    bool     m_bSampled;    //!< a delay has been measured
+public:
+    MBRTTEstimator() { Reset(); } //!< default constructor, no delay known
+    void Reset();                 //!< forgets the delays and the failures
+
+    void Sample( uint32_t uDelayUS );   //!< a response came after uDelayUS; clears the failures
+
+    /*! @brief Failure - a request timed out
+    *   @param uNowUS         - micros() now
+    *   @param uBackoffUS     - the hold-off after the second timeout in a row
+    *   @param uMaxBackoffUS  - the longest hold-off
+    */
+    void Failure( uint32_t uNowUS, uint32_t uBackoffUS, uint32_t uMaxBackoffUS );
+
+    /*! @brief TimeoutUS - how long to wait for the next response to start
+    *   @param uFloorUS  - the least timeout and the least deviation allowance, the t3.5 gap of the bus
+    *   @param uMaxUS    - the timeout before the first sample and the longest one
+    *   @param uMarginUS - the least allowance over the smoothed delay; a steady slave shows almost no
+    *                      deviation, so without it any late interrupt or scheduler hiccup is a timeout
+    */
+    uint32_t TimeoutUS( uint32_t uFloorUS, uint32_t uMaxUS, uint32_t uMarginUS = 0 ) const;
+    bool Ready( uint32_t uNowUS ) const { return m_nFailures < 2 || (int32_t)( uNowUS - m_uRetryUS ) >= 0; } //!< the slave may be asked now
+
+    uint32_t SmoothedUS() const { return m_uSRTT8 >> 3; }      //!< the smoothed delay
+    uint32_t DeviationUS() const { return m_uRTTVar4 >> 2; }   //!< its mean deviation
+    uint8_t Failures() const { return m_nFailures; }           //!< consecutive timeouts
+};
+
+/*! @brief class MBSlaveTimeouts - an MBRTTEstimator per slave address for a master or a gateway
+*
+*   An MBRTUClient given the table takes each timeout from it, records each outcome in it and
+*   answers stSkipped without touching the bus while a slave is held off:
+*
+*       MBSlaveTimeouts timeouts;
+*       timeouts.SetFloor( MBRTUAdapter::FrameGapUS( serial.CharUS() ) );
+*       rtu.SetTimeouts( &timeouts );
+*
+*   A timeout never comes sooner than the smoothed delay plus the margin, nDefaultMarginUS unless
+*   set; a master behind a USB serial adapter, whose latency runs to milliseconds, wants more.
+*
+*   The table takes about 4 KB; a master of a few slaves on a small part keeps an MBRTTEstimator
+*   for each of them instead.
+*/
+class MBSlaveTimeouts
+{
+protected:
+    MBRTTEstimator m_arrSlaves[256];    //!< by address
+    uint32_t       m_uFloorUS;          //!< the least timeout
+    uint32_t       m_uMarginUS;         //!< the least allowance over the smoothed delay
+    uint32_t       m_uMaxUS;            //!< the timeout before the first sample and the longest one
+    uint32_t       m_uBackoffUS;        //!< the first hold-off of a failing slave
+    uint32_t       m_uMaxBackoffUS;     //!< the longest hold-off
+public:
+    static const uint32_t nDefaultMarginUS = 5000; //!< a few milliseconds: a wait for a dead slave costs little more, the back-off bounds it
+
+    MBSlaveTimeouts( uint32_t uMaxUS = 1000000 ); //!< constructor with the timeout to start from
+
+    void SetFloor( uint32_t uFloorUS ) { m_uFloorUS = uFloorUS; } //!< the least timeout, MBRTUAdapter::FrameGapUS() of the bus
+    void SetMargin( uint32_t uMarginUS ) { m_uMarginUS = uMarginUS; } //!< the least allowance over the smoothed delay, e.g. a few ms or 20 CharUS
+    void SetMax( uint32_t uMaxUS ) { m_uMaxUS = uMaxUS; }         //!< the timeout before the first sample and the longest one
+    void SetBackoff( uint32_t uBackoffUS, uint32_t uMaxBackoffUS ) { m_uBackoffUS = uBackoffUS; m_uMaxBackoffUS = uMaxBackoffUS; } //!< the first and the longest hold-off
+
+    uint32_t TimeoutUS( uint8_t uDeviceID ) const { return m_arrSlaves[ uDeviceID ].TimeoutUS( m_uFloorUS, m_uMaxUS, m_uMarginUS ); } //!< the timeout for a slave
+    bool Ready( uint8_t uDeviceID, uint32_t uNowUS ) const { return m_arrSlaves[ uDeviceID ].Ready( uNowUS ); } //!< the slave may be asked now
+
+    /*! @brief Record - takes the outcome of a transaction
+    *   @param stRV     - a response of any kind is a delay sample, stTimeout a failure, the rest is ignored
+    *   @param uDelayUS - the response delay, MBRTUClient::LastDelay()
+    */
+    void Record( uint8_t uDeviceID, MBClient::eStatus stRV, uint32_t uDelayUS, uint32_t uNowUS );
+
+    const MBRTTEstimator& Slave( uint8_t uDeviceID ) const { return m_arrSlaves[ uDeviceID ]; } //!< the estimator of a slave
+    void Reset( uint8_t uDeviceID ) { m_arrSlaves[ uDeviceID ].Reset(); } //!< forgets a slave, e.g. after it was replaced
+};
+
+
+#endif
@@ -0,0 +1,449 @@
+#ifndef _MBUS_MAP_H_
+#define _MBUS_MAP_H_
+
+/*
+* MIT License
+* 
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#include "MBusTiny.h"
+
+/*
+* Compile-time register map: an alternative to the MB_BEGIN_* / MB_END_* macros.
+*
+* The address-to-handler tables are types listed in the derived class; the
+* lookup is a binary search unrolled at compile time and the handlers are
+* called statically, so the compiler can inline them. Adjacent entries with the
+* same callbacks are merged into one run at compile time, and a span request
+* walks the sorted runs, handing each overlapping one its whole part of the span.
+* Entries must be listed in ascending address order; overlapping or duplicate
+* addresses fail to compile.
+*
+*   class MyDev : public MBUSTinyMap< MyDev >
+*   {
+*   public:
+*       MyDev( IPDUAdapter* pAdapter, uint8_t uDevID ) : MBUSTinyMap< MyDev >( pAdapter, uDevID ) {}
+*       exCode readTemp( int nIndex, uint8_t* pbValue );
+*       uint16_t m_arruSetpoints[8];
+*
+*       typedef MBMap< Reg< 10, &MyDev::readTemp > > RegisterMap;
+*       typedef MBMap< RegArray< 100, 8, &MyDev::m_arruSetpoints > > HoldingRegMap;
+*   };
+*
+* Tables that are not listed are empty.
+*/
+
+/*! @brief MBMap - a sorted list of map entries */
+template< class... E >
+struct MBMap;
+
+//! @cond internal
+namespace mbmap
+{
+    // the k-th entry of a map
+    template< int k, class TMap >
+    struct At;
+    template< int k, class E0, class... E >
+    struct At< k, MBMap< E0, E... > > : At< k - 1, MBMap< E... > > {};
+    template< class E0, class... E >
+    struct At< 0, MBMap< E0, E... > > { typedef E0 type; };
+
+    // the entries are valid, in ascending order and do not overlap
+    template< class... E >
+    struct Sorted { static const bool value = true; };
+    template< class E0 >
+    struct Sorted< E0 > { static const bool value = (int)E0::nFirst <= (int)E0::nLast; };
+    template< class E0, class E1, class... E >
+    struct Sorted< E0, E1, E... >
+    {
+        static const bool value = (int)E0::nFirst <= (int)E0::nLast && (int)E0::nLast < (int)E1::nFirst && Sorted< E1, E... >::value;
+    };
+
+    // the first entry with nLast >= nIndex, searched in [nLo, nHi), then TAction< TMap, k >
+    template< class TMap, int nLo, int nHi, template< class, int > class TAction >
+    struct LowerBound
+    {
+        template< class... A >
+        static MBUSTiny::exCode Do( int nIndex, A&... a )
+        {
+            const int nMid = ( nLo + nHi ) / 2;
+            if( At< nMid, TMap >::type::nLast < nIndex )
+                return LowerBound< TMap, nMid + 1, nHi, TAction >::Do( nIndex, a... );
+            return LowerBound< TMap, nLo, nMid, TAction >::Do( nIndex, a... );
+        }
+    };
+    template< class TMap, int k, template< class, int > class TAction >
+    struct LowerBound< TMap, k, k, TAction >
+    {
+        template< class... A >
+        static MBUSTiny::exCode Do( int nIndex, A&... a )
+        {
+            return TAction< TMap, k >::Do( nIndex, a... );
+        }
+    };
+
+    template< class T0, class T1 >
+    struct IsSame { static const bool value = false; };
+    template< class T >
+    struct IsSame< T, T > { static const bool value = true; };
+
+    template< class E0, class TMap >
+    struct Prepend;
+    template< class E0, class... E >
+    struct Prepend< E0, MBMap< E... > > { typedef MBMap< E0, E... > type; };
+
+    // adjacent entries with the same callbacks are joined into one run, so a run of
+    // single-register mappings is found with one comparison and served in one loop
+    template< class TMap >
+    struct Merge { typedef TMap type; };
+    template< bool bJoin, class E0, class E1, class... E >
+    struct MergeStep;
+    template< class E0, class E1, class... E >
+    struct Merge< MBMap< E0, E1, E... > >
+    {
+        typedef typename MergeStep<
+            IsSame< typename E0::Key, typename E1::Key >::value && (int)E0::nLast + 1 == (int)E1::nFirst,
+            E0, E1, E... >::type type;
+    };
+    template< class E0, class E1, class... E >
+    struct MergeStep< true, E0, E1, E... >
+    {
+        typedef typename Merge< MBMap< typename E0::template Resize< (int)E0::nFirst, (int)E1::nLast >::type, E... > >::type type;
+    };
+    template< class E0, class E1, class... E >
+    struct MergeStep< false, E0, E1, E... >
+    {
+        typedef typename Prepend< E0, typename Merge< MBMap< E1, E... > >::type >::type type;
+    };
+
+    template< class TMap >
+    struct Size;
+    template< class... E >
+    struct Size< MBMap< E... > > { static const int value = sizeof...( E ); };
+
+    // walks a word span from the k-th entry on; unmapped addresses are left as they are (zero on read).
+    // Kept out of line: every search leaf enters the walk, inlining it would grow the code quadratically
+    template< class TMap, int k, bool bEnd = ( k >= Size< TMap >::value ) >
+    struct WalkWords
+    {
+        template< class TDerived >
+        __attribute__((noinline)) static MBUSTiny::exCode Do( int nIndex, TDerived& rDev, int& rnCount, uint8_t*& rpbValue, MBUSTiny::eDataDir& rdirData )
+        {
+            typedef typename At< k, TMap >::type E;
+            int nEnd = nIndex + rnCount;
+            if( nEnd <= E::nFirst )
+                return MBUSTiny::exOK;
+            int nFrom = nIndex > E::nFirst ? nIndex : E::nFirst;
+            int nTo = nEnd - 1 < E::nLast ? nEnd - 1 : E::nLast;
+            MBUSTiny::exCode exRV = E::Do( rDev, nFrom, nTo - nFrom + 1, rpbValue + 2 * ( nFrom - nIndex ), rdirData );
+            if( exRV != MBUSTiny::exOK || nTo == nEnd - 1 )
+                return exRV;
+            uint8_t* pbNext = rpbValue + 2 * ( nTo + 1 - nIndex );
+            int nNext = nEnd - nTo - 1;
+            return WalkWords< TMap, k + 1 >::Do( nTo + 1, rDev, nNext, pbNext, rdirData );
+        }
+    };
+    template< class TMap, int k >
+    struct WalkWords< TMap, k, true >
+    {
+        template< class TDerived >
+        static MBUSTiny::exCode Do( int, TDerived&, int&, uint8_t*&, MBUSTiny::eDataDir& )
+        {
+            return MBUSTiny::exOK;
+        }
+    };
+
+    // a single bit at the k-th entry, if it covers the address; unmapped bits read as 0
+    template< class TMap, int k, bool bEnd = ( k >= Size< TMap >::value ) >
+    struct FindBit
+    {
+        template< class TDerived >
+        static MBUSTiny::exCode Do( int nIndex, TDerived& rDev, int& rbValue, MBUSTiny::eDataDir& rdirData )
+        {
+            typedef typename At< k, TMap >::type E;
+            if( nIndex < E::nFirst )
+                return FindBit< TMap, k, true >::Do( nIndex, rDev, rbValue, rdirData );
+            return E::Do( rDev, nIndex, rbValue, rdirData );
+        }
+    };
+    template< class TMap, int k >
+    struct FindBit< TMap, k, true >
+    {
+        template< class TDerived >
+        static MBUSTiny::exCode Do( int, TDerived&, int& rbValue, MBUSTiny::eDataDir& rdirData )
+        {
+            if( rdirData == MBUSTiny::dataRead )
+                rbValue = 0;
+            return MBUSTiny::exOK;
+        }
+    };
+
+    template< class TMap, int k >
+    struct WalkWordsAction : WalkWords< TMap, k > {};
+    template< class TMap, int k >
+    struct FindBitAction : FindBit< TMap, k > {};
+}
+//! @endcond
+
+template< class... E >
+struct MBMap
+{
+    static_assert( mbmap::Sorted< E... >::value, "MBMap entries must be in ascending address order and must not overlap" );
+
+    typedef typename mbmap::Merge< MBMap >::type Runs; //!< the entries with the adjacent ones joined
+
+    template< class TDerived >
+    static MBUSTiny::exCode Words( TDerived& rDev, int nIndex, int nCount, uint8_t* pbValue, MBUSTiny::eDataDir dirData )
+    {
+        return mbmap::LowerBound< Runs, 0, mbmap::Size< Runs >::value, mbmap::WalkWordsAction >::Do( nIndex, rDev, nCount, pbValue, dirData );
+    }
+
+    template< class TDerived >
+    static MBUSTiny::exCode Bit( TDerived& rDev, int nIndex, int& rbValue, MBUSTiny::eDataDir dirData )
+    {
+        return mbmap::LowerBound< Runs, 0, mbmap::Size< Runs >::value, mbmap::FindBitAction >::Do( nIndex, rDev, rbValue, dirData );
+    }
+};
+
+/*! @brief class MBUSTinyMap - MBUSTiny with the register tables given as compile-time maps
+*   @param TDerived - the device class (CRTP); it lists its tables as InputMap, CoilMap, RegisterMap and HoldingRegMap
+*   @param TBase    - MBUSTiny, or MBUSDevice for a device hosted by MBMultiSlave
+*/
+template< class TDerived, class TBase = MBUSTiny >
+class MBUSTinyMap : public TBase
+{
+public:
+    MBUSTinyMap() {} //!< default constructor, for MBUSDevice based maps
+    MBUSTinyMap( IPDUAdapter* pAdapter, uint8_t uDevID ) : TBase( pAdapter, uDevID ) {} //!< adapter and device address constructor
+
+    // the base is a template parameter, so its names are brought in explicitly
+    typedef MBUSDevice::exCode exCode;
+    typedef MBUSDevice::eDataDir eDataDir;
+
+    typedef MBMap<> InputMap;       //!< empty unless the derived class lists it
+    typedef MBMap<> CoilMap;        //!< empty unless the derived class lists it
+    typedef MBMap<> RegisterMap;    //!< empty unless the derived class lists it
+    typedef MBMap<> HoldingRegMap;  //!< empty unless the derived class lists it
+
+    // map entries; get/set callbacks have the same signatures as with the macros
+    typedef exCode (TDerived::*BitFn)( int, int& );
+    typedef exCode (TDerived::*WordFn)( int, uint8_t* );
+    typedef exCode (TDerived::*SpanFn)( int, int, uint8_t* );
+
+    /*! @brief InputRun - discrete inputs from nFirstAddr to nLastAddr served by one callback */
+    template< int nFirstAddr, int nLastAddr, BitFn pfnGet >
+    struct InputRun
+    {
+        enum { nFirst = nFirstAddr, nLast = nLastAddr };
+        typedef InputRun< 0, 0, pfnGet > Key;
+        template< int nF, int nL > struct Resize { typedef InputRun< nF, nL, pfnGet > type; };
+        static exCode Do( TDerived& rDev, int nIndex, int& rbValue, eDataDir )
+        {
+            rbValue = 0;
+            return ( rDev.*pfnGet )( nIndex, rbValue );
+        }
+    };
+    /*! @brief Input - a discrete input served by a callback */
+    template< int nAddr, BitFn pfnGet >
+    struct Input : InputRun< nAddr, nAddr, pfnGet > {};
+
+    /*! @brief CoilRun - coils from nFirstAddr to nLastAddr served by getter and setter callbacks */
+    template< int nFirstAddr, int nLastAddr, BitFn pfnGet, BitFn pfnSet >
+    struct CoilRun
+    {
+        enum { nFirst = nFirstAddr, nLast = nLastAddr };
+        typedef CoilRun< 0, 0, pfnGet, pfnSet > Key;
+        template< int nF, int nL > struct Resize { typedef CoilRun< nF, nL, pfnGet, pfnSet > type; };
+        static exCode Do( TDerived& rDev, int nIndex, int& rbValue, eDataDir dirData )
+        {
+            if( dirData == MBUSDevice::dataRead )
+            {
+                rbValue = -1;
+                return ( rDev.*pfnGet )( nIndex, rbValue );
+            }
+            return ( rDev.*pfnSet )( nIndex, rbValue );
+        }
+    };
+    /*! @brief Coil - a coil served by getter and setter callbacks */
+    template< int nAddr, BitFn pfnGet, BitFn pfnSet >
+    struct Coil : CoilRun< nAddr, nAddr, pfnGet, pfnSet > {};
+
+    /*! @brief Bit - a coil or an input bound to a bit of a byte member */
+    template< int nAddr, uint8_t TDerived::*pbByte, int nBit >
+    struct Bit
+    {
+        enum { nFirst = nAddr, nLast = nAddr };
+        typedef Bit Key;
+        static exCode Do( TDerived& rDev, int, int& rbValue, eDataDir dirData )
+        {
+            if( dirData == MBUSDevice::dataRead )
+                rbValue = ( rDev.*pbByte >> nBit ) & 1;
+            else if( rbValue )
+                rDev.*pbByte |= 1U << nBit;
+            else
+                rDev.*pbByte &= ~(1U << nBit);
+            return MBUSDevice::exOK;
+        }
+    };
+
+    /*! @brief RegRun - read-only registers from nFirstAddr to nLastAddr served by one single-register callback */
+    template< int nFirstAddr, int nLastAddr, WordFn pfnGet >
+    struct RegRun
+    {
+        enum { nFirst = nFirstAddr, nLast = nLastAddr };
+        typedef RegRun< 0, 0, pfnGet > Key;
+        template< int nF, int nL > struct Resize { typedef RegRun< nF, nL, pfnGet > type; };
+        static exCode Do( TDerived& rDev, int nIndex, int nCount, uint8_t* pbValue, eDataDir dirData )
+        {
+            if( dirData != MBUSDevice::dataRead )
+                return MBUSDevice::exOK;
+            for( int cReg = 0; cReg < nCount; cReg ++ )
+            {
+                exCode exRV = ( rDev.*pfnGet )( nIndex + cReg, pbValue + 2 * cReg );
+                if( exRV != MBUSDevice::exOK )
+                    return exRV;
+            }
+            return MBUSDevice::exOK;
+        }
+    };
+    /*! @brief Reg - a read-only register served by a callback */
+    template< int nAddr, WordFn pfnGet >
+    struct Reg : RegRun< nAddr, nAddr, pfnGet > {};
+
+    /*! @brief HoldingRegRun - holding registers from nFirstAddr to nLastAddr served by single-register getter and setter callbacks */
+    template< int nFirstAddr, int nLastAddr, WordFn pfnGet, WordFn pfnSet >
+    struct HoldingRegRun
+    {
+        enum { nFirst = nFirstAddr, nLast = nLastAddr };
+        typedef HoldingRegRun< 0, 0, pfnGet, pfnSet > Key;
+        template< int nF, int nL > struct Resize { typedef HoldingRegRun< nF, nL, pfnGet, pfnSet > type; };
+        static exCode Do( TDerived& rDev, int nIndex, int nCount, uint8_t* pbValue, eDataDir dirData )
+        {
+            for( int cReg = 0; cReg < nCount; cReg ++ )
+            {
+                exCode exRV = dirData == MBUSDevice::dataRead ? ( rDev.*pfnGet )( nIndex + cReg, pbValue + 2 * cReg )
+                                                  : ( rDev.*pfnSet )( nIndex + cReg, pbValue + 2 * cReg );
+                if( exRV != MBUSDevice::exOK )
+                    return exRV;
+            }
+            return MBUSDevice::exOK;
+        }
+    };
+    /*! @brief HoldingReg - a holding register served by getter and setter callbacks */
+    template< int nAddr, WordFn pfnGet, WordFn pfnSet >
+    struct HoldingReg : HoldingRegRun< nAddr, nAddr, pfnGet, pfnSet > {};
+
+    /*! @brief RegRange - a span of registers served by one range callback */
+    template< int nFirstAddr, int nLastAddr, SpanFn pfnGet >
+    struct RegRange
+    {
+        enum { nFirst = nFirstAddr, nLast = nLastAddr };
+        typedef RegRange Key;
+        static exCode Do( TDerived& rDev, int nIndex, int nCount, uint8_t* pbValue, eDataDir dirData )
+        {
+            if( dirData == MBUSDevice::dataRead )
+                return ( rDev.*pfnGet )( nIndex, nCount, pbValue );
+            return MBUSDevice::exOK;
+        }
+    };
+
+    /*! @brief HoldingRegRange - a span of holding registers served by range getter and setter callbacks */
+    template< int nFirstAddr, int nLastAddr, SpanFn pfnGet, SpanFn pfnSet >
+    struct HoldingRegRange
+    {
+        enum { nFirst = nFirstAddr, nLast = nLastAddr };
+        typedef HoldingRegRange Key;
+        static exCode Do( TDerived& rDev, int nIndex, int nCount, uint8_t* pbValue, eDataDir dirData )
+        {
+            if( dirData == MBUSDevice::dataRead )
+                return ( rDev.*pfnGet )( nIndex, nCount, pbValue );
+            return ( rDev.*pfnSet )( nIndex, nCount, pbValue );
+        }
+    };
+
+    /*! @brief RegVar - a register bound to a uint16_t member */
+    template< int nAddr, uint16_t TDerived::*puVar >
+    struct RegVar
+    {
+        enum { nFirst = nAddr, nLast = nAddr };
+        typedef RegVar Key;
+        static exCode Do( TDerived& rDev, int, int, uint8_t* pbValue, eDataDir dirData )
+        {
+            if( dirData == MBUSDevice::dataRead )
+                MBUSDevice::StoreRegs( pbValue, &( rDev.*puVar ), 1 );
+            else
+                MBUSDevice::LoadRegs( &( rDev.*puVar ), pbValue, 1 );
+            return MBUSDevice::exOK;
+        }
+    };
+
+    /*! @brief RegArray - a span of registers bound to a uint16_t array member of nRegs elements */
+    template< int nFirstAddr, int nRegs, uint16_t (TDerived::*parruVar)[nRegs] >
+    struct RegArray
+    {
+        enum { nFirst = nFirstAddr, nLast = nFirstAddr + nRegs - 1 };
+        typedef RegArray Key;
+        static exCode Do( TDerived& rDev, int nIndex, int nCount, uint8_t* pbValue, eDataDir dirData )
+        {
+            uint16_t* puVar = ( rDev.*parruVar ) + ( nIndex - nFirstAddr );
+            if( dirData == MBUSDevice::dataRead )
+                MBUSDevice::StoreRegs( pbValue, puVar, nCount );
+            else
+                MBUSDevice::LoadRegs( puVar, pbValue, nCount );
+            return MBUSDevice::exOK;
+        }
+    };
+
+protected:
+    virtual exCode DIInputs( int nIndex, int& rbValue )
+    {
+        return TDerived::InputMap::Bit( Derived(), nIndex, rbValue, MBUSDevice::dataRead );
+    }
+    virtual exCode DIOCoils( int nIndex, int& rbValue, eDataDir dirData )
+    {
+        return TDerived::CoilMap::Bit( Derived(), nIndex, rbValue, dirData );
+    }
+    virtual exCode DIRegisters( int nIndex, uint8_t* pbValue )
+    {
+        return TDerived::RegisterMap::Words( Derived(), nIndex, 1, pbValue, MBUSDevice::dataRead );
+    }
+    virtual exCode DIOHoldingRegs( int nIndex, uint8_t* pbValue, eDataDir dirData )
+    {
+        return TDerived::HoldingRegMap::Words( Derived(), nIndex, 1, pbValue, dirData );
+    }
+    virtual exCode DIRegistersRange( int nIndex, int nCount, uint8_t* pbValue, int& rnDone )
+    {
+        rnDone = nCount;
+        return TDerived::RegisterMap::Words( Derived(), nIndex, nCount, pbValue, MBUSDevice::dataRead );
+    }
+    virtual exCode DIOHoldingRegsRange( int nIndex, int nCount, uint8_t* pbValue, eDataDir dirData, int& rnDone )
+    {
+        rnDone = nCount;
+        return TDerived::HoldingRegMap::Words( Derived(), nIndex, nCount, pbValue, dirData );
+    }
+private:
+    TDerived& Derived() { return *static_cast< TDerived* >( this ); }
+};
+
+
+#endif
@@ -23,18 +23,36 @@
 */
 
 #include "MBusTiny.h"
+#include "MBFrameCache.h"
 #include <string.h>
 #include <Arduino.h>
 
-MBUSTiny::MBUSTiny()
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+MBUSDevice::MBUSDevice()
 {
 
 }
 
+MBUSDevice::~MBUSDevice()
+{
+
+}
+
+MBUSTiny::MBUSTiny()
+{
+    m_pFrames = NULL;
+}
+
 MBUSTiny::MBUSTiny(IPDUAdapter* pAdapter , uint8_t uDevID)
 {
     m_pAdapter = pAdapter;
     m_uDeviceID = uDevID;
+    m_pFrames = NULL;
 }
 
 MBUSTiny::~MBUSTiny()
@@ -43,45 +61,226 @@ MBUSTiny::~MBUSTiny()
 }
 
 
-MBUSTiny::exCode
-MBUSTiny::DIInputs( int nIndex, int& rbValue )
+MBUSDevice::exCode
+MBUSDevice::DIInputs( int nIndex, int& rbValue )
 {
     rbValue = 0;
     return exOK;
 }
 
-MBUSTiny::exCode
-MBUSTiny::DIOCoils( int nIndex, int& rbValue, eDataDir dirData )
+MBUSDevice::exCode
+MBUSDevice::DIOCoils( int nIndex, int& rbValue, eDataDir dirData )
 {
     rbValue = 0;
     return exOK;
 }
 
-MBUSTiny::exCode
-MBUSTiny::DIRegisters( int nIndex, uint8_t* pbValue)
+MBUSDevice::exCode
+MBUSDevice::DIRegisters( int nIndex, uint8_t* pbValue)
+{
+    return exOK;
+}
+
+MBUSDevice::exCode
+MBUSDevice::DIOHoldingRegs( int nIndex, uint8_t* pbValue, eDataDir dirData )
+{
+    return exOK;
+}
+
+MBUSDevice::exCode
+MBUSDevice::DIRegistersRange( int nIndex, int nCount, uint8_t* pbValue, int& rnDone )
+{
+    for( rnDone = 0; rnDone < nCount; rnDone ++, pbValue += sizeof( uint16_t ) )
+    {
+        exCode exRV = DIRegisters( nIndex + rnDone, pbValue );
+        if( exRV != exOK )
+            return exRV;
+    }
+    return exOK;
+}
+
+MBUSDevice::exCode
+MBUSDevice::DIOHoldingRegsRange( int nIndex, int nCount, uint8_t* pbValue, eDataDir dirData, int& rnDone )
+{
+    for( rnDone = 0; rnDone < nCount; rnDone ++, pbValue += sizeof( uint16_t ) )
+    {
+        exCode exRV = DIOHoldingRegs( nIndex + rnDone, pbValue, dirData );
+        if( exRV != exOK )
+            return exRV;
+    }
+    return exOK;
+}
+
+MBUSDevice::exCode
+MBUSDevice::DIInputsMask( int nIndex, int nCount, uint32_t& ruBits, int& rnDone )
 {
+    ruBits = 0;
+    for( rnDone = 0; rnDone < nCount; rnDone ++ )
+    {
+        int bVal = 0;
+        exCode exRV = DIInputs( nIndex + rnDone, bVal );
+        if( exRV != exOK )
+            return exRV;
+        ruBits |= (uint32_t)( bVal != 0 ) << rnDone;
+    }
     return exOK;
 }
 
-MBUSTiny::exCode
-MBUSTiny::DIOHoldingRegs( int nIndex, uint8_t* pbValue, eDataDir dirData )
+MBUSDevice::exCode
+MBUSDevice::DIOCoilsMask( int nIndex, int nCount, uint32_t& ruBits, eDataDir dirData, int& rnDone )
 {
+    if( dirData == dataRead )
+        ruBits = 0;
+    for( rnDone = 0; rnDone < nCount; rnDone ++ )
+    {
+        int bVal = ( ruBits >> rnDone ) & 1;
+        exCode exRV = DIOCoils( nIndex + rnDone, bVal, dirData );
+        if( exRV != exOK )
+            return exRV;
+        if( dirData == dataRead )
+            ruBits |= (uint32_t)( bVal != 0 ) << rnDone;
+    }
     return exOK;
 }
 
+void
+MBUSDevice::StoreRegs( uint8_t* pbOut, const uint16_t* puIn, size_t nRegs )
+{
+    size_t cReg = 0;
+#if defined(__SSE2__)
+    for( ; cReg + 8 <= nRegs; cReg += 8 )
+    {
+        __m128i xmmRegs = _mm_loadu_si128( (const __m128i*)( puIn + cReg ) );
+        xmmRegs = _mm_or_si128( _mm_slli_epi16( xmmRegs, 8 ), _mm_srli_epi16( xmmRegs, 8 ) );
+        _mm_storeu_si128( (__m128i*)( pbOut + 2 * cReg ), xmmRegs );
+    }
+#elif defined(__ARM_NEON)
+    for( ; cReg + 8 <= nRegs; cReg += 8 )
+        vst1q_u8( pbOut + 2 * cReg, vrev16q_u8( vreinterpretq_u8_u16( vld1q_u16( puIn + cReg ) ) ) );
+#endif
+    for( ; cReg < nRegs; cReg ++ )
+    {
+        pbOut[ 2 * cReg ] = puIn[ cReg ] >> 8;
+        pbOut[ 2 * cReg + 1 ] = puIn[ cReg ] & 0xFF;
+    }
+}
+
+void
+MBUSDevice::LoadRegs( uint16_t* puOut, const uint8_t* pbIn, size_t nRegs )
+{
+    size_t cReg = 0;
+#if defined(__SSE2__)
+    for( ; cReg + 8 <= nRegs; cReg += 8 )
+    {
+        __m128i xmmRegs = _mm_loadu_si128( (const __m128i*)( pbIn + 2 * cReg ) );
+        xmmRegs = _mm_or_si128( _mm_slli_epi16( xmmRegs, 8 ), _mm_srli_epi16( xmmRegs, 8 ) );
+        _mm_storeu_si128( (__m128i*)( puOut + cReg ), xmmRegs );
+    }
+#elif defined(__ARM_NEON)
+    for( ; cReg + 8 <= nRegs; cReg += 8 )
+        vst1q_u16( puOut + cReg, vreinterpretq_u16_u8( vrev16q_u8( vld1q_u8( pbIn + 2 * cReg ) ) ) );
+#endif
+    for( ; cReg < nRegs; cReg ++ )
+        puOut[ cReg ] = ( pbIn[ 2 * cReg ] << 8 ) | pbIn[ 2 * cReg + 1 ];
+}
+
+uint32_t
+MBUSDevice::PackBytes( const uint8_t* pbIn, int nCount )
+{
+    uint32_t uBits = 0;
+    int cElem = 0;
+#if defined(__SSE2__)
+    const __m128i xmmZero = _mm_setzero_si128();
+    for( ; cElem + 16 <= nCount; cElem += 16 )
+    {
+        __m128i xmmStates = _mm_loadu_si128( (const __m128i*)( pbIn + cElem ) );
+        uint32_t uZero = _mm_movemask_epi8( _mm_cmpeq_epi8( xmmStates, xmmZero ) );
+        uBits |= ( ~uZero & 0xFFFF ) << cElem;
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    static const uint8_t arrbWeights[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    const uint8x16_t vWeights = vld1q_u8( arrbWeights );
+    for( ; cElem + 16 <= nCount; cElem += 16 )
+    {
+        uint8x16_t vStates = vld1q_u8( pbIn + cElem );
+        vStates = vandq_u8( vtstq_u8( vStates, vStates ), vWeights );
+        uint32_t uWord = vaddv_u8( vget_low_u8( vStates ) ) | ( vaddv_u8( vget_high_u8( vStates ) ) << 8 );
+        uBits |= uWord << cElem;
+    }
+#endif
+    for( ; cElem < nCount; cElem ++ )
+        uBits |= (uint32_t)( pbIn[ cElem ] != 0 ) << cElem;
+    return uBits;
+}
+
+void
+MBUSDevice::UnpackBytes( uint8_t* pbOut, uint32_t uBits, int nCount )
+{
+    int cElem = 0;
+#if defined(__SSE2__)
+    const __m128i xmmWeights = _mm_set_epi8( -128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1 );
+    const __m128i xmmOne = _mm_set1_epi8( 1 );
+    for( ; cElem + 16 <= nCount; cElem += 16, uBits >>= 16 )
+    {
+        // spread the low byte over the low 8 lanes and the high byte over the high 8
+        __m128i xmmBits = _mm_cvtsi32_si128( uBits & 0xFFFF );
+        xmmBits = _mm_unpacklo_epi8( xmmBits, xmmBits );
+        xmmBits = _mm_unpacklo_epi16( xmmBits, xmmBits );
+        xmmBits = _mm_unpacklo_epi32( xmmBits, xmmBits );
+        xmmBits = _mm_cmpeq_epi8( _mm_and_si128( xmmBits, xmmWeights ), xmmWeights );
+        _mm_storeu_si128( (__m128i*)( pbOut + cElem ), _mm_and_si128( xmmBits, xmmOne ) );
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    static const uint8_t arrbWeights[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    const uint8x16_t vWeights = vld1q_u8( arrbWeights );
+    for( ; cElem + 16 <= nCount; cElem += 16, uBits >>= 16 )
+    {
+        uint8x16_t vBits = vcombine_u8( vdup_n_u8( uBits & 0xFF ), vdup_n_u8( ( uBits >> 8 ) & 0xFF ) );
+        vst1q_u8( pbOut + cElem, vandq_u8( vtstq_u8( vBits, vWeights ), vdupq_n_u8( 1 ) ) );
+    }
+#endif
+    for( ; cElem < nCount; cElem ++, uBits >>= 1 )
+        pbOut[ cElem ] = uBits & 1;
+}
 
 bool
-MBUSTiny::HasTrailing( uint8_t uFC )
+MBUSDevice::HasTrailing( uint8_t uFC )
 {
     switch( static_cast<eFunctionCode>(uFC))
     {
      case   fcWriteMultipleCoils:
      case   fcWriteMultipleHoldingRegisters:
+     case   fcReadWriteMultipleRegisters:
         return true;
      }
     return false;
 }
 
+size_t
+MBUSDevice::HeaderSize( uint8_t uFC )
+{
+    // FC23 carries both the read and the write address and quantity
+    if( static_cast<eFunctionCode>(uFC) == fcReadWriteMultipleRegisters )
+        return 10;
+    return 6;
+}
+
+bool
+MBUSDevice::RequestSizeOK( const uint8_t* pbPDU, size_t nPDU )
+{
+    if( nPDU < 2 )
+        return false;
+    uint8_t uFC = pbPDU[1];
+    if( HasTrailing( uFC ) )
+    {
+        size_t nHeader = HeaderSize( uFC );
+        return nPDU > nHeader && nPDU == nHeader + 1 + pbPDU[ nHeader ];
+    }
+    if( uFC >= fcReadCoils && uFC <= fcWriteSingleHoldingRegister )
+        return nPDU == HeaderSize( uFC );
+    return true;
+}
+
 
 const size_t cbDevAddr = 0;
 const size_t cbFC = 1;
@@ -101,23 +300,8 @@ PMNtoH16( const uint8_t* pbBase )
     uRV += pbBase[  1 ];
     return uRV;
 }
-///////////////////////////////////////////////////////////////////////////////////////////
-/// \brief MBRPushBit
-/// \param pbMBR
-/// \param nIndex
-/// \param bSet
-///
-///
-static void
-MBRPushBit( uint8_t* pbMBR, size_t nIndex, bool bSet )
-{
-    size_t nBase = nIndex / 8;
-    if( bSet )
-        pbMBR[ nBase ] |= 1U << ( nIndex % 8 );
-    else
-        pbMBR[ nBase ] &= ~(1U << ( nIndex % 8 ));
-}
-
+// the widest bitmask a mask callback is asked for
+const int nMaskBits = 32;
 
 bool
 MBUSTiny::TranscievePDU()
@@ -132,34 +316,45 @@ MBUSTiny::TranscievePDU()
   bRV = m_pAdapter->ReceivePDU( m_uDeviceID, m_arrbPDU, nPDU, nRX );
   if( ! bRV )
       return bRV;
+  if( m_pFrames )
+      return m_pFrames->Serve( this, m_pAdapter, m_uDeviceID, m_arrbPDU, nRX );
+  return m_pAdapter->TransmitPDU( m_uDeviceID, m_arrbPDU, ServePDU( m_arrbPDU ) );
+}
+
+size_t
+MBUSDevice::ServePDU( uint8_t* pbPDU )
+{
    // now, decode PDU
   exCode exRV = exOK;
   size_t cbRPDU = 0;
-  switch( static_cast<eFunctionCode>(m_arrbPDU[ cbFC ]))
+  switch( static_cast<eFunctionCode>(pbPDU[ cbFC ]))
   {
    case   fcReadCoils:
-      exRV = DoReadCoils( m_arrbPDU + cbRqArrdess, cbRPDU );
+      exRV = DoReadCoils( pbPDU + cbRqArrdess, cbRPDU );
       break;
    case   fcReadDiscreteInputs:
-      exRV = DoReadDiscreteInputs( m_arrbPDU + cbRqArrdess, cbRPDU );
+      exRV = DoReadDiscreteInputs( pbPDU + cbRqArrdess, cbRPDU );
       break;
    case   fcReadMultipleHoldingRegisters:
-      exRV = DoReadMultipleHoldingRegisters( m_arrbPDU + cbRqArrdess, cbRPDU );
+      exRV = DoReadMultipleHoldingRegisters( pbPDU + cbRqArrdess, cbRPDU );
       break;
    case   fcReadInputRegisters:
-      exRV = DoReadInputRegisters( m_arrbPDU + cbRqArrdess, cbRPDU );
+      exRV = DoReadInputRegisters( pbPDU + cbRqArrdess, cbRPDU );
       break;
    case   fcWriteSingleCoil:
-      exRV = DoWriteSingleCoil( m_arrbPDU + cbRqArrdess, cbRPDU );
+      exRV = DoWriteSingleCoil( pbPDU + cbRqArrdess, cbRPDU );
       break;
    case   fcWriteSingleHoldingRegister:
-      exRV = DoWriteSingleHoldingRegister( m_arrbPDU + cbRqArrdess, cbRPDU );
+      exRV = DoWriteSingleHoldingRegister( pbPDU + cbRqArrdess, cbRPDU );
       break;
    case   fcWriteMultipleCoils:
-      exRV = DoWriteMultipleCoils( m_arrbPDU + cbRqArrdess, cbRPDU );
+      exRV = DoWriteMultipleCoils( pbPDU + cbRqArrdess, cbRPDU );
       break;
    case   fcWriteMultipleHoldingRegisters:
-      exRV = DoWriteMultipleHoldingRegisters( m_arrbPDU + cbRqArrdess, cbRPDU );
+      exRV = DoWriteMultipleHoldingRegisters( pbPDU + cbRqArrdess, cbRPDU );
+      break;
+   case   fcReadWriteMultipleRegisters:
+      exRV = DoReadWriteMultipleRegisters( pbPDU + cbRqArrdess, cbRPDU );
       break;
    default:
        exRV = exIllegalFunction;
@@ -167,12 +362,12 @@ MBUSTiny::TranscievePDU()
 
 
   if( exRV == exOK )
-      return m_pAdapter->TransmitPDU( m_uDeviceID, m_arrbPDU, cbRPDU + 2 );
+      return cbRPDU + 2;
 
   // error case
-  m_arrbPDU[cbFC] |= 0x80;
-  m_arrbPDU[cbFC + 1 ] = static_cast<uint8_t>(exRV);
-  return m_pAdapter->TransmitPDU( m_uDeviceID, m_arrbPDU, 3 );
+  pbPDU[cbFC] |= 0x80;
+  pbPDU[cbFC + 1 ] = static_cast<uint8_t>(exRV);
+  return 3;
 
 }
 
@@ -182,87 +377,109 @@ BytesFromBitCount( size_t nBits )
     return nBits / 8 + !! ( nBits %  8 );
 }
 
-MBUSTiny::exCode
-MBUSTiny::DoReadCoils( uint8_t* pbRV, size_t& rcbOut )
+MBUSDevice::exCode
+MBUSDevice::DoReadCoils( uint8_t* pbRV, size_t& rcbOut )
 {
     uint16_t uBase   = PMNtoH16( pbRV );
     uint16_t uExtent = PMNtoH16( pbRV + 2 );
+    if( uExtent < 1 || uExtent > 0x7D0 )
+        return exIllegalDataValue;
 
     size_t nExtentBytes = BytesFromBitCount(uExtent );
-    memset( pbRV, 0, nExtentBytes + 1);
     pbRV[ 0 ] = nExtentBytes;
+    uint8_t* pbOut = pbRV + 1;
 
     exCode exRV = exOK;
 
+    // the masks are shifted into an accumulator and leave it in whole bytes
+    uint64_t uAcc = 0;
+    int nAcc = 0;
     int cElem;
-    for( cElem = 0; cElem < uExtent; cElem ++ )
+    int nDone = 0;
+    for( cElem = 0; cElem < uExtent; cElem += nDone )
     {
-        int bVal = 0;
-        exRV = DIOCoils( uBase + cElem, bVal, eDataDir::dataRead );
+        uint32_t uBits = 0;
+        int nCount = uExtent - cElem < nMaskBits ? uExtent - cElem : nMaskBits;
+        nDone = 1;
+        exRV = DIOCoilsMask( uBase + cElem, nCount, uBits, eDataDir::dataRead, nDone );
         if( exRV != exOK )
             return exRV;
-        MBRPushBit( pbRV + 1, cElem, bVal );
+        if( nDone < 1 || nDone > nCount )
+            return exSlaveDeviceFailure;
+        uAcc |= (uint64_t)( uBits & ( 0xFFFFFFFFUL >> ( nMaskBits - nDone ) ) ) << nAcc;
+        for( nAcc += nDone; nAcc >= 8; nAcc -= 8, uAcc >>= 8 )
+            *pbOut ++ = (uint8_t)uAcc;
     }
+    if( nAcc > 0 )
+        *pbOut = (uint8_t)uAcc;
     rcbOut  = nExtentBytes + 1;
     return exRV;
 }
 
 
 
-MBUSTiny::exCode
-MBUSTiny::DoReadDiscreteInputs(uint8_t *pbRV, size_t& rcbOut )
+MBUSDevice::exCode
+MBUSDevice::DoReadDiscreteInputs(uint8_t *pbRV, size_t& rcbOut )
 {
     uint16_t uBase   = PMNtoH16( pbRV );
     uint16_t uExtent = PMNtoH16( pbRV + 2 );
+    if( uExtent < 1 || uExtent > 0x7D0 )
+        return exIllegalDataValue;
 
     size_t nExtentBytes = BytesFromBitCount(uExtent );
-    memset( pbRV, 0, nExtentBytes + 1);
     pbRV[ 0 ] = nExtentBytes;
+    uint8_t* pbOut = pbRV + 1;
 
     exCode exRV = exOK;
 
+    uint64_t uAcc = 0;
+    int nAcc = 0;
     int cElem;
-    for( cElem = 0; cElem < uExtent; cElem ++ )
+    int nDone = 0;
+    for( cElem = 0; cElem < uExtent; cElem += nDone )
     {
-        int bVal = 0;
-        exRV = DIInputs( uBase + cElem, bVal );
+        uint32_t uBits = 0;
+        int nCount = uExtent - cElem < nMaskBits ? uExtent - cElem : nMaskBits;
+        nDone = 1;
+        exRV = DIInputsMask( uBase + cElem, nCount, uBits, nDone );
         if( exRV != exOK )
             return exRV;
-        MBRPushBit( pbRV + 1, cElem, bVal );
+        if( nDone < 1 || nDone > nCount )
+            return exSlaveDeviceFailure;
+        uAcc |= (uint64_t)( uBits & ( 0xFFFFFFFFUL >> ( nMaskBits - nDone ) ) ) << nAcc;
+        for( nAcc += nDone; nAcc >= 8; nAcc -= 8, uAcc >>= 8 )
+            *pbOut ++ = (uint8_t)uAcc;
     }
+    if( nAcc > 0 )
+        *pbOut = (uint8_t)uAcc;
     rcbOut  = nExtentBytes + 1;
     return exRV;
 }
 
-MBUSTiny::exCode
-MBUSTiny::DoReadMultipleHoldingRegisters(uint8_t *pbRV, size_t& rcbOut )
+MBUSDevice::exCode
+MBUSDevice::DoReadMultipleHoldingRegisters(uint8_t *pbRV, size_t& rcbOut )
 {
     uint16_t uBase   = PMNtoH16( pbRV );
     uint16_t uExtent = PMNtoH16( pbRV + 2 );
+    if( uExtent < 1 || uExtent > 0x7D )
+        return exIllegalDataValue;
 
     size_t nExtentBytes = uExtent * sizeof( uint16_t );
     memset( pbRV, 0, nExtentBytes + 1);
     pbRV[ 0 ] = nExtentBytes;
-    uint8_t* pbOut = pbRV + 1;
 
-    exCode exRV = exOK;
-
-    int cElem;
-    for( cElem = 0; cElem < uExtent; cElem ++, pbOut += sizeof( uint16_t))
-    {
-        exRV = DIOHoldingRegs( uBase + cElem, pbOut, eDataDir::dataRead );
-        if( exRV != exOK )
-            return exRV;
-    }
+    exCode exRV = DoHoldingRegsSpan( uBase, uExtent, pbRV + 1, eDataDir::dataRead );
     rcbOut  = nExtentBytes + 1;
     return exRV;
 }
 
-MBUSTiny::exCode
-MBUSTiny::DoReadInputRegisters(uint8_t *pbRV, size_t& rcbOut )
+MBUSDevice::exCode
+MBUSDevice::DoReadInputRegisters(uint8_t *pbRV, size_t& rcbOut )
 {
     uint16_t uBase   = PMNtoH16( pbRV );
     uint16_t uExtent = PMNtoH16( pbRV + 2 );
+    if( uExtent < 1 || uExtent > 0x7D )
+        return exIllegalDataValue;
 
     size_t nExtentBytes = uExtent * sizeof( uint16_t );
     memset( pbRV, 0, nExtentBytes + 1);
@@ -272,43 +489,135 @@ MBUSTiny::DoReadInputRegisters(uint8_t *pbRV, size_t& rcbOut )
     exCode exRV = exOK;
 
     int cElem;
-    for( cElem = 0; cElem < uExtent; cElem ++, pbOut += sizeof( uint16_t))
+    int nDone = 0;
+    for( cElem = 0; cElem < uExtent; cElem += nDone, pbOut += nDone * sizeof( uint16_t))
     {
-        exRV = DIRegisters( uBase + cElem, pbOut );
+        nDone = 1;
+        exRV = DIRegistersRange( uBase + cElem, uExtent - cElem, pbOut, nDone );
         if( exRV != exOK )
             return exRV;
+        if( nDone < 1 || nDone > uExtent - cElem )
+            return exSlaveDeviceFailure;
     }
     rcbOut  = nExtentBytes + 1;
     return exRV;
 }
 
-MBUSTiny::exCode
-MBUSTiny::DoWriteSingleCoil(uint8_t *pbRV, size_t& rcbOut )
+MBUSDevice::exCode
+MBUSDevice::DoWriteSingleCoil(uint8_t *pbRV, size_t& rcbOut )
 {
     uint16_t uAddress   = PMNtoH16( pbRV );
     uint16_t uValue     = PMNtoH16( pbRV + 2 );
     rcbOut = 2 * sizeof( uint16_t );
-    int bVal = uValue > 0 ;
-    return DIOCoils( uAddress, bVal, eDataDir::dataWrite );
+    // through the mask path, so coils mapped only as masks, words or byte arrays take the write too
+    uint32_t uBits = uValue > 0;
+    int nDone = 1;
+    exCode exRV = DIOCoilsMask( uAddress, 1, uBits, eDataDir::dataWrite, nDone );
+    if( exRV == exOK && nDone != 1 )
+        return exSlaveDeviceFailure;
+    return exRV;
 }
 
-MBUSTiny::exCode
-MBUSTiny::DoWriteSingleHoldingRegister(uint8_t *pbRV, size_t& rcbOut )
-
+MBUSDevice::exCode
+MBUSDevice::DoWriteSingleHoldingRegister(uint8_t *pbRV, size_t& rcbOut )
 {
-    return exIllegalFunction;
+    uint16_t uAddress   = PMNtoH16( pbRV );
+    rcbOut = 2 * sizeof( uint16_t );
+    // the value stays in the request and is echoed back unchanged
+    int nDone = 1;
+    exCode exRV = DIOHoldingRegsRange( uAddress, 1, pbRV + 2, eDataDir::dataWrite, nDone );
+    if( exRV == exOK && nDone < 1 )
+        return exSlaveDeviceFailure;
+    return exRV;
 }
 
-MBUSTiny::exCode
-MBUSTiny::DoWriteMultipleCoils(uint8_t *pbRV, size_t& rcbOut )
+MBUSDevice::exCode
+MBUSDevice::DoWriteMultipleCoils(uint8_t *pbRV, size_t& rcbOut )
+{
+    uint16_t uBase   = PMNtoH16( pbRV );
+    uint16_t uExtent = PMNtoH16( pbRV + 2 );
+    if( uExtent < 1 || uExtent > 0x7B0 || (size_t)pbRV[ 4 ] != BytesFromBitCount( uExtent ) )
+        return exIllegalDataValue;
+
+    const uint8_t* pbIn = pbRV + 5;
+    const int nInBytes = pbRV[ 4 ];
+    exCode exRV = exOK;
+
+    int cElem;
+    int nDone = 0;
+    for( cElem = 0; cElem < uExtent; cElem += nDone )
+    {
+        // the next up to 32 bits of the request, starting at bit cElem
+        uint64_t uAcc = 0;
+        int cByte = cElem / 8;
+        for( int nShift = 0; nShift < 40 && cByte < nInBytes; nShift += 8, cByte ++ )
+            uAcc |= (uint64_t)pbIn[ cByte ] << nShift;
+        uint32_t uBits = (uint32_t)( uAcc >> ( cElem % 8 ) );
+
+        int nCount = uExtent - cElem < nMaskBits ? uExtent - cElem : nMaskBits;
+        nDone = 1;
+        exRV = DIOCoilsMask( uBase + cElem, nCount, uBits, eDataDir::dataWrite, nDone );
+        if( exRV != exOK )
+            return exRV;
+        if( nDone < 1 || nDone > nCount )
+            return exSlaveDeviceFailure;
+    }
+    rcbOut = 2 * sizeof( uint16_t );
+    return exRV;
+}
 
+MBUSDevice::exCode
+MBUSDevice::DoWriteMultipleHoldingRegisters(uint8_t *pbRV, size_t& rcbOut )
 {
-    return exIllegalFunction;
+    uint16_t uBase   = PMNtoH16( pbRV );
+    uint16_t uExtent = PMNtoH16( pbRV + 2 );
+    if( uExtent < 1 || uExtent > 0x7B || (size_t)pbRV[ 4 ] != uExtent * sizeof( uint16_t ) )
+        return exIllegalDataValue;
+
+    // the setters get the register values where they are in the request
+    exCode exRV = DoHoldingRegsSpan( uBase, uExtent, pbRV + 5, eDataDir::dataWrite );
+    rcbOut = 2 * sizeof( uint16_t );
+    return exRV;
 }
 
-MBUSTiny::exCode
-MBUSTiny::DoWriteMultipleHoldingRegisters(uint8_t *pbRV, size_t& rcbOut )
+MBUSDevice::exCode
+MBUSDevice::DoReadWriteMultipleRegisters(uint8_t *pbRV, size_t& rcbOut )
+{
+    uint16_t uReadBase    = PMNtoH16( pbRV );
+    uint16_t uReadExtent  = PMNtoH16( pbRV + 2 );
+    uint16_t uWriteBase   = PMNtoH16( pbRV + 4 );
+    uint16_t uWriteExtent = PMNtoH16( pbRV + 6 );
+    if( uReadExtent < 1 || uReadExtent > 0x7D ||
+        uWriteExtent < 1 || uWriteExtent > 0x79 || (size_t)pbRV[ 8 ] != uWriteExtent * sizeof( uint16_t ) )
+        return exIllegalDataValue;
+
+    // the write is done first, from the request in place; the read then overwrites the request
+    // with the reply, so both happen within the one TranscievePDU() call
+    exCode exRV = DoHoldingRegsSpan( uWriteBase, uWriteExtent, pbRV + 9, eDataDir::dataWrite );
+    if( exRV != exOK )
+        return exRV;
+
+    size_t nExtentBytes = uReadExtent * sizeof( uint16_t );
+    memset( pbRV, 0, nExtentBytes + 1);
+    pbRV[ 0 ] = nExtentBytes;
+    exRV = DoHoldingRegsSpan( uReadBase, uReadExtent, pbRV + 1, eDataDir::dataRead );
+    rcbOut  = nExtentBytes + 1;
+    return exRV;
+}
 
+MBUSDevice::exCode
+MBUSDevice::DoHoldingRegsSpan( uint16_t uBase, uint16_t uExtent, uint8_t* pbValue, eDataDir dirData )
 {
-    return exIllegalFunction;
+    int cElem;
+    int nDone = 0;
+    for( cElem = 0; cElem < uExtent; cElem += nDone, pbValue += nDone * sizeof( uint16_t))
+    {
+        nDone = 1;
+        exCode exRV = DIOHoldingRegsRange( uBase + cElem, uExtent - cElem, pbValue, dirData, nDone );
+        if( exRV != exOK )
+            return exRV;
+        if( nDone < 1 || nDone > uExtent - cElem )
+            return exSlaveDeviceFailure;
+    }
+    return exOK;
 }
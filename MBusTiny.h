@@ -28,8 +28,17 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
 const size_t nPDU = 256;
+const size_t nMaxSegments = 8;  //!< the most segments a gather transmit has to take
+
+/*! @brief MBSegment - a piece of a frame for the gather transmits, sent as is without a copy */
+struct MBSegment
+{
+    const uint8_t* pbData;  //!< the bytes
+    size_t         nData;   //!< the number of bytes
+};
 
 /*!  @brief class IPDUAdapter - the base class for PDU transfer */ 
 class IPDUAdapter
@@ -59,10 +68,62 @@ public:
                           uint8_t uSDeviceID,
                           uint8_t* pbBuffer, // the actual implementation may add CRC here, so the pointer is not const and the buffer should be at least nBuffer + 2 bytes 
                           size_t nBuffer) = 0;
+
+    /*! @brief TransmitSegments - transmits a PDU gathered from constant segments, e.g. a header and a response image
+    *   @param pSegments  - the segments, in order
+    *   @param nSegments  - the number of segments, at most nMaxSegments
+    *   @returns          - true on success, false o.w.
+    *
+    *   The default copies the segments into a frame buffer on the stack and calls TransmitPDU(); the adapters
+    *   of this library override it to send the segments as they are, and their TransmitPDU() writes nothing
+    *   into the buffer.
+    */
+    virtual bool TransmitSegments(
+                          uint8_t uSDeviceID,
+                          const MBSegment* pSegments,
+                          size_t nSegments)
+    {
+        uint8_t arrbFrame[nPDU];
+        size_t nFrame = 0;
+        for( size_t cSeg = 0; cSeg < nSegments; cSeg ++ )
+        {
+            if( pSegments[cSeg].nData > nPDU - 2 - nFrame )
+                return false;
+            memcpy( arrbFrame + nFrame, pSegments[cSeg].pbData, pSegments[cSeg].nData );
+            nFrame += pSegments[cSeg].nData;
+        }
+        return TransmitPDU( uSDeviceID, arrbFrame, nFrame );
+    }
+
+    /*! @brief TransmitFrame - transmits a PDU whose CRC is computed already, e.g. a response kept for a repeated request
+    *   @param pbFrame    - the PDU followed by its CRC, low byte first
+    *   @param nFrame     - the size of the PDU and the CRC
+    *   @returns          - true on success, false o.w.
+    *
+    *   The default drops the CRC and calls TransmitSegments(), as adapters that add no CRC need; the RTU
+    *   adapter sends the frame as it is, without touching the CRC.
+    */
+    virtual bool TransmitFrame(
+                          uint8_t uSDeviceID,
+                          const uint8_t* pbFrame,
+                          size_t nFrame)
+    {
+        if( nFrame < 2 )
+            return false;
+        MBSegment segPDU = { pbFrame, nFrame - 2 };
+        return TransmitSegments( uSDeviceID, &segPDU, 1 );
+    }
 };
 
-/*! @brief class MBUSTiny - the base class for Modbus device implementation */
-class MBUSTiny
+const uint8_t uAnyDeviceID = 0xFF;  //!< passed to IPDUAdapter::ReceivePDU() to take the frames for every device address
+
+/*! @brief class MBUSDevice - a Modbus register map: the callbacks and the function code processing
+*
+*   The device owns no buffer and no adapter; ServePDU() serves a request in a buffer it is
+*   handed. MBUSTiny adds both for a device of its own on an adapter, MBMultiSlave hosts many
+*   devices on one adapter and one buffer.
+*/
+class MBUSDevice
 {
 public:
     /*! @brief exCode - exception codes enumeration */
@@ -108,19 +169,19 @@ public:
         fcWriteSingleCoil = 5,
         fcWriteSingleHoldingRegister	= 6,
         fcWriteMultipleCoils  = 15,
-        fcWriteMultipleHoldingRegisters	= 16
+        fcWriteMultipleHoldingRegisters	= 16,
+        fcReadWriteMultipleRegisters = 23
     };
 
-protected:
-    uint8_t         m_arrbPDU[nPDU]; //!< the PDU transfer buffer
-    IPDUAdapter*    m_pAdapter;      //!< the PDU adapter to use
-    uint8_t         m_uDeviceID;     //!< the Modbus device address associated with our device
 public:
-    MBUSTiny();                      //!< default constructor; shound not be used, bt we avoid using delete keyword here
-    MBUSTiny(IPDUAdapter*, uint8_t); //!< adapter and device address constructor
-    virtual ~MBUSTiny();
+    MBUSDevice();                    //!< default constructor
+    virtual ~MBUSDevice();
 
-    bool TranscievePDU();            //!< sends and receives PDUs and dispatches the callabck calls; shoud be called in loop()    
+    /*! @brief ServePDU - decodes a request, dispatches the callback calls and puts the response in its place
+    *   @param pbPDU  - nPDU bytes holding the request, device address and function code first
+    *   @returns      - the response size, device address included
+    */
+    size_t ServePDU( uint8_t* pbPDU );
 
 protected:
     // default get/set processing; the methods are overrided in derived classes
@@ -128,6 +189,16 @@ protected:
     virtual exCode DIOCoils( int nIndex, int& rbValue, eDataDir dirData );
     virtual exCode DIRegisters( int nIndex, uint8_t* pbValue);
     virtual exCode DIOHoldingRegs( int nIndex, uint8_t* pbValue, eDataDir dirData );
+
+    // span processing; the default implementation serves the whole span element by element
+    // via the methods above, the MB_BEGIN_*_RANGES macros override it for mapped ranges
+    virtual exCode DIRegistersRange( int nIndex, int nCount, uint8_t* pbValue, int& rnDone );
+    virtual exCode DIOHoldingRegsRange( int nIndex, int nCount, uint8_t* pbValue, eDataDir dirData, int& rnDone );
+
+    // bitmask processing; up to 32 inputs or coils travel as one word, bit 0 being nIndex.
+    // The default implementation goes element by element, the MB_BEGIN_*_MASKS macros override it
+    virtual exCode DIInputsMask( int nIndex, int nCount, uint32_t& ruBits, int& rnDone );
+    virtual exCode DIOCoilsMask( int nIndex, int nCount, uint32_t& ruBits, eDataDir dirData, int& rnDone );
 private:
     // Modbus functions implementation
     exCode DoReadCoils( uint8_t* pbRV, size_t& rcbOut );
@@ -138,8 +209,45 @@ private:
     exCode DoWriteSingleHoldingRegister( uint8_t* pbRV, size_t& rcbOut );
     exCode DoWriteMultipleCoils( uint8_t* pbRV, size_t& rcbOut );
     exCode DoWriteMultipleHoldingRegisters( uint8_t* pbRV, size_t& rcbOut );
+    exCode DoReadWriteMultipleRegisters( uint8_t* pbRV, size_t& rcbOut );
+    exCode DoHoldingRegsSpan( uint16_t uBase, uint16_t uExtent, uint8_t* pbValue, eDataDir dirData );
 public:
     static bool HasTrailing( uint8_t uFC ) ;
+    /*! @brief HeaderSize - the request size up to the trailing byte count, device address and function code included */
+    static size_t HeaderSize( uint8_t uFC );
+    /*! @brief RequestSizeOK - checks a request's size against its function code; sizes of unknown codes are not checked
+    *   @param pbPDU  - the request, device address and function code included
+    *   @param nPDU   - its size, without a CRC
+    */
+    static bool RequestSizeOK( const uint8_t* pbPDU, size_t nPDU );
+
+    /*! @brief StoreRegs - copies host order registers into a big-endian transfer buffer, vectorized on hosts */
+    static void StoreRegs( uint8_t* pbOut, const uint16_t* puIn, size_t nRegs );
+    /*! @brief LoadRegs - copies big-endian registers from a transfer buffer into host order */
+    static void LoadRegs( uint16_t* puOut, const uint8_t* pbIn, size_t nRegs );
+    /*! @brief PackBytes - packs up to 32 byte-sized states, nonzero being set, into a bitmask; vectorized on hosts */
+    static uint32_t PackBytes( const uint8_t* pbIn, int nCount );
+    /*! @brief UnpackBytes - stores up to 32 bits of a bitmask as 0/1 bytes */
+    static void UnpackBytes( uint8_t* pbOut, uint32_t uBits, int nCount );
+};
+
+class MBFrameCache;
+
+/*! @brief class MBUSTiny - the base class for Modbus device implementation: a register map with its own adapter and PDU buffer */
+class MBUSTiny : public MBUSDevice
+{
+protected:
+    uint8_t         m_arrbPDU[nPDU]; //!< the PDU transfer buffer
+    IPDUAdapter*    m_pAdapter;      //!< the PDU adapter to use
+    uint8_t         m_uDeviceID;     //!< the Modbus device address associated with our device
+    MBFrameCache*   m_pFrames;       //!< keeps the response frames of repeated reads, NULL for none
+public:
+    MBUSTiny();                      //!< default constructor; shound not be used, bt we avoid using delete keyword here
+    MBUSTiny(IPDUAdapter*, uint8_t); //!< adapter and device address constructor
+    virtual ~MBUSTiny();
+
+    bool TranscievePDU();            //!< sends and receives PDUs and dispatches the callabck calls; shoud be called in loop()    
+    void SetFrameCache( MBFrameCache* pFrames ) { m_pFrames = pFrames; } //!< serves the requests through a frame cache, NULL for none
 };
 
 // macros that do the magic
@@ -165,6 +273,11 @@ MBUSTiny::exCode name::DIInputs( int nIndex, int& rbValue ){\
     case index:\
         return this->fname( index, rbValue );
 
+#define MB_INPUT_BIT( index, byte, bit )\
+    case index:\
+        rbValue = ( this->byte >> (bit) ) & 1;\
+        return exOK;
+
 #define MB_BEGIN_COILS( name, basename )\
 MBUSTiny::exCode name::DIOCoils( int nIndex, int& rbValue, eDataDir dirData ){\
   if( dirData  == dataRead )\
@@ -190,6 +303,16 @@ MBUSTiny::exCode name::DIOCoils( int nIndex, int& rbValue, eDataDir dirData ){\
             return exOK;\
         return this->fnameSet( index, rbValue );
 
+#define MB_COIL_BIT( index, byte, bit )\
+    case index:\
+        if( dirData == dataRead )\
+            rbValue = ( this->byte >> (bit) ) & 1;\
+        else if( rbValue )\
+            this->byte |= 1U << (bit);\
+        else\
+            this->byte &= ~(1U << (bit));\
+        return exOK;
+
 #define MB_BEGIN_REGISTERS( name, basename )\
 MBUSTiny::exCode name::DIRegisters( int nIndex, uint8_t* pbValue ){\
   switch ( nIndex ){
@@ -205,6 +328,11 @@ MBUSTiny::exCode name::DIRegisters( int nIndex, uint8_t* pbValue ){\
     case index:\
         return this->fname( index, pbValue );
 
+#define MB_REGISTER_VAR( index, member )\
+    case index:\
+        StoreRegs( pbValue, &this->member, 1 );\
+        return exOK;
+
 #define MB_BEGIN_HOLDINGREGS( name, basename )\
 MBUSTiny::exCode name::DIOHoldingRegs( int nIndex, uint8_t* pbValue, eDataDir dirData ){\
   switch ( nIndex ){
@@ -228,5 +356,174 @@ MBUSTiny::exCode name::DIOHoldingRegs( int nIndex, uint8_t* pbValue, eDataDir di
             return exOK;\
         return this->fnameSet( index, pbValue );
 
+#define MB_HOLDINGREG_VAR( index, member )\
+    case index:\
+        if( dirData == dataRead )\
+            StoreRegs( pbValue, &this->member, 1 );\
+        else\
+            LoadRegs( &this->member, pbValue, 1 );\
+        return exOK;
+
+
+// range mapping: one callback serves a contiguous address span;
+// the callback receives the first address, the count and the big-endian buffer
+#define MB_DECLARE_RANGES( )\
+    virtual exCode DIRegistersRange( int nIndex, int nCount, uint8_t* pbValue, int& rnDone );\
+    virtual exCode DIOHoldingRegsRange( int nIndex, int nCount, uint8_t* pbValue, eDataDir dirData, int& rnDone );
+
+// the part of [nIndex, nIndex + nCount) inside [first, last]
+#define MB_RANGE_SPAN( first, last )\
+    ( nIndex + nCount > (last) + 1 ? (last) + 1 - nIndex : nCount )
+
+// stops the span before a range that starts inside it, so the element-wise default does not run into it
+#define MB_RANGE_CLIP( first )\
+    if( nIndex < (first) && nIndex + nCount > (first) )\
+        nCount = (first) - nIndex;
+
+#define MB_BEGIN_REGISTER_RANGES( name, basename )\
+MBUSTiny::exCode name::DIRegistersRange( int nIndex, int nCount, uint8_t* pbValue, int& rnDone ){
+
+#define MB_END_REGISTER_RANGES( name, basename )\
+  return basename::DIRegistersRange( nIndex, nCount, pbValue, rnDone );\
+}
+
+#define MB_REGISTER_RANGE( first, last, fname )\
+    if( nIndex >= (first) && nIndex <= (last) ){\
+        rnDone = MB_RANGE_SPAN( first, last );\
+        return this->fname( nIndex, rnDone, pbValue );\
+    }\
+    MB_RANGE_CLIP( first )
+
+// a uint16_t array member bound to the addresses from first on; a span is served by one bulk byte-swap copy
+#define MB_REGISTER_ARRAY( first, array )\
+    if( nIndex >= (first) && nIndex < (first) + (int)( sizeof( this->array ) / sizeof( this->array[0] ) ) ){\
+        rnDone = MB_RANGE_SPAN( first, (first) + (int)( sizeof( this->array ) / sizeof( this->array[0] ) ) - 1 );\
+        StoreRegs( pbValue, this->array + ( nIndex - (first) ), rnDone );\
+        return exOK;\
+    }\
+    MB_RANGE_CLIP( first )
+
+#define MB_BEGIN_HOLDINGREG_RANGES( name, basename )\
+MBUSTiny::exCode name::DIOHoldingRegsRange( int nIndex, int nCount, uint8_t* pbValue, eDataDir dirData, int& rnDone ){
+
+#define MB_END_HOLDINGREG_RANGES( name, basename )\
+  return basename::DIOHoldingRegsRange( nIndex, nCount, pbValue, dirData, rnDone );\
+}
+
+#define MB_HOLDINGREG_RANGE( first, last, fnameGet, fnameSet )\
+    if( nIndex >= (first) && nIndex <= (last) ){\
+        rnDone = MB_RANGE_SPAN( first, last );\
+        if( dirData == dataRead )\
+            return this->fnameGet( nIndex, rnDone, pbValue );\
+        return this->fnameSet( nIndex, rnDone, pbValue );\
+    }\
+    MB_RANGE_CLIP( first )
+
+#define MB_HOLDINGREG_ARRAY( first, array )\
+    if( nIndex >= (first) && nIndex < (first) + (int)( sizeof( this->array ) / sizeof( this->array[0] ) ) ){\
+        rnDone = MB_RANGE_SPAN( first, (first) + (int)( sizeof( this->array ) / sizeof( this->array[0] ) ) - 1 );\
+        if( dirData == dataRead )\
+            StoreRegs( pbValue, this->array + ( nIndex - (first) ), rnDone );\
+        else\
+            LoadRegs( this->array + ( nIndex - (first) ), pbValue, rnDone );\
+        return exOK;\
+    }\
+    MB_RANGE_CLIP( first )
+
+#define MB_HOLDINGREG_RANGE_WO( first, last, fnameSet )\
+    if( nIndex >= (first) && nIndex <= (last) ){\
+        rnDone = MB_RANGE_SPAN( first, last );\
+        if( dirData == dataRead )\
+            return exOK;\
+        return this->fnameSet( nIndex, rnDone, pbValue );\
+    }\
+    MB_RANGE_CLIP( first )
+
+
+// bitmask mapping: one callback serves up to 32 inputs or coils of a span as a word;
+// the callback receives the first address, the count and the bits, bit 0 being the first address
+#define MB_DECLARE_MASKS( )\
+    virtual exCode DIInputsMask( int nIndex, int nCount, uint32_t& ruBits, int& rnDone );\
+    virtual exCode DIOCoilsMask( int nIndex, int nCount, uint32_t& ruBits, eDataDir dirData, int& rnDone );
+
+// the number of bits in an integer member or in a byte array
+#define MB_MASK_BITS( member )  ( (int)( 8 * sizeof( this->member ) ) )
+#define MB_MASK_BYTES( array )  ( (int)( sizeof( this->array ) / sizeof( this->array[0] ) ) )
+// the lowest n bits set, n being 1..32
+#define MB_MASK_LOW( n )        ( 0xFFFFFFFFUL >> ( 32 - (n) ) )
+
+#define MB_BEGIN_INPUT_MASKS( name, basename )\
+MBUSTiny::exCode name::DIInputsMask( int nIndex, int nCount, uint32_t& ruBits, int& rnDone ){
+
+#define MB_END_INPUT_MASKS( name, basename )\
+  return basename::DIInputsMask( nIndex, nCount, ruBits, rnDone );\
+}
+
+#define MB_INPUT_MASK( first, last, fname )\
+    if( nIndex >= (first) && nIndex <= (last) ){\
+        rnDone = MB_RANGE_SPAN( first, last );\
+        return this->fname( nIndex, rnDone, ruBits );\
+    }\
+    MB_RANGE_CLIP( first )
+
+// an unsigned 8, 16 or 32 bit member bound to the addresses from first on, bit 0 being first
+#define MB_INPUT_WORD( first, member )\
+    if( nIndex >= (first) && nIndex < (first) + MB_MASK_BITS( member ) ){\
+        rnDone = MB_RANGE_SPAN( first, (first) + MB_MASK_BITS( member ) - 1 );\
+        ruBits = (uint32_t)this->member >> ( nIndex - (first) );\
+        return exOK;\
+    }\
+    MB_RANGE_CLIP( first )
+
+// a bool or uint8_t array member, one state per element, bound to the addresses from first on
+#define MB_INPUT_BYTES( first, array )\
+    if( nIndex >= (first) && nIndex < (first) + MB_MASK_BYTES( array ) ){\
+        rnDone = MB_RANGE_SPAN( first, (first) + MB_MASK_BYTES( array ) - 1 );\
+        ruBits = PackBytes( (const uint8_t*)( this->array + ( nIndex - (first) ) ), rnDone );\
+        return exOK;\
+    }\
+    MB_RANGE_CLIP( first )
+
+#define MB_BEGIN_COIL_MASKS( name, basename )\
+MBUSTiny::exCode name::DIOCoilsMask( int nIndex, int nCount, uint32_t& ruBits, eDataDir dirData, int& rnDone ){
+
+#define MB_END_COIL_MASKS( name, basename )\
+  return basename::DIOCoilsMask( nIndex, nCount, ruBits, dirData, rnDone );\
+}
+
+#define MB_COIL_MASK( first, last, fnameGet, fnameSet )\
+    if( nIndex >= (first) && nIndex <= (last) ){\
+        rnDone = MB_RANGE_SPAN( first, last );\
+        if( dirData == dataRead )\
+            return this->fnameGet( nIndex, rnDone, ruBits );\
+        return this->fnameSet( nIndex, rnDone, ruBits );\
+    }\
+    MB_RANGE_CLIP( first )
+
+#define MB_COIL_WORD( first, member )\
+    if( nIndex >= (first) && nIndex < (first) + MB_MASK_BITS( member ) ){\
+        rnDone = MB_RANGE_SPAN( first, (first) + MB_MASK_BITS( member ) - 1 );\
+        if( dirData == dataRead )\
+            ruBits = (uint32_t)this->member >> ( nIndex - (first) );\
+        else\
+        {\
+            uint32_t uMask = MB_MASK_LOW( rnDone ) << ( nIndex - (first) );\
+            this->member = ( this->member & ~uMask ) | ( ( ruBits << ( nIndex - (first) ) ) & uMask );\
+        }\
+        return exOK;\
+    }\
+    MB_RANGE_CLIP( first )
+
+#define MB_COIL_BYTES( first, array )\
+    if( nIndex >= (first) && nIndex < (first) + MB_MASK_BYTES( array ) ){\
+        rnDone = MB_RANGE_SPAN( first, (first) + MB_MASK_BYTES( array ) - 1 );\
+        if( dirData == dataRead )\
+            ruBits = PackBytes( (const uint8_t*)( this->array + ( nIndex - (first) ) ), rnDone );\
+        else\
+            UnpackBytes( (uint8_t*)( this->array + ( nIndex - (first) ) ), ruBits, rnDone );\
+        return exOK;\
+    }\
+    MB_RANGE_CLIP( first )
+
 
 #endif
@@ -0,0 +1,107 @@
+#ifndef _BENCHBUS_H_
+#define _BENCHBUS_H_
+
+/*
+* A simulated RTU bus for the master side benchmarks: slaves whose values derive
+* from their address, and a transport that serves a request once sent and paces
+* the response bytes at the line speed after a t3.6 turnaround.
+*/
+
+#include <MBusTiny.h>
+#include <MBRTUAdapter.h>
+#include <CrcFsm.h>
+#include "BenchUtil.h"
+
+/*! @brief a slave whose every address reads a value derived from the slave and the address */
+class SimDevice : public MBUSDevice
+{
+public:
+    uint8_t m_uDeviceID;
+
+    static uint16_t Expected( uint8_t uDeviceID, uint8_t uTable, uint16_t uAddress )
+    {
+        switch( uTable )
+        {
+        case fcReadCoils:           return ( ( uAddress >> 1 ) + uDeviceID ) & 1;
+        case fcReadDiscreteInputs:  return ( uAddress + uDeviceID ) & 1;
+        case fcReadInputRegisters:  return (uint16_t)( uAddress * 3 + uDeviceID );
+        default:                    return (uint16_t)( uDeviceID * 1000 + uAddress );
+        }
+    }
+protected:
+    virtual exCode DIInputs( int nIndex, int& rbValue ) { rbValue = Expected( m_uDeviceID, fcReadDiscreteInputs, nIndex ); return exOK; }
+    virtual exCode DIOCoils( int nIndex, int& rbValue, eDataDir /* dirData */ ) { rbValue = Expected( m_uDeviceID, fcReadCoils, nIndex ); return exOK; }
+    virtual exCode DIRegisters( int nIndex, uint8_t* pbValue )
+    {
+        BenchPut16( pbValue, Expected( m_uDeviceID, fcReadInputRegisters, nIndex ) );
+        return exOK;
+    }
+    virtual exCode DIOHoldingRegs( int nIndex, uint8_t* pbValue, eDataDir dirData )
+    {
+        // a write is taken and echoed, the register keeps reading its derived value
+        if( dirData == dataRead )
+            BenchPut16( pbValue, Expected( m_uDeviceID, fcReadMultipleHoldingRegisters, nIndex ) );
+        return exOK;
+    }
+};
+
+/*! @brief an RTU bus with the slaves on it: a request is served when it has been sent, and the response
+*   bytes become readable one character time apart after the turnaround */
+class SimBusTransport : public IRTUTransport
+{
+protected:
+    MBUSDevice* m_arrpDevices[256];
+    uint16_t    m_uCharUS;
+    uint8_t     m_arrbRX[nPDU + 2];
+    size_t      m_nRX;
+    size_t      m_nRXPos;
+    uint64_t    m_uFirstUS;     // when the first response byte is complete
+public:
+    SimBusTransport( uint16_t uCharUS ) : m_uCharUS( uCharUS ), m_nRX( 0 ), m_nRXPos( 0 ), m_uFirstUS( 0 )
+    {
+        memset( m_arrpDevices, 0, sizeof( m_arrpDevices ) );
+    }
+    void Attach( uint8_t uDeviceID, MBUSDevice* pDevice ) { m_arrpDevices[ uDeviceID ] = pDevice; }
+
+    virtual bool AvailableIn()
+    {
+        return m_nRXPos < m_nRX && BenchNowNS() / 1000 >= m_uFirstUS + m_nRXPos * m_uCharUS;
+    }
+    virtual bool ReceiveBuffer( uint8_t* pbBuffer, size_t nBuffer )
+    {
+        if( nBuffer > m_nRX - m_nRXPos )
+            return false;
+        while( BenchNowNS() / 1000 < m_uFirstUS + ( m_nRXPos + nBuffer - 1 ) * m_uCharUS )
+            ;
+        memcpy( pbBuffer, m_arrbRX + m_nRXPos, nBuffer );
+        m_nRXPos += nBuffer;
+        return true;
+    }
+    virtual bool TransmitBuffer( const uint8_t* pbBuffer, size_t nBuffer )
+    {
+        MBSegment seg = { pbBuffer, nBuffer };
+        return TransmitSegments( &seg, 1 );
+    }
+    virtual bool TransmitSegments( const MBSegment* pSegments, size_t nSegments )
+    {
+        uint8_t arrbFrame[nPDU + 2];
+        size_t nFrame = 0;
+        for( size_t cSeg = 0; cSeg < nSegments; cSeg ++ )
+        {
+            memcpy( arrbFrame + nFrame, pSegments[cSeg].pbData, pSegments[cSeg].nData );
+            nFrame += pSegments[cSeg].nData;
+        }
+        m_nRX = 0;
+        m_nRXPos = 0;
+        MBUSDevice* pDevice = m_arrpDevices[ arrbFrame[0] ];
+        if( nFrame < 4 || CRC16Fsm( arrbFrame, nFrame ) != 0 || ! pDevice )
+            return true; // nobody answers
+        m_nRX = BenchAppendCRC( arrbFrame, pDevice->ServePDU( arrbFrame ) );
+        memcpy( m_arrbRX, arrbFrame, m_nRX );
+        m_uFirstUS = BenchNowNS() / 1000 + ( nFrame + 1 ) * m_uCharUS + 36 * m_uCharUS / 10;
+        return true;
+    }
+    virtual uint16_t CharUS() { return m_uCharUS; }
+};
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef _BENCHMETER_H_
+#define _BENCHMETER_H_
+
+/*
+* The simulated meter the multi-device benchmarks host by the hundred: holding
+* registers 0..9 hold device * 100 + index, register 100 the device address.
+*/
+
+#include <MBusTiny.h>
+#include <MBusMap.h>
+
+/*! @brief a simulated meter: ten holding registers and an identity register */
+template< class TBase >
+class BenchMeter : public MBUSTinyMap< BenchMeter< TBase >, TBase >
+{
+public:
+    typedef MBUSTinyMap< BenchMeter< TBase >, TBase > Map;
+    uint16_t m_arruRegs[10];
+    uint16_t m_uIdentity;
+
+    BenchMeter() { Init( 0 ); }
+    BenchMeter( IPDUAdapter* pAdapter, uint8_t uDevID ) : Map( pAdapter, uDevID ) { Init( uDevID ); }
+    void Init( uint8_t uDevID )
+    {
+        for( int cReg = 0; cReg < 10; cReg ++ )
+            m_arruRegs[ cReg ] = uDevID * 100 + cReg;
+        m_uIdentity = uDevID;
+    }
+
+    typedef MBMap< typename Map::template RegArray< 0, 10, &BenchMeter::m_arruRegs >,
+                   typename Map::template RegVar< 100, &BenchMeter::m_uIdentity > > HoldingRegMap;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#include "BenchSlave.h"
+
+BenchSlave::BenchSlave( IPDUAdapter* pAdapter , uint8_t uDevID )
+    : MBUSTiny( pAdapter , uDevID )
+{
+    for( int i = 0; i < 16; i ++ )
+    {
+        m_arruRegs[i] = 0x1000 + i;
+        m_arrnCoils[i] = i & 1;
+    }
+    for( int i = 0; i < 128; i ++ )
+    {
+        m_arruBlock[i] = 0x2000 + i;
+        m_arruImage[i] = 0x3000 + i;
+    }
+    m_uStatus = 0x5A5A;
+    m_bFlags = 0;
+    m_uInputWord = 0xDEADBEEFUL;
+    for( int i = 0; i < 2000; i ++ )
+        m_arrbStates[i] = i % 3 == 0;
+}
+
+MB_BEGIN_INPUTS( BenchSlave, MBUSTiny )
+  MB_INPUT( 0, readInput )
+  MB_INPUT( 1, readInput )
+  MB_INPUT( 2, readInput )
+  MB_INPUT( 3, readInput )
+  MB_INPUT( 4, readInput )
+  MB_INPUT( 5, readInput )
+  MB_INPUT( 6, readInput )
+  MB_INPUT( 7, readInput )
+MB_END_INPUTS( BenchSlave, MBUSTiny )
+
+MB_BEGIN_COILS( BenchSlave, MBUSTiny )
+  MB_COIL( 0, getCoil, setCoil )
+  MB_COIL( 1, getCoil, setCoil )
+  MB_COIL( 2, getCoil, setCoil )
+  MB_COIL( 3, getCoil, setCoil )
+  MB_COIL( 4, getCoil, setCoil )
+  MB_COIL( 5, getCoil, setCoil )
+  MB_COIL( 6, getCoil, setCoil )
+  MB_COIL( 7, getCoil, setCoil )
+  MB_COIL_BIT( 100, m_bFlags, 0 )
+  MB_COIL_BIT( 101, m_bFlags, 1 )
+MB_END_COILS( BenchSlave, MBUSTiny )
+
+MB_BEGIN_REGISTERS( BenchSlave, MBUSTiny )
+  MB_REGISTER( 0, readReg )
+  MB_REGISTER( 1, readReg )
+  MB_REGISTER( 2, readReg )
+  MB_REGISTER( 3, readReg )
+  MB_REGISTER( 4, readReg )
+  MB_REGISTER( 5, readReg )
+  MB_REGISTER( 6, readReg )
+  MB_REGISTER( 7, readReg )
+  MB_REGISTER_VAR( 100, m_uStatus )
+MB_END_REGISTERS( BenchSlave, MBUSTiny )
+
+MB_BEGIN_HOLDINGREGS( BenchSlave, MBUSTiny )
+  MB_HOLDINGREG( 0, readReg, writeReg )
+  MB_HOLDINGREG( 1, readReg, writeReg )
+  MB_HOLDINGREG( 2, readReg, writeReg )
+  MB_HOLDINGREG( 3, readReg, writeReg )
+  MB_HOLDINGREG( 4, readReg, writeReg )
+  MB_HOLDINGREG( 5, readReg, writeReg )
+  MB_HOLDINGREG( 6, readReg, writeReg )
+  MB_HOLDINGREG( 7, readReg, writeReg )
+  MB_HOLDINGREG_VAR( 100, m_uStatus )
+MB_END_HOLDINGREGS( BenchSlave, MBUSTiny )
+
+MB_BEGIN_REGISTER_RANGES( BenchSlave, MBUSTiny )
+  MB_REGISTER_RANGE( 1000, 1127, readBlock )
+  MB_REGISTER_ARRAY( 3000, m_arruImage )
+MB_END_REGISTER_RANGES( BenchSlave, MBUSTiny )
+
+MB_BEGIN_HOLDINGREG_RANGES( BenchSlave, MBUSTiny )
+  MB_HOLDINGREG_RANGE( 1000, 1127, readBlock, writeBlock )
+  MB_HOLDINGREG_ARRAY( 3000, m_arruImage )
+MB_END_HOLDINGREG_RANGES( BenchSlave, MBUSTiny )
+
+MB_BEGIN_INPUT_MASKS( BenchSlave, MBUSTiny )
+  MB_INPUT_WORD( 200, m_uInputWord )
+  MB_INPUT_MASK( 4000, 5999, readInputMask )
+MB_END_INPUT_MASKS( BenchSlave, MBUSTiny )
+
+MB_BEGIN_COIL_MASKS( BenchSlave, MBUSTiny )
+  MB_COIL_BYTES( 5000, m_arrbStates )
+MB_END_COIL_MASKS( BenchSlave, MBUSTiny )
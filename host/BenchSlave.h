@@ -0,0 +1,58 @@
+#ifndef _BENCHSLAVE_H_
+#define _BENCHSLAVE_H_
+#include <MBusTiny.h>
+
+/*! @brief class BenchSlave - a macro-mapped device used by the host benchmarks */
+class BenchSlave : public MBUSTiny
+{
+  public:
+    uint16_t m_arruRegs[16];
+    int      m_arrnCoils[16];
+    uint16_t m_arruBlock[128];  //!< an ADC-like sample block served by range callbacks
+    uint16_t m_arruImage[128];  //!< a register image bound directly to addresses
+    uint16_t m_uStatus;         //!< a single directly bound register
+    uint8_t  m_bFlags;          //!< directly bound coils
+    uint32_t m_uInputWord;      //!< inputs bound to the bits of a word
+    uint8_t  m_arrbStates[2000];//!< coils bound to a byte array, one state per byte
+
+    BenchSlave( IPDUAdapter* pAdapter , uint8_t uDevID );
+
+    MB_DECLARE( )
+    MB_DECLARE_RANGES( )
+    MB_DECLARE_MASKS( )
+
+    // callbacks
+    MBUSTiny::exCode readInput( int nIndex, int& rbValue ){ rbValue = nIndex & 1; return exOK; }
+    MBUSTiny::exCode getCoil( int nIndex, int& rbValue ){ rbValue = m_arrnCoils[nIndex % 16]; return exOK; }
+    MBUSTiny::exCode setCoil( int nIndex, int& rbValue ){ m_arrnCoils[nIndex % 16] = rbValue; return exOK; }
+    MBUSTiny::exCode readInputMask( int nBase, int /* nCount */, uint32_t& ruBits ){ ruBits = 0x55555555UL << ( nBase & 1 ); return exOK; }
+    MBUSTiny::exCode readReg( int nIndex, uint8_t* pbValue )
+    {
+        pbValue[0] = m_arruRegs[nIndex % 16] >> 8;
+        pbValue[1] = m_arruRegs[nIndex % 16] & 0xFF;
+        return exOK;
+    }
+    MBUSTiny::exCode writeReg( int nIndex, uint8_t* pbValue )
+    {
+        m_arruRegs[nIndex % 16] = ( pbValue[0] << 8 ) | pbValue[1];
+        return exOK;
+    }
+    MBUSTiny::exCode readBlock( int nBase, int nCount, uint8_t* pbValue )
+    {
+        const uint16_t* puSrc = m_arruBlock + ( nBase % 1000 );
+        for( int i = 0; i < nCount; i ++ )
+        {
+            pbValue[ 2 * i ] = puSrc[i] >> 8;
+            pbValue[ 2 * i + 1 ] = puSrc[i] & 0xFF;
+        }
+        return exOK;
+    }
+    MBUSTiny::exCode writeBlock( int nBase, int nCount, uint8_t* pbValue )
+    {
+        uint16_t* puDst = m_arruBlock + ( nBase % 1000 );
+        for( int i = 0; i < nCount; i ++ )
+            puDst[i] = ( pbValue[ 2 * i ] << 8 ) | pbValue[ 2 * i + 1 ];
+        return exOK;
+    }
+};
+#endif
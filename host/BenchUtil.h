@@ -0,0 +1,157 @@
+#ifndef _BENCHUTIL_H_
+#define _BENCHUTIL_H_
+
+/*
+* MIT License
+* 
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+/*
+* Helpers shared by the host benchmarks and tests: request framing, a monotonic
+* clock, a global allocation counter and the tests' failure count. Include from
+* exactly one translation unit per binary, since it replaces the global
+* operator new/delete.
+*/
+
+#include <CrcFsm.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <new>
+
+static size_t g_nBenchAllocs = 0;
+
+// both forms allocate with malloc themselves, so each pairs with the free of its own delete
+static inline void*
+BenchAlloc( size_t n )
+{
+    g_nBenchAllocs ++;
+    void* pv = malloc( n ? n : 1 );
+    if( ! pv )
+        throw std::bad_alloc();
+    return pv;
+}
+
+void* operator new( size_t n ) { return BenchAlloc( n ); }
+void* operator new[]( size_t n ) { return BenchAlloc( n ); }
+void operator delete( void* pv ) noexcept { free( pv ); }
+void operator delete[]( void* pv ) noexcept { free( pv ); }
+void operator delete( void* pv, size_t ) noexcept { free( pv ); }
+void operator delete[]( void* pv, size_t ) noexcept { free( pv ); }
+
+static size_t g_nFailures = 0;
+
+/// \brief Expect - counts and reports a failed check of a test
+static inline void
+Expect( bool bOK, const char* pszWhat )
+{
+    if( bOK )
+        return;
+    printf( "FAILED: %s\n", pszWhat );
+    g_nFailures ++;
+}
+
+/// \brief Expect - counts and reports a failed check at a register or coil address
+static inline void
+Expect( bool bOK, const char* pszWhat, uint16_t uAddress )
+{
+    if( bOK )
+        return;
+    printf( "FAILED: %s at %u\n", pszWhat, uAddress );
+    g_nFailures ++;
+}
+
+static inline uint64_t
+BenchNowNS()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void
+BenchPut16( uint8_t* pb, uint16_t u )
+{
+    pb[0] = u >> 8;
+    pb[1] = u & 0xFF;
+}
+
+/// \brief BenchAppendCRC - appends the RTU CRC to a frame of nFrame bytes
+/// \return the frame size including the CRC
+static inline size_t
+BenchAppendCRC( uint8_t* pbFrame, size_t nFrame )
+{
+    uint16_t uCRC = CRC16Fsm( pbFrame, nFrame );
+    pbFrame[ nFrame ] = uCRC % 256;
+    pbFrame[ nFrame + 1 ] = uCRC / 256;
+    return nFrame + 2;
+}
+
+/// \brief BenchRequest - builds an RTU request frame for the function code
+/// \return the frame size including the CRC
+static inline size_t
+BenchRequest( uint8_t* pbFrame, uint8_t uDevID, uint8_t uFC, uint16_t uAddress, uint16_t uCount )
+{
+    pbFrame[0] = uDevID;
+    pbFrame[1] = uFC;
+    BenchPut16( pbFrame + 2, uAddress );
+    size_t nFrame = 6;
+    switch( uFC )
+    {
+    case 5:
+        BenchPut16( pbFrame + 4, uCount ? 0xFF00 : 0 );
+        break;
+    case 6:
+        BenchPut16( pbFrame + 4, uCount );
+        break;
+    case 15:
+        BenchPut16( pbFrame + 4, uCount );
+        pbFrame[6] = ( uCount + 7 ) / 8;
+        memset( pbFrame + 7, 0xA5, pbFrame[6] );
+        nFrame = 7 + pbFrame[6];
+        break;
+    case 16:
+        BenchPut16( pbFrame + 4, uCount );
+        pbFrame[6] = uCount * 2;
+        for( size_t i = 0; i < uCount; i ++ )
+            BenchPut16( pbFrame + 7 + 2 * i, 0x1000 + i );
+        nFrame = 7 + pbFrame[6];
+        break;
+    case 23:
+        // writes and reads back the same span
+        BenchPut16( pbFrame + 4, uCount );
+        BenchPut16( pbFrame + 6, uAddress );
+        BenchPut16( pbFrame + 8, uCount );
+        pbFrame[10] = uCount * 2;
+        for( size_t i = 0; i < uCount; i ++ )
+            BenchPut16( pbFrame + 11 + 2 * i, 0x4000 + i );
+        nFrame = 11 + pbFrame[10];
+        break;
+    default:
+        BenchPut16( pbFrame + 4, uCount );
+        break;
+    }
+    return BenchAppendCRC( pbFrame, nFrame );
+}
+
+#endif
@@ -0,0 +1,118 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#include "LoopbackTransport.h"
+#include <string.h>
+
+LoopbackTransport::LoopbackTransport( uint16_t uCharUS )
+{
+    m_nRX = 0;
+    m_nRXPos = 0;
+    m_nTX = 0;
+    m_nReply = 0;
+    m_uCharUS = uCharUS;
+}
+
+void
+LoopbackTransport::Load( const uint8_t* pbFrame, size_t nFrame )
+{
+    if( nFrame > sizeof( m_arrbRX ) )
+        nFrame = sizeof( m_arrbRX );
+    memcpy( m_arrbRX, pbFrame, nFrame );
+    m_nRX = nFrame;
+    Rewind();
+}
+
+void
+LoopbackTransport::Rewind()
+{
+    m_nRXPos = 0;
+    m_nTX = 0;
+}
+
+void
+LoopbackTransport::Reply( const uint8_t* pbFrame, size_t nFrame )
+{
+    if( nFrame > sizeof( m_arrbReply ) )
+        nFrame = sizeof( m_arrbReply );
+    memcpy( m_arrbReply, pbFrame, nFrame );
+    m_nReply = nFrame;
+}
+
+bool
+LoopbackTransport::AvailableIn()
+{
+    return m_nRXPos < m_nRX;
+}
+
+bool
+LoopbackTransport::ReceiveBuffer(
+                      uint8_t* pbBuffer,
+                      size_t nBuffer)
+{
+    if( nBuffer > m_nRX - m_nRXPos )
+        return false;
+    memcpy( pbBuffer, m_arrbRX + m_nRXPos, nBuffer );
+    m_nRXPos += nBuffer;
+    return true;
+}
+
+bool
+LoopbackTransport::TransmitBuffer(
+                      const uint8_t* pbBuffer,
+                      size_t nBuffer)
+{
+    if( nBuffer > sizeof( m_arrbTX ) - m_nTX )
+        return false;
+    memcpy( m_arrbTX + m_nTX, pbBuffer, nBuffer );
+    m_nTX += nBuffer;
+    return true;
+}
+
+bool
+LoopbackTransport::TransmitSegments(
+                      const MBSegment* pSegments,
+                      size_t nSegments)
+{
+    // with a reply set, each transmission is a request of its own and is answered only once it is out
+    if( m_nReply )
+        m_nTX = 0;
+    if( ! IRTUTransport::TransmitSegments( pSegments, nSegments ) )
+        return false;
+    if( m_nReply )
+    {
+        // the request just sent stays readable through TXFrame()
+        memcpy( m_arrbRX, m_arrbReply, m_nReply );
+        m_nRX = m_nReply;
+        m_nRXPos = 0;
+    }
+    return true;
+}
+
+uint16_t
+LoopbackTransport::CharUS()
+{
+    return m_uCharUS;
+}
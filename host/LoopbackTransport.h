@@ -0,0 +1,73 @@
+#ifndef _LOOPBACKTRANSPORT_H_
+#define _LOOPBACKTRANSPORT_H_
+
+/*
+* MIT License
+* 
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#include <MBusTiny.h>
+#include <MBRTUAdapter.h>
+
+/*! @brief class LoopbackTransport - in-memory IRTUTransport for host builds and benchmarks
+*
+*   The transport replays a preloaded request frame on the receive side and
+*   captures whatever is transmitted, so a complete MBUSTiny::TranscievePDU
+*   round trip can run without any hardware. For a master, Reply() sets a frame
+*   that is replayed only once a request has gone out, as a slave would answer.
+*/
+class LoopbackTransport: public IRTUTransport
+{
+protected:
+    uint8_t  m_arrbRX[nPDU + 2]; //!< the request frame to be replayed
+    size_t   m_nRX;              //!< the size of the request frame
+    size_t   m_nRXPos;           //!< the read position in the request frame
+    uint8_t  m_arrbTX[nPDU + 2]; //!< the last transmitted frame
+    size_t   m_nTX;              //!< the size of the last transmitted frame
+    uint8_t  m_arrbReply[nPDU + 2]; //!< the frame answering each transmitted one
+    size_t   m_nReply;           //!< the size of the answer, 0 for none
+    uint16_t m_uCharUS;          //!< the reported character time
+public:
+    LoopbackTransport( uint16_t uCharUS ); //!< Constructor with the character time to report
+    void Load( const uint8_t* pbFrame, size_t nFrame ); //!< sets the request frame and rewinds
+    void Rewind();                                      //!< replays the request frame again
+    void Reply( const uint8_t* pbFrame, size_t nFrame ); //!< loads the frame for receiving after each transmitted one; nFrame 0 stops
+    const uint8_t* TXFrame() const { return m_arrbTX; } //!< the last transmitted frame
+    size_t TXSize() const { return m_nTX; }             //!< the size of the last transmitted frame
+
+    virtual bool AvailableIn(); //!< overrides base class method
+    virtual size_t Available() { return m_nRX - m_nRXPos; } //!< overrides base class method
+    virtual bool ReceiveBuffer(
+                          uint8_t* pbBuffer,
+                          size_t nBuffer); //!< overrides base class method
+    virtual bool TransmitBuffer(
+                          const uint8_t* pbBuffer,
+                          size_t nBuffer) ; //!< overrides base class method
+    virtual bool TransmitSegments(
+                          const MBSegment* pSegments,
+                          size_t nSegments); //!< overrides base class method, loads the reply after the frame
+    virtual uint16_t CharUS(); //!< overrides base class method
+};
+
+
+#endif
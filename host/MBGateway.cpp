@@ -0,0 +1,256 @@
+/*
+* MIT License
+*
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "MBGateway.h"
+#include <string.h>
+
+const uint8_t uMaxSlaveID = 247;  // RTU device addresses above this are reserved
+
+MBGateway::MBGateway( MBTCPAdapter* pServer, MBRTUClient* pBus, size_t nMaxJobs )
+{
+    m_pServer = pServer;
+    m_pBus = pBus;
+    m_pCache = NULL;
+    m_pJobs = new Job[ nMaxJobs ];
+    m_nMaxJobs = nMaxJobs;
+    m_pFree = NULL;
+    for( size_t cJob = nMaxJobs; cJob > 0; cJob -- )
+    {
+        m_pJobs[ cJob - 1 ].pNext = m_pFree;
+        m_pFree = m_pJobs + cJob - 1;
+    }
+    m_ppQueue = new Job*[ nMaxJobs ];
+    m_nQueued = 0;
+    m_uSeq = 0;
+    m_bMerge = true;
+    m_nIdleMS = 1;
+    m_nRequests = 0;
+    m_nMerged = 0;
+    m_nBusy = 0;
+    m_nUnresponsive = 0;
+    m_nDropped = 0;
+}
+
+MBGateway::~MBGateway()
+{
+    delete [] m_ppQueue;
+    delete [] m_pJobs;
+}
+
+bool
+MBGateway::Service()
+{
+    // while requests wait for the bus, the sockets are only drained; the rest come in
+    // behind the next transaction and can still merge with what is queued
+    m_pServer->SetPollTimeout( m_nQueued ? 0 : m_nIdleMS );
+    size_t nRequest = 0;
+    uint32_t uTicket;
+    for( size_t cTaken = 0; cTaken < m_nMaxJobs && m_pServer->AvailableIn(); cTaken ++ )
+    {
+        m_pServer->SetPollTimeout( 0 );
+        if( m_pServer->ReceivePDU( uAnyDeviceID, m_arrbRequest, nPDU, nRequest ) && m_pServer->Defer( uTicket ) )
+            Admit( uTicket, nRequest );
+    }
+    if( m_nQueued == 0 )
+        return false;
+    Forward( Pop() );
+    return true;
+}
+
+uint8_t
+MBGateway::Priority( const uint8_t* pbRequest, size_t /* nRequest */ )
+{
+    switch( pbRequest[1] )
+    {
+    case MBUSDevice::fcWriteSingleCoil:
+    case MBUSDevice::fcWriteSingleHoldingRegister:
+    case MBUSDevice::fcWriteMultipleCoils:
+    case MBUSDevice::fcWriteMultipleHoldingRegisters:
+    case MBUSDevice::fcReadWriteMultipleRegisters:
+        return 0;
+    default:
+        return 1;
+    }
+}
+
+void
+MBGateway::Admit( uint32_t uTicket, size_t nRequest )
+{
+    m_nRequests ++;
+    uint8_t uDeviceID = m_arrbRequest[0];
+    uint8_t uFC = m_arrbRequest[1];
+    bool bRead = uFC >= MBUSDevice::fcReadCoils && uFC <= MBUSDevice::fcReadInputRegisters;
+    // nobody answers a broadcast read, and the reserved addresses lead nowhere
+    if( uDeviceID > uMaxSlaveID || ( uDeviceID == 0 && bRead ) )
+    {
+        Refuse( uTicket, MBUSDevice::exGWPathUnavailable );
+        return;
+    }
+
+    const uint8_t* pbCached;
+    size_t nCached;
+    if( bRead && m_pCache && m_pCache->Lookup( m_arrbRequest, nRequest, pbCached, nCached ) )
+    {
+        MBSegment segReply = { pbCached, nCached };
+        if( ! m_pServer->TransmitDeferred( uTicket, &segReply, 1 ) )
+            m_nDropped ++;
+        return;
+    }
+
+    if( m_bMerge && bRead )
+    {
+        for( size_t cJob = 0; cJob < m_nQueued; cJob ++ )
+        {
+            Job* pJob = m_ppQueue[ cJob ];
+            if( pJob->nRequest == nRequest && pJob->nWaiters < nMaxWaiters &&
+                memcmp( pJob->arrbRequest, m_arrbRequest, nRequest ) == 0 )
+            {
+                pJob->arruTickets[ pJob->nWaiters ++ ] = uTicket;
+                m_nMerged ++;
+                return;
+            }
+        }
+    }
+
+    Job* pJob = m_pFree;
+    if( ! pJob )
+    {
+        m_nBusy ++;
+        Refuse( uTicket, MBUSDevice::exSlaveDeviceBusy );
+        return;
+    }
+    m_pFree = pJob->pNext;
+    memcpy( pJob->arrbRequest, m_arrbRequest, nRequest );
+    pJob->nRequest = nRequest;
+    pJob->uPriority = Priority( m_arrbRequest, nRequest );
+    pJob->uSeq = m_uSeq ++;
+    pJob->arruTickets[0] = uTicket;
+    pJob->nWaiters = 1;
+    Push( pJob );
+}
+
+void
+MBGateway::Forward( Job* pJob )
+{
+    MBResponse resp;
+    MBClient::eStatus stRV = m_pBus->Transact( pJob->arrbRequest, pJob->nRequest, resp );
+    uint8_t uFC = pJob->arrbRequest[1];
+    if( m_pCache )
+    {
+        // anything but a read may change what the device's inputs read, even without a response
+        if( uFC > MBUSDevice::fcReadInputRegisters )
+            m_pCache->Invalidate( pJob->arrbRequest[0] );
+        else if( stRV == MBClient::stOK )
+            m_pCache->Store( pJob->arrbRequest, pJob->nRequest, m_pBus->Frame(), m_pBus->FrameSize() );
+    }
+
+    // the response goes back as received, so the waiters share one buffer
+    uint8_t arrbReply[6] = { pJob->arrbRequest[0], (uint8_t)( uFC | 0x80 ), MBUSDevice::exGWTargetUnresponsive };
+    MBSegment segReply = { arrbReply, 3 };
+    switch( stRV )
+    {
+    case MBClient::stOK:
+    case MBClient::stException:
+        if( pJob->arrbRequest[0] == 0 )
+        {
+            // a broadcast write is acknowledged with the echo its unicast response would be
+            segReply.nData = pJob->nRequest < sizeof( arrbReply ) ? pJob->nRequest : sizeof( arrbReply );
+            memcpy( arrbReply, pJob->arrbRequest, segReply.nData );
+        }
+        else
+        {
+            segReply.pbData = m_pBus->Frame();
+            segReply.nData = m_pBus->FrameSize();
+        }
+        break;
+    case MBClient::stFailed:
+        arrbReply[2] = MBUSDevice::exGWPathUnavailable;
+        break;
+    default:
+        // a timeout, a slave held off, or a response that did not answer the request
+        m_nUnresponsive ++;
+        break;
+    }
+    for( size_t cWaiter = 0; cWaiter < pJob->nWaiters; cWaiter ++ )
+        if( ! m_pServer->TransmitDeferred( pJob->arruTickets[ cWaiter ], &segReply, 1 ) )
+            m_nDropped ++;
+
+    pJob->pNext = m_pFree;
+    m_pFree = pJob;
+}
+
+void
+MBGateway::Refuse( uint32_t uTicket, MBUSDevice::exCode exRV )
+{
+    uint8_t arrbReply[3] = { m_arrbRequest[0], (uint8_t)( m_arrbRequest[1] | 0x80 ), (uint8_t)exRV };
+    MBSegment segReply = { arrbReply, 3 };
+    if( ! m_pServer->TransmitDeferred( uTicket, &segReply, 1 ) )
+        m_nDropped ++;
+}
+
+bool
+MBGateway::Before( const Job* pA, const Job* pB ) const
+{
+    if( pA->uPriority != pB->uPriority )
+        return pA->uPriority < pB->uPriority;
+    return (int32_t)( pA->uSeq - pB->uSeq ) < 0;
+}
+
+void
+MBGateway::Push( Job* pJob )
+{
+    size_t nPos = m_nQueued ++;
+    while( nPos > 0 )
+    {
+        size_t nParent = ( nPos - 1 ) / 2;
+        if( ! Before( pJob, m_ppQueue[ nParent ] ) )
+            break;
+        m_ppQueue[ nPos ] = m_ppQueue[ nParent ];
+        nPos = nParent;
+    }
+    m_ppQueue[ nPos ] = pJob;
+}
+
+MBGateway::Job*
+MBGateway::Pop()
+{
+    Job* pTop = m_ppQueue[0];
+    Job* pLast = m_ppQueue[ -- m_nQueued ];
+    size_t nPos = 0;
+    for( ;; )
+    {
+        size_t nChild = 2 * nPos + 1;
+        if( nChild >= m_nQueued )
+            break;
+        if( nChild + 1 < m_nQueued && Before( m_ppQueue[ nChild + 1 ], m_ppQueue[ nChild ] ) )
+            nChild ++;
+        if( ! Before( m_ppQueue[ nChild ], pLast ) )
+            break;
+        m_ppQueue[ nPos ] = m_ppQueue[ nChild ];
+        nPos = nChild;
+    }
+    if( m_nQueued > 0 )
+        m_ppQueue[ nPos ] = pLast;
+    return pTop;
+}
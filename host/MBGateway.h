@@ -0,0 +1,127 @@
+#ifndef _MBGATEWAY_H_
+#define _MBGATEWAY_H_
+
+/*
+* MIT License
+*
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#include <MBusTiny.h>
+#include <MBClient.h>
+#include <MBRTUClient.h>
+#include "MBTCPAdapter.h"
+#include "MBResponseCache.h"
+
+const size_t nMaxWaiters = 16;      //!< the most TCP requests one bus transaction answers
+
+/*! @brief class MBGateway - Modbus TCP to RTU gateway
+*
+*   Requests taken from an MBTCPAdapter are deferred and queued for the bus by priority, writes
+*   ahead of reads unless Priority() says otherwise, and in arrival order within a priority. The
+*   bus runs one transaction per Service(); meanwhile the sockets are only drained, never waited
+*   on. A read identical to one already queued, as HMIs polling the same registers send, is not
+*   queued again: it waits on the queued one and gets the same response, so one bus transaction
+*   answers many clients. A slave that does not answer, or that MBSlaveTimeouts holds off, is
+*   reported with the gateway exception exGWTargetUnresponsive. With an MBResponseCache, reads of its
+*   ranges are answered from there while fresh, and every write forwarded drops the cached responses
+*   of its device:
+*
+*       MBTCPAdapter tcp( 64 );
+*       tcp.Listen( 502 );
+*       MBRTUClient rtu( &serial );
+*       rtu.SetTimeout( 200000 );
+*       MBGateway gw( &tcp, &rtu, 64 );
+*       for( ;; )
+*           gw.Service();
+*/
+class MBGateway
+{
+protected:
+    /*! @brief Job - a request waiting for the bus */
+    struct Job
+    {
+        uint8_t  arrbRequest[nPDU];            //!< the request, device address first
+        size_t   nRequest;                     //!< the size of the request
+        uint8_t  uPriority;                    //!< lower goes first
+        uint32_t uSeq;                         //!< the arrival order
+        size_t   nWaiters;                     //!< the TCP requests it answers
+        uint32_t arruTickets[nMaxWaiters];     //!< their MBTCPAdapter::Defer() tickets
+        Job*     pNext;                        //!< the next free job
+    };
+
+    MBTCPAdapter* m_pServer;              //!< the TCP side
+    MBRTUClient*  m_pBus;                 //!< the RTU side
+    MBResponseCache* m_pCache;            //!< answers the reads it holds, NULL for none
+    Job*          m_pJobs;                //!< the job pool
+    size_t        m_nMaxJobs;             //!< the size of the pool
+    Job*          m_pFree;                //!< free jobs
+    Job**         m_ppQueue;              //!< the jobs waiting for the bus, a binary heap on priority and arrival
+    size_t        m_nQueued;              //!< the number of jobs waiting
+    uint32_t      m_uSeq;                 //!< the next arrival number
+    bool          m_bMerge;               //!< identical reads share a transaction
+    int           m_nIdleMS;              //!< how long Service() waits for requests when none is queued
+    uint8_t       m_arrbRequest[nPDU];    //!< the request being admitted
+    uint32_t      m_nRequests;            //!< TCP requests taken
+    uint32_t      m_nMerged;              //!< TCP requests answered by another one's transaction
+    uint32_t      m_nBusy;                //!< TCP requests refused because the pool was full
+    uint32_t      m_nUnresponsive;        //!< transactions answered with exGWTargetUnresponsive
+    uint32_t      m_nDropped;             //!< replies whose connection had gone
+
+public:
+    /*! @brief Constructor
+    *   @param pServer  - the TCP side; its requests for every unit are forwarded
+    *   @param pBus     - the RTU side, with its timeout or MBSlaveTimeouts set
+    *   @param nMaxJobs - the most requests waiting for the bus; one per connection is enough, as each waits for its reply
+    */
+    MBGateway( MBTCPAdapter* pServer, MBRTUClient* pBus, size_t nMaxJobs );
+    virtual ~MBGateway();
+
+    void SetMerge( bool bMerge ) { m_bMerge = bMerge; }            //!< identical reads share a transaction, the default
+    void SetIdleTimeout( int nTimeoutMS ) { m_nIdleMS = nTimeoutMS; } //!< how long Service() waits for requests when none is queued
+    void SetCache( MBResponseCache* pCache ) { m_pCache = pCache; } //!< answers reads from the cache while fresh, NULL for none
+
+    /*! @brief Service - takes the requests that have come in, then runs the first queued one on the bus
+    *   @returns - true if a bus transaction ran
+    */
+    bool Service();
+
+    size_t Queued() const { return m_nQueued; }                     //!< the jobs waiting for the bus
+    uint32_t Requests() const { return m_nRequests; }               //!< TCP requests taken
+    uint32_t Merged() const { return m_nMerged; }                   //!< TCP requests answered by another one's transaction
+    uint32_t Busy() const { return m_nBusy; }                       //!< TCP requests refused with exSlaveDeviceBusy
+    uint32_t Unresponsive() const { return m_nUnresponsive; }       //!< transactions answered with exGWTargetUnresponsive
+    uint32_t Dropped() const { return m_nDropped; }                 //!< replies whose connection had gone
+
+protected:
+    /*! @brief Priority - the bus priority of a request, lower goes first; writes 0, the rest 1 */
+    virtual uint8_t Priority( const uint8_t* pbRequest, size_t nRequest );
+
+    void Admit( uint32_t uTicket, size_t nRequest );      //!< merges or queues the request being admitted
+    void Forward( Job* pJob );                            //!< runs a job on the bus and replies to its waiters
+    void Refuse( uint32_t uTicket, MBUSDevice::exCode exRV ); //!< replies to the request being admitted with an exception
+    bool Before( const Job* pA, const Job* pB ) const;    //!< the heap order
+    void Push( Job* pJob );                               //!< queues a job
+    Job* Pop();                                           //!< takes the first job off the queue
+};
+
+#endif
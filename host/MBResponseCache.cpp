@@ -0,0 +1,182 @@
+/*
+* MIT License
+*
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "MBResponseCache.h"
+#include <Arduino.h>
+#include <string.h>
+
+const size_t nProbes = 4;         // table slots a key may take, the oldest of them is replaced
+
+MBResponseCache::MBResponseCache( size_t nMaxEntries, size_t nMaxMappings )
+{
+    size_t nEntries = 1;
+    while( nEntries < nMaxEntries || nEntries < nProbes )
+        nEntries <<= 1;
+    m_pEntries = new Entry[ nEntries ];
+    m_nMask = nEntries - 1;
+    m_pMappings = new Mapping[ nMaxMappings ];
+    m_nMaxMappings = nMaxMappings;
+    m_nMappings = 0;
+    memset( m_arruGeneration, 0, sizeof( m_arruGeneration ) );
+    m_nHits = 0;
+    m_nMisses = 0;
+    m_nInvalidations = 0;
+    Clear();
+}
+
+MBResponseCache::~MBResponseCache()
+{
+    delete [] m_pEntries;
+    delete [] m_pMappings;
+}
+
+bool
+MBResponseCache::AddMapping( uint8_t uDeviceID, uint8_t uFC, uint16_t uAddress, uint16_t uCount, uint32_t uTTLUS )
+{
+    if( ( uFC != MBUSDevice::fcReadDiscreteInputs && uFC != MBUSDevice::fcReadInputRegisters ) ||
+        uCount == 0 || uDeviceID == 0 || m_nMappings == m_nMaxMappings )
+        return false;
+    Mapping& rMapping = m_pMappings[ m_nMappings ++ ];
+    rMapping.uDeviceID = uDeviceID;
+    rMapping.uFC = uFC;
+    rMapping.uAddress = uAddress;
+    rMapping.uEnd = (uint32_t)uAddress + uCount;
+    rMapping.uTTLUS = uTTLUS;
+    return true;
+}
+
+bool
+MBResponseCache::Lookup( const uint8_t* pbRequest, size_t nRequest, const uint8_t*& rpbResponse, size_t& rnResponse )
+{
+    if( ! Find( pbRequest, nRequest ) )
+        return false;
+    uint64_t uKey = Key( pbRequest );
+    uint32_t uNowUS = micros();
+    size_t nSlot = Slot( uKey );
+    for( size_t cProbe = 0; cProbe < nProbes; cProbe ++ )
+    {
+        const Entry& rEntry = m_pEntries[ ( nSlot + cProbe ) & m_nMask ];
+        if( rEntry.uKey != uKey )
+            continue;
+        if( rEntry.uGeneration != m_arruGeneration[ pbRequest[0] ] || uNowUS - rEntry.uStoredUS >= rEntry.uTTLUS )
+            break;
+        rpbResponse = rEntry.arrbResponse;
+        rnResponse = rEntry.nResponse;
+        m_nHits ++;
+        return true;
+    }
+    m_nMisses ++;
+    return false;
+}
+
+void
+MBResponseCache::Store( const uint8_t* pbRequest, size_t nRequest, const uint8_t* pbResponse, size_t nResponse )
+{
+    const Mapping* pMapping = Find( pbRequest, nRequest );
+    if( ! pMapping || nResponse > nPDU || nResponse < 3 || ( pbResponse[1] & 0x80 ) )
+        return;
+    uint64_t uKey = Key( pbRequest );
+    uint32_t uNowUS = micros();
+    uint16_t uGeneration = m_arruGeneration[ pbRequest[0] ];
+
+    // the entry of the same request, a free or lapsed one, or else the oldest
+    size_t nSlot = Slot( uKey );
+    Entry* pVictim = NULL;
+    for( size_t cProbe = 0; cProbe < nProbes; cProbe ++ )
+    {
+        Entry* pEntry = m_pEntries + ( ( nSlot + cProbe ) & m_nMask );
+        if( pEntry->uKey == uKey || pEntry->uKey == 0 )
+        {
+            pVictim = pEntry;
+            break;
+        }
+        uint8_t uEntryDevice = (uint8_t)( pEntry->uKey >> 40 );
+        if( pEntry->uGeneration != m_arruGeneration[ uEntryDevice ] || uNowUS - pEntry->uStoredUS >= pEntry->uTTLUS )
+        {
+            pVictim = pEntry;
+            break;
+        }
+        if( ! pVictim || uNowUS - pEntry->uStoredUS > uNowUS - pVictim->uStoredUS )
+            pVictim = pEntry;
+    }
+    pVictim->uKey = uKey;
+    pVictim->uStoredUS = uNowUS;
+    pVictim->uTTLUS = pMapping->uTTLUS;
+    pVictim->uGeneration = uGeneration;
+    pVictim->nResponse = (uint8_t)nResponse;
+    memcpy( pVictim->arrbResponse, pbResponse, nResponse );
+}
+
+void
+MBResponseCache::Invalidate( uint8_t uDeviceID )
+{
+    m_nInvalidations ++;
+    if( uDeviceID != 0 )
+    {
+        m_arruGeneration[ uDeviceID ] ++;
+        return;
+    }
+    for( size_t cDevice = 0; cDevice < 256; cDevice ++ )
+        m_arruGeneration[ cDevice ] ++;
+}
+
+void
+MBResponseCache::Clear()
+{
+    for( size_t cEntry = 0; cEntry <= m_nMask; cEntry ++ )
+        m_pEntries[ cEntry ].uKey = 0;
+}
+
+const MBResponseCache::Mapping*
+MBResponseCache::Find( const uint8_t* pbRequest, size_t nRequest ) const
+{
+    if( nRequest != 6 )
+        return NULL;
+    uint16_t uAddress = ( pbRequest[2] << 8 ) | pbRequest[3];
+    uint32_t uEnd = (uint32_t)uAddress + ( ( pbRequest[4] << 8 ) | pbRequest[5] );
+    for( size_t cMapping = 0; cMapping < m_nMappings; cMapping ++ )
+    {
+        const Mapping& rMapping = m_pMappings[ cMapping ];
+        if( rMapping.uDeviceID == pbRequest[0] && rMapping.uFC == pbRequest[1] &&
+            uAddress >= rMapping.uAddress && uEnd <= rMapping.uEnd )
+            return &rMapping;
+    }
+    return NULL;
+}
+
+uint64_t
+MBResponseCache::Key( const uint8_t* pbRequest )
+{
+    // the leading one keeps every key of a request apart from a free entry's 0
+    uint64_t uKey = 1;
+    for( size_t cByte = 0; cByte < 6; cByte ++ )
+        uKey = ( uKey << 8 ) | pbRequest[ cByte ];
+    return uKey;
+}
+
+size_t
+MBResponseCache::Slot( uint64_t uKey ) const
+{
+    return (size_t)( ( uKey * 0x9E3779B97F4A7C15ULL ) >> 32 ) & m_nMask;
+}
@@ -0,0 +1,114 @@
+#ifndef _MBRESPONSECACHE_H_
+#define _MBRESPONSECACHE_H_
+
+/*
+* MIT License
+*
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#include <MBusTiny.h>
+
+/*! @brief class MBResponseCache - answers repeated reads of slowly changing inputs without the bus
+*
+*   Only the ranges given with AddMapping() are cached, each with its own time to live: discrete
+*   inputs (FC2) and input registers (FC4) such as firmware versions, calibration constants or slow
+*   temperatures. An entry holds the response as received for one exact request, device, function
+*   code, address and count, in a fixed open addressed table, so a lookup is a hash and a compare
+*   or two. A write to a device may change what its inputs read, so Invalidate() drops every entry
+*   of the device at once by advancing its generation:
+*
+*       MBResponseCache cache( 256, 16 );
+*       cache.AddMapping( 7, MBUSDevice::fcReadInputRegisters, 0, 32, 10000000 );
+*       gateway.SetCache( &cache );
+*/
+class MBResponseCache
+{
+protected:
+    /*! @brief Mapping - a cached range */
+    struct Mapping
+    {
+        uint8_t  uDeviceID;            //!< the device
+        uint8_t  uFC;                  //!< fcReadDiscreteInputs or fcReadInputRegisters
+        uint16_t uAddress;             //!< the first address
+        uint32_t uEnd;                 //!< the address past the range
+        uint32_t uTTLUS;               //!< how long a response stays valid
+    };
+    /*! @brief Entry - a cached response */
+    struct Entry
+    {
+        uint64_t uKey;                 //!< device, function code, address and count; 0 for a free entry
+        uint32_t uStoredUS;            //!< micros() when stored
+        uint32_t uTTLUS;               //!< its mapping's time to live
+        uint16_t uGeneration;          //!< its device's generation when stored
+        uint8_t  nResponse;            //!< the size of the response
+        uint8_t  arrbResponse[nPDU];   //!< the response, device address first and without CRC
+    };
+
+    Mapping* m_pMappings;              //!< the cached ranges
+    size_t   m_nMaxMappings;
+    size_t   m_nMappings;
+    Entry*   m_pEntries;               //!< the table, a power of two in size
+    size_t   m_nMask;                  //!< its size less one
+    uint16_t m_arruGeneration[256];    //!< per device, advanced by Invalidate()
+    uint32_t m_nHits;                  //!< reads answered from the cache
+    uint32_t m_nMisses;                //!< reads of a cached range that went to the bus
+    uint32_t m_nInvalidations;         //!< Invalidate() calls
+
+public:
+    /*! @brief Constructor
+    *   @param nMaxEntries  - the responses kept, rounded up to a power of two
+    *   @param nMaxMappings - the ranges AddMapping() takes
+    */
+    MBResponseCache( size_t nMaxEntries, size_t nMaxMappings );
+    virtual ~MBResponseCache();
+
+    /*! @brief AddMapping - caches the reads within a range
+    *   @param uTTLUS - how long a response stays valid, in microseconds
+    *   @returns      - false if the function code is neither FC2 nor FC4, the range is empty or the mappings are full
+    */
+    bool AddMapping( uint8_t uDeviceID, uint8_t uFC, uint16_t uAddress, uint16_t uCount, uint32_t uTTLUS );
+
+    /*! @brief Lookup - the cached response to a request
+    *   @param rpbResponse - receives the response, valid until the next Store()
+    *   @param rnResponse  - receives its size
+    *   @returns           - true on a hit; a miss is counted only for a request within a mapping
+    */
+    bool Lookup( const uint8_t* pbRequest, size_t nRequest, const uint8_t*& rpbResponse, size_t& rnResponse );
+
+    /*! @brief Store - keeps the response to a request within a mapping; others are ignored */
+    void Store( const uint8_t* pbRequest, size_t nRequest, const uint8_t* pbResponse, size_t nResponse );
+
+    void Invalidate( uint8_t uDeviceID );  //!< drops the entries of a device, of all devices for the broadcast address 0
+    void Clear();                          //!< drops all entries
+
+    uint32_t Hits() const { return m_nHits; }                       //!< reads answered from the cache
+    uint32_t Misses() const { return m_nMisses; }                   //!< reads of a cached range that went to the bus
+    uint32_t Invalidations() const { return m_nInvalidations; }     //!< Invalidate() calls
+
+protected:
+    const Mapping* Find( const uint8_t* pbRequest, size_t nRequest ) const; //!< the mapping a request falls within, NULL if none
+    static uint64_t Key( const uint8_t* pbRequest );                        //!< the entry key of a request
+    size_t Slot( uint64_t uKey ) const;                                     //!< the first table slot a key probes
+};
+
+#endif
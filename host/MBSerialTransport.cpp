@@ -0,0 +1,325 @@
+/*
+* MIT License
+*
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "MBSerialTransport.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <linux/serial.h>
+
+const uint32_t uMinByteTimeoutUS = 1750; // the fixed t3.5 Modbus prescribes above 19200 bps
+const int nTXTimeoutMS = 1000;           // how long a transmission may wait for room in the kernel
+
+static uint64_t
+SerialNowUS()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static speed_t
+SerialSpeed( uint32_t uBaud )
+{
+    switch( uBaud )
+    {
+    case 1200:    return B1200;
+    case 2400:    return B2400;
+    case 4800:    return B4800;
+    case 9600:    return B9600;
+    case 19200:   return B19200;
+    case 38400:   return B38400;
+    case 57600:   return B57600;
+    case 115200:  return B115200;
+    case 230400:  return B230400;
+    case 460800:  return B460800;
+    case 500000:  return B500000;
+    case 921600:  return B921600;
+    case 1000000: return B1000000;
+    case 2000000: return B2000000;
+    case 3000000: return B3000000;
+    case 4000000: return B4000000;
+    default:      return B0;
+    }
+}
+
+MBSerialTransport::MBSerialTransport()
+{
+    m_fd = -1;
+    m_uCharUS = 0;
+    m_uByteTimeoutUS = uMinByteTimeoutUS;
+    m_nPollTimeoutUS = 1000;
+    m_bLowLatency = false;
+    m_nHead = 0;
+    m_nTail = 0;
+    m_nReads = 0;
+    m_nTimeouts = 0;
+}
+
+MBSerialTransport::~MBSerialTransport()
+{
+    Close();
+}
+
+bool
+MBSerialTransport::Open( const char* pszDevice, uint32_t uBaud, char cParity, int nStopBits )
+{
+    speed_t speed = SerialSpeed( uBaud );
+    if( speed == B0 || ( cParity != 'N' && cParity != 'E' && cParity != 'O' ) || nStopBits < 1 || nStopBits > 2 )
+        return false;
+    Close();
+    // non-blocking, so read() returns what is there and the waits stay in Wait()
+    m_fd = open( pszDevice, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC );
+    if( m_fd < 0 )
+        return false;
+
+    struct termios tio;
+    if( tcgetattr( m_fd, &tio ) < 0 )
+    {
+        Close();
+        return false;
+    }
+    cfmakeraw( &tio );
+    tio.c_cflag &= ~( CSIZE | PARENB | PARODD | CSTOPB | CRTSCTS );
+    tio.c_cflag |= CS8 | CLOCAL | CREAD;
+    if( cParity != 'N' )
+        tio.c_cflag |= PARENB | ( cParity == 'O' ? PARODD : 0 );
+    if( nStopBits == 2 )
+        tio.c_cflag |= CSTOPB;
+    // readable at the first byte and never changed afterwards; the timeouts are kept by ppoll() at
+    // microsecond resolution, and the ring takes whatever has arrived by the time of a read
+    tio.c_cc[ VMIN ] = 1;
+    tio.c_cc[ VTIME ] = 0;
+    cfsetispeed( &tio, speed );
+    cfsetospeed( &tio, speed );
+    if( tcsetattr( m_fd, TCSANOW, &tio ) < 0 )
+    {
+        Close();
+        return false;
+    }
+    tcflush( m_fd, TCIOFLUSH );
+
+    // start bit + 8 data bits + parity + stop bits
+    uint32_t uBits = 1 + 8 + ( cParity != 'N' ? 1 : 0 ) + nStopBits;
+    m_uCharUS = ( uBits * 1000000UL + uBaud - 1 ) / uBaud;
+    m_uByteTimeoutUS = ( (uint32_t)35 * m_uCharUS ) / 10;
+    if( m_uByteTimeoutUS < uMinByteTimeoutUS )
+        m_uByteTimeoutUS = uMinByteTimeoutUS;
+
+    // UART drivers then push the received bytes to the line discipline at once instead of from a work queue;
+    // pseudo-terminals and many USB adapters do not support it, which is fine
+    struct serial_struct ss;
+    m_bLowLatency = false;
+    if( ioctl( m_fd, TIOCGSERIAL, &ss ) == 0 )
+    {
+        ss.flags |= ASYNC_LOW_LATENCY;
+        m_bLowLatency = ioctl( m_fd, TIOCSSERIAL, &ss ) == 0;
+    }
+    m_nHead = 0;
+    m_nTail = 0;
+    return true;
+}
+
+void
+MBSerialTransport::Close()
+{
+    if( m_fd >= 0 )
+        close( m_fd );
+    m_fd = -1;
+}
+
+bool
+MBSerialTransport::SetRS485( bool bEnable, uint32_t uDelayBeforeMS, uint32_t uDelayAfterMS )
+{
+    if( m_fd < 0 )
+        return false;
+    struct serial_rs485 rs;
+    memset( &rs, 0, sizeof( rs ) );
+    if( bEnable )
+    {
+        // RTS high while sending, low again once the last stop bit is out
+        rs.flags = SER_RS485_ENABLED | SER_RS485_RTS_ON_SEND;
+        rs.delay_rts_before_send = uDelayBeforeMS;
+        rs.delay_rts_after_send = uDelayAfterMS;
+    }
+    return ioctl( m_fd, TIOCSRS485, &rs ) == 0;
+}
+
+bool
+MBSerialTransport::Wait( int nTimeoutUS )
+{
+    struct pollfd pfd;
+    pfd.fd = m_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    struct timespec ts;
+    ts.tv_sec = nTimeoutUS / 1000000;
+    ts.tv_nsec = ( nTimeoutUS % 1000000 ) * 1000;
+    // a hang-up or an error reports ready as well; the following read() tells
+    return ppoll( &pfd, 1, nTimeoutUS < 0 ? NULL : &ts, NULL ) > 0;
+}
+
+bool
+MBSerialTransport::Fill()
+{
+    size_t nTail = m_nTail & ( cbSerialRing - 1 );
+    size_t nFree = cbSerialRing - Buffered();
+    if( nFree > cbSerialRing - nTail )
+        nFree = cbSerialRing - nTail;
+    if( nFree == 0 )
+        return true;
+    ssize_t nRead = read( m_fd, m_arrbRing + nTail, nFree );
+    if( nRead > 0 )
+    {
+        m_nTail += nRead;
+        m_nReads ++;
+        return true;
+    }
+    return nRead < 0 && ( errno == EAGAIN || errno == EINTR );
+}
+
+bool
+MBSerialTransport::AvailableIn()
+{
+    if( Buffered() == 0 && m_fd >= 0 && Wait( m_nPollTimeoutUS ) )
+        Fill();
+    return Buffered() != 0;
+}
+
+bool
+MBSerialTransport::ReceiveBuffer(
+                      uint8_t* pbBuffer,
+                      size_t nBuffer)
+{
+    if( m_fd < 0 || nBuffer > cbSerialRing )
+        return false;
+    if( Buffered() < nBuffer )
+    {
+        // the missing bytes are due in their transmission time; past that plus the byte timeout the frame is lost
+        uint64_t uDeadline = SerialNowUS() + ( nBuffer - Buffered() ) * (uint64_t)m_uCharUS + m_uByteTimeoutUS;
+        while( Buffered() < nBuffer )
+        {
+            uint64_t uNow = SerialNowUS();
+            if( uNow >= uDeadline || ! Wait( (int)( uDeadline - uNow ) ) )
+            {
+                m_nTimeouts ++;
+                return false;
+            }
+            if( ! Fill() )
+                return false;
+            if( Buffered() >= nBuffer )
+                break;
+            // the rest is still coming at the line rate: one sleep through it instead of a wakeup per byte
+            uNow = SerialNowUS();
+            uint64_t uDueUS = uNow + ( nBuffer - Buffered() ) * (uint64_t)m_uCharUS;
+            if( uDueUS > uDeadline )
+                uDueUS = uDeadline;
+            struct timespec ts;
+            ts.tv_sec = ( uDueUS - uNow ) / 1000000;
+            ts.tv_nsec = ( ( uDueUS - uNow ) % 1000000 ) * 1000;
+            nanosleep( &ts, NULL );
+            if( ! Fill() )
+                return false;
+        }
+    }
+    size_t nHead = m_nHead & ( cbSerialRing - 1 );
+    size_t nFirst = cbSerialRing - nHead;
+    if( nFirst > nBuffer )
+        nFirst = nBuffer;
+    memcpy( pbBuffer, m_arrbRing + nHead, nFirst );
+    memcpy( pbBuffer + nFirst, m_arrbRing, nBuffer - nFirst );
+    m_nHead += nBuffer;
+    return true;
+}
+
+bool
+MBSerialTransport::TransmitBuffer(
+                      const uint8_t* pbBuffer,
+                      size_t nBuffer)
+{
+    MBSegment seg = { pbBuffer, nBuffer };
+    return TransmitSegments( &seg, 1 );
+}
+
+bool
+MBSerialTransport::TransmitSegments(
+                      const MBSegment* pSegments,
+                      size_t nSegments)
+{
+    if( m_fd < 0 )
+        return false;
+    if( nSegments > nMaxSegments + 1 )
+        return IRTUTransport::TransmitSegments( pSegments, nSegments );
+    struct iovec arrIov[ nMaxSegments + 1 ];
+    for( size_t cSeg = 0; cSeg < nSegments; cSeg ++ )
+    {
+        arrIov[cSeg].iov_base = (void*)pSegments[cSeg].pbData;
+        arrIov[cSeg].iov_len = pSegments[cSeg].nData;
+    }
+    struct iovec* pIov = arrIov;
+    while( nSegments > 0 )
+    {
+        ssize_t nWritten = writev( m_fd, pIov, nSegments );
+        if( nWritten < 0 )
+        {
+            if( errno == EINTR )
+                continue;
+            if( errno != EAGAIN )
+                return false;
+            // the output buffer is full: wait for the UART to drain some of it
+            struct pollfd pfd;
+            pfd.fd = m_fd;
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+            if( poll( &pfd, 1, nTXTimeoutMS ) <= 0 )
+                return false;
+            continue;
+        }
+        // skip what went out, the first segment left may be cut
+        size_t nDone = nWritten;
+        while( nSegments > 0 && nDone >= pIov->iov_len )
+        {
+            nDone -= pIov->iov_len;
+            pIov ++;
+            nSegments --;
+        }
+        if( nSegments > 0 )
+        {
+            pIov->iov_base = (uint8_t*)pIov->iov_base + nDone;
+            pIov->iov_len -= nDone;
+        }
+    }
+    return true;
+}
+
+uint16_t
+MBSerialTransport::CharUS()
+{
+    return m_uCharUS;
+}
@@ -0,0 +1,110 @@
+#ifndef _MBSERIALTRANSPORT_H_
+#define _MBSERIALTRANSPORT_H_
+
+/*
+* MIT License
+*
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#include <MBusTiny.h>
+#include <MBRTUAdapter.h>
+#include <termios.h>
+
+const size_t cbSerialRing = 1024;   //!< the receive ring; a power of two, room for several frames
+
+/*! @brief class MBSerialTransport - IRTUTransport for a Linux serial port (/dev/ttyS*, /dev/ttyUSB*, a pty)
+*
+*   The port runs raw with VMIN 1 and VTIME 0, set once by Open(), so the kernel
+*   reports it readable at the first byte. Every read() takes all the kernel holds
+*   into a ring, so the later chunks of a frame that is already in come from memory
+*   without a system call. When a chunk is still on the line, ReceiveBuffer() sleeps
+*   through its transmission time and then reads it, rather than waking for each byte:
+*
+*       MBSerialTransport serial;
+*       serial.Open( "/dev/ttyS1", 19200 );
+*       serial.SetRS485( true );
+*       MBRTUAdapter rtu( &serial );
+*       MBT mb( &rtu, 42 );
+*/
+class MBSerialTransport: public IRTUTransport
+{
+protected:
+    int      m_fd;                          //!< the port, -1 when closed
+    uint16_t m_uCharUS;                     //!< the character time at the configured rate and framing
+    uint32_t m_uByteTimeoutUS;              //!< how long ReceiveBuffer() waits past the expected arrival of the bytes it misses
+    int      m_nPollTimeoutUS;              //!< how long AvailableIn() waits for the first byte
+    bool     m_bLowLatency;                 //!< the driver accepted ASYNC_LOW_LATENCY
+    uint8_t  m_arrbRing[ cbSerialRing ];    //!< received bytes not yet taken
+    size_t   m_nHead;                       //!< the read position, free running
+    size_t   m_nTail;                       //!< the write position, free running
+    uint32_t m_nReads;                      //!< read() calls that returned data
+    uint32_t m_nTimeouts;                   //!< ReceiveBuffer() calls that gave up
+
+public:
+    MBSerialTransport();
+    virtual ~MBSerialTransport();
+
+    /*! @brief Open - opens the port raw, 8 data bits, and asks the driver for low latency
+    *   @param pszDevice - the device path
+    *   @param uBaud     - a standard rate from 1200 to 4000000
+    *   @param cParity   - 'N', 'E' or 'O'
+    *   @param nStopBits - 1 or 2
+    *   @returns         - true on success, false o.w.
+    */
+    bool Open( const char* pszDevice, uint32_t uBaud, char cParity = 'E', int nStopBits = 1 );
+    void Close();                           //!< closes the port
+
+    /*! @brief SetRS485 - switches the driver's RS-485 mode, which drives RTS while it sends
+    *   @param bEnable       - RS-485 on or off
+    *   @param uDelayBeforeMS - RTS set this long before the first bit
+    *   @param uDelayAfterMS  - RTS held this long after the last bit
+    *   @returns             - true if the driver accepted it, false o.w.
+    */
+    bool SetRS485( bool bEnable, uint32_t uDelayBeforeMS = 0, uint32_t uDelayAfterMS = 0 );
+    void SetByteTimeout( uint32_t uTimeoutUS ) { m_uByteTimeoutUS = uTimeoutUS; } //!< widens the receive timeout, e.g. for USB adapters
+    void SetPollTimeout( int nTimeoutUS ) { m_nPollTimeoutUS = nTimeoutUS; }     //!< 0 polls without blocking, -1 blocks
+    int Handle() const { return m_fd; }                        //!< the port descriptor
+    bool LowLatency() const { return m_bLowLatency; }          //!< the driver accepted ASYNC_LOW_LATENCY
+    uint32_t Reads() const { return m_nReads; }                //!< read() calls that returned data
+    uint32_t Timeouts() const { return m_nTimeouts; }          //!< ReceiveBuffer() calls that gave up
+
+    virtual bool AvailableIn(); //!< overrides base class method
+    virtual size_t Available() { return AvailableIn() ? Buffered() : 0; } //!< overrides base class method, what the ring holds
+    virtual bool ReceiveBuffer(
+                          uint8_t* pbBuffer,
+                          size_t nBuffer); //!< overrides base class method
+    virtual bool TransmitBuffer(
+                          const uint8_t* pbBuffer,
+                          size_t nBuffer) ; //!< overrides base class method
+    virtual uint16_t CharUS(); //!< overrides base class method
+    virtual bool TransmitSegments(
+                          const MBSegment* pSegments,
+                          size_t nSegments); //!< overrides base class method, one writev() for the whole frame
+
+protected:
+    size_t Buffered() const { return m_nTail - m_nHead; }     //!< bytes in the ring
+    bool Fill();                            //!< takes what the kernel holds into the ring; false on error or hang-up
+    bool Wait( int nTimeoutUS );            //!< waits until the port holds a byte; false on timeout
+};
+
+#endif
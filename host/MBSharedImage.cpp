@@ -0,0 +1,145 @@
+/*
+* MIT License
+*
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "MBSharedImage.h"
+
+MBSharedImage::MBSharedImage( size_t nRegs, size_t nBits )
+{
+    m_pRegs = new std::atomic<uint16_t>[ nRegs ];
+    m_pBits = new std::atomic<uint8_t>[ nBits ];
+    m_nRegs = nRegs;
+    m_nBits = nBits;
+    for( size_t cReg = 0; cReg < nRegs; cReg ++ )
+        m_pRegs[ cReg ].store( 0, std::memory_order_relaxed );
+    for( size_t cBit = 0; cBit < nBits; cBit ++ )
+        m_pBits[ cBit ].store( 0, std::memory_order_relaxed );
+    m_uSeq.store( 0, std::memory_order_release );
+}
+
+MBSharedImage::~MBSharedImage()
+{
+    delete [] m_pRegs;
+    delete [] m_pBits;
+}
+
+void
+MBSharedImage::ReadRegs( size_t nIndex, size_t nCount, uint8_t* pbOut )
+{
+    uint32_t uSeq;
+    do
+    {
+        uSeq = m_uSeq.load( std::memory_order_acquire );
+        if( uSeq & 1 )
+            continue; // a writer is in
+        for( size_t cReg = 0; cReg < nCount; cReg ++ )
+        {
+            uint16_t uValue = m_pRegs[ nIndex + cReg ].load( std::memory_order_relaxed );
+            pbOut[ 2 * cReg ] = uValue >> 8;
+            pbOut[ 2 * cReg + 1 ] = uValue & 0xFF;
+        }
+        std::atomic_thread_fence( std::memory_order_acquire );
+    }
+    while( ( uSeq & 1 ) || m_uSeq.load( std::memory_order_relaxed ) != uSeq );
+}
+
+void
+MBSharedImage::WriteRegs( size_t nIndex, size_t nCount, const uint8_t* pbIn )
+{
+    uint32_t uSeq = BeginWrite();
+    for( size_t cReg = 0; cReg < nCount; cReg ++ )
+        m_pRegs[ nIndex + cReg ].store( ( pbIn[ 2 * cReg ] << 8 ) | pbIn[ 2 * cReg + 1 ], std::memory_order_relaxed );
+    EndWrite( uSeq );
+}
+
+void
+MBSharedImage::SetReg( size_t nIndex, uint16_t uValue )
+{
+    uint8_t arrbValue[2] = { (uint8_t)( uValue >> 8 ), (uint8_t)uValue };
+    WriteRegs( nIndex, 1, arrbValue );
+}
+
+uint32_t
+MBSharedImage::ReadBits( size_t nIndex, size_t nCount )
+{
+    uint32_t uSeq;
+    uint32_t uBits;
+    do
+    {
+        uSeq = m_uSeq.load( std::memory_order_acquire );
+        uBits = 0;
+        for( size_t cBit = 0; cBit < nCount; cBit ++ )
+            uBits |= (uint32_t)m_pBits[ nIndex + cBit ].load( std::memory_order_relaxed ) << cBit;
+        std::atomic_thread_fence( std::memory_order_acquire );
+    }
+    while( ( uSeq & 1 ) || m_uSeq.load( std::memory_order_relaxed ) != uSeq );
+    return uBits;
+}
+
+void
+MBSharedImage::WriteBits( size_t nIndex, size_t nCount, uint32_t uBits )
+{
+    uint32_t uSeq = BeginWrite();
+    for( size_t cBit = 0; cBit < nCount; cBit ++, uBits >>= 1 )
+        m_pBits[ nIndex + cBit ].store( uBits & 1, std::memory_order_relaxed );
+    EndWrite( uSeq );
+}
+
+uint32_t
+MBSharedImage::BeginWrite()
+{
+    m_mtxWrite.lock();
+    uint32_t uSeq = m_uSeq.load( std::memory_order_relaxed ) + 1;
+    m_uSeq.store( uSeq, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+    return uSeq;
+}
+
+void
+MBSharedImage::EndWrite( uint32_t uSeq )
+{
+    m_uSeq.store( uSeq + 1, std::memory_order_release );
+    m_mtxWrite.unlock();
+}
+
+MBSharedSlave::MBSharedSlave( IPDUAdapter* pAdapter, uint8_t uDevID, MBSharedImage* pImage )
+    : MBUSTiny( pAdapter, uDevID )
+{
+    m_pImage = pImage;
+}
+
+MB_BEGIN_REGISTER_RANGES( MBSharedSlave, MBUSTiny )
+  MB_REGISTER_RANGE( 0, (int)m_pImage->Regs() - 1, readRegs )
+MB_END_REGISTER_RANGES( MBSharedSlave, MBUSTiny )
+
+MB_BEGIN_HOLDINGREG_RANGES( MBSharedSlave, MBUSTiny )
+  MB_HOLDINGREG_RANGE( 0, (int)m_pImage->Regs() - 1, readRegs, writeRegs )
+MB_END_HOLDINGREG_RANGES( MBSharedSlave, MBUSTiny )
+
+MB_BEGIN_INPUT_MASKS( MBSharedSlave, MBUSTiny )
+  MB_INPUT_MASK( 0, (int)m_pImage->Bits() - 1, readBits )
+MB_END_INPUT_MASKS( MBSharedSlave, MBUSTiny )
+
+MB_BEGIN_COIL_MASKS( MBSharedSlave, MBUSTiny )
+  MB_COIL_MASK( 0, (int)m_pImage->Bits() - 1, readBits, writeBits )
+MB_END_COIL_MASKS( MBSharedSlave, MBUSTiny )
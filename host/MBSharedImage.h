@@ -0,0 +1,94 @@
+#ifndef _MBSHAREDIMAGE_H_
+#define _MBSHAREDIMAGE_H_
+
+/*
+* MIT License
+*
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#include <MBusTiny.h>
+#include <atomic>
+#include <mutex>
+
+/*! @brief class MBSharedImage - a register and bit image shared by several server threads
+*
+*   Readers never write to shared memory: a span is copied under a sequence lock
+*   and retried if a writer got in between, so every read returns a consistent
+*   snapshot and readers on different cores do not contend. Writers serialize on
+*   a mutex. Registers are kept in host order; the transfers convert to the
+*   big-endian wire order.
+*/
+class MBSharedImage
+{
+protected:
+    std::atomic<uint16_t>*  m_pRegs;    //!< the registers
+    std::atomic<uint8_t>*   m_pBits;    //!< the bits, one per byte
+    size_t                  m_nRegs;    //!< the number of registers
+    size_t                  m_nBits;    //!< the number of bits
+    std::atomic<uint32_t>   m_uSeq;     //!< the sequence lock; odd while a write is in progress
+    std::mutex              m_mtxWrite; //!< serializes the writers
+
+public:
+    MBSharedImage( size_t nRegs, size_t nBits ); //!< Constructor with the image sizes
+    ~MBSharedImage();
+
+    size_t Regs() const { return m_nRegs; }     //!< the number of registers
+    size_t Bits() const { return m_nBits; }     //!< the number of bits
+
+    void ReadRegs( size_t nIndex, size_t nCount, uint8_t* pbOut );         //!< copies a span out, big-endian
+    void WriteRegs( size_t nIndex, size_t nCount, const uint8_t* pbIn );   //!< copies a big-endian span in
+    uint32_t ReadBits( size_t nIndex, size_t nCount );                     //!< up to 32 bits, bit 0 being nIndex
+    void WriteBits( size_t nIndex, size_t nCount, uint32_t uBits );        //!< up to 32 bits, bit 0 being nIndex
+
+    uint16_t Reg( size_t nIndex ) const { return m_pRegs[ nIndex ].load( std::memory_order_relaxed ); } //!< a single register
+    void SetReg( size_t nIndex, uint16_t uValue );    //!< sets a single register
+
+protected:
+    uint32_t BeginWrite();              //!< takes the writer lock and makes the sequence odd
+    void EndWrite( uint32_t uSeq );     //!< makes the sequence even again and releases the writer lock
+};
+
+/*! @brief class MBSharedSlave - a device serving an MBSharedImage
+*
+*   Holding and input registers both map to the image registers from address 0,
+*   coils and discrete inputs to the image bits. Every server thread runs its own
+*   MBSharedSlave, with its own PDU buffer, over the one image.
+*/
+class MBSharedSlave : public MBUSTiny
+{
+protected:
+    MBSharedImage* m_pImage;    //!< the shared image
+public:
+    MBSharedSlave( IPDUAdapter* pAdapter, uint8_t uDevID, MBSharedImage* pImage );
+
+    MB_DECLARE_RANGES( )
+    MB_DECLARE_MASKS( )
+
+    // callbacks
+    exCode readRegs( int nIndex, int nCount, uint8_t* pbValue ){ m_pImage->ReadRegs( nIndex, nCount, pbValue ); return exOK; }
+    exCode writeRegs( int nIndex, int nCount, uint8_t* pbValue ){ m_pImage->WriteRegs( nIndex, nCount, pbValue ); return exOK; }
+    exCode readBits( int nIndex, int nCount, uint32_t& ruBits ){ ruBits = m_pImage->ReadBits( nIndex, nCount ); return exOK; }
+    exCode writeBits( int nIndex, int nCount, uint32_t& ruBits ){ m_pImage->WriteBits( nIndex, nCount, ruBits ); return exOK; }
+};
+
+#endif
@@ -0,0 +1,522 @@
+/*
+* MIT License
+*
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "MBTCPAdapter.h"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+const int nEpollBatch = 64;       // socket events taken per epoll_wait
+const uint8_t uAnyUnit = 0xFF;    // the unit identifier of a directly addressed TCP server
+
+MBTCPAdapter::MBTCPAdapter( size_t nMaxConns )
+{
+    m_fdEpoll = epoll_create1( EPOLL_CLOEXEC );
+    m_fdListen = -1;
+    m_pConns = new Conn[ nMaxConns ];
+    m_nMaxConns = nMaxConns;
+    m_nConns.store( 0 );
+    m_pFree = NULL;
+    for( size_t cConn = nMaxConns; cConn > 0; cConn -- )
+    {
+        Conn* pConn = m_pConns + cConn - 1;
+        pConn->fd = -1;
+        pConn->uGeneration = 0;
+        pConn->bQueued = false;
+        pConn->bDeferred = false;
+        pConn->uInFlight = 0;
+        Release( pConn );
+    }
+    m_pReadyHead = NULL;
+    m_pReadyTail = NULL;
+    m_pCurrent = NULL;
+    m_nTimeoutMS = 1;
+    m_nRejected = 0;
+    m_nBadFrames = 0;
+    m_nBadSizes = 0;
+}
+
+MBTCPAdapter::~MBTCPAdapter()
+{
+    for( size_t cConn = 0; cConn < m_nMaxConns; cConn ++ )
+        if( m_pConns[ cConn ].fd >= 0 )
+            close( m_pConns[ cConn ].fd );
+    if( m_fdListen >= 0 )
+        close( m_fdListen );
+    if( m_fdEpoll >= 0 )
+        close( m_fdEpoll );
+    delete [] m_pConns;
+}
+
+bool
+MBTCPAdapter::Listen( uint16_t uPort, const char* pszAddress, bool bReusePort )
+{
+    if( m_fdEpoll < 0 ) // epoll_create1 failed in the constructor
+        return false;
+    m_fdListen = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+    if( m_fdListen < 0 )
+        return false;
+    int nOn = 1;
+    setsockopt( m_fdListen, SOL_SOCKET, SO_REUSEADDR, &nOn, sizeof( nOn ) );
+    if( bReusePort && setsockopt( m_fdListen, SOL_SOCKET, SO_REUSEPORT, &nOn, sizeof( nOn ) ) < 0 )
+        return false;
+
+    struct sockaddr_in sa;
+    memset( &sa, 0, sizeof( sa ) );
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons( uPort );
+    if( inet_pton( AF_INET, pszAddress, &sa.sin_addr ) != 1 )
+        return false;
+    if( bind( m_fdListen, (struct sockaddr*)&sa, sizeof( sa ) ) < 0 || listen( m_fdListen, SOMAXCONN ) < 0 )
+        return false;
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL; // the listening socket is the only one without a slot
+    return epoll_ctl( m_fdEpoll, EPOLL_CTL_ADD, m_fdListen, &ev ) == 0;
+}
+
+uint16_t
+MBTCPAdapter::Port() const
+{
+    struct sockaddr_in sa;
+    socklen_t nSA = sizeof( sa );
+    if( getsockname( m_fdListen, (struct sockaddr*)&sa, &nSA ) < 0 )
+        return 0;
+    return ntohs( sa.sin_port );
+}
+
+bool
+MBTCPAdapter::AvailableIn()
+{
+    Unanswered();
+    // queued requests are served before the sockets are polled again
+    if( m_pReadyHead )
+        return true;
+
+    struct epoll_event arrEv[ nEpollBatch ];
+    int nEv = epoll_wait( m_fdEpoll, arrEv, nEpollBatch, m_nTimeoutMS );
+    for( int cEv = 0; cEv < nEv; cEv ++ )
+    {
+        Conn* pConn = (Conn*)arrEv[ cEv ].data.ptr;
+        if( ! pConn )
+        {
+            Accept();
+            continue;
+        }
+        uint32_t uEvents = arrEv[ cEv ].events;
+        if( ( uEvents & EPOLLOUT ) && ! Flush( pConn ) )
+            continue;
+        if( ! ( pConn->uWatched & ( EPOLLIN | EPOLLOUT ) ) )
+        {
+            // a hang-up or an error is reported even with no events watched; the reply could not go out anyway
+            if( uEvents & ( EPOLLHUP | EPOLLERR ) )
+                Close( pConn );
+            continue;
+        }
+        if( uEvents & ( EPOLLIN | EPOLLHUP | EPOLLERR ) )
+            Read( pConn );
+    }
+    return m_pReadyHead != NULL;
+}
+
+bool
+MBTCPAdapter::ReceivePDU(
+                      uint8_t uSDeviceID,
+                      uint8_t* pbBuffer,
+                      size_t nBuffer,
+                      size_t& nBufferOut )
+{
+    Unanswered();
+    while( m_pReadyHead )
+    {
+        Conn* pConn = m_pReadyHead;
+        m_pReadyHead = pConn->pNext;
+        if( ! m_pReadyHead )
+            m_pReadyTail = NULL;
+        pConn->bQueued = false;
+        if( pConn->fd < 0 )
+        {
+            ReleaseIfIdle( pConn );
+            continue;
+        }
+
+        size_t nFrame = 0;
+        FrameSize( pConn, nFrame );
+        // unit identifier, function code and data map onto the RTU PDU layout
+        const uint8_t* pbFrame = pConn->arrbRX;
+        size_t nUnitPDU = nFrame - ( cbMBAP - 1 );
+        bool bOurs = ( pbFrame[6] == uSDeviceID || pbFrame[6] == uAnyUnit || uSDeviceID == uAnyDeviceID ) && nUnitPDU <= nBuffer;
+        if( bOurs )
+        {
+            pConn->uTID = ( pbFrame[0] << 8 ) | pbFrame[1];
+            memcpy( pbBuffer, pbFrame + cbMBAP - 1, nUnitPDU );
+            nBufferOut = nUnitPDU;
+        }
+        pConn->nRX -= nFrame;
+        memmove( pConn->arrbRX, pConn->arrbRX + nFrame, pConn->nRX );
+        Drained( pConn );
+        if( bOurs && ! MBUSDevice::RequestSizeOK( pbBuffer, nUnitPDU ) )
+        {
+            // the MBAP length disagrees with the function code: refuse it here, the device would read past the data
+            m_nBadSizes ++;
+            uint8_t arrbEx[3] = { pbBuffer[0], (uint8_t)( pbBuffer[1] | 0x80 ), MBUSDevice::exIllegalDataValue };
+            MBSegment segEx = { arrbEx, sizeof( arrbEx ) };
+            m_pCurrent = pConn;
+            TransmitSegments( uSDeviceID, &segEx, 1 );
+            continue;
+        }
+        if( bOurs )
+        {
+            m_pCurrent = pConn;
+            return true;
+        }
+        QueueIfReady( pConn );
+    }
+    return false;
+}
+
+bool
+MBTCPAdapter::TransmitPDU(
+                      uint8_t uSDeviceID,
+                      uint8_t* pbBuffer,
+                      size_t nBuffer)
+{
+    MBSegment segPDU = { pbBuffer, nBuffer };
+    return TransmitSegments( uSDeviceID, &segPDU, 1 );
+}
+
+bool
+MBTCPAdapter::TransmitSegments(
+                      uint8_t /* uSDeviceID */,
+                      const MBSegment* pSegments,
+                      size_t nSegments)
+{
+    Conn* pConn = m_pCurrent;
+    m_pCurrent = NULL;
+    if( ! pConn )
+        return false;
+    if( pConn->fd < 0 )
+    {
+        ReleaseIfIdle( pConn );
+        return false;
+    }
+    size_t nBuffer = 0;
+    for( size_t cSeg = 0; cSeg < nSegments; cSeg ++ )
+        nBuffer += pSegments[cSeg].nData;
+    if( nSegments > nMaxSegments || nBuffer > cbTCPFrame - ( cbMBAP - 1 ) )
+    {
+        QueueIfReady( pConn );
+        return false;
+    }
+
+    // the reply's unit identifier is the PDU's first byte, so only six header bytes are prepended
+    uint8_t arrbHeader[ cbMBAP - 1 ] = { (uint8_t)( pConn->uTID >> 8 ), (uint8_t)pConn->uTID, 0, 0,
+                                         (uint8_t)( nBuffer >> 8 ), (uint8_t)nBuffer };
+    struct iovec arrIov[ nMaxSegments + 1 ];
+    arrIov[0].iov_base = arrbHeader;
+    arrIov[0].iov_len = sizeof( arrbHeader );
+    for( size_t cSeg = 0; cSeg < nSegments; cSeg ++ )
+    {
+        arrIov[ cSeg + 1 ].iov_base = (void*)pSegments[cSeg].pbData;
+        arrIov[ cSeg + 1 ].iov_len = pSegments[cSeg].nData;
+    }
+    struct msghdr msg;
+    memset( &msg, 0, sizeof( msg ) );
+    msg.msg_iov = arrIov;
+    msg.msg_iovlen = nSegments + 1;
+    ssize_t nSent = sendmsg( pConn->fd, &msg, MSG_NOSIGNAL );
+    if( nSent < 0 )
+    {
+        if( errno != EAGAIN && errno != EWOULDBLOCK )
+        {
+            Close( pConn );
+            return false;
+        }
+        nSent = 0;
+    }
+
+    size_t nFrame = sizeof( arrbHeader ) + nBuffer;
+    if( (size_t)nSent < nFrame )
+    {
+        // the socket is full: keep the rest and stop reading until it drains
+        pConn->nTX = Gather( pConn->arrbTX, arrbHeader, pSegments, nSegments );
+        pConn->nTXPos = nSent;
+        Watch( pConn );
+        return true;
+    }
+    QueueIfReady( pConn );
+    return true;
+}
+
+bool
+MBTCPAdapter::Defer( uint32_t& ruTicket )
+{
+    Conn* pConn = m_pCurrent;
+    if( ! pConn )
+        return false;
+    m_pCurrent = NULL;
+    pConn->bDeferred = true;
+    Watch( pConn );
+    ruTicket = ( (uint32_t)( pConn - m_pConns ) << 16 ) | pConn->uGeneration;
+    return true;
+}
+
+bool
+MBTCPAdapter::TransmitDeferred( uint32_t uTicket, const MBSegment* pSegments, size_t nSegments )
+{
+    size_t nConn = uTicket >> 16;
+    if( nConn >= m_nMaxConns )
+        return false;
+    Conn* pConn = m_pConns + nConn;
+    // a slot released and reused since has another generation
+    if( ! pConn->bDeferred || pConn->uGeneration != (uint16_t)uTicket || pConn->fd < 0 )
+        return false;
+    Unanswered();
+    pConn->bDeferred = false;
+    Watch( pConn );
+    m_pCurrent = pConn;
+    return TransmitSegments( uAnyDeviceID, pSegments, nSegments );
+}
+
+size_t
+MBTCPAdapter::Gather( uint8_t* pbFrame, const uint8_t* pbHeader, const MBSegment* pSegments, size_t nSegments )
+{
+    memcpy( pbFrame, pbHeader, cbMBAP - 1 );
+    size_t nFrame = cbMBAP - 1;
+    for( size_t cSeg = 0; cSeg < nSegments; cSeg ++ )
+    {
+        memcpy( pbFrame + nFrame, pSegments[cSeg].pbData, pSegments[cSeg].nData );
+        nFrame += pSegments[cSeg].nData;
+    }
+    return nFrame;
+}
+
+void
+MBTCPAdapter::Accept()
+{
+    for( ;; )
+    {
+        int fd = accept4( m_fdListen, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC );
+        if( fd < 0 )
+            return;
+        Conn* pConn = Adopt( fd );
+        if( ! pConn )
+            continue;
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = pConn;
+        epoll_ctl( m_fdEpoll, EPOLL_CTL_ADD, fd, &ev );
+    }
+}
+
+MBTCPAdapter::Conn*
+MBTCPAdapter::Adopt( int fd )
+{
+    if( ! m_pFree )
+    {
+        m_nRejected ++;
+        close( fd );
+        return NULL;
+    }
+    Conn* pConn = m_pFree;
+    m_pFree = pConn->pNext;
+    pConn->fd = fd;
+    pConn->nRX = 0;
+    pConn->nTX = 0;
+    pConn->nTXPos = 0;
+    pConn->bQueued = false;
+    pConn->bDeferred = false;
+    pConn->uWatched = EPOLLIN;
+    pConn->uInFlight = 0;
+    pConn->pNext = NULL;
+    m_nConns.fetch_add( 1, std::memory_order_relaxed );
+
+    int nOn = 1;
+    setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &nOn, sizeof( nOn ) );
+    return pConn;
+}
+
+void
+MBTCPAdapter::Read( Conn* pConn )
+{
+    for( ;; )
+    {
+        size_t nRoom = sizeof( pConn->arrbRX ) - pConn->nRX;
+        if( nRoom == 0 )
+            break;
+        ssize_t nRead = recv( pConn->fd, pConn->arrbRX + pConn->nRX, nRoom, 0 );
+        if( nRead > 0 )
+        {
+            pConn->nRX += nRead;
+            if( (size_t)nRead < nRoom )
+                break;
+            continue;
+        }
+        if( nRead < 0 && errno == EINTR )
+            continue;
+        if( nRead < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+            break;
+        Close( pConn ); // orderly shutdown or error
+        return;
+    }
+    Received( pConn );
+    Watch( pConn );
+}
+
+void
+MBTCPAdapter::Received( Conn* pConn )
+{
+    size_t nFrame = 0;
+    if( ! FrameSize( pConn, nFrame ) )
+    {
+        m_nBadFrames ++;
+        Close( pConn );
+        return;
+    }
+    QueueIfReady( pConn );
+}
+
+bool
+MBTCPAdapter::Flush( Conn* pConn )
+{
+    while( pConn->nTXPos < pConn->nTX )
+    {
+        ssize_t nSent = send( pConn->fd, pConn->arrbTX + pConn->nTXPos, pConn->nTX - pConn->nTXPos, MSG_NOSIGNAL );
+        if( nSent < 0 && errno == EINTR )
+            continue;
+        if( nSent < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+            return true;
+        if( nSent <= 0 )
+        {
+            Close( pConn );
+            return false;
+        }
+        pConn->nTXPos += nSent;
+    }
+    pConn->nTX = 0;
+    pConn->nTXPos = 0;
+    Watch( pConn );
+    QueueIfReady( pConn );
+    return true;
+}
+
+void
+MBTCPAdapter::Watch( Conn* pConn )
+{
+    // EPOLLIN is level-triggered: left on with no room to read into, or with the connection not to be served,
+    // it would wake every epoll_wait for the bytes left in the socket
+    uint32_t uEvents = EPOLLIN;
+    if( pConn->nTX != 0 )
+        uEvents = EPOLLOUT;
+    else if( pConn->bDeferred || pConn->nRX == sizeof( pConn->arrbRX ) )
+        uEvents = 0;
+    if( pConn->fd < 0 || uEvents == pConn->uWatched )
+        return;
+    pConn->uWatched = uEvents;
+    struct epoll_event ev;
+    ev.events = uEvents;
+    ev.data.ptr = pConn;
+    epoll_ctl( m_fdEpoll, EPOLL_CTL_MOD, pConn->fd, &ev );
+}
+
+void
+MBTCPAdapter::Close( Conn* pConn )
+{
+    if( pConn->fd < 0 )
+        return;
+    epoll_ctl( m_fdEpoll, EPOLL_CTL_DEL, pConn->fd, NULL );
+    close( pConn->fd );
+    pConn->fd = -1;
+    m_nConns.fetch_sub( 1, std::memory_order_relaxed );
+    // a queued or served slot is freed when ReceivePDU()/TransmitPDU() come across it
+    ReleaseIfIdle( pConn );
+}
+
+void
+MBTCPAdapter::ReleaseIfIdle( Conn* pConn )
+{
+    if( pConn->fd < 0 && ! pConn->bQueued && pConn != m_pCurrent && pConn->uInFlight == 0 )
+        Release( pConn );
+}
+
+void
+MBTCPAdapter::Unanswered()
+{
+    if( ! m_pCurrent )
+        return;
+    // the last request was left without a reply; its connection carries on
+    Conn* pConn = m_pCurrent;
+    m_pCurrent = NULL;
+    if( pConn->fd < 0 )
+        ReleaseIfIdle( pConn );
+    else
+        QueueIfReady( pConn );
+}
+
+void
+MBTCPAdapter::Release( Conn* pConn )
+{
+    pConn->uGeneration ++;
+    pConn->pNext = m_pFree;
+    m_pFree = pConn;
+}
+
+void
+MBTCPAdapter::QueueIfReady( Conn* pConn )
+{
+    size_t nFrame = 0;
+    if( pConn->bQueued || pConn->bDeferred || pConn == m_pCurrent || pConn->fd < 0 || pConn->nTX != 0 )
+        return;
+    if( ! FrameSize( pConn, nFrame ) || nFrame == 0 )
+        return;
+    pConn->bQueued = true;
+    pConn->pNext = NULL;
+    if( m_pReadyTail )
+        m_pReadyTail->pNext = pConn;
+    else
+        m_pReadyHead = pConn;
+    m_pReadyTail = pConn;
+}
+
+bool
+MBTCPAdapter::FrameSize( Conn* pConn, size_t& rnFrame )
+{
+    rnFrame = 0;
+    if( pConn->nRX < cbMBAP - 1 )
+        return true;
+    const uint8_t* pbFrame = pConn->arrbRX;
+    size_t nLength = ( pbFrame[4] << 8 ) | pbFrame[5]; // unit identifier + PDU
+    if( pbFrame[2] != 0 || pbFrame[3] != 0 || nLength < 2 || nLength > cbTCPFrame - ( cbMBAP - 1 ) )
+        return false;
+    if( pConn->nRX >= cbMBAP - 1 + nLength )
+        rnFrame = cbMBAP - 1 + nLength;
+    return true;
+}
@@ -0,0 +1,150 @@
+#ifndef _MBTCPADAPTER_H_
+#define _MBTCPADAPTER_H_
+
+/*
+* MIT License
+*
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#include <MBusTiny.h>
+#include <atomic>
+
+const size_t cbMBAP = 7;                  //!< MBAP header: transaction, protocol, length, unit
+const size_t cbTCPFrame = cbMBAP + 253;   //!< the largest Modbus TCP frame
+
+/*! @brief class MBTCPAdapter - Modbus TCP (MBAP) server adapter on a Linux epoll loop
+*
+*   One thread serves all client connections. Each connection owns fixed receive
+*   and transmit buffers from a pool allocated once by the constructor, so serving
+*   a request allocates nothing. Connections holding a complete request frame wait
+*   in a FIFO ready queue; AvailableIn() polls the sockets only once the queue is
+*   empty, and ReceivePDU()/TransmitPDU() serve the connection at its head, with the
+*   unit identifier in place of the RTU device address:
+*
+*       MBTCPAdapter tcp( 1024 );
+*       tcp.Listen( 502 );
+*       MBT mb( &tcp, 42 );
+*       for( ;; )
+*           mb.TranscievePDU();
+*/
+class MBTCPAdapter: public IPDUAdapter
+{
+protected:
+    /*! @brief Conn - a client connection slot */
+    struct Conn
+    {
+        int      fd;                        //!< the socket, -1 when the slot is free or closed
+        uint8_t  arrbRX[2 * cbTCPFrame];    //!< received bytes, room for a pipelined request behind the current one
+        size_t   nRX;                       //!< the number of received bytes
+        size_t   nRXArmed;                  //!< where an asynchronous read the kernel holds puts its bytes
+        uint8_t  arrbTX[cbTCPFrame];        //!< the part of a reply the socket did not take at once
+        size_t   nTX;                       //!< the number of bytes pending in arrbTX
+        size_t   nTXPos;                    //!< the send position in arrbTX
+        uint16_t uTID;                      //!< the transaction identifier of the request being served
+        uint16_t uGeneration;               //!< counts the slot's reuses, so a deferred reply cannot reach a later connection
+        bool     bQueued;                   //!< the connection is in the ready queue
+        bool     bDeferred;                 //!< the request being served was set aside by Defer()
+        uint32_t uWatched;                  //!< the epoll events the socket is registered for
+        uint8_t  uInFlight;                 //!< a bit per asynchronous operation the kernel still holds on the slot
+        Conn*    pNext;                     //!< the next slot in the free list or the ready queue
+    };
+
+    int      m_fdEpoll;           //!< the epoll instance
+    int      m_fdListen;          //!< the listening socket
+    Conn*    m_pConns;            //!< the connection pool
+    size_t   m_nMaxConns;         //!< the size of the pool
+    std::atomic<size_t> m_nConns; //!< the number of open connections; changed by the serving thread, read from any
+    Conn*    m_pFree;             //!< free slots
+    Conn*    m_pReadyHead;        //!< connections holding a complete request, oldest first
+    Conn*    m_pReadyTail;
+    Conn*    m_pCurrent;          //!< the connection whose request is being served
+    int      m_nTimeoutMS;        //!< how long AvailableIn() waits for socket events
+    uint32_t m_nRejected;         //!< connections refused because the pool was full
+    uint32_t m_nBadFrames;        //!< connections dropped for malformed MBAP headers
+    uint32_t m_nBadSizes;         //!< requests answered exIllegalDataValue for a size not matching the function code
+
+public:
+    MBTCPAdapter( size_t nMaxConns );      //!< Constructor with the size of the connection pool
+    virtual ~MBTCPAdapter();
+
+    /*! @brief Listen - binds the listening socket; uPort 0 picks an ephemeral port
+    *   @param bReusePort - binds with SO_REUSEPORT, so several adapters share the port and the kernel spreads the connections
+    *   @returns      - true on success, false o.w.
+    */
+    virtual bool Listen( uint16_t uPort, const char* pszAddress = "0.0.0.0", bool bReusePort = false );
+    uint16_t Port() const;                 //!< the port listened on
+    void SetPollTimeout( int nTimeoutMS ) { m_nTimeoutMS = nTimeoutMS; } //!< 0 polls without blocking, -1 blocks
+    size_t Connections() const { return m_nConns.load( std::memory_order_relaxed ); } //!< the number of open connections, safe from any thread
+    uint32_t Rejected() const { return m_nRejected; }      //!< connections refused because the pool was full
+    uint32_t BadFrames() const { return m_nBadFrames; }    //!< connections dropped for malformed MBAP headers
+    uint32_t BadSizes() const { return m_nBadSizes; }      //!< requests refused for a size not matching the function code
+
+    virtual bool AvailableIn();  //!< overrides base class method
+    virtual bool ReceivePDU(
+                          uint8_t uSDeviceID,
+                          uint8_t* pbBuffer,
+                          size_t nBuffer,
+                          size_t& nBufferOut ); //!< overrides base class method
+    virtual bool TransmitPDU(
+                          uint8_t uSDeviceID,
+                          uint8_t* pbBuffer,
+                          size_t nBuffer); //!< overrides base class method
+    virtual bool TransmitSegments(
+                          uint8_t uSDeviceID,
+                          const MBSegment* pSegments,
+                          size_t nSegments); //!< overrides base class method, one sendmsg() with the MBAP header in front
+
+    /*! @brief Defer - sets the request just received aside, to be answered later with TransmitDeferred()
+    *
+    *   The connection is not served again until then, so its replies stay in order;
+    *   further requests it pipelines wait in its receive buffer. A gateway defers the
+    *   requests it forwards onto a slower bus and goes on receiving from the other
+    *   connections meanwhile.
+    *   @param ruTicket - receives the handle naming the request
+    *   @returns      - true on success, false if no request is being served
+    */
+    bool Defer( uint32_t& ruTicket );
+
+    /*! @brief TransmitDeferred - sends the reply to a deferred request
+    *   @returns      - true if the reply was sent or queued, false if the connection has gone meanwhile
+    */
+    bool TransmitDeferred( uint32_t uTicket, const MBSegment* pSegments, size_t nSegments );
+
+protected:
+    void Accept();                         //!< accepts all pending connections
+    Conn* Adopt( int fd );                 //!< takes an accepted socket into a free slot; NULL and the socket closed if the pool is full
+    void Read( Conn* pConn );              //!< reads what the socket has and queues the connection on a complete frame
+    void Received( Conn* pConn );          //!< checks the received bytes and queues the connection on a complete frame
+    bool Flush( Conn* pConn );             //!< sends the pending reply part; false if the connection broke
+    virtual void Close( Conn* pConn );     //!< closes the socket; the slot is freed once it is idle
+    virtual void Drained( Conn* pConn ) { Watch( pConn ); } //!< called when a request frame has been taken out of the receive buffer
+    virtual void Watch( Conn* pConn );     //!< registers the socket for the events the connection's state calls for
+    void ReleaseIfIdle( Conn* pConn );     //!< frees a closed slot that is neither queued, served nor held by the kernel
+    void Unanswered();                     //!< lets the connection of a request left without a reply carry on
+    void Release( Conn* pConn );           //!< returns the slot to the free list
+    void QueueIfReady( Conn* pConn );      //!< appends the connection to the ready queue if it holds a complete frame
+    static size_t Gather( uint8_t* pbFrame, const uint8_t* pbHeader, const MBSegment* pSegments, size_t nSegments ); //!< copies the MBAP header and the segments into one frame, returns its size
+    bool FrameSize( Conn* pConn, size_t& rnFrame ); //!< the size of the complete frame at the head of arrbRX, 0 if incomplete; false if malformed
+};
+
+#endif
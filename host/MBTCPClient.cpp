@@ -0,0 +1,285 @@
+/*
+* MIT License
+*
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "MBTCPClient.h"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+static uint64_t
+ClientNowUS()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+MBTCPClient::MBTCPClient()
+{
+    m_fd = -1;
+    m_uNextTID = 0;
+    m_nWindow = nMaxOutstanding;
+    m_uTimeoutUS = 1000000;
+    m_nStray = 0;
+    Close();
+}
+
+MBTCPClient::~MBTCPClient()
+{
+    Close();
+}
+
+bool
+MBTCPClient::Connect( const char* pszAddress, uint16_t uPort )
+{
+    Close();
+    struct sockaddr_in sa;
+    memset( &sa, 0, sizeof( sa ) );
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons( uPort );
+    if( inet_pton( AF_INET, pszAddress, &sa.sin_addr ) != 1 )
+        return false;
+
+    m_fd = socket( AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+    if( m_fd < 0 )
+        return false;
+    int nOn = 1;
+    setsockopt( m_fd, IPPROTO_TCP, TCP_NODELAY, &nOn, sizeof( nOn ) );
+    if( connect( m_fd, (struct sockaddr*)&sa, sizeof( sa ) ) < 0 )
+    {
+        Close();
+        return false;
+    }
+    // connected blocking, served non-blocking
+    fcntl( m_fd, F_SETFL, fcntl( m_fd, F_GETFL ) | O_NONBLOCK );
+    return true;
+}
+
+void
+MBTCPClient::Close()
+{
+    if( m_fd >= 0 )
+        close( m_fd );
+    m_fd = -1;
+    for( size_t cSlot = 0; cSlot < nMaxOutstanding; cSlot ++ )
+        m_arrPending[ cSlot ].bUsed = false;
+    m_nOutstanding = 0;
+    m_uNextDeadlineUS = UINT64_MAX;
+    m_nTX = 0;
+    m_nTXPos = 0;
+    m_nRX = 0;
+    m_nRXPos = 0;
+}
+
+bool
+MBTCPClient::Submit( const uint8_t* pbRequest, size_t nRequest, uint16_t& ruTID )
+{
+    if( m_fd < 0 || nRequest < 2 || nRequest > cbTCPFrame - ( cbMBAP - 1 ) || m_nOutstanding >= m_nWindow )
+        return false;
+    Pending& rPending = m_arrPending[ m_uNextTID % nMaxOutstanding ];
+    if( rPending.bUsed )
+        return false; // a request that old still waits for its response
+    if( cbClientBuffer - m_nTX < cbMBAP - 1 + nRequest && ! Flush( true ) )
+        return false;
+
+    // the MBAP header goes in front of the request, whose device address is the unit identifier
+    uint8_t* pbFrame = m_arrbTX + m_nTX;
+    pbFrame[0] = m_uNextTID >> 8;
+    pbFrame[1] = m_uNextTID & 0xFF;
+    pbFrame[2] = 0;
+    pbFrame[3] = 0;
+    pbFrame[4] = nRequest >> 8;
+    pbFrame[5] = nRequest & 0xFF;
+    memcpy( pbFrame + cbMBAP - 1, pbRequest, nRequest );
+    m_nTX += cbMBAP - 1 + nRequest;
+
+    rPending.bUsed = true;
+    rPending.uTID = m_uNextTID;
+    rPending.uDeadlineUS = ClientNowUS() + m_uTimeoutUS;
+    memcpy( rPending.arrbRequest, pbRequest, nRequest < sizeof( rPending.arrbRequest ) ? nRequest : sizeof( rPending.arrbRequest ) );
+    if( rPending.uDeadlineUS < m_uNextDeadlineUS )
+        m_uNextDeadlineUS = rPending.uDeadlineUS;
+    ruTID = m_uNextTID ++;
+    m_nOutstanding ++;
+    return true;
+}
+
+bool
+MBTCPClient::Flush( bool bWait )
+{
+    while( m_nTXPos < m_nTX )
+    {
+        ssize_t nSent = send( m_fd, m_arrbTX + m_nTXPos, m_nTX - m_nTXPos, MSG_NOSIGNAL );
+        if( nSent < 0 && errno == EINTR )
+            continue;
+        if( nSent < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+        {
+            if( ! bWait )
+                return true;
+            struct pollfd pfd = { m_fd, POLLOUT, 0 };
+            poll( &pfd, 1, -1 );
+            continue;
+        }
+        if( nSent <= 0 )
+        {
+            Close();
+            return false;
+        }
+        m_nTXPos += nSent;
+    }
+    m_nTX = 0;
+    m_nTXPos = 0;
+    return true;
+}
+
+bool
+MBTCPClient::Receive( uint16_t& ruTID, MBClient::eStatus& rStatus, MBResponse& rResp, int nTimeoutMS )
+{
+    if( m_fd < 0 || ( m_nTX && ! Flush( false ) ) )
+        return false;
+    uint64_t uEndUS = ClientNowUS() + (uint64_t)nTimeoutMS * 1000;
+    for( ;; )
+    {
+        if( TakeFrame( ruTID, rStatus, rResp ) )
+            return true;
+        if( m_fd < 0 )
+            return false;
+        uint64_t uNowUS = ClientNowUS();
+        if( uNowUS >= m_uNextDeadlineUS && TakeExpired( uNowUS, ruTID ) )
+        {
+            rStatus = MBClient::stTimeout;
+            memset( &rResp, 0, sizeof( rResp ) );
+            return true;
+        }
+        if( uNowUS >= uEndUS )
+            return false;
+
+        uint64_t uWaitUS = ( uEndUS < m_uNextDeadlineUS ? uEndUS : m_uNextDeadlineUS ) - uNowUS;
+        struct pollfd pfd = { m_fd, (short)( POLLIN | ( m_nTX ? POLLOUT : 0 ) ), 0 };
+        int nReady = poll( &pfd, 1, (int)( ( uWaitUS + 999 ) / 1000 ) );
+        if( nReady < 0 && errno != EINTR )
+        {
+            Close();
+            return false;
+        }
+        if( nReady <= 0 )
+            continue;
+        if( ( pfd.revents & POLLOUT ) && ! Flush( false ) )
+            return false;
+        if( ( pfd.revents & ( POLLIN | POLLERR | POLLHUP ) ) && ! Read() )
+            return false;
+    }
+}
+
+bool
+MBTCPClient::TakeFrame( uint16_t& ruTID, MBClient::eStatus& rStatus, MBResponse& rResp )
+{
+    while( m_nRX - m_nRXPos >= cbMBAP )
+    {
+        const uint8_t* pbFrame = m_arrbRX + m_nRXPos;
+        size_t nUnitPDU = ( pbFrame[4] << 8 ) | pbFrame[5];
+        if( pbFrame[2] != 0 || pbFrame[3] != 0 || nUnitPDU < 2 || nUnitPDU > cbTCPFrame - ( cbMBAP - 1 ) )
+        {
+            Close(); // the stream lost its framing
+            return false;
+        }
+        if( m_nRX - m_nRXPos < cbMBAP - 1 + nUnitPDU )
+            return false;
+        m_nRXPos += cbMBAP - 1 + nUnitPDU;
+
+        uint16_t uTID = ( pbFrame[0] << 8 ) | pbFrame[1];
+        Pending& rPending = m_arrPending[ uTID % nMaxOutstanding ];
+        if( ! rPending.bUsed || rPending.uTID != uTID )
+        {
+            m_nStray ++;
+            continue;
+        }
+        rPending.bUsed = false;
+        m_nOutstanding --;
+        ruTID = uTID;
+        // unit identifier, function code and data are the PDU layout the decoder takes
+        rStatus = MBClient::Decode( rPending.arrbRequest, pbFrame + cbMBAP - 1, nUnitPDU, rResp );
+        return true;
+    }
+    return false;
+}
+
+bool
+MBTCPClient::TakeExpired( uint64_t uNowUS, uint16_t& ruTID )
+{
+    // the scan also finds the next deadline, so it runs only once one has passed
+    bool bFound = false;
+    uint64_t uNextUS = UINT64_MAX;
+    for( size_t cSlot = 0; cSlot < nMaxOutstanding; cSlot ++ )
+    {
+        Pending& rPending = m_arrPending[ cSlot ];
+        if( ! rPending.bUsed )
+            continue;
+        if( ! bFound && rPending.uDeadlineUS <= uNowUS )
+        {
+            rPending.bUsed = false;
+            m_nOutstanding --;
+            ruTID = rPending.uTID;
+            bFound = true;
+        }
+        else if( rPending.uDeadlineUS < uNextUS )
+            uNextUS = rPending.uDeadlineUS;
+    }
+    m_uNextDeadlineUS = uNextUS;
+    return bFound;
+}
+
+bool
+MBTCPClient::Read()
+{
+    // the frames taken so far make room; the responses handed out before stay valid until here
+    if( m_nRXPos > 0 )
+    {
+        m_nRX -= m_nRXPos;
+        memmove( m_arrbRX, m_arrbRX + m_nRXPos, m_nRX );
+        m_nRXPos = 0;
+    }
+    for( ;; )
+    {
+        ssize_t nRead = recv( m_fd, m_arrbRX + m_nRX, cbClientBuffer - m_nRX, 0 );
+        if( nRead < 0 && errno == EINTR )
+            continue;
+        if( nRead < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+            return true;
+        if( nRead <= 0 )
+        {
+            Close();
+            return false;
+        }
+        m_nRX += nRead;
+        return true;
+    }
+}
@@ -0,0 +1,124 @@
+#ifndef _MBTCPCLIENT_H_
+#define _MBTCPCLIENT_H_
+
+/*
+* MIT License
+*
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#include <MBusTiny.h>
+#include <MBClient.h>
+#include "MBTCPAdapter.h"
+
+const size_t nMaxOutstanding = 256;          //!< the most requests an MBTCPClient keeps in flight on its connection
+const size_t cbClientBuffer = 16 * cbTCPFrame; //!< the client send and receive buffers
+
+/*! @brief class MBTCPClient - Modbus TCP (MBAP) client that pipelines requests on one connection
+*
+*   Submit() queues a request under a fresh transaction identifier without waiting for the
+*   responses before it, so requests to many units behind a gateway or to a busy server overlap;
+*   the queued requests go out together, in one send(), when Flush() or Receive() runs. The
+*   transaction identifier indexes a slot table, so a response is matched, in whatever order it
+*   comes, with one lookup, and it is decoded in place in the receive buffer:
+*
+*       MBTCPClient tcp;
+*       tcp.Connect( "10.0.0.5", 502 );
+*       for( uint8_t uUnit = 1; uUnit <= 32; uUnit ++ )
+*           tcp.Submit( arrbReq, MBClient::EncodeRead( arrbReq, uUnit, 3, 0, 10 ), uTID );
+*       while( tcp.Outstanding() && tcp.Receive( uTID, stRV, resp, 100 ) )
+*           Store( uTID, stRV, resp.Regs() );
+*/
+class MBTCPClient
+{
+protected:
+    /*! @brief Pending - a request in flight */
+    struct Pending
+    {
+        bool     bUsed;             //!< the slot holds a request in flight
+        uint16_t uTID;              //!< its transaction identifier
+        uint64_t uDeadlineUS;       //!< when it times out
+        uint8_t  arrbRequest[6];    //!< its head, which the response is checked against
+    };
+
+    int      m_fd;                          //!< the socket, -1 when not connected
+    uint16_t m_uNextTID;                    //!< the next transaction identifier
+    size_t   m_nWindow;                     //!< the most requests in flight
+    size_t   m_nOutstanding;                //!< the requests in flight
+    uint32_t m_uTimeoutUS;                  //!< how long a response may take
+    uint64_t m_uNextDeadlineUS;             //!< no request in flight times out before this
+    uint32_t m_nStray;                      //!< responses without a request in flight
+    Pending  m_arrPending[nMaxOutstanding]; //!< the requests in flight, by transaction identifier
+    uint8_t  m_arrbTX[cbClientBuffer];      //!< queued request frames
+    size_t   m_nTX;                         //!< the number of queued bytes
+    size_t   m_nTXPos;                      //!< the send position in m_arrbTX
+    uint8_t  m_arrbRX[cbClientBuffer];      //!< received response frames
+    size_t   m_nRX;                         //!< the number of received bytes
+    size_t   m_nRXPos;                      //!< the first byte not yet taken
+
+public:
+    MBTCPClient();                          //!< default constructor
+    virtual ~MBTCPClient();
+
+    /*! @brief Connect - connects to a Modbus TCP server
+    *   @returns - true on success, false o.w.
+    */
+    bool Connect( const char* pszAddress, uint16_t uPort );
+    void Close();                           //!< closes the connection; the requests in flight are forgotten
+    bool Connected() const { return m_fd >= 0; } //!< the connection is open
+    int Handle() const { return m_fd; }     //!< the socket, for an external poll loop
+
+    void SetTimeout( uint32_t uTimeoutUS ) { m_uTimeoutUS = uTimeoutUS; } //!< how long a response may take
+    void SetWindow( size_t nWindow ) { m_nWindow = nWindow < 1 ? 1 : nWindow > nMaxOutstanding ? nMaxOutstanding : nWindow; } //!< the most requests in flight
+    size_t Outstanding() const { return m_nOutstanding; }  //!< the requests in flight
+    uint32_t Stray() const { return m_nStray; }            //!< responses without a request in flight, late ones included
+
+    /*! @brief Submit - queues a request
+    *   @param pbRequest - the request, unit identifier first, as the MBClient encoders build it
+    *   @param nRequest  - the size of the request
+    *   @param ruTID     - the transaction identifier the response comes back with
+    *   @returns         - true if queued, false if the window is full or the request is malformed
+    */
+    bool Submit( const uint8_t* pbRequest, size_t nRequest, uint16_t& ruTID );
+
+    /*! @brief Flush - sends the queued requests
+    *   @param bWait - waits until all are sent, o.w. sends what the socket takes
+    *   @returns     - false if the connection broke
+    */
+    bool Flush( bool bWait = false );
+
+    /*! @brief Receive - takes the next completed transaction
+    *   @param ruTID      - its transaction identifier
+    *   @param rStatus    - its outcome, stTimeout for a request whose response did not come in time
+    *   @param rResp      - the decoded response, valid until the next Receive()
+    *   @param nTimeoutMS - how long to wait, 0 takes only what is already there
+    *   @returns          - true if a transaction completed, false on timeout or a broken connection
+    */
+    bool Receive( uint16_t& ruTID, MBClient::eStatus& rStatus, MBResponse& rResp, int nTimeoutMS );
+
+protected:
+    bool TakeFrame( uint16_t& ruTID, MBClient::eStatus& rStatus, MBResponse& rResp ); //!< decodes the next complete frame of the receive buffer
+    bool TakeExpired( uint64_t uNowUS, uint16_t& ruTID ); //!< frees the slot of a request past its deadline
+    bool Read();                                         //!< reads what the socket has; false if the connection broke
+};
+
+#endif
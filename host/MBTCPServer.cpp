@@ -0,0 +1,110 @@
+/*
+* MIT License
+*
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "MBTCPServer.h"
+#include "MBTCPUringAdapter.h"
+#include <pthread.h>
+#include <sched.h>
+
+MBTCPServer::MBTCPServer( size_t nWorkers, size_t nConnsPerWorker, DeviceFactory pfnCreate, void* pvContext, bool bUring )
+{
+    m_pWorkers = new Worker[ nWorkers ];
+    m_nWorkers = nWorkers;
+    m_bStop.store( false );
+    for( size_t cWorker = 0; cWorker < nWorkers; cWorker ++ )
+    {
+        if( bUring )
+            m_pWorkers[ cWorker ].pAdapter = new MBTCPUringAdapter( nConnsPerWorker );
+        else
+            m_pWorkers[ cWorker ].pAdapter = new MBTCPAdapter( nConnsPerWorker );
+        m_pWorkers[ cWorker ].pDevice = pfnCreate( m_pWorkers[ cWorker ].pAdapter, pvContext );
+    }
+}
+
+MBTCPServer::~MBTCPServer()
+{
+    Stop();
+    for( size_t cWorker = 0; cWorker < m_nWorkers; cWorker ++ )
+    {
+        delete m_pWorkers[ cWorker ].pDevice;
+        delete m_pWorkers[ cWorker ].pAdapter;
+    }
+    delete [] m_pWorkers;
+}
+
+bool
+MBTCPServer::Start( uint16_t uPort, const char* pszAddress )
+{
+    // the first worker resolves an ephemeral port, the others join it
+    for( size_t cWorker = 0; cWorker < m_nWorkers; cWorker ++ )
+    {
+        if( ! m_pWorkers[ cWorker ].pAdapter->Listen( uPort, pszAddress, true ) )
+            return false;
+        uPort = m_pWorkers[ cWorker ].pAdapter->Port();
+    }
+
+    size_t nCores = std::thread::hardware_concurrency();
+    if( nCores == 0 )
+        nCores = 1;
+    m_bStop.store( false );
+    for( size_t cWorker = 0; cWorker < m_nWorkers; cWorker ++ )
+        m_pWorkers[ cWorker ].thServe = std::thread( &MBTCPServer::Serve, this, m_pWorkers + cWorker, cWorker % nCores );
+    return true;
+}
+
+void
+MBTCPServer::Stop()
+{
+    m_bStop.store( true );
+    for( size_t cWorker = 0; cWorker < m_nWorkers; cWorker ++ )
+        if( m_pWorkers[ cWorker ].thServe.joinable() )
+            m_pWorkers[ cWorker ].thServe.join();
+}
+
+uint16_t
+MBTCPServer::Port() const
+{
+    return m_nWorkers ? m_pWorkers[0].pAdapter->Port() : 0;
+}
+
+size_t
+MBTCPServer::Connections() const
+{
+    size_t nConns = 0;
+    for( size_t cWorker = 0; cWorker < m_nWorkers; cWorker ++ )
+        nConns += m_pWorkers[ cWorker ].pAdapter->Connections();
+    return nConns;
+}
+
+void
+MBTCPServer::Serve( Worker* pWorker, size_t nCore )
+{
+    cpu_set_t setCPU;
+    CPU_ZERO( &setCPU );
+    CPU_SET( nCore, &setCPU );
+    pthread_setaffinity_np( pthread_self(), sizeof( setCPU ), &setCPU );
+
+    while( ! m_bStop.load( std::memory_order_relaxed ) )
+        pWorker->pDevice->TranscievePDU();
+}
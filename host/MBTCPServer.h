@@ -0,0 +1,82 @@
+#ifndef _MBTCPSERVER_H_
+#define _MBTCPSERVER_H_
+
+/*
+* MIT License
+*
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#include "MBTCPAdapter.h"
+#include <atomic>
+#include <thread>
+
+/*! @brief class MBTCPServer - a Modbus TCP server sharded over worker threads
+*
+*   Each worker owns an MBTCPAdapter listening on the same port with SO_REUSEPORT,
+*   so the kernel spreads the incoming connections, and its own device instance
+*   with its own PDU buffer; nothing is shared between the workers except what the
+*   devices share themselves, e.g. an MBSharedImage. Workers are pinned to cores
+*   round robin. With bUring the workers use MBTCPUringAdapter, which falls back to
+*   epoll by itself where io_uring is not available.
+*
+*       MBSharedImage image( 10000, 10000 );
+*       MBTCPServer server( 4, 1024, CreateSlave, &image );
+*       server.Start( 502 );
+*/
+class MBTCPServer
+{
+public:
+    /*! @brief DeviceFactory - creates the device a worker serves; called once per worker */
+    typedef MBUSTiny* (*DeviceFactory)( IPDUAdapter* pAdapter, void* pvContext );
+
+protected:
+    /*! @brief Worker - a server thread with its connections and device */
+    struct Worker
+    {
+        MBTCPAdapter*   pAdapter;
+        MBUSTiny*       pDevice;
+        std::thread     thServe;
+    };
+
+    Worker*             m_pWorkers;     //!< the workers
+    size_t              m_nWorkers;     //!< the number of workers
+    std::atomic<bool>   m_bStop;        //!< tells the workers to leave their loops
+
+public:
+    MBTCPServer( size_t nWorkers, size_t nConnsPerWorker, DeviceFactory pfnCreate, void* pvContext, bool bUring = false );
+    ~MBTCPServer();
+
+    /*! @brief Start - binds all workers to the port and starts them; uPort 0 picks an ephemeral port
+    *   @returns      - true on success, false o.w.
+    */
+    bool Start( uint16_t uPort, const char* pszAddress = "0.0.0.0" );
+    void Stop();                                    //!< stops and joins the workers
+    uint16_t Port() const;                          //!< the port listened on
+    size_t Workers() const { return m_nWorkers; }   //!< the number of workers
+    size_t Connections() const;                     //!< the open connections over all workers, safe while they run
+
+protected:
+    void Serve( Worker* pWorker, size_t nCore );    //!< the worker loop
+};
+
+#endif
@@ -0,0 +1,452 @@
+/*
+* MIT License
+*
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "MBTCPUringAdapter.h"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+// the slot operations, kept in the low bits of the completion user data; 0 is the accept
+const unsigned uOpRead  = 1;
+const unsigned uOpWrite = 2;
+const unsigned uOpMask  = 7;
+
+const unsigned nSubmitBatch = 64; // replies prepared before they are submitted without waiting for the queue to drain
+
+static unsigned
+RoundUpPow2( size_t n )
+{
+    unsigned u = 1;
+    while( u < n )
+        u <<= 1;
+    return u;
+}
+
+MBTCPUringAdapter::MBTCPUringAdapter( size_t nMaxConns )
+    : MBTCPAdapter( nMaxConns )
+{
+    m_fdRing = -1;
+    m_pvSQRing = MAP_FAILED;
+    m_pvCQRing = MAP_FAILED;
+    m_pSQEs = (io_uring_sqe*)MAP_FAILED;
+    m_nToSubmit = 0;
+    m_bFixed = false;
+    m_bMultishotAccept = true;
+    m_bExtArg = false;
+    m_bUnarmed = false;
+    m_bAcceptUnarmed = false;
+    m_nEnters = 0;
+
+    unsigned nEntries = RoundUpPow2( nMaxConns < 64 ? 64 : nMaxConns > 2048 ? 2048 : nMaxConns );
+    if( ! Setup( nEntries ) )
+        return;
+
+    // reads land straight in the connection slots
+    struct iovec iov = { m_pConns, nMaxConns * sizeof( Conn ) };
+    m_bFixed = syscall( __NR_io_uring_register, m_fdRing, IORING_REGISTER_BUFFERS, &iov, 1 ) == 0;
+}
+
+MBTCPUringAdapter::~MBTCPUringAdapter()
+{
+    if( m_pSQEs != MAP_FAILED )
+        munmap( m_pSQEs, m_nSQEntries * sizeof( io_uring_sqe ) );
+    if( m_pvCQRing != MAP_FAILED && m_pvCQRing != m_pvSQRing )
+        munmap( m_pvCQRing, m_cbCQRing );
+    if( m_pvSQRing != MAP_FAILED )
+        munmap( m_pvSQRing, m_cbSQRing );
+    if( m_fdRing >= 0 )
+        close( m_fdRing );
+}
+
+bool
+MBTCPUringAdapter::Setup( unsigned nEntries )
+{
+    struct io_uring_params params;
+    memset( &params, 0, sizeof( params ) );
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = RoundUpPow2( 2 * m_nMaxConns + nEntries );
+    int fd = syscall( __NR_io_uring_setup, nEntries, &params );
+    if( fd < 0 && errno == EINVAL )
+    {
+        // kernels before 5.19 do not know COOP_TASKRUN
+        params.flags = IORING_SETUP_CQSIZE;
+        fd = syscall( __NR_io_uring_setup, nEntries, &params );
+    }
+    if( fd < 0 )
+        return false;
+
+    m_cbSQRing = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+    m_cbCQRing = params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe );
+    if( params.features & IORING_FEAT_SINGLE_MMAP )
+    {
+        if( m_cbCQRing > m_cbSQRing )
+            m_cbSQRing = m_cbCQRing;
+        m_cbCQRing = m_cbSQRing;
+    }
+    m_pvSQRing = mmap( NULL, m_cbSQRing, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING );
+    if( m_pvSQRing == MAP_FAILED )
+    {
+        close( fd );
+        return false;
+    }
+    if( params.features & IORING_FEAT_SINGLE_MMAP )
+        m_pvCQRing = m_pvSQRing;
+    else
+        m_pvCQRing = mmap( NULL, m_cbCQRing, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING );
+    m_nSQEntries = params.sq_entries;
+    m_pSQEs = (io_uring_sqe*)mmap( NULL, m_nSQEntries * sizeof( io_uring_sqe ), PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES );
+    if( m_pvCQRing == MAP_FAILED || m_pSQEs == (io_uring_sqe*)MAP_FAILED )
+    {
+        close( fd );
+        return false;
+    }
+
+    uint8_t* pbSQ = (uint8_t*)m_pvSQRing;
+    m_puSQHead  = (unsigned*)( pbSQ + params.sq_off.head );
+    m_puSQTail  = (unsigned*)( pbSQ + params.sq_off.tail );
+    m_puSQArray = (unsigned*)( pbSQ + params.sq_off.array );
+    m_uSQMask   = *(unsigned*)( pbSQ + params.sq_off.ring_mask );
+    uint8_t* pbCQ = (uint8_t*)m_pvCQRing;
+    m_puCQHead  = (unsigned*)( pbCQ + params.cq_off.head );
+    m_puCQTail  = (unsigned*)( pbCQ + params.cq_off.tail );
+    m_uCQMask   = *(unsigned*)( pbCQ + params.cq_off.ring_mask );
+    m_pCQEs     = (io_uring_cqe*)( pbCQ + params.cq_off.cqes );
+    m_bExtArg   = params.features & IORING_FEAT_EXT_ARG;
+    m_fdRing = fd;
+    return true;
+}
+
+bool
+MBTCPUringAdapter::Listen( uint16_t uPort, const char* pszAddress, bool bReusePort )
+{
+    if( ! MBTCPAdapter::Listen( uPort, pszAddress, bReusePort ) )
+        return false;
+    if( UsingUring() )
+        ArmAccept();
+    return true;
+}
+
+bool
+MBTCPUringAdapter::AvailableIn()
+{
+    if( ! UsingUring() )
+        return MBTCPAdapter::AvailableIn();
+    Unanswered();
+    if( m_pReadyHead )
+        return true;
+
+    // the replies of the drained queue go out with the wait for the next completions
+    if( *m_puCQHead != __atomic_load_n( m_puCQTail, __ATOMIC_ACQUIRE ) )
+    {
+        if( m_nToSubmit )
+            Enter( 0, 0 );
+    }
+    else
+        Enter( 1, m_nTimeoutMS );
+    Reap();
+    if( m_bUnarmed )
+        Rearm();
+    return m_pReadyHead != NULL;
+}
+
+bool
+MBTCPUringAdapter::TransmitSegments(
+                      uint8_t uSDeviceID,
+                      const MBSegment* pSegments,
+                      size_t nSegments)
+{
+    if( ! UsingUring() )
+        return MBTCPAdapter::TransmitSegments( uSDeviceID, pSegments, nSegments );
+
+    Conn* pConn = m_pCurrent;
+    m_pCurrent = NULL;
+    if( ! pConn )
+        return false;
+    if( pConn->fd < 0 )
+    {
+        ReleaseIfIdle( pConn );
+        return false;
+    }
+    size_t nBuffer = 0;
+    for( size_t cSeg = 0; cSeg < nSegments; cSeg ++ )
+        nBuffer += pSegments[cSeg].nData;
+    if( nSegments > nMaxSegments || nBuffer > cbTCPFrame - ( cbMBAP - 1 ) )
+    {
+        QueueIfReady( pConn );
+        return false;
+    }
+
+    // the reply is kept in the slot until the kernel has sent it; the connection
+    // is not served again before that, so the replies stay in order
+    uint8_t arrbHeader[ cbMBAP - 1 ] = { (uint8_t)( pConn->uTID >> 8 ), (uint8_t)pConn->uTID, 0, 0,
+                                         (uint8_t)( nBuffer >> 8 ), (uint8_t)nBuffer };
+    pConn->nTX = Gather( pConn->arrbTX, arrbHeader, pSegments, nSegments );
+    pConn->nTXPos = 0;
+    ArmWrite( pConn );
+    if( m_nToSubmit >= nSubmitBatch )
+        Enter( 0, 0 );
+    return true;
+}
+
+void
+MBTCPUringAdapter::Close( Conn* pConn )
+{
+    // the shutdown completes the read the kernel holds, which then frees the slot
+    if( UsingUring() && pConn->fd >= 0 )
+        shutdown( pConn->fd, SHUT_RDWR );
+    MBTCPAdapter::Close( pConn );
+}
+
+void
+MBTCPUringAdapter::Drained( Conn* pConn )
+{
+    if( ! UsingUring() )
+        MBTCPAdapter::Drained( pConn );
+    else if( pConn->fd >= 0 )
+        ArmRead( pConn );
+}
+
+void
+MBTCPUringAdapter::Watch( Conn* pConn )
+{
+    // reads are armed one at a time and only with room for them, so there is nothing to turn off
+    if( ! UsingUring() )
+        MBTCPAdapter::Watch( pConn );
+}
+
+io_uring_sqe*
+MBTCPUringAdapter::NextSQE()
+{
+    unsigned uTail = *m_puSQTail;
+    if( uTail - __atomic_load_n( m_puSQHead, __ATOMIC_ACQUIRE ) >= m_nSQEntries )
+    {
+        // EBUSY or EAGAIN: the kernel takes no more before its completions are reaped
+        if( ! Enter( 0, 0 ) || uTail - __atomic_load_n( m_puSQHead, __ATOMIC_ACQUIRE ) >= m_nSQEntries )
+        {
+            m_bUnarmed = true;
+            return NULL;
+        }
+    }
+    // without SQPOLL the kernel reads the entries only in io_uring_enter, so publishing the tail first is safe
+    io_uring_sqe* pSQE = m_pSQEs + ( uTail & m_uSQMask );
+    memset( pSQE, 0, sizeof( *pSQE ) );
+    m_puSQArray[ uTail & m_uSQMask ] = uTail & m_uSQMask;
+    __atomic_store_n( m_puSQTail, uTail + 1, __ATOMIC_RELEASE );
+    m_nToSubmit ++;
+    return pSQE;
+}
+
+bool
+MBTCPUringAdapter::Enter( unsigned nWaitFor, int nTimeoutMS )
+{
+    unsigned uFlags = nWaitFor ? IORING_ENTER_GETEVENTS : 0;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    void* pvArg = NULL;
+    size_t cbArg = 0;
+    if( nWaitFor && nTimeoutMS >= 0 )
+    {
+        if( ! m_bExtArg )
+            nWaitFor = 0, uFlags = 0; // no way to bound the wait: just submit
+        else
+        {
+            ts.tv_sec = nTimeoutMS / 1000;
+            ts.tv_nsec = ( nTimeoutMS % 1000 ) * 1000000LL;
+            memset( &arg, 0, sizeof( arg ) );
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+            uFlags |= IORING_ENTER_EXT_ARG;
+            pvArg = &arg;
+            cbArg = sizeof( arg );
+        }
+    }
+    m_nEnters ++;
+    int nRV = syscall( __NR_io_uring_enter, m_fdRing, m_nToSubmit, nWaitFor, uFlags, pvArg, cbArg );
+    // a timed out or interrupted wait has still submitted; EBUSY and EAGAIN leave the entries prepared
+    if( nRV < 0 )
+        return errno == ETIME || errno == EINTR;
+    m_nToSubmit -= (unsigned)nRV < m_nToSubmit ? (unsigned)nRV : m_nToSubmit;
+    return true;
+}
+
+void
+MBTCPUringAdapter::Reap()
+{
+    unsigned uHead = *m_puCQHead;
+    for( ;; )
+    {
+        if( uHead == __atomic_load_n( m_puCQTail, __ATOMIC_ACQUIRE ) )
+            break;
+        io_uring_cqe* pCQE = m_pCQEs + ( uHead & m_uCQMask );
+        uint64_t uData = pCQE->user_data;
+        int nResult = pCQE->res;
+        unsigned uFlags = pCQE->flags;
+        __atomic_store_n( m_puCQHead, ++ uHead, __ATOMIC_RELEASE );
+
+        if( uData == 0 )
+        {
+            if( nResult >= 0 )
+            {
+                Conn* pConn = Adopt( nResult );
+                if( pConn )
+                    ArmRead( pConn );
+            }
+            else if( nResult == -EINVAL && m_bMultishotAccept )
+                m_bMultishotAccept = false; // kernels before 5.19 accept one at a time
+            if( ! ( uFlags & IORING_CQE_F_MORE ) )
+                ArmAccept();
+            continue;
+        }
+        Completed( (Conn*)(uintptr_t)( uData & ~(uint64_t)uOpMask ), uData & uOpMask, nResult, uFlags );
+    }
+}
+
+void
+MBTCPUringAdapter::Completed( Conn* pConn, unsigned uOp, int nResult, unsigned /* uFlags */ )
+{
+    pConn->uInFlight &= ~uOp;
+    if( pConn->fd < 0 )
+    {
+        ReleaseIfIdle( pConn );
+        return;
+    }
+
+    if( uOp == uOpRead )
+    {
+        if( nResult == -EINTR || nResult == -EAGAIN )
+        {
+            ArmRead( pConn );
+            return;
+        }
+        if( nResult <= 0 )
+        {
+            Close( pConn ); // orderly shutdown or error
+            return;
+        }
+        // frames taken out meanwhile moved the rest of the buffer down
+        if( pConn->nRXArmed != pConn->nRX )
+            memmove( pConn->arrbRX + pConn->nRX, pConn->arrbRX + pConn->nRXArmed, nResult );
+        pConn->nRX += nResult;
+        Received( pConn );
+        if( pConn->fd >= 0 )
+            ArmRead( pConn );
+        return;
+    }
+
+    if( nResult <= 0 )
+    {
+        Close( pConn );
+        return;
+    }
+    pConn->nTXPos += nResult;
+    if( pConn->nTXPos < pConn->nTX )
+    {
+        ArmWrite( pConn );
+        return;
+    }
+    pConn->nTX = 0;
+    pConn->nTXPos = 0;
+    QueueIfReady( pConn );
+}
+
+void
+MBTCPUringAdapter::ArmAccept()
+{
+    io_uring_sqe* pSQE = NextSQE();
+    m_bAcceptUnarmed = ! pSQE;
+    if( ! pSQE )
+        return;
+    pSQE->opcode = IORING_OP_ACCEPT;
+    pSQE->fd = m_fdListen;
+    pSQE->accept_flags = SOCK_CLOEXEC;
+    if( m_bMultishotAccept )
+        pSQE->ioprio = IORING_ACCEPT_MULTISHOT;
+    pSQE->user_data = 0;
+}
+
+void
+MBTCPUringAdapter::ArmRead( Conn* pConn )
+{
+    size_t nRoom = sizeof( pConn->arrbRX ) - pConn->nRX;
+    if( ( pConn->uInFlight & uOpRead ) || nRoom == 0 )
+        return;
+    io_uring_sqe* pSQE = NextSQE();
+    if( ! pSQE )
+        return;
+    pSQE->fd = pConn->fd;
+    pSQE->addr = (uint64_t)(uintptr_t)( pConn->arrbRX + pConn->nRX );
+    pSQE->len = nRoom;
+    pConn->nRXArmed = pConn->nRX;
+    if( m_bFixed )
+    {
+        pSQE->opcode = IORING_OP_READ_FIXED;
+        pSQE->off = (uint64_t)-1; // sockets have no file position
+        pSQE->buf_index = 0;
+    }
+    else
+        pSQE->opcode = IORING_OP_RECV;
+    pSQE->user_data = (uint64_t)(uintptr_t)pConn | uOpRead;
+    pConn->uInFlight |= uOpRead;
+}
+
+void
+MBTCPUringAdapter::ArmWrite( Conn* pConn )
+{
+    // without an entry the reply waits in the slot for Rearm(); the connection is not served meanwhile
+    io_uring_sqe* pSQE = NextSQE();
+    if( ! pSQE )
+        return;
+    // a send rather than a fixed-buffer write: only send takes MSG_NOSIGNAL, and a
+    // reply is copied into the socket buffer either way
+    pSQE->opcode = IORING_OP_SEND;
+    pSQE->fd = pConn->fd;
+    pSQE->addr = (uint64_t)(uintptr_t)( pConn->arrbTX + pConn->nTXPos );
+    pSQE->len = pConn->nTX - pConn->nTXPos;
+    pSQE->msg_flags = MSG_NOSIGNAL;
+    pSQE->user_data = (uint64_t)(uintptr_t)pConn | uOpWrite;
+    pConn->uInFlight |= uOpWrite;
+}
+
+void
+MBTCPUringAdapter::Rearm()
+{
+    m_bUnarmed = false;
+    if( m_bAcceptUnarmed )
+        ArmAccept();
+    for( size_t cConn = 0; cConn < m_nMaxConns && ! m_bUnarmed; cConn ++ )
+    {
+        Conn* pConn = m_pConns + cConn;
+        if( pConn->fd < 0 )
+            continue;
+        if( pConn->nTX != 0 && ! ( pConn->uInFlight & uOpWrite ) )
+            ArmWrite( pConn );
+        ArmRead( pConn );
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef _MBTCPURINGADAPTER_H_
+#define _MBTCPURINGADAPTER_H_
+
+/*
+* MIT License
+*
+* Copyright (c) 2021 Ivaylo Baylov, ibaylov@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#include "MBTCPAdapter.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+/*! @brief class MBTCPUringAdapter - MBTCPAdapter on io_uring instead of epoll
+*
+*   One multishot accept takes all connections. Reads land straight in the
+*   connection slots and replies go out of them; the slot pool is registered with
+*   the ring, so reads and writes use the fixed-buffer opcodes. The replies are
+*   submitted in one batch once the ready queue has been drained, together with
+*   the wait for new completions, so a busy server makes one io_uring_enter per
+*   batch rather than several syscalls per request. Each read is re-armed only
+*   when the slot has room, which keeps TCP flow control working. An operation
+*   that finds the submission ring full, because the kernel is busy until its
+*   completions are reaped, is armed again after the next reap rather than failed.
+*
+*   The ring is set up by raw system calls; if the kernel refuses it, every
+*   method falls back to the epoll implementation of the base class:
+*
+*       MBTCPUringAdapter tcp( 1024 );
+*       tcp.Listen( 502 );
+*       printf( "%s\n", tcp.UsingUring() ? "io_uring" : "epoll" );
+*/
+class MBTCPUringAdapter: public MBTCPAdapter
+{
+protected:
+    int             m_fdRing;           //!< the ring, -1 when falling back to epoll
+    void*           m_pvSQRing;         //!< the mapped submission ring
+    void*           m_pvCQRing;         //!< the mapped completion ring, may be the same mapping
+    size_t          m_cbSQRing;
+    size_t          m_cbCQRing;
+    io_uring_sqe*   m_pSQEs;            //!< the mapped submission entries
+    unsigned        m_nSQEntries;
+    unsigned*       m_puSQHead;
+    unsigned*       m_puSQTail;
+    unsigned*       m_puSQArray;
+    unsigned        m_uSQMask;
+    unsigned*       m_puCQHead;
+    unsigned*       m_puCQTail;
+    unsigned        m_uCQMask;
+    io_uring_cqe*   m_pCQEs;
+    unsigned        m_nToSubmit;        //!< entries prepared since the last io_uring_enter
+    bool            m_bFixed;           //!< the slot pool is registered with the ring
+    bool            m_bMultishotAccept; //!< the kernel keeps the accept armed
+    bool            m_bExtArg;          //!< io_uring_enter takes a timeout
+    bool            m_bUnarmed;         //!< a read or write found the submission ring full and waits for Rearm()
+    bool            m_bAcceptUnarmed;   //!< the accept found the submission ring full
+    uint32_t        m_nEnters;          //!< io_uring_enter calls made
+
+public:
+    MBTCPUringAdapter( size_t nMaxConns ); //!< Constructor with the size of the connection pool
+    virtual ~MBTCPUringAdapter();
+
+    bool UsingUring() const { return m_fdRing >= 0; } //!< false if the adapter fell back to epoll
+    uint32_t Enters() const { return m_nEnters; }      //!< io_uring_enter calls made so far
+
+    virtual bool Listen( uint16_t uPort, const char* pszAddress = "0.0.0.0", bool bReusePort = false ); //!< overrides base class method
+
+    virtual bool AvailableIn();  //!< overrides base class method
+    virtual bool TransmitSegments(
+                          uint8_t uSDeviceID,
+                          const MBSegment* pSegments,
+                          size_t nSegments); //!< overrides base class method
+
+protected:
+    virtual void Close( Conn* pConn );     //!< overrides base class method
+    virtual void Drained( Conn* pConn );   //!< overrides base class method
+    virtual void Watch( Conn* pConn );     //!< overrides base class method, the ring has no events to register
+
+    bool Setup( unsigned nEntries );       //!< creates and maps the ring
+    io_uring_sqe* NextSQE();               //!< a cleared submission entry, submitting first if the ring is full
+    bool Enter( unsigned nWaitFor, int nTimeoutMS ); //!< submits the prepared entries and optionally waits; false if the kernel took none
+    void Reap();                           //!< processes all available completions
+    void Rearm();                          //!< arms what found the submission ring full, once completions made room
+    void ArmAccept();
+    void ArmRead( Conn* pConn );
+    void ArmWrite( Conn* pConn );
+    void Completed( Conn* pConn, unsigned uOp, int nResult, unsigned uFlags ); //!< one completion of a slot operation
+};
+
+#endif
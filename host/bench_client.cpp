@@ -0,0 +1,134 @@
+/*
+* bench_client - the master side: MBRTUClient transactions replayed over the
+* loopback transport, ns per encode, transmit, receive and decode; then an
+* MBTCPClient pipelining FC3 requests to eight units of an MBMultiSlave behind
+* an MBTCPAdapter on its own thread, requests/s at growing pipeline depths.
+*
+* usage: bench_client [iterations] [tcp requests per depth]
+*/
+
+#include <MBusTiny.h>
+#include <MBClient.h>
+#include <MBRTUClient.h>
+#include <MBMultiSlave.h>
+#include "MBTCPClient.h"
+#include "LoopbackTransport.h"
+#include "BenchMeter.h"
+#include "BenchUtil.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+const size_t nUnits = 8;
+
+static double
+BenchRTU( size_t nIter, size_t& rnErrors )
+{
+    LoopbackTransport transLoop( 0 );
+    MBRTUClient rtu( &transLoop );
+
+    // the response of device 7 to FC3 x10 at 0: registers 700..709
+    uint8_t arrbResp[nPDU];
+    arrbResp[0] = 7;
+    arrbResp[1] = 3;
+    arrbResp[2] = 20;
+    for( int cReg = 0; cReg < 10; cReg ++ )
+        BenchPut16( arrbResp + 3 + 2 * cReg, 700 + cReg );
+    size_t nResp = BenchAppendCRC( arrbResp, 23 );
+
+    // the response is on the line only once the request is out, so the client's drain before sending leaves it alone
+    transLoop.Reply( arrbResp, nResp );
+
+    uint8_t arrbReq[nPDU];
+    MBResponse resp;
+    uint64_t uStart = BenchNowNS();
+    for( size_t i = 0; i < nIter; i ++ )
+    {
+        size_t nReq = MBClient::EncodeRead( arrbReq, 7, MBUSDevice::fcReadMultipleHoldingRegisters, 0, 10 );
+        if( rtu.Transact( arrbReq, nReq, resp ) != MBClient::stOK || resp.Regs()[9] != 709 )
+            rnErrors ++;
+    }
+    return (double)( BenchNowNS() - uStart ) / nIter;
+}
+
+static double
+BenchTCP( uint16_t uPort, size_t nDepth, size_t nRequests, size_t& rnErrors )
+{
+    MBTCPClient tcp;
+    if( ! tcp.Connect( "127.0.0.1", uPort ) )
+    {
+        rnErrors ++;
+        return 0;
+    }
+    tcp.SetWindow( nDepth );
+
+    uint8_t arrbReq[nPDU];
+    size_t nSent = 0;
+    size_t nDone = 0;
+    uint16_t uTID;
+    MBClient::eStatus stRV;
+    MBResponse resp;
+    uint64_t uStart = BenchNowNS();
+    while( nDone < nRequests )
+    {
+        // the window refills in one burst, sent with one send() by Receive()
+        while( nSent < nRequests && tcp.Outstanding() < nDepth )
+        {
+            uint8_t uUnit = 1 + nSent % nUnits;
+            size_t nReq = MBClient::EncodeRead( arrbReq, uUnit, MBUSDevice::fcReadMultipleHoldingRegisters, 0, 10 );
+            if( ! tcp.Submit( arrbReq, nReq, uTID ) )
+                break;
+            nSent ++;
+        }
+        if( ! tcp.Receive( uTID, stRV, resp, 1000 ) )
+        {
+            rnErrors += nRequests - nDone;
+            break;
+        }
+        nDone ++;
+        if( stRV != MBClient::stOK || resp.Regs()[0] != resp.uDeviceID * 100 )
+            rnErrors ++;
+    }
+    return nDone * 1e9 / ( BenchNowNS() - uStart );
+}
+
+int
+main( int argc, char** argv )
+{
+    size_t nIter = argc > 1 ? strtoul( argv[1], NULL, 0 ) : 1000000;
+    size_t nRequests = argc > 2 ? strtoul( argv[2], NULL, 0 ) : 100000;
+
+    size_t nErrors = 0;
+    double dRTUNS = BenchRTU( nIter, nErrors );
+    printf( "RTU FC3 x10 over loopback: %.1f ns per transaction, %zu errors\n", dRTUNS, nErrors );
+
+    MBTCPAdapter tcpServer( 16 );
+    if( ! tcpServer.Listen( 0, "127.0.0.1" ) )
+    {
+        printf( "listen failed\n" );
+        return 1;
+    }
+    MBMultiSlave multi( &tcpServer );
+    std::vector< BenchMeter< MBUSDevice > > vecMeters( nUnits );
+    for( size_t cUnit = 0; cUnit < nUnits; cUnit ++ )
+    {
+        vecMeters[ cUnit ].Init( cUnit + 1 );
+        multi.Attach( cUnit + 1, &vecMeters[ cUnit ] );
+    }
+    std::atomic<bool> bStop( false );
+    std::thread thServer( [&]{ while( ! bStop.load( std::memory_order_relaxed ) ) multi.TranscievePDU(); } );
+
+    static const size_t arrnDepths[] = { 1, 4, 16, 64, 256 };
+    for( size_t cDepth = 0; cDepth < sizeof( arrnDepths ) / sizeof( arrnDepths[0] ); cDepth ++ )
+    {
+        size_t nTCPErrors = 0;
+        double dRate = BenchTCP( tcpServer.Port(), arrnDepths[ cDepth ], nRequests, nTCPErrors );
+        printf( "TCP FC3 x10 to %zu units, %3zu in flight: %9.0f req/s, %zu errors\n",
+                nUnits, arrnDepths[ cDepth ], dRate, nTCPErrors );
+        nErrors += nTCPErrors;
+    }
+
+    bStop = true;
+    thServer.join();
+    return nErrors != 0;
+}
@@ -0,0 +1,105 @@
+/*
+* bench_crc - compares the CRC16 engines on frame sizes from 8 to 256 bytes.
+*
+* usage: bench_crc [iterations]
+*/
+
+#include <CrcFsm.h>
+#include "BenchUtil.h"
+
+typedef uint16_t (*CRCEngine)( const uint8_t*, size_t );
+
+struct BenchEngine
+{
+    const char* pszName;
+    CRCEngine   pfnCRC;
+};
+
+static const BenchEngine g_arrEngines[] =
+{
+    { "fsm",    CRC16Fsm },
+    { "table",  CRC16Table },
+    { "slice4", CRC16Slice4 },
+    { "slice8", CRC16Slice8 },
+    { "nibble", CRC16Nibble },
+    { "clmul",  CRC16Clmul },
+};
+
+static const size_t g_arrnSizes[] = { 8, 16, 32, 48, 64, 100, 128, 200, 256 };
+
+int
+main( int argc, char** argv )
+{
+    size_t nIter = argc > 1 ? strtoul( argv[1], NULL, 0 ) : 1000000;
+
+    uint8_t arrbFrame[256];
+    for( size_t i = 0; i < sizeof( arrbFrame ); i ++ )
+        arrbFrame[i] = (uint8_t)( i * 131 + 7 );
+
+    printf( "%-8s", "bytes" );
+    for( const BenchEngine& be : g_arrEngines )
+        printf( " %10s", be.pszName );
+    printf( "   (ns/frame)\n" );
+
+    for( size_t nSize : g_arrnSizes )
+    {
+        uint16_t uRef = CRC16Fsm( arrbFrame, nSize );
+        printf( "%-8zu", nSize );
+        for( const BenchEngine& be : g_arrEngines )
+        {
+            if( be.pfnCRC( arrbFrame, nSize ) != uRef )
+            {
+                printf( "\n%s: CRC mismatch at %zu bytes\n", be.pszName, nSize );
+                return 1;
+            }
+            volatile uint16_t uSink = 0;
+            uint64_t uStart = BenchNowNS();
+            for( size_t i = 0; i < nIter; i ++ )
+            {
+                arrbFrame[0] = (uint8_t)i;
+                uSink = uSink ^ be.pfnCRC( arrbFrame, nSize );
+            }
+            uint64_t uNS = BenchNowNS() - uStart;
+            arrbFrame[0] = 7;
+            printf( " %10.1f", (double)uNS / nIter );
+        }
+        printf( "\n" );
+    }
+
+    // batch validation of a mixed receive batch: mostly 8 byte requests, some long writes
+    const size_t nBatch = 64;
+    static uint8_t arrbBatch[ nBatch ][ 256 ];
+    const uint8_t* arrpbBatch[ nBatch ];
+    size_t arrnBatch[ nBatch ];
+    size_t cbBatch = 0;
+    for( size_t i = 0; i < nBatch; i ++ )
+    {
+        arrnBatch[i] = ( i % 8 == 7 ) ? 255 : 8;
+        for( size_t j = 0; j < arrnBatch[i] - 2; j ++ )
+            arrbBatch[i][j] = (uint8_t)( i * 7 + j );
+        BenchAppendCRC( arrbBatch[i], arrnBatch[i] - 2 );
+        arrpbBatch[i] = arrbBatch[i];
+        cbBatch += arrnBatch[i];
+    }
+    if( CRC16CheckBatch( arrpbBatch, arrnBatch, nBatch, NULL ) != nBatch )
+    {
+        printf( "batch: validation failed\n" );
+        return 1;
+    }
+    size_t nBatchIter = nIter / nBatch + 1;
+    uint64_t uStart = BenchNowNS();
+    volatile size_t nSink = 0;
+    for( size_t i = 0; i < nBatchIter; i ++ )
+        nSink = nSink + CRC16CheckBatch( arrpbBatch, arrnBatch, nBatch, NULL );
+    uint64_t uBatchNS = BenchNowNS() - uStart;
+    uStart = BenchNowNS();
+    for( size_t i = 0; i < nBatchIter; i ++ )
+        for( size_t j = 0; j < nBatch; j ++ )
+            nSink = nSink + ( CRC16Slice8( arrpbBatch[j], arrnBatch[j] ) == 0 );
+    uint64_t uLoopNS = BenchNowNS() - uStart;
+    printf( "\nbatch of %zu frames, %zu bytes: CRC16CheckBatch %.1f ns/frame, CRC16Slice8 loop %.1f ns/frame\n",
+            nBatch, cbBatch,
+            (double)uBatchNS / ( nBatchIter * nBatch ),
+            (double)uLoopNS / ( nBatchIter * nBatch ) );
+    return 0;
+}
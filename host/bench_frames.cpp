@@ -0,0 +1,149 @@
+/*
+* bench_frames - MBFrameCache on a master's repeated FC3 x125 poll over the
+* loopback RTU transport: ns per TranscievePDU without the cache and with it,
+* when nothing changes between polls, when two registers change and when all of
+* them do, and with TrackChanges() when the application reports no change. Every
+* response is checked for its CRC and values in a run of its own. The library is
+* built with one CRC engine, so the CRC work alone follows for each engine: a full
+* pass over the response against CRC16Patch() for the two changed registers.
+*
+* usage: bench_frames [iterations]
+*/
+
+#include <MBusTiny.h>
+#include <MBRTUAdapter.h>
+#include <MBFrameCache.h>
+#include <CrcFsm.h>
+#include "LoopbackTransport.h"
+#include "BenchSlave.h"
+#include "BenchUtil.h"
+
+const uint16_t uBase = 1000;    // served by the range callbacks from m_arruBlock
+const uint16_t uCount = 125;
+
+enum eChange { chNone, chTwo, chAll };
+
+static void
+Change( BenchSlave& rSlave, MBFrameCache* pFrames, eChange chPattern, size_t nPoll )
+{
+    if( chPattern == chTwo )
+    {
+        rSlave.m_arruBlock[5] = (uint16_t)nPoll;
+        rSlave.m_arruBlock[90] = (uint16_t)( nPoll * 7 );
+    }
+    else if( chPattern == chAll )
+        for( uint16_t cReg = 0; cReg < uCount; cReg ++ )
+            rSlave.m_arruBlock[ cReg ] = (uint16_t)( nPoll + cReg );
+    if( pFrames && chPattern != chNone )
+        pFrames->Changed();
+}
+
+static bool
+Check( const LoopbackTransport& rLoop, const BenchSlave& rSlave )
+{
+    const uint8_t* pbTX = rLoop.TXFrame();
+    if( rLoop.TXSize() != 3 + 2 * uCount + 2 || CRC16( pbTX, rLoop.TXSize() ) != 0 )
+        return false;
+    for( uint16_t cReg = 0; cReg < uCount; cReg ++ )
+        if( ( ( pbTX[ 3 + 2 * cReg ] << 8 ) | pbTX[ 4 + 2 * cReg ] ) != rSlave.m_arruBlock[ cReg ] )
+            return false;
+    return true;
+}
+
+static double
+Run( const char* pszName, bool bCache, bool bTrack, eChange chPattern, size_t nIter, size_t& rnErrors )
+{
+    LoopbackTransport transLoop( 0 );
+    MBRTUAdapter rtu( &transLoop );
+    BenchSlave mb( &rtu, 42 );
+    for( uint16_t cReg = 0; cReg < uCount; cReg ++ )
+        mb.m_arruBlock[ cReg ] = 0x1000 + cReg;
+    MBFrameEntry arrFrames[2];
+    MBFrameCache frames( arrFrames, 2 );
+    frames.TrackChanges( bTrack );
+    if( bCache )
+        mb.SetFrameCache( &frames );
+
+    uint8_t arrbFrame[ nPDU + 2 ];
+    transLoop.Load( arrbFrame, BenchRequest( arrbFrame, 42, MBUSDevice::fcReadMultipleHoldingRegisters, uBase, uCount ) );
+
+    size_t nErrors = 0;
+    for( size_t cPoll = 0; cPoll < 10000; cPoll ++ )
+    {
+        Change( mb, bCache ? &frames : NULL, chPattern, cPoll );
+        transLoop.Rewind();
+        if( ! mb.TranscievePDU() || ! Check( transLoop, mb ) )
+            nErrors ++;
+    }
+
+    uint64_t uStart = BenchNowNS();
+    for( size_t cPoll = 0; cPoll < nIter; cPoll ++ )
+    {
+        Change( mb, bCache ? &frames : NULL, chPattern, cPoll );
+        transLoop.Rewind();
+        mb.TranscievePDU();
+    }
+    double dNS = (double)( BenchNowNS() - uStart ) / nIter;
+    printf( "%-34s %8.1f ns/poll   unchanged %8u  patched %8u  built %8u  bypassed %8u  %zu errors\n",
+            pszName, dNS, frames.Unchanged(), frames.Patched(), frames.Built(), frames.Bypassed(), nErrors );
+    rnErrors += nErrors;
+    return dNS;
+}
+
+int
+main( int argc, char** argv )
+{
+    size_t nIter = argc > 1 ? strtoul( argv[1], NULL, 0 ) : 1000000;
+    size_t nErrors = 0;
+    printf( "FC3 x%u, CRC engine %d\n", uCount, MB_CRC_ENGINE );
+    Run( "no change, no cache", false, false, chNone, nIter, nErrors );
+    Run( "no change, cache", true, false, chNone, nIter, nErrors );
+    Run( "no change, cache, tracked", true, true, chNone, nIter, nErrors );
+    Run( "2 registers change, no cache", false, false, chTwo, nIter, nErrors );
+    Run( "2 registers change, cache", true, false, chTwo, nIter, nErrors );
+    Run( "2 registers change, cache, tracked", true, true, chTwo, nIter, nErrors );
+    Run( "all change, no cache", false, false, chAll, nIter, nErrors );
+    Run( "all change, cache", true, false, chAll, nIter, nErrors );
+    Run( "all change, cache, tracked", true, true, chAll, nIter, nErrors );
+
+    uint8_t arrbOld[ nPDU ];
+    uint8_t arrbNew[ nPDU ];
+    size_t nResponse = 3 + 2 * uCount;
+    for( size_t cByte = 0; cByte < nResponse; cByte ++ )
+        arrbOld[ cByte ] = arrbNew[ cByte ] = (uint8_t)( cByte * 7 );
+    static const struct { const char* pszName; uint16_t (*pfnCRC)( const uint8_t*, size_t ); } arrEngines[] =
+    {
+        { "fsm", CRC16Fsm }, { "nibble", CRC16Nibble }, { "table", CRC16Table },
+        { "slice4", CRC16Slice4 }, { "slice8", CRC16Slice8 }, { "clmul", CRC16Clmul }
+    };
+    size_t nCRCIter = nIter / 10;
+    volatile uint16_t uSink = 0;
+    for( size_t cEngine = 0; cEngine < sizeof( arrEngines ) / sizeof( arrEngines[0] ); cEngine ++ )
+    {
+        uint64_t uStart = BenchNowNS();
+        for( size_t cPoll = 0; cPoll < nCRCIter; cPoll ++ )
+        {
+            arrbNew[ 3 + 2 * 5 ] = (uint8_t)cPoll;
+            uSink = uSink + arrEngines[ cEngine ].pfnCRC( arrbNew, nResponse );
+        }
+        printf( "full pass, %-6s %8.1f ns\n", arrEngines[ cEngine ].pszName, (double)( BenchNowNS() - uStart ) / nCRCIter );
+    }
+    uint64_t uStart = BenchNowNS();
+    uint16_t uCRC = CRC16( arrbOld, nResponse );
+    for( size_t cPoll = 0; cPoll < nCRCIter; cPoll ++ )
+    {
+        arrbNew[ 3 + 2 * 5 ] = (uint8_t)cPoll;
+        arrbNew[ 3 + 2 * 90 ] = (uint8_t)( cPoll * 7 );
+        uCRC = CRC16Patch( uCRC, arrbOld + 3 + 2 * 5, arrbNew + 3 + 2 * 5, 2, nResponse - 3 - 2 * 6 );
+        uCRC = CRC16Patch( uCRC, arrbOld + 3 + 2 * 90, arrbNew + 3 + 2 * 90, 2, nResponse - 3 - 2 * 91 );
+        memcpy( arrbOld + 3 + 2 * 5, arrbNew + 3 + 2 * 5, 2 );
+        memcpy( arrbOld + 3 + 2 * 90, arrbNew + 3 + 2 * 90, 2 );
+    }
+    printf( "CRC16Patch, 2 registers %6.1f ns\n", (double)( BenchNowNS() - uStart ) / nCRCIter );
+    if( uCRC != CRC16( arrbNew, nResponse ) )
+    {
+        printf( "CRC16Patch differs from a full pass\n" );
+        nErrors ++;
+    }
+    return nErrors != 0;
+}
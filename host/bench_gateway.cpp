@@ -0,0 +1,170 @@
+/*
+* bench_gateway - MBGateway in front of a simulated RTU bus at 9600 bps: eight
+* HMI clients poll the same block of one slave, a ninth client writes a register
+* of it every 100 ms and a tenth polls a slave that is not on the bus. Each run
+* prints the TCP requests answered and the bus transactions they took, with
+* identical reads merging and without, the latency of the reads and of the writes
+* the priority queue puts ahead of them, and checks that the missing slave is
+* reported with exGWTargetUnresponsive. The last run polls input registers through
+* an MBResponseCache with a one second time to live, which every write clears.
+*
+* usage: bench_gateway [seconds per run] [baud]
+*/
+
+#include <MBusTiny.h>
+#include <MBClient.h>
+#include <MBRTUClient.h>
+#include "MBGateway.h"
+#include "MBTCPClient.h"
+#include "BenchBus.h"
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+const size_t nReaders = 8;
+const uint8_t uReadUnit = 1;
+const uint8_t uMissingUnit = 9;
+const uint16_t uReadAddress = 100;
+const uint16_t uReadCount = 10;
+
+/*! @brief what one client saw */
+struct ClientStats
+{
+    size_t   nDone;
+    size_t   nErrors;
+    uint64_t uLatencyNS;
+};
+
+static bool
+Check( const uint8_t* pbReq, MBClient::eStatus stRV, const MBResponse& resp )
+{
+    if( pbReq[0] == uMissingUnit )
+        return stRV == MBClient::stException && resp.exRV == MBUSDevice::exGWTargetUnresponsive;
+    if( stRV != MBClient::stOK )
+        return false;
+    if( pbReq[1] != MBUSDevice::fcReadMultipleHoldingRegisters && pbReq[1] != MBUSDevice::fcReadInputRegisters )
+        return true;
+    for( uint16_t cReg = 0; cReg < uReadCount; cReg ++ )
+        if( resp.Regs()[ cReg ] != SimDevice::Expected( pbReq[0], pbReq[1], uReadAddress + cReg ) )
+            return false;
+    return true;
+}
+
+static void
+RunClient( uint16_t uPort, const uint8_t* pbReq, size_t nReq, uint32_t uPauseUS, std::atomic<bool>& rbStop, ClientStats& rStats )
+{
+    MBTCPClient tcp;
+    memset( &rStats, 0, sizeof( rStats ) );
+    if( ! tcp.Connect( "127.0.0.1", uPort ) )
+    {
+        rStats.nErrors ++;
+        return;
+    }
+    tcp.SetTimeout( 5000000 );
+    uint16_t uTID;
+    MBClient::eStatus stRV;
+    MBResponse resp;
+    while( ! rbStop.load( std::memory_order_relaxed ) )
+    {
+        uint64_t uStart = BenchNowNS();
+        if( ! tcp.Submit( pbReq, nReq, uTID ) || ! tcp.Receive( uTID, stRV, resp, 5000 ) )
+        {
+            rStats.nErrors ++;
+            return;
+        }
+        rStats.uLatencyNS += BenchNowNS() - uStart;
+        rStats.nDone ++;
+        if( ! Check( pbReq, stRV, resp ) )
+            rStats.nErrors ++;
+        if( uPauseUS )
+            usleep( uPauseUS );
+    }
+}
+
+static size_t
+RunGateway( bool bMerge, uint8_t uReadFC, uint32_t uTTLUS, uint16_t uCharUS, double dSeconds )
+{
+    SimBusTransport bus( uCharUS );
+    SimDevice device;
+    device.m_uDeviceID = uReadUnit;
+    bus.Attach( uReadUnit, &device );
+    MBRTUClient rtu( &bus );
+    rtu.SetTimeout( 50000 );
+
+    MBTCPAdapter tcpServer( 16 );
+    if( ! tcpServer.Listen( 0, "127.0.0.1" ) )
+    {
+        printf( "listen failed\n" );
+        return 1;
+    }
+    MBGateway gateway( &tcpServer, &rtu, 16 );
+    gateway.SetMerge( bMerge );
+    MBResponseCache cache( 64, 4 );
+    if( uTTLUS )
+    {
+        cache.AddMapping( uReadUnit, uReadFC, 0, 1000, uTTLUS );
+        gateway.SetCache( &cache );
+    }
+    std::atomic<bool> bStopGateway( false );
+    std::thread thGateway( [&]{ while( ! bStopGateway.load( std::memory_order_relaxed ) ) gateway.Service(); } );
+
+    uint8_t arrbRead[nPDU];
+    uint8_t arrbWrite[nPDU];
+    uint8_t arrbMissing[nPDU];
+    size_t nRead = MBClient::EncodeRead( arrbRead, uReadUnit, uReadFC, uReadAddress, uReadCount );
+    size_t nWrite = MBClient::EncodeWriteRegister( arrbWrite, uReadUnit, 5, 1234 );
+    size_t nMissing = MBClient::EncodeRead( arrbMissing, uMissingUnit, MBUSDevice::fcReadMultipleHoldingRegisters, uReadAddress, uReadCount );
+
+    std::atomic<bool> bStop( false );
+    ClientStats arrStats[ nReaders + 2 ];
+    std::vector< std::thread > vecClients;
+    for( size_t cClient = 0; cClient < nReaders; cClient ++ )
+        vecClients.push_back( std::thread( RunClient, tcpServer.Port(), arrbRead, nRead, 0, std::ref( bStop ), std::ref( arrStats[ cClient ] ) ) );
+    vecClients.push_back( std::thread( RunClient, tcpServer.Port(), arrbWrite, nWrite, 100000, std::ref( bStop ), std::ref( arrStats[ nReaders ] ) ) );
+    vecClients.push_back( std::thread( RunClient, tcpServer.Port(), arrbMissing, nMissing, 0, std::ref( bStop ), std::ref( arrStats[ nReaders + 1 ] ) ) );
+
+    usleep( (useconds_t)( dSeconds * 1e6 ) );
+    bStop = true;
+    for( size_t cClient = 0; cClient < vecClients.size(); cClient ++ )
+        vecClients[ cClient ].join();
+    bStopGateway = true;
+    thGateway.join();
+
+    ClientStats statReads;
+    memset( &statReads, 0, sizeof( statReads ) );
+    size_t nErrors = 0;
+    for( size_t cClient = 0; cClient < nReaders + 2; cClient ++ )
+    {
+        if( cClient < nReaders )
+        {
+            statReads.nDone += arrStats[ cClient ].nDone;
+            statReads.uLatencyNS += arrStats[ cClient ].uLatencyNS;
+        }
+        nErrors += arrStats[ cClient ].nErrors;
+    }
+    const ClientStats& rWrites = arrStats[ nReaders ];
+    const ClientStats& rMissing = arrStats[ nReaders + 1 ];
+    printf( "FC%u, merge %-3s, cache %-3s: %7.1f reads/s to %zu clients, %5.1f bus transactions/s, %u merged, %u hits, %u misses\n",
+            uReadFC, bMerge ? "on" : "off", uTTLUS ? "on" : "off", statReads.nDone / dSeconds, nReaders,
+            rtu.Transactions() / dSeconds, gateway.Merged(), cache.Hits(), cache.Misses() );
+    printf( "           read latency %6.1f ms, write latency %6.1f ms (%zu writes), %zu gateway exceptions for the missing slave\n",
+            statReads.nDone ? statReads.uLatencyNS / 1e6 / statReads.nDone : 0.0,
+            rWrites.nDone ? rWrites.uLatencyNS / 1e6 / rWrites.nDone : 0.0, rWrites.nDone, rMissing.nDone );
+    printf( "           %zu errors, %u busy, %u dropped\n", nErrors, gateway.Busy(), gateway.Dropped() );
+    return nErrors + ( rMissing.nDone == 0 );
+}
+
+int
+main( int argc, char** argv )
+{
+    double dSeconds = argc > 1 ? atof( argv[1] ) : 3;
+    uint32_t uBaud = argc > 2 ? strtoul( argv[2], NULL, 0 ) : 9600;
+    uint16_t uCharUS = ( 11 * 1000000UL + uBaud / 2 ) / uBaud;
+    printf( "%zu readers of x%u registers at %u bps, CharUS %u\n", nReaders, uReadCount, uBaud, uCharUS );
+
+    size_t nErrors = RunGateway( false, MBUSDevice::fcReadMultipleHoldingRegisters, 0, uCharUS, dSeconds );
+    nErrors += RunGateway( true, MBUSDevice::fcReadMultipleHoldingRegisters, 0, uCharUS, dSeconds );
+    nErrors += RunGateway( true, MBUSDevice::fcReadInputRegisters, 1000000, uCharUS, dSeconds );
+    return nErrors != 0;
+}
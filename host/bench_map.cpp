@@ -0,0 +1,87 @@
+/*
+* bench_map - the macro register map against the compile-time MBUSTinyMap:
+* ns and cycles per TranscievePDU for the same requests on the same map.
+*
+* usage: bench_map [iterations]
+*/
+
+#include <MBusTiny.h>
+#include <MBRTUAdapter.h>
+#include "LoopbackTransport.h"
+#include "BenchUtil.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLES() __rdtsc()
+#else
+#define BENCH_CYCLES() 0
+#endif
+
+MBUSTiny* CreateMacroDev( IPDUAdapter* pAdapter, uint8_t uDevID );
+MBUSTiny* CreateTemplateDev( IPDUAdapter* pAdapter, uint8_t uDevID );
+
+struct BenchCase
+{
+    const char* pszName;
+    uint8_t     uFC;
+    uint16_t    uAddress;
+    uint16_t    uCount;
+};
+
+static const BenchCase g_arrCases[] =
+{
+    { "FC1  coils x16",              1,    0,  16 },
+    { "FC2  inputs x16",             2,    0,  16 },
+    { "FC3  holding regs x32",       3,    0,  32 },
+    { "FC4  input regs x32",         4,    0,  32 },
+    { "FC4  input regs x125 sparse", 4,    0, 125 },
+    { "FC3  holding var x1",         3,  100,   1 },
+    { "FC3  holding range x125",     3, 1000, 125 },
+    { "FC4  input array x125",       4, 3000, 125 },
+    { "FC5  write single coil",      5,   12,   1 },
+};
+
+int
+main( int argc, char** argv )
+{
+    size_t nIter = argc > 1 ? strtoul( argv[1], NULL, 0 ) : 200000;
+
+    LoopbackTransport transLoop( 0 );
+    MBRTUAdapter rtu( &transLoop );
+    MBUSTiny* arrpDev[2] = { CreateMacroDev( &rtu, 42 ), CreateTemplateDev( &rtu, 42 ) };
+
+    printf( "%-30s %10s %10s %10s %10s\n", "case", "macro ns", "map ns", "macro cyc", "map cyc" );
+    for( const BenchCase& bc : g_arrCases )
+    {
+        uint8_t arrbFrame[ nPDU + 2 ];
+        size_t nFrame = BenchRequest( arrbFrame, 42, bc.uFC, bc.uAddress, bc.uCount );
+        transLoop.Load( arrbFrame, nFrame );
+
+        uint8_t arrbReply[2][ nPDU + 2 ];
+        double arrdNS[2], arrdCycles[2];
+        for( int cDev = 0; cDev < 2; cDev ++ )
+        {
+            transLoop.Rewind();
+            arrpDev[ cDev ]->TranscievePDU();
+            memcpy( arrbReply[ cDev ], transLoop.TXFrame(), transLoop.TXSize() );
+
+            uint64_t uStart = BenchNowNS();
+            uint64_t uCycles = BENCH_CYCLES();
+            for( size_t i = 0; i < nIter; i ++ )
+            {
+                transLoop.Rewind();
+                arrpDev[ cDev ]->TranscievePDU();
+            }
+            arrdCycles[ cDev ] = (double)( BENCH_CYCLES() - uCycles ) / nIter;
+            arrdNS[ cDev ] = (double)( BenchNowNS() - uStart ) / nIter;
+        }
+        bool bSame = memcmp( arrbReply[0], arrbReply[1], transLoop.TXSize() ) == 0;
+        printf( "%-30s %10.1f %10.1f %10.0f %10.0f%s\n",
+                bc.pszName, arrdNS[0], arrdNS[1], arrdCycles[0], arrdCycles[1],
+                bSame ? "" : "  REPLY MISMATCH" );
+        if( ! bSame )
+            return 1;
+    }
+    delete arrpDev[0];
+    delete arrpDev[1];
+    return 0;
+}
@@ -0,0 +1,76 @@
+/*
+* bench_multi - MBMultiSlave hosting many devices on one RTU adapter against a
+* single MBUSTiny with the same register map: ns per TranscievePDU for requests
+* addressed round robin to all hosted devices, and the RAM each device takes.
+*
+* usage: bench_multi [devices] [iterations]
+*/
+
+#include <MBusTiny.h>
+#include <MBusMap.h>
+#include <MBMultiSlave.h>
+#include <MBRTUAdapter.h>
+#include "LoopbackTransport.h"
+#include "BenchMeter.h"
+#include "BenchUtil.h"
+#include <vector>
+
+int
+main( int argc, char** argv )
+{
+    size_t nDevices = argc > 1 ? strtoul( argv[1], NULL, 0 ) : 200;
+    size_t nIter = argc > 2 ? strtoul( argv[2], NULL, 0 ) : 1000000;
+    if( nDevices < 1 || nDevices > 247 )
+        nDevices = 200;
+
+    LoopbackTransport transLoop( 0 );
+    MBRTUAdapter rtu( &transLoop );
+
+    std::vector< BenchMeter< MBUSDevice > > vecMeters( nDevices );
+    MBMultiSlave multi( &rtu );
+    for( size_t cDev = 0; cDev < nDevices; cDev ++ )
+    {
+        vecMeters[ cDev ].Init( cDev + 1 );
+        multi.Attach( cDev + 1, &vecMeters[ cDev ] );
+    }
+    BenchMeter< MBUSTiny > single( &rtu, 1 );
+
+    // one request per device, replayed round robin
+    std::vector< uint8_t > vecFrames( nDevices * ( nPDU + 2 ) );
+    std::vector< size_t > vecSizes( nDevices );
+    for( size_t cDev = 0; cDev < nDevices; cDev ++ )
+        vecSizes[ cDev ] = BenchRequest( &vecFrames[ cDev * ( nPDU + 2 ) ], cDev + 1, 3, 0, 10 );
+
+    size_t nErrors = 0;
+    for( size_t cDev = 0; cDev < nDevices; cDev ++ )
+    {
+        transLoop.Load( &vecFrames[ cDev * ( nPDU + 2 ) ], vecSizes[ cDev ] );
+        multi.TranscievePDU();
+        const uint8_t* pbReply = transLoop.TXFrame();
+        nErrors += transLoop.TXSize() != 25 || pbReply[0] != cDev + 1 || (size_t)( ( pbReply[3] << 8 ) | pbReply[4] ) != ( cDev + 1 ) * 100;
+    }
+
+    uint64_t uStart = BenchNowNS();
+    for( size_t i = 0; i < nIter; i ++ )
+    {
+        size_t cDev = i % nDevices;
+        transLoop.Load( &vecFrames[ cDev * ( nPDU + 2 ) ], vecSizes[ cDev ] );
+        multi.TranscievePDU();
+    }
+    double dMultiNS = (double)( BenchNowNS() - uStart ) / nIter;
+
+    uStart = BenchNowNS();
+    for( size_t i = 0; i < nIter; i ++ )
+    {
+        transLoop.Load( &vecFrames[0], vecSizes[0] );
+        single.TranscievePDU();
+    }
+    double dSingleNS = (double)( BenchNowNS() - uStart ) / nIter;
+
+    printf( "FC3 x10 round robin over %zu devices: MBMultiSlave %.1f ns/req, one MBUSTiny %.1f ns/req\n",
+            nDevices, dMultiNS, dSingleNS );
+    printf( "RAM: MBMultiSlave %zu bytes + %zu bytes per device; an MBUSTiny per device would take %zu bytes each\n",
+            sizeof( multi ), sizeof( BenchMeter< MBUSDevice > ), sizeof( BenchMeter< MBUSTiny > ) );
+    printf( "unhosted requests %u, reply errors %zu\n", multi.Unhosted(), nErrors );
+    return nErrors != 0;
+}
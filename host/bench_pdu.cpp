@@ -0,0 +1,110 @@
+/*
+* bench_pdu - end-to-end MBUSTiny::TranscievePDU throughput over a loopback
+* RTU transport, one row per supported function code.
+*
+* usage: bench_pdu [iterations] [charUS]
+*/
+
+#include <MBusTiny.h>
+#include <MBRTUAdapter.h>
+#include "LoopbackTransport.h"
+#include "BenchSlave.h"
+#include "BenchUtil.h"
+
+struct BenchCase
+{
+    const char* pszName;
+    uint8_t     uFC;
+    uint16_t    uAddress;
+    uint16_t    uCount;
+};
+
+static const BenchCase g_arrCases[] =
+{
+    { "FC1  read coils x256",           1,  0, 256 },
+    { "FC2  read inputs x256",          2,  0, 256 },
+    { "FC1  read coil bytes x2000",     1, 5000, 2000 },
+    { "FC2  read input mask x2000",     2, 4000, 2000 },
+    { "FC2  read input word x32",       2, 200, 32 },
+    { "FC3  read holding regs x125",    3,  0, 125 },
+    { "FC4  read input regs x125",      4,  0, 125 },
+    { "FC3  read holding range x125",   3, 1000, 125 },
+    { "FC4  read input range x125",     4, 1000, 125 },
+    { "FC3  read holding array x125",   3, 3000, 125 },
+    { "FC4  read input array x125",     4, 3000, 125 },
+    { "FC5  write single coil",         5,  3,   1 },
+    { "FC6  write single holding reg",  6,  3, 0x1234 },
+    { "FC15 write coils x64",          15,  0,  64 },
+    { "FC15 write coil bytes x1968",   15, 5000, 1968 },
+    { "FC16 write holding regs x123",  16,  0, 123 },
+    { "FC16 write holding range x123", 16, 1000, 123 },
+    { "FC16 write holding array x123", 16, 3000, 123 },
+    { "FC23 write+read array x121",    23, 3000, 121 },
+};
+
+int
+main( int argc, char** argv )
+{
+    size_t nIter = argc > 1 ? strtoul( argv[1], NULL, 0 ) : 200000;
+    uint16_t uCharUS = argc > 2 ? strtoul( argv[2], NULL, 0 ) : 0;
+
+    LoopbackTransport transLoop( uCharUS );
+    MBRTUAdapter rtu( &transLoop );
+    BenchSlave mb( &rtu, 42 );
+
+    printf( "%-32s %12s %10s %10s %6s\n", "case", "req/s", "ns/req", "allocs/req", "resp" );
+    for( const BenchCase& bc : g_arrCases )
+    {
+        uint8_t arrbFrame[ nPDU + 2 ];
+        size_t nFrame = BenchRequest( arrbFrame, 42, bc.uFC, bc.uAddress, bc.uCount );
+        transLoop.Load( arrbFrame, nFrame );
+
+        // warm up and sanity check the reply
+        if( ! mb.TranscievePDU() || CRC16Fsm( transLoop.TXFrame(), transLoop.TXSize() ) != 0 )
+        {
+            printf( "%-32s failed\n", bc.pszName );
+            return 1;
+        }
+        bool bException = transLoop.TXFrame()[1] & 0x80;
+
+        size_t nAllocs = g_nBenchAllocs;
+        uint64_t uStart = BenchNowNS();
+        for( size_t i = 0; i < nIter; i ++ )
+        {
+            transLoop.Rewind();
+            mb.TranscievePDU();
+        }
+        uint64_t uNS = BenchNowNS() - uStart;
+        nAllocs = g_nBenchAllocs - nAllocs;
+
+        printf( "%-32s %12.0f %10.1f %10.3f %4zu%s\n",
+                bc.pszName,
+                nIter * 1e9 / uNS,
+                (double)uNS / nIter,
+                (double)nAllocs / nIter,
+                transLoop.TXSize(),
+                bException ? " ex" : "" );
+    }
+
+    // frames for another device on a shared segment: full receive vs. early address rejection
+    uint8_t arrbForeign[ nPDU + 2 ];
+    size_t nForeign = BenchRequest( arrbForeign, 17, 16, 0, 123 );
+    transLoop.Load( arrbForeign, nForeign );
+    for( int nEarly = 0; nEarly < 2; nEarly ++ )
+    {
+        rtu.SetEarlyReject( nEarly );
+        uint64_t uStart = BenchNowNS();
+        for( size_t i = 0; i < nIter; i ++ )
+        {
+            transLoop.Rewind();
+            mb.TranscievePDU();
+        }
+        uint64_t uNS = BenchNowNS() - uStart;
+        printf( "%-32s %12.0f %10.1f\n",
+                nEarly ? "foreign FC16 x123, early reject" : "foreign FC16 x123, full frame",
+                nIter * 1e9 / uNS,
+                (double)uNS / nIter );
+    }
+    printf( "foreign frames skipped: %u, bytes: %u\n", rtu.ForeignFrames(), rtu.ForeignBytes() );
+    return 0;
+}
@@ -0,0 +1,140 @@
+/*
+* bench_poll - MBPollScheduler on a simulated RTU bus: four slaves with a few
+* hundred scattered points, polled at 500 ms and 5 s through MBRTUClient. The
+* bus transport paces the response bytes at the line speed and answers after a
+* t3.6 turnaround, as MBRTUAdapter does. For each gap fill threshold it prints
+* the requests the points merged into, the bus time the schedule needs and the
+* utilization achieved, and checks every value read. Then a fifth slave drops
+* off the bus: the schedule runs with a fixed timeout and with MBSlaveTimeouts.
+*
+* usage: bench_poll [seconds per run, at least the 5 s period] [baud]
+*/
+
+#include <MBusTiny.h>
+#include <MBClient.h>
+#include <MBRTUClient.h>
+#include <MBPollScheduler.h>
+#include <MBSlaveTimeouts.h>
+#include "BenchBus.h"
+#include <vector>
+
+const size_t nSlaves = 4;
+
+static void
+MakePoints( std::vector< MBPollPoint >& rvecPoints, size_t nDevices )
+{
+    // clusters of addresses a few apart, as device register maps group their values
+    static const struct { uint8_t uTable; size_t nPoints; uint16_t uSpread; } arrTables[] =
+    {
+        { 3, 80, 1000 }, { 4, 24, 300 }, { 1, 40, 2000 }, { 2, 40, 4000 }
+    };
+    uint32_t uSeed = 12345;
+    for( uint8_t uDev = 1; uDev <= nDevices; uDev ++ )
+        for( size_t cTable = 0; cTable < sizeof( arrTables ) / sizeof( arrTables[0] ); cTable ++ )
+        {
+            uint16_t uAddress = 0;
+            for( size_t cPoint = 0; cPoint < arrTables[ cTable ].nPoints; cPoint ++ )
+            {
+                uSeed = uSeed * 1103515245 + 12345;
+                uint32_t uRand = uSeed >> 16;
+                uAddress = uRand % 8 == 0 ? uRand % arrTables[ cTable ].uSpread : uAddress + 1 + uRand % 4;
+                MBPollPoint point;
+                memset( &point, 0, sizeof( point ) );
+                point.uDeviceID = uDev;
+                point.uTable = arrTables[ cTable ].uTable;
+                point.uAddress = uAddress;
+                point.uPeriodUS = uRand % 4 == 0 ? 500000 : 5000000;
+                point.uTag = rvecPoints.size();
+                rvecPoints.push_back( point );
+            }
+        }
+}
+
+/// \brief RunSchedule - polls for dSeconds and prints the outcome
+/// \return the values of the slaves on the bus not read right
+static size_t
+RunSchedule( const char* pszLabel, MBRTUClient& rRTU, std::vector< MBPollPoint >& rvecPoints, size_t nGapBytes, double dSeconds )
+{
+    std::vector< MBPollBlock > vecBlocks( rvecPoints.size() );
+    MBPollScheduler poll( &rRTU, &vecBlocks[0], vecBlocks.size() );
+    poll.SetGapFill( nGapBytes );
+    if( ! poll.Build( &rvecPoints[0], rvecPoints.size() ) )
+    {
+        printf( "build failed\n" );
+        return 1;
+    }
+    poll.ResetStats();
+    uint32_t nTimeouts = rRTU.Timeouts();
+    uint64_t uEnd = BenchNowNS() + (uint64_t)( dSeconds * 1e9 );
+    while( BenchNowNS() < uEnd )
+        poll.Poll();
+
+    size_t nWrong = 0;
+    for( size_t cPoint = 0; cPoint < rvecPoints.size(); cPoint ++ )
+    {
+        const MBPollPoint& rPoint = rvecPoints[ cPoint ];
+        if( rPoint.uDeviceID > nSlaves )
+            continue; // nobody answers there
+        nWrong += rPoint.stLast != MBClient::stOK ||
+                  rPoint.uValue != SimDevice::Expected( rPoint.uDeviceID, rPoint.uTable, rPoint.uAddress );
+    }
+    printf( "%s: %3zu requests, schedule needs %5.1f%% of the bus; achieved: busy %5.1f%%, wire %5.1f%%, "
+            "%u polls, %u overruns, %u timeouts, %u skipped, %zu values not read right\n",
+            pszLabel, poll.Blocks(), poll.DemandUS() / 1e4,
+            100.0 * poll.BusyUS() / poll.ElapsedUS(), 100.0 * poll.WireUS() / poll.ElapsedUS(),
+            poll.Polls(), poll.Overruns(), rRTU.Timeouts() - nTimeouts, poll.Skipped(), nWrong );
+    return nWrong;
+}
+
+int
+main( int argc, char** argv )
+{
+    double dSeconds = argc > 1 ? atof( argv[1] ) : 6;
+    uint32_t uBaud = argc > 2 ? strtoul( argv[2], NULL, 0 ) : 115200;
+    uint16_t uCharUS = ( 11 * 1000000UL + uBaud / 2 ) / uBaud;
+
+    SimBusTransport bus( uCharUS );
+    std::vector< SimDevice > vecSlaves( nSlaves );
+    for( size_t cSlave = 0; cSlave < nSlaves; cSlave ++ )
+    {
+        vecSlaves[ cSlave ].m_uDeviceID = cSlave + 1;
+        bus.Attach( cSlave + 1, &vecSlaves[ cSlave ] );
+    }
+    MBRTUClient rtu( &bus );
+    rtu.SetTimeout( 50000 );
+
+    std::vector< MBPollPoint > vecPoints;
+    MakePoints( vecPoints, nSlaves );
+    uint64_t uUnmergedUS = 0;
+    for( size_t cPoint = 0; cPoint < vecPoints.size(); cPoint ++ )
+        uUnmergedUS += (uint64_t)MBPollScheduler::WireUS( vecPoints[ cPoint ].uTable, 1, uCharUS ) * 1000000 / vecPoints[ cPoint ].uPeriodUS;
+    printf( "%zu points on %zu slaves at %u bps, CharUS %u; one request per point needs %.1f%% of the bus\n",
+            vecPoints.size(), nSlaves, uBaud, uCharUS, uUnmergedUS / 1e4 );
+
+    static const size_t arrnGaps[] = { 0, 20, 64 };
+    size_t nErrors = 0;
+    char szLabel[64];
+    for( size_t cGap = 0; cGap < sizeof( arrnGaps ) / sizeof( arrnGaps[0] ); cGap ++ )
+    {
+        uint32_t nTimeouts = rtu.Timeouts();
+        snprintf( szLabel, sizeof( szLabel ), "gap fill %2zu bytes", arrnGaps[ cGap ] );
+        nErrors += RunSchedule( szLabel, rtu, vecPoints, arrnGaps[ cGap ], dSeconds ) + rtu.Timeouts() - nTimeouts;
+    }
+
+    // one more slave in the point list, but not on the bus
+    std::vector< MBPollPoint > vecDead;
+    MakePoints( vecDead, nSlaves + 1 );
+    printf( "slave %zu drops off the bus; %zu points:\n", nSlaves + 1, vecDead.size() );
+    RunSchedule( "fixed 50 ms timeout", rtu, vecDead, 20, dSeconds ); // falls behind: the stale values are the point
+
+    MBSlaveTimeouts timeouts( 50000 );
+    timeouts.SetFloor( MBRTUAdapter::FrameGapUS( uCharUS ) );
+    timeouts.SetBackoff( 500000, 8000000 );
+    rtu.SetTimeouts( &timeouts );
+    nErrors += RunSchedule( "adaptive timeouts ", rtu, vecDead, 20, dSeconds );
+    const MBRTTEstimator& rLive = timeouts.Slave( 1 );
+    printf( "slave 1: response delay %u us, deviation %u us, timeout %u us; slave %zu: %u timeouts in a row\n",
+            rLive.SmoothedUS(), rLive.DeviationUS(), timeouts.TimeoutUS( 1 ),
+            nSlaves + 1, timeouts.Slave( nSlaves + 1 ).Failures() );
+    return nErrors != 0;
+}
@@ -0,0 +1,94 @@
+/*
+* bench_ring - stress test of MBRingTransport: a producer thread pushes a
+* pseudo-random byte stream as fast as the ring takes it, single bytes as an
+* ISR would and blocks as a DMA handler would, while the consumer drains it in
+* random chunk sizes and checks every byte against the same sequence.
+*
+* usage: bench_ring [megabytes]
+*/
+
+#include <MBusTiny.h>
+#include <MBRingTransport.h>
+#include "LoopbackTransport.h"
+#include "BenchUtil.h"
+#include <atomic>
+#include <thread>
+
+static inline uint32_t
+BenchNext( uint32_t& ruState )
+{
+    ruState = ruState * 1664525UL + 1013904223UL;
+    return ruState >> 24;
+}
+
+int
+main( int argc, char** argv )
+{
+    size_t nBytes = ( argc > 1 ? strtoul( argv[1], NULL, 0 ) : 256 ) << 20;
+
+    LoopbackTransport loop( 10000 ); // a long character time: the consumer may wait for a descheduled producer
+    static MBRingTransport< 1024 > ring( &loop );
+    std::atomic<size_t> nSpinsFull( 0 );
+
+    uint64_t uStart = BenchNowNS();
+    std::thread thProducer( [&]{
+        uint32_t uSeq = 1, uSize = 7;
+        uint8_t arrbBlock[ 64 ];
+        size_t nSpins = 0;
+        for( size_t nSent = 0; nSent < nBytes; )
+        {
+            // every other burst as single bytes, the others as blocks of up to 64 bytes
+            size_t nBurst = 1 + BenchNext( uSize ) % 64;
+            if( nBurst > nBytes - nSent )
+                nBurst = nBytes - nSent;
+            while( ring.Free() < nBurst )
+            {
+                nSpins ++;
+                std::this_thread::yield();
+            }
+            if( nBurst & 1 )
+                for( size_t c = 0; c < nBurst; c ++ )
+                    ring.Push( (uint8_t)BenchNext( uSeq ) );
+            else
+            {
+                for( size_t c = 0; c < nBurst; c ++ )
+                    arrbBlock[ c ] = (uint8_t)BenchNext( uSeq );
+                ring.PushBuffer( arrbBlock, nBurst );
+            }
+            nSent += nBurst;
+        }
+        nSpinsFull = nSpins;
+    } );
+
+    uint32_t uSeq = 1, uSize = 3;
+    uint8_t arrbChunk[ 256 ];
+    size_t nErrors = 0, nReceived = 0, nSpinsEmpty = 0;
+    while( nReceived < nBytes )
+    {
+        size_t nChunk = 1 + BenchNext( uSize ) % 256;
+        if( nChunk > nBytes - nReceived )
+            nChunk = nBytes - nReceived;
+        if( ring.Pending() < nChunk )
+        {
+            nSpinsEmpty ++;
+            std::this_thread::yield();
+            continue;
+        }
+        if( ! ring.ReceiveBuffer( arrbChunk, nChunk ) )
+        {
+            nErrors ++;
+            break;
+        }
+        for( size_t c = 0; c < nChunk; c ++ )
+            nErrors += arrbChunk[ c ] != (uint8_t)BenchNext( uSeq );
+        nReceived += nChunk;
+    }
+    thProducer.join();
+    uint64_t uNS = BenchNowNS() - uStart;
+
+    printf( "%zu MB through a 1 KB ring in %.2f s: %.0f MB/s, %.2f ns/byte\n",
+            nReceived >> 20, uNS / 1e9, nReceived * 1e3 / uNS, (double)uNS / nReceived );
+    printf( "producer waits %zu, consumer waits %zu, dropped %u, mismatches %zu\n",
+            nSpinsFull.load(), nSpinsEmpty, ring.Dropped(), nErrors );
+    return nErrors != 0 || ring.Dropped() != 0;
+}
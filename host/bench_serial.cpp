@@ -0,0 +1,150 @@
+/*
+* bench_serial - MBSerialTransport over a pseudo-terminal pair: the slave side
+* runs MBRTUAdapter with the BenchSlave map on its own thread, the master side
+* sends RTU requests one at a time and checks every reply's CRC, function code
+* and size. A pty moves the bytes without pacing them, so the latency is the
+* adapter's t3.6 turnaround plus the system call and wakeup costs.
+*
+* usage: bench_serial [requests] [baud]
+*/
+
+#include <MBusTiny.h>
+#include "MBSerialTransport.h"
+#include "BenchSlave.h"
+#include "BenchUtil.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+struct BenchSerialCase
+{
+    uint8_t  uFC;
+    uint16_t uAddress;
+    uint16_t uCount;
+};
+
+static const BenchSerialCase g_arrCases[] =
+{
+    {  3,    0,  10 },
+    {  3, 3000, 125 },
+    { 16,    0,  10 },
+    {  1,    0, 256 },
+};
+
+/// \brief ReadReply - reads one reply frame from the pty master
+/// \return the frame size, 0 on timeout
+static size_t
+ReadReply( int fdMaster, uint8_t* pbFrame, size_t nFrame )
+{
+    size_t nRX = 0, nWant = 3;
+    while( nRX < nWant )
+    {
+        struct pollfd pfd;
+        pfd.fd = fdMaster;
+        pfd.events = POLLIN;
+        if( poll( &pfd, 1, 1000 ) <= 0 )
+            return 0;
+        ssize_t nRead = read( fdMaster, pbFrame + nRX, nFrame - nRX );
+        if( nRead <= 0 )
+            return 0;
+        nRX += nRead;
+        if( nRX >= 3 )
+        {
+            uint8_t uFC = pbFrame[1];
+            if( uFC & 0x80 )
+                nWant = 5;
+            else if( uFC <= 4 || uFC == 23 )
+                nWant = 5 + pbFrame[2];
+            else
+                nWant = 8;
+        }
+    }
+    return nRX;
+}
+
+int
+main( int argc, char** argv )
+{
+    size_t nRequests = argc > 1 ? strtoul( argv[1], NULL, 0 ) : 20000;
+    uint32_t uBaud = argc > 2 ? strtoul( argv[2], NULL, 0 ) : 115200;
+
+    int fdMaster = posix_openpt( O_RDWR | O_NOCTTY );
+    if( fdMaster < 0 || grantpt( fdMaster ) < 0 || unlockpt( fdMaster ) < 0 )
+    {
+        perror( "posix_openpt" );
+        return 1;
+    }
+    // the master has a line discipline of its own, which must not wait for line ends either
+    struct termios tio;
+    tcgetattr( fdMaster, &tio );
+    cfmakeraw( &tio );
+    tcsetattr( fdMaster, TCSANOW, &tio );
+    MBSerialTransport serial;
+    if( ! serial.Open( ptsname( fdMaster ), uBaud ) )
+    {
+        perror( "open" );
+        return 1;
+    }
+    MBRTUAdapter rtu( &serial );
+    BenchSlave mb( &rtu, 42 );
+    std::atomic<bool> bStop( false );
+    std::thread thServer( [&]{ while( ! bStop.load( std::memory_order_relaxed ) ) mb.TranscievePDU(); } );
+
+    const size_t nCases = sizeof( g_arrCases ) / sizeof( g_arrCases[0] );
+    uint8_t arrarrbReq[ nCases ][ nPDU + 2 ];
+    size_t arrnReq[ nCases ];
+    for( size_t cCase = 0; cCase < nCases; cCase ++ )
+        arrnReq[ cCase ] = BenchRequest( arrarrbReq[ cCase ], 42, g_arrCases[ cCase ].uFC,
+                                         g_arrCases[ cCase ].uAddress, g_arrCases[ cCase ].uCount );
+
+    std::vector<uint32_t> vecLatNS;
+    vecLatNS.reserve( nRequests );
+    size_t nErrors = 0;
+    uint8_t arrbReply[ nPDU + 2 ];
+    uint64_t uStart = BenchNowNS();
+    for( size_t cReq = 0; cReq < nRequests; cReq ++ )
+    {
+        size_t cCase = cReq % nCases;
+        uint64_t uSent = BenchNowNS();
+        if( write( fdMaster, arrarrbReq[ cCase ], arrnReq[ cCase ] ) != (ssize_t)arrnReq[ cCase ] )
+        {
+            perror( "write" );
+            break;
+        }
+        size_t nReply = ReadReply( fdMaster, arrbReply, sizeof( arrbReply ) );
+        uint64_t uDone = BenchNowNS();
+        if( nReply == 0 || CRC16Fsm( arrbReply, nReply ) != 0 || arrbReply[0] != 42 || arrbReply[1] != g_arrCases[ cCase ].uFC )
+        {
+            nErrors ++;
+            usleep( 10000 ); // a late reply must not be taken for the next one
+            tcflush( fdMaster, TCIFLUSH );
+            continue;
+        }
+        vecLatNS.push_back( (uint32_t)std::min<uint64_t>( uDone - uSent, 0xFFFFFFFFU ) );
+    }
+    uint64_t uNS = BenchNowNS() - uStart;
+
+    bStop = true;
+    thServer.join();
+
+    std::sort( vecLatNS.begin(), vecLatNS.end() );
+    size_t nDone = vecLatNS.size();
+    printf( "pty at %u bps, CharUS %u, turnaround t3.6 %.1f us, low latency %s\n",
+            uBaud, serial.CharUS(), 3.6 * serial.CharUS(), serial.LowLatency() ? "on" : "not supported" );
+    printf( "%zu requests in %.2f s, %.0f req/s\n", nDone, uNS / 1e9, nDone * 1e9 / uNS );
+    if( nDone )
+        printf( "round trip us: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+                vecLatNS[ nDone / 2 ] / 1e3,
+                vecLatNS[ nDone * 90 / 100 ] / 1e3,
+                vecLatNS[ nDone * 99 / 100 ] / 1e3,
+                vecLatNS[ nDone - 1 ] / 1e3 );
+    printf( "read() calls per request %.2f, receive timeouts %u, errors %zu\n",
+            nDone ? (double)serial.Reads() / nDone : 0.0, serial.Timeouts(), nErrors );
+    close( fdMaster );
+    return nErrors != 0;
+}
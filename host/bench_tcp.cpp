@@ -0,0 +1,223 @@
+/*
+* bench_tcp - open-loop load generator for MBTCPAdapter: the server runs the
+* BenchSlave map on its own thread, the clients send FC3 requests from many
+* localhost connections at a fixed aggregate rate and report latency percentiles.
+* Latency is taken from each request's scheduled send time, so a stalled server
+* shows up in the tail instead of slowing the generator down.
+*
+* usage: bench_tcp [connections] [requests/s] [seconds] [epoll|uring]
+*/
+
+#include <MBusTiny.h>
+#include "MBTCPUringAdapter.h"
+#include "BenchSlave.h"
+#include "BenchUtil.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+
+const size_t nBacklog = 64;   // requests a busy connection may owe before it counts drops
+
+struct BenchConn
+{
+    int      fd;
+    bool     bBusy;                     // a request is in flight
+    uint64_t uSentSched;                // the scheduled time of the request in flight
+    uint64_t arruOwed[ nBacklog ];      // scheduled times of requests waiting for the one in flight
+    size_t   nOwedHead;
+    size_t   nOwed;
+    uint8_t  arrbRX[ cbTCPFrame ];
+    size_t   nRX;
+    uint16_t uTID;
+};
+
+static const uint8_t g_arrbRequest[] = { 0, 0, 0, 0, 0, 6, 42, 3, 0, 0, 0, 10 }; // FC3, 10 holding registers at 0
+
+static bool
+SendRequest( BenchConn& bc, uint64_t uSched )
+{
+    uint8_t arrbReq[ sizeof( g_arrbRequest ) ];
+    memcpy( arrbReq, g_arrbRequest, sizeof( arrbReq ) );
+    bc.uTID ++;
+    BenchPut16( arrbReq, bc.uTID );
+    if( send( bc.fd, arrbReq, sizeof( arrbReq ), MSG_NOSIGNAL ) != (ssize_t)sizeof( arrbReq ) )
+        return false;
+    bc.bBusy = true;
+    bc.uSentSched = uSched;
+    return true;
+}
+
+static int
+ConnectLocal( uint16_t uPort )
+{
+    int fd = socket( AF_INET, SOCK_STREAM, 0 );
+    struct sockaddr_in sa;
+    memset( &sa, 0, sizeof( sa ) );
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons( uPort );
+    sa.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    if( connect( fd, (struct sockaddr*)&sa, sizeof( sa ) ) < 0 )
+    {
+        close( fd );
+        return -1;
+    }
+    int nOn = 1;
+    setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &nOn, sizeof( nOn ) );
+    return fd;
+}
+
+static void
+ArmTimer( int fdTimer, uint64_t uAtNS )
+{
+    struct itimerspec its;
+    memset( &its, 0, sizeof( its ) );
+    its.it_value.tv_sec = uAtNS / 1000000000ULL;
+    its.it_value.tv_nsec = uAtNS % 1000000000ULL;
+    timerfd_settime( fdTimer, TFD_TIMER_ABSTIME, &its, NULL );
+}
+
+int
+main( int argc, char** argv )
+{
+    size_t nConns = argc > 1 ? strtoul( argv[1], NULL, 0 ) : 1000;
+    double dRate = argc > 2 ? strtod( argv[2], NULL ) : 10000;
+    double dSeconds = argc > 3 ? strtod( argv[3], NULL ) : 3;
+    bool bUring = argc > 4 && strcmp( argv[4], "uring" ) == 0;
+
+    MBTCPAdapter* pTCP = bUring ? new MBTCPUringAdapter( nConns + 16 ) : new MBTCPAdapter( nConns + 16 );
+    MBTCPAdapter& tcp = *pTCP;
+    if( ! tcp.Listen( 0, "127.0.0.1" ) )
+    {
+        perror( "listen" );
+        return 1;
+    }
+    if( bUring && ! ( (MBTCPUringAdapter*)pTCP )->UsingUring() )
+        printf( "io_uring is not available, running on epoll\n" );
+    BenchSlave mb( &tcp, 42 );
+    std::atomic<bool> bStop( false );
+    std::thread thServer( [&]{ while( ! bStop.load( std::memory_order_relaxed ) ) mb.TranscievePDU(); } );
+
+    std::vector<BenchConn> vecConns( nConns );
+    int fdEpoll = epoll_create1( 0 );
+    for( size_t cConn = 0; cConn < nConns; cConn ++ )
+    {
+        BenchConn& bc = vecConns[ cConn ];
+        memset( &bc, 0, sizeof( bc ) );
+        bc.fd = ConnectLocal( tcp.Port() );
+        if( bc.fd < 0 )
+        {
+            perror( "connect" );
+            return 1;
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = cConn;
+        epoll_ctl( fdEpoll, EPOLL_CTL_ADD, bc.fd, &ev );
+    }
+    int fdTimer = timerfd_create( CLOCK_MONOTONIC, 0 );
+    struct epoll_event evTimer;
+    evTimer.events = EPOLLIN;
+    evTimer.data.u64 = nConns;
+    epoll_ctl( fdEpoll, EPOLL_CTL_ADD, fdTimer, &evTimer );
+
+    size_t nPlanned = (size_t)( dRate * dSeconds );
+    std::vector<uint32_t> vecLatNS;
+    vecLatNS.reserve( nPlanned );
+    double dIntervalNS = 1e9 / dRate;
+
+    size_t nAllocs = g_nBenchAllocs;
+    uint64_t uStart = BenchNowNS() + 10000000; // let the connections settle
+    size_t nScheduled = 0, nDropped = 0, nErrors = 0;
+    uint64_t uDrainEnd = uStart + (uint64_t)( dSeconds * 1e9 ) + 1000000000ULL;
+    ArmTimer( fdTimer, uStart );
+
+    struct epoll_event arrEv[ 64 ];
+    while( vecLatNS.size() + nDropped + nErrors < nPlanned && BenchNowNS() < uDrainEnd )
+    {
+        int nEv = epoll_wait( fdEpoll, arrEv, 64, 100 );
+        uint64_t uNow = BenchNowNS();
+        for( int cEv = 0; cEv < nEv; cEv ++ )
+        {
+            size_t cConn = arrEv[ cEv ].data.u64;
+            if( cConn == nConns )
+            {
+                uint64_t uExp;
+                if( read( fdTimer, &uExp, sizeof( uExp ) ) < 0 )
+                    continue;
+                // every request due by now goes out, round robin over the connections
+                for( ; nScheduled < nPlanned; nScheduled ++ )
+                {
+                    uint64_t uSched = uStart + (uint64_t)( nScheduled * dIntervalNS );
+                    if( uSched > uNow )
+                        break;
+                    BenchConn& bc = vecConns[ nScheduled % nConns ];
+                    if( ! bc.bBusy )
+                        nErrors += ! SendRequest( bc, uSched );
+                    else if( bc.nOwed < nBacklog )
+                        bc.arruOwed[ ( bc.nOwedHead + bc.nOwed ++ ) % nBacklog ] = uSched;
+                    else
+                        nDropped ++;
+                }
+                if( nScheduled < nPlanned )
+                    ArmTimer( fdTimer, uStart + (uint64_t)( nScheduled * dIntervalNS ) );
+                continue;
+            }
+
+            BenchConn& bc = vecConns[ cConn ];
+            ssize_t nRead = recv( bc.fd, bc.arrbRX + bc.nRX, sizeof( bc.arrbRX ) - bc.nRX, 0 );
+            if( nRead <= 0 )
+            {
+                fprintf( stderr, "connection %zu closed\n", cConn );
+                return 1;
+            }
+            bc.nRX += nRead;
+            size_t nFrame = bc.nRX >= 6 ? 6 + ( ( bc.arrbRX[4] << 8 ) | bc.arrbRX[5] ) : 0;
+            if( nFrame == 0 || bc.nRX < nFrame )
+                continue;
+            if( bc.arrbRX[7] != 3 || ( ( bc.arrbRX[0] << 8 ) | bc.arrbRX[1] ) != bc.uTID )
+                nErrors ++;
+            else
+                vecLatNS.push_back( (uint32_t)std::min<uint64_t>( uNow - bc.uSentSched, 0xFFFFFFFFU ) );
+            bc.nRX -= nFrame;
+            memmove( bc.arrbRX, bc.arrbRX + nFrame, bc.nRX );
+            bc.bBusy = false;
+            if( bc.nOwed > 0 )
+            {
+                uint64_t uSched = bc.arruOwed[ bc.nOwedHead ];
+                bc.nOwedHead = ( bc.nOwedHead + 1 ) % nBacklog;
+                bc.nOwed --;
+                nErrors += ! SendRequest( bc, uSched );
+            }
+        }
+    }
+    uint64_t uNS = BenchNowNS() - uStart;
+    nAllocs = g_nBenchAllocs - nAllocs;
+
+    bStop = true;
+    thServer.join();
+
+    std::sort( vecLatNS.begin(), vecLatNS.end() );
+    size_t nDone = vecLatNS.size();
+    printf( "%s, connections %zu, offered %.0f req/s, achieved %.0f req/s over %.2f s\n",
+            bUring ? "io_uring" : "epoll", nConns, dRate, nDone * 1e9 / uNS, uNS / 1e9 );
+    if( nDone )
+        printf( "latency us: p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+                vecLatNS[ nDone / 2 ] / 1e3,
+                vecLatNS[ nDone * 90 / 100 ] / 1e3,
+                vecLatNS[ nDone * 99 / 100 ] / 1e3,
+                vecLatNS[ nDone * 999 / 1000 ] / 1e3,
+                vecLatNS[ nDone - 1 ] / 1e3 );
+    printf( "completed %zu, dropped %zu, errors %zu, server connections %zu, allocations during the run %zu\n",
+            nDone, nDropped, nErrors, tcp.Connections(), nAllocs );
+    delete pTCP;
+    return nErrors != 0;
+}
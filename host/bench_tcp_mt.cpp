@@ -0,0 +1,206 @@
+/*
+* bench_tcp_mt - closed-loop Modbus TCP throughput of MBTCPServer with 1, 2, 4 ...
+* worker threads over one MBSharedImage. Client threads keep a fixed number of
+* pipelined requests in flight on each of their connections; one request in ten
+* is an FC16 write, the rest are FC3 reads. Both the epoll and the io_uring
+* adapter are measured; the server CPU time per request shows the syscall savings.
+*
+* usage: bench_tcp_mt [max workers] [client threads] [connections per client thread] [depth] [seconds] [epoll|uring|both]
+*/
+
+#include "MBTCPServer.h"
+#include "MBTCPUringAdapter.h"
+#include "MBSharedImage.h"
+#include "BenchUtil.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+static std::atomic<double> g_dClientCPUNS( 0 ); // CPU time the client threads used
+
+static double
+CPUTimeNS( clockid_t idClock )
+{
+    struct timespec ts;
+    clock_gettime( idClock, &ts );
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double
+ProcessCPUNS()
+{
+    return CPUTimeNS( CLOCK_PROCESS_CPUTIME_ID );
+}
+
+static MBUSTiny*
+CreateSlave( IPDUAdapter* pAdapter, void* pvImage )
+{
+    return new MBSharedSlave( pAdapter, 42, (MBSharedImage*)pvImage );
+}
+
+static size_t
+BuildRequest( uint8_t* pbReq, uint16_t uTID, bool bWrite )
+{
+    BenchPut16( pbReq, uTID );
+    BenchPut16( pbReq + 2, 0 );
+    pbReq[6] = 42;
+    if( ! bWrite )
+    {
+        BenchPut16( pbReq + 4, 6 );
+        pbReq[7] = 3;
+        BenchPut16( pbReq + 8, uTID % 1000 );
+        BenchPut16( pbReq + 10, 16 );
+        return 12;
+    }
+    BenchPut16( pbReq + 4, 7 + 8 );
+    pbReq[7] = 16;
+    BenchPut16( pbReq + 8, uTID % 1000 );
+    BenchPut16( pbReq + 10, 4 );
+    pbReq[12] = 8;
+    for( int i = 0; i < 4; i ++ )
+        BenchPut16( pbReq + 13 + 2 * i, uTID );
+    return 21;
+}
+
+static void
+Client( uint16_t uPort, size_t nConns, size_t nDepth, std::atomic<bool>* pbStop, std::atomic<size_t>* pnDone )
+{
+    int fdEpoll = epoll_create1( 0 );
+    std::vector<int> vecFD( nConns );
+    std::vector<size_t> vecRX( nConns );
+    std::vector<uint8_t> vecBuf( nConns * 4096 );
+    uint16_t uTID = 0;
+    for( size_t cConn = 0; cConn < nConns; cConn ++ )
+    {
+        int fd = socket( AF_INET, SOCK_STREAM, 0 );
+        struct sockaddr_in sa;
+        memset( &sa, 0, sizeof( sa ) );
+        sa.sin_family = AF_INET;
+        sa.sin_port = htons( uPort );
+        sa.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+        if( connect( fd, (struct sockaddr*)&sa, sizeof( sa ) ) < 0 )
+        {
+            perror( "connect" );
+            exit( 1 );
+        }
+        int nOn = 1;
+        setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &nOn, sizeof( nOn ) );
+        vecFD[ cConn ] = fd;
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = cConn;
+        epoll_ctl( fdEpoll, EPOLL_CTL_ADD, fd, &ev );
+
+        uint8_t arrbReq[ 32 * 21 ];
+        size_t nReq = 0;
+        for( size_t cReq = 0; cReq < nDepth && cReq < 32; cReq ++, uTID ++ )
+            nReq += BuildRequest( arrbReq + nReq, uTID, uTID % 10 == 0 );
+        send( fd, arrbReq, nReq, MSG_NOSIGNAL );
+    }
+
+    size_t nDone = 0;
+    struct epoll_event arrEv[ 64 ];
+    while( ! pbStop->load( std::memory_order_relaxed ) )
+    {
+        int nEv = epoll_wait( fdEpoll, arrEv, 64, 10 );
+        for( int cEv = 0; cEv < nEv; cEv ++ )
+        {
+            size_t cConn = arrEv[ cEv ].data.u64;
+            uint8_t* pbRX = &vecBuf[ cConn * 4096 ];
+            ssize_t nRead = recv( vecFD[ cConn ], pbRX + vecRX[ cConn ], 4096 - vecRX[ cConn ], 0 );
+            if( nRead <= 0 )
+            {
+                fprintf( stderr, "connection closed\n" );
+                exit( 1 );
+            }
+            vecRX[ cConn ] += nRead;
+            // one new request for every complete reply keeps the depth constant
+            uint8_t arrbReq[ 32 * 21 ];
+            size_t nReq = 0, nPos = 0;
+            while( vecRX[ cConn ] - nPos >= 6 )
+            {
+                size_t nFrame = 6 + ( ( pbRX[ nPos + 4 ] << 8 ) | pbRX[ nPos + 5 ] );
+                if( vecRX[ cConn ] - nPos < nFrame )
+                    break;
+                nPos += nFrame;
+                nDone ++;
+                if( nReq + 21 <= sizeof( arrbReq ) )
+                {
+                    nReq += BuildRequest( arrbReq + nReq, uTID, uTID % 10 == 0 );
+                    uTID ++;
+                }
+            }
+            vecRX[ cConn ] -= nPos;
+            memmove( pbRX, pbRX + nPos, vecRX[ cConn ] );
+            if( nReq )
+                send( vecFD[ cConn ], arrbReq, nReq, MSG_NOSIGNAL );
+        }
+    }
+    pnDone->fetch_add( nDone );
+    double dCPU = g_dClientCPUNS.load();
+    while( ! g_dClientCPUNS.compare_exchange_weak( dCPU, dCPU + CPUTimeNS( CLOCK_THREAD_CPUTIME_ID ) ) )
+        ;
+    for( int fd : vecFD )
+        close( fd );
+    close( fdEpoll );
+}
+
+int
+main( int argc, char** argv )
+{
+    size_t nMaxWorkers = argc > 1 ? strtoul( argv[1], NULL, 0 ) : std::thread::hardware_concurrency();
+    size_t nClients = argc > 2 ? strtoul( argv[2], NULL, 0 ) : 2;
+    size_t nConns = argc > 3 ? strtoul( argv[3], NULL, 0 ) : 64;
+    size_t nDepth = argc > 4 ? strtoul( argv[4], NULL, 0 ) : 4;
+    double dSeconds = argc > 5 ? strtod( argv[5], NULL ) : 2;
+
+    const char* pszBackend = argc > 6 ? argv[6] : "both";
+    if( nMaxWorkers == 0 )
+        nMaxWorkers = 1;
+
+    MBSharedImage image( 2000, 2000 );
+    printf( "%zu client threads x %zu connections, depth %zu, %u cores\n",
+            nClients, nConns, nDepth, std::thread::hardware_concurrency() );
+    printf( "%-8s %8s %12s %10s %12s\n", "backend", "workers", "req/s", "scaling", "server ns/req" );
+    for( int nUring = 0; nUring < 2; nUring ++ )
+    {
+        if( strcmp( pszBackend, "both" ) != 0 && strcmp( pszBackend, nUring ? "uring" : "epoll" ) != 0 )
+            continue;
+        double dBase = 0;
+        for( size_t nWorkers = 1; nWorkers <= nMaxWorkers; nWorkers = nWorkers < nMaxWorkers && nWorkers * 2 > nMaxWorkers ? nMaxWorkers : nWorkers * 2 )
+        {
+            MBTCPServer server( nWorkers, nClients * nConns, CreateSlave, &image, nUring );
+            if( ! server.Start( 0, "127.0.0.1" ) )
+            {
+                perror( "start" );
+                return 1;
+            }
+            std::atomic<bool> bStop( false );
+            std::atomic<size_t> nDone( 0 );
+            std::vector<std::thread> vecClients;
+            uint64_t uStart = BenchNowNS();
+            double dCPUStart = ProcessCPUNS();
+            for( size_t cClient = 0; cClient < nClients; cClient ++ )
+                vecClients.push_back( std::thread( Client, server.Port(), nConns, nDepth, &bStop, &nDone ) );
+            usleep( (useconds_t)( dSeconds * 1e6 ) );
+            bStop = true;
+            for( std::thread& th : vecClients )
+                th.join();
+            double dRate = nDone * 1e9 / ( BenchNowNS() - uStart );
+            server.Stop();
+            // the client threads are done, so what the process used beyond their time is the server's
+            double dServerNS = ProcessCPUNS() - dCPUStart - g_dClientCPUNS.exchange( 0 );
+            if( dBase == 0 )
+                dBase = dRate;
+            printf( "%-8s %8zu %12.0f %9.2fx %12.0f\n", nUring ? "io_uring" : "epoll", nWorkers, dRate, dRate / dBase,
+                    nDone ? dServerNS / nDone : 0.0 );
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,184 @@
+#include <MBusTiny.h>
+#include <string.h>
+
+/*
+* The same register map written with the MB_BEGIN_* / MB_END_* macros; bench_map compares the two and
+* the map_size target reports their code size.
+*/
+
+class MapMacroDev : public MBUSTiny
+{
+public:
+    MapMacroDev( IPDUAdapter* pAdapter, uint8_t uDevID ) : MBUSTiny( pAdapter, uDevID )
+    {
+        memset( m_arrnCoils, 0, sizeof( m_arrnCoils ) );
+        m_bInputs = 0xA5;
+        m_bCoils = 0;
+        for( int i = 0; i < 32; i ++ )
+            m_arruRegs[i] = 0x1000 + i;
+        m_uStatus = 0x5A5A;
+        for( int i = 0; i < 128; i ++ )
+            m_arruBlock[i] = m_arruImage[i] = 0x2000 + i;
+    }
+
+    MB_DECLARE( )
+    MB_DECLARE_RANGES( )
+
+    exCode readInput( int nIndex, int& rbValue ){ rbValue = nIndex & 1; return exOK; }
+    exCode getCoil( int nIndex, int& rbValue ){ rbValue = m_arrnCoils[nIndex % 8]; return exOK; }
+    exCode setCoil( int nIndex, int& rbValue ){ m_arrnCoils[nIndex % 8] = rbValue; return exOK; }
+    exCode readReg( int nIndex, uint8_t* pbValue )
+    {
+        StoreRegs( pbValue, m_arruRegs + nIndex % 32, 1 );
+        return exOK;
+    }
+    exCode writeReg( int nIndex, uint8_t* pbValue )
+    {
+        LoadRegs( m_arruRegs + nIndex % 32, pbValue, 1 );
+        return exOK;
+    }
+    exCode readBlock( int nBase, int nCount, uint8_t* pbValue )
+    {
+        StoreRegs( pbValue, m_arruBlock + nBase - 1000, nCount );
+        return exOK;
+    }
+    exCode writeBlock( int nBase, int nCount, uint8_t* pbValue )
+    {
+        LoadRegs( m_arruBlock + nBase - 1000, pbValue, nCount );
+        return exOK;
+    }
+
+    int      m_arrnCoils[8];
+    uint8_t  m_bInputs;
+    uint8_t  m_bCoils;
+    uint16_t m_arruRegs[32];
+    uint16_t m_uStatus;
+    uint16_t m_arruBlock[128];
+    uint16_t m_arruImage[128];
+};
+
+MB_BEGIN_INPUTS( MapMacroDev, MBUSTiny )
+  MB_INPUT( 0, readInput )
+  MB_INPUT( 1, readInput )
+  MB_INPUT( 2, readInput )
+  MB_INPUT( 3, readInput )
+  MB_INPUT( 4, readInput )
+  MB_INPUT( 5, readInput )
+  MB_INPUT( 6, readInput )
+  MB_INPUT( 7, readInput )
+  MB_INPUT_BIT( 8, m_bInputs, 0 )
+  MB_INPUT_BIT( 9, m_bInputs, 1 )
+  MB_INPUT_BIT( 10, m_bInputs, 2 )
+  MB_INPUT_BIT( 11, m_bInputs, 3 )
+  MB_INPUT_BIT( 12, m_bInputs, 4 )
+  MB_INPUT_BIT( 13, m_bInputs, 5 )
+  MB_INPUT_BIT( 14, m_bInputs, 6 )
+  MB_INPUT_BIT( 15, m_bInputs, 7 )
+MB_END_INPUTS( MapMacroDev, MBUSTiny )
+
+MB_BEGIN_COILS( MapMacroDev, MBUSTiny )
+  MB_COIL( 0, getCoil, setCoil )
+  MB_COIL( 1, getCoil, setCoil )
+  MB_COIL( 2, getCoil, setCoil )
+  MB_COIL( 3, getCoil, setCoil )
+  MB_COIL( 4, getCoil, setCoil )
+  MB_COIL( 5, getCoil, setCoil )
+  MB_COIL( 6, getCoil, setCoil )
+  MB_COIL( 7, getCoil, setCoil )
+  MB_COIL_BIT( 8, m_bCoils, 0 )
+  MB_COIL_BIT( 9, m_bCoils, 1 )
+  MB_COIL_BIT( 10, m_bCoils, 2 )
+  MB_COIL_BIT( 11, m_bCoils, 3 )
+  MB_COIL_BIT( 12, m_bCoils, 4 )
+  MB_COIL_BIT( 13, m_bCoils, 5 )
+  MB_COIL_BIT( 14, m_bCoils, 6 )
+  MB_COIL_BIT( 15, m_bCoils, 7 )
+MB_END_COILS( MapMacroDev, MBUSTiny )
+
+MB_BEGIN_REGISTERS( MapMacroDev, MBUSTiny )
+  MB_REGISTER( 0, readReg )
+  MB_REGISTER( 1, readReg )
+  MB_REGISTER( 2, readReg )
+  MB_REGISTER( 3, readReg )
+  MB_REGISTER( 4, readReg )
+  MB_REGISTER( 5, readReg )
+  MB_REGISTER( 6, readReg )
+  MB_REGISTER( 7, readReg )
+  MB_REGISTER( 8, readReg )
+  MB_REGISTER( 9, readReg )
+  MB_REGISTER( 10, readReg )
+  MB_REGISTER( 11, readReg )
+  MB_REGISTER( 12, readReg )
+  MB_REGISTER( 13, readReg )
+  MB_REGISTER( 14, readReg )
+  MB_REGISTER( 15, readReg )
+  MB_REGISTER( 16, readReg )
+  MB_REGISTER( 17, readReg )
+  MB_REGISTER( 18, readReg )
+  MB_REGISTER( 19, readReg )
+  MB_REGISTER( 20, readReg )
+  MB_REGISTER( 21, readReg )
+  MB_REGISTER( 22, readReg )
+  MB_REGISTER( 23, readReg )
+  MB_REGISTER( 24, readReg )
+  MB_REGISTER( 25, readReg )
+  MB_REGISTER( 26, readReg )
+  MB_REGISTER( 27, readReg )
+  MB_REGISTER( 28, readReg )
+  MB_REGISTER( 29, readReg )
+  MB_REGISTER( 30, readReg )
+  MB_REGISTER( 31, readReg )
+  MB_REGISTER_VAR( 100, m_uStatus )
+MB_END_REGISTERS( MapMacroDev, MBUSTiny )
+
+MB_BEGIN_HOLDINGREGS( MapMacroDev, MBUSTiny )
+  MB_HOLDINGREG( 0, readReg, writeReg )
+  MB_HOLDINGREG( 1, readReg, writeReg )
+  MB_HOLDINGREG( 2, readReg, writeReg )
+  MB_HOLDINGREG( 3, readReg, writeReg )
+  MB_HOLDINGREG( 4, readReg, writeReg )
+  MB_HOLDINGREG( 5, readReg, writeReg )
+  MB_HOLDINGREG( 6, readReg, writeReg )
+  MB_HOLDINGREG( 7, readReg, writeReg )
+  MB_HOLDINGREG( 8, readReg, writeReg )
+  MB_HOLDINGREG( 9, readReg, writeReg )
+  MB_HOLDINGREG( 10, readReg, writeReg )
+  MB_HOLDINGREG( 11, readReg, writeReg )
+  MB_HOLDINGREG( 12, readReg, writeReg )
+  MB_HOLDINGREG( 13, readReg, writeReg )
+  MB_HOLDINGREG( 14, readReg, writeReg )
+  MB_HOLDINGREG( 15, readReg, writeReg )
+  MB_HOLDINGREG( 16, readReg, writeReg )
+  MB_HOLDINGREG( 17, readReg, writeReg )
+  MB_HOLDINGREG( 18, readReg, writeReg )
+  MB_HOLDINGREG( 19, readReg, writeReg )
+  MB_HOLDINGREG( 20, readReg, writeReg )
+  MB_HOLDINGREG( 21, readReg, writeReg )
+  MB_HOLDINGREG( 22, readReg, writeReg )
+  MB_HOLDINGREG( 23, readReg, writeReg )
+  MB_HOLDINGREG( 24, readReg, writeReg )
+  MB_HOLDINGREG( 25, readReg, writeReg )
+  MB_HOLDINGREG( 26, readReg, writeReg )
+  MB_HOLDINGREG( 27, readReg, writeReg )
+  MB_HOLDINGREG( 28, readReg, writeReg )
+  MB_HOLDINGREG( 29, readReg, writeReg )
+  MB_HOLDINGREG( 30, readReg, writeReg )
+  MB_HOLDINGREG( 31, readReg, writeReg )
+  MB_HOLDINGREG_VAR( 100, m_uStatus )
+MB_END_HOLDINGREGS( MapMacroDev, MBUSTiny )
+
+MB_BEGIN_REGISTER_RANGES( MapMacroDev, MBUSTiny )
+  MB_REGISTER_RANGE( 1000, 1127, readBlock )
+  MB_REGISTER_ARRAY( 3000, m_arruImage )
+MB_END_REGISTER_RANGES( MapMacroDev, MBUSTiny )
+
+MB_BEGIN_HOLDINGREG_RANGES( MapMacroDev, MBUSTiny )
+  MB_HOLDINGREG_RANGE( 1000, 1127, readBlock, writeBlock )
+  MB_HOLDINGREG_ARRAY( 3000, m_arruImage )
+MB_END_HOLDINGREG_RANGES( MapMacroDev, MBUSTiny )
+
+MBUSTiny*
+CreateMacroDev( IPDUAdapter* pAdapter, uint8_t uDevID )
+{
+    return new MapMacroDev( pAdapter, uDevID );
+}
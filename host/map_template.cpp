@@ -0,0 +1,175 @@
+#include <MBusMap.h>
+#include <string.h>
+
+/*
+* The same register map written with the compile-time MBUSTinyMap; bench_map compares the two and
+* the map_size target reports their code size.
+*/
+
+class MapTemplateDev : public MBUSTinyMap< MapTemplateDev >
+{
+public:
+    MapTemplateDev( IPDUAdapter* pAdapter, uint8_t uDevID ) : MBUSTinyMap< MapTemplateDev >( pAdapter, uDevID )
+    {
+        memset( m_arrnCoils, 0, sizeof( m_arrnCoils ) );
+        m_bInputs = 0xA5;
+        m_bCoils = 0;
+        for( int i = 0; i < 32; i ++ )
+            m_arruRegs[i] = 0x1000 + i;
+        m_uStatus = 0x5A5A;
+        for( int i = 0; i < 128; i ++ )
+            m_arruBlock[i] = m_arruImage[i] = 0x2000 + i;
+    }
+
+    exCode readInput( int nIndex, int& rbValue ){ rbValue = nIndex & 1; return exOK; }
+    exCode getCoil( int nIndex, int& rbValue ){ rbValue = m_arrnCoils[nIndex % 8]; return exOK; }
+    exCode setCoil( int nIndex, int& rbValue ){ m_arrnCoils[nIndex % 8] = rbValue; return exOK; }
+    exCode readReg( int nIndex, uint8_t* pbValue )
+    {
+        StoreRegs( pbValue, m_arruRegs + nIndex % 32, 1 );
+        return exOK;
+    }
+    exCode writeReg( int nIndex, uint8_t* pbValue )
+    {
+        LoadRegs( m_arruRegs + nIndex % 32, pbValue, 1 );
+        return exOK;
+    }
+    exCode readBlock( int nBase, int nCount, uint8_t* pbValue )
+    {
+        StoreRegs( pbValue, m_arruBlock + nBase - 1000, nCount );
+        return exOK;
+    }
+    exCode writeBlock( int nBase, int nCount, uint8_t* pbValue )
+    {
+        LoadRegs( m_arruBlock + nBase - 1000, pbValue, nCount );
+        return exOK;
+    }
+
+    int      m_arrnCoils[8];
+    uint8_t  m_bInputs;
+    uint8_t  m_bCoils;
+    uint16_t m_arruRegs[32];
+    uint16_t m_uStatus;
+    uint16_t m_arruBlock[128];
+    uint16_t m_arruImage[128];
+
+    typedef MBMap<
+        Input< 0, &MapTemplateDev::readInput >,
+        Input< 1, &MapTemplateDev::readInput >,
+        Input< 2, &MapTemplateDev::readInput >,
+        Input< 3, &MapTemplateDev::readInput >,
+        Input< 4, &MapTemplateDev::readInput >,
+        Input< 5, &MapTemplateDev::readInput >,
+        Input< 6, &MapTemplateDev::readInput >,
+        Input< 7, &MapTemplateDev::readInput >,
+        Bit< 8, &MapTemplateDev::m_bInputs, 0 >,
+        Bit< 9, &MapTemplateDev::m_bInputs, 1 >,
+        Bit< 10, &MapTemplateDev::m_bInputs, 2 >,
+        Bit< 11, &MapTemplateDev::m_bInputs, 3 >,
+        Bit< 12, &MapTemplateDev::m_bInputs, 4 >,
+        Bit< 13, &MapTemplateDev::m_bInputs, 5 >,
+        Bit< 14, &MapTemplateDev::m_bInputs, 6 >,
+        Bit< 15, &MapTemplateDev::m_bInputs, 7 >
+    > InputMap;
+
+    typedef MBMap<
+        Coil< 0, &MapTemplateDev::getCoil, &MapTemplateDev::setCoil >,
+        Coil< 1, &MapTemplateDev::getCoil, &MapTemplateDev::setCoil >,
+        Coil< 2, &MapTemplateDev::getCoil, &MapTemplateDev::setCoil >,
+        Coil< 3, &MapTemplateDev::getCoil, &MapTemplateDev::setCoil >,
+        Coil< 4, &MapTemplateDev::getCoil, &MapTemplateDev::setCoil >,
+        Coil< 5, &MapTemplateDev::getCoil, &MapTemplateDev::setCoil >,
+        Coil< 6, &MapTemplateDev::getCoil, &MapTemplateDev::setCoil >,
+        Coil< 7, &MapTemplateDev::getCoil, &MapTemplateDev::setCoil >,
+        Bit< 8, &MapTemplateDev::m_bCoils, 0 >,
+        Bit< 9, &MapTemplateDev::m_bCoils, 1 >,
+        Bit< 10, &MapTemplateDev::m_bCoils, 2 >,
+        Bit< 11, &MapTemplateDev::m_bCoils, 3 >,
+        Bit< 12, &MapTemplateDev::m_bCoils, 4 >,
+        Bit< 13, &MapTemplateDev::m_bCoils, 5 >,
+        Bit< 14, &MapTemplateDev::m_bCoils, 6 >,
+        Bit< 15, &MapTemplateDev::m_bCoils, 7 >
+    > CoilMap;
+
+    typedef MBMap<
+        Reg< 0, &MapTemplateDev::readReg >,
+        Reg< 1, &MapTemplateDev::readReg >,
+        Reg< 2, &MapTemplateDev::readReg >,
+        Reg< 3, &MapTemplateDev::readReg >,
+        Reg< 4, &MapTemplateDev::readReg >,
+        Reg< 5, &MapTemplateDev::readReg >,
+        Reg< 6, &MapTemplateDev::readReg >,
+        Reg< 7, &MapTemplateDev::readReg >,
+        Reg< 8, &MapTemplateDev::readReg >,
+        Reg< 9, &MapTemplateDev::readReg >,
+        Reg< 10, &MapTemplateDev::readReg >,
+        Reg< 11, &MapTemplateDev::readReg >,
+        Reg< 12, &MapTemplateDev::readReg >,
+        Reg< 13, &MapTemplateDev::readReg >,
+        Reg< 14, &MapTemplateDev::readReg >,
+        Reg< 15, &MapTemplateDev::readReg >,
+        Reg< 16, &MapTemplateDev::readReg >,
+        Reg< 17, &MapTemplateDev::readReg >,
+        Reg< 18, &MapTemplateDev::readReg >,
+        Reg< 19, &MapTemplateDev::readReg >,
+        Reg< 20, &MapTemplateDev::readReg >,
+        Reg< 21, &MapTemplateDev::readReg >,
+        Reg< 22, &MapTemplateDev::readReg >,
+        Reg< 23, &MapTemplateDev::readReg >,
+        Reg< 24, &MapTemplateDev::readReg >,
+        Reg< 25, &MapTemplateDev::readReg >,
+        Reg< 26, &MapTemplateDev::readReg >,
+        Reg< 27, &MapTemplateDev::readReg >,
+        Reg< 28, &MapTemplateDev::readReg >,
+        Reg< 29, &MapTemplateDev::readReg >,
+        Reg< 30, &MapTemplateDev::readReg >,
+        Reg< 31, &MapTemplateDev::readReg >,
+        RegVar< 100, &MapTemplateDev::m_uStatus >,
+        RegRange< 1000, 1127, &MapTemplateDev::readBlock >,
+        RegArray< 3000, 128, &MapTemplateDev::m_arruImage >
+    > RegisterMap;
+
+    typedef MBMap<
+        HoldingReg< 0, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 1, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 2, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 3, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 4, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 5, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 6, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 7, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 8, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 9, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 10, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 11, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 12, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 13, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 14, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 15, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 16, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 17, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 18, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 19, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 20, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 21, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 22, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 23, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 24, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 25, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 26, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 27, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 28, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 29, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 30, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        HoldingReg< 31, &MapTemplateDev::readReg, &MapTemplateDev::writeReg >,
+        RegVar< 100, &MapTemplateDev::m_uStatus >,
+        HoldingRegRange< 1000, 1127, &MapTemplateDev::readBlock, &MapTemplateDev::writeBlock >,
+        RegArray< 3000, 128, &MapTemplateDev::m_arruImage >
+    > HoldingRegMap;
+};
+
+MBUSTiny*
+CreateTemplateDev( IPDUAdapter* pAdapter, uint8_t uDevID )
+{
+    return new MapTemplateDev( pAdapter, uDevID );
+}
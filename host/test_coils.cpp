@@ -0,0 +1,102 @@
+/*
+* test_coils - FC5 and FC15 writes to coils mapped through MB_COIL_MASK,
+* MB_COIL_WORD and MB_COIL_BYTES, each read back with FC1.
+*
+* usage: test_coils
+*/
+
+#include <MBusTiny.h>
+#include <MBClient.h>
+#include "BenchUtil.h"
+
+/*! @brief a device whose coils are mapped only through the mask macros */
+class MaskCoils : public MBUSTiny
+{
+public:
+    uint32_t m_uMaskCoils;      //!< behind MB_COIL_MASK at 0..31
+    uint16_t m_uWordCoils;      //!< MB_COIL_WORD at 100..115
+    uint8_t  m_arrbByteCoils[8];//!< MB_COIL_BYTES at 200..207
+
+    MaskCoils() : MBUSTiny( NULL, 1 ), m_uMaskCoils( 0 ), m_uWordCoils( 0 ) { memset( m_arrbByteCoils, 0, sizeof( m_arrbByteCoils ) ); }
+
+    MB_DECLARE_MASKS( )
+
+    MBUSTiny::exCode getMask( int nBase, int /* nCount */, uint32_t& ruBits ) { ruBits = m_uMaskCoils >> nBase; return exOK; }
+    MBUSTiny::exCode setMask( int nBase, int nCount, uint32_t& ruBits )
+    {
+        uint32_t uMask = MB_MASK_LOW( nCount ) << nBase;
+        m_uMaskCoils = ( m_uMaskCoils & ~uMask ) | ( ( ruBits << nBase ) & uMask );
+        return exOK;
+    }
+};
+
+MB_BEGIN_INPUT_MASKS( MaskCoils, MBUSTiny )
+MB_END_INPUT_MASKS( MaskCoils, MBUSTiny )
+
+MB_BEGIN_COIL_MASKS( MaskCoils, MBUSTiny )
+  MB_COIL_MASK( 0, 31, getMask, setMask )
+  MB_COIL_WORD( 100, m_uWordCoils )
+  MB_COIL_BYTES( 200, m_arrbByteCoils )
+MB_END_COIL_MASKS( MaskCoils, MBUSTiny )
+
+// FC1 x1 at uAddress, -1 on an exception
+static int
+ReadCoil( MBUSDevice& rDevice, uint16_t uAddress )
+{
+    uint8_t arrbPDU[nPDU];
+    MBClient::EncodeRead( arrbPDU, 1, MBUSDevice::fcReadCoils, uAddress, 1 );
+    size_t nResponse = rDevice.ServePDU( arrbPDU );
+    if( nResponse != 4 || arrbPDU[1] != MBUSDevice::fcReadCoils )
+        return -1;
+    return arrbPDU[3] & 1;
+}
+
+static void
+WriteSingle( MBUSDevice& rDevice, uint16_t uAddress, bool bOn )
+{
+    uint8_t arrbPDU[nPDU];
+    size_t nRequest = MBClient::EncodeWriteCoil( arrbPDU, 1, uAddress, bOn );
+    uint8_t arrbEcho[nPDU];
+    memcpy( arrbEcho, arrbPDU, nRequest );
+    size_t nResponse = rDevice.ServePDU( arrbPDU );
+    Expect( nResponse == nRequest && memcmp( arrbPDU, arrbEcho, nRequest ) == 0, "FC5 echo", uAddress );
+}
+
+static void
+WriteMultiple( MBUSDevice& rDevice, uint16_t uAddress, bool bOn )
+{
+    uint8_t arrbPDU[nPDU];
+    uint8_t bBits = bOn;
+    MBClient::EncodeWriteCoils( arrbPDU, 1, uAddress, 1, &bBits );
+    Expect( rDevice.ServePDU( arrbPDU ) == 6 && arrbPDU[1] == MBUSDevice::fcWriteMultipleCoils, "FC15 response", uAddress );
+}
+
+int
+main()
+{
+    MaskCoils dev;
+    static const uint16_t arruAddresses[] = { 0, 17, 31, 100, 109, 115, 200, 203, 207 };
+    for( size_t cAddr = 0; cAddr < sizeof( arruAddresses ) / sizeof( arruAddresses[0] ); cAddr ++ )
+    {
+        uint16_t uAddress = arruAddresses[ cAddr ];
+        Expect( ReadCoil( dev, uAddress ) == 0, "initial state", uAddress );
+        WriteSingle( dev, uAddress, true );
+        Expect( ReadCoil( dev, uAddress ) == 1, "FC5 on", uAddress );
+        WriteSingle( dev, uAddress, false );
+        Expect( ReadCoil( dev, uAddress ) == 0, "FC5 off", uAddress );
+        WriteMultiple( dev, uAddress, true );
+        Expect( ReadCoil( dev, uAddress ) == 1, "FC15 on", uAddress );
+        WriteSingle( dev, uAddress, false );
+        Expect( ReadCoil( dev, uAddress ) == 0, "FC5 off after FC15", uAddress );
+    }
+    // the neighbours of a single write keep their state
+    WriteSingle( dev, 5, true );
+    Expect( dev.m_uMaskCoils == ( 1UL << 5 ), "FC5 touches only its bit", 5 );
+    WriteSingle( dev, 104, true );
+    Expect( dev.m_uWordCoils == ( 1 << 4 ), "FC5 touches only its bit", 104 );
+    WriteSingle( dev, 202, true );
+    Expect( dev.m_arrbByteCoils[2] == 1 && dev.m_arrbByteCoils[1] == 0 && dev.m_arrbByteCoils[3] == 0, "FC5 touches only its byte", 202 );
+
+    printf( "test_coils: %zu failures\n", g_nFailures );
+    return g_nFailures != 0;
+}
@@ -0,0 +1,61 @@
+/*
+* test_frame_cache - MBFrameCache with TrackChanges(): a kept frame goes out
+* until Changed(), a changed value goes out after it, also when the version
+* counter has wrapped back to the value the frame was kept with.
+*
+* usage: test_frame_cache
+*/
+
+#include <MBusTiny.h>
+#include <MBRTUAdapter.h>
+#include <MBFrameCache.h>
+#include <CrcFsm.h>
+#include "LoopbackTransport.h"
+#include "BenchSlave.h"
+#include "BenchUtil.h"
+
+// polls FC3 x1 at 1000 and returns the value sent, -1 on a bad frame
+static int
+Poll( BenchSlave& rSlave, LoopbackTransport& rLoop )
+{
+    rLoop.Rewind();
+    if( ! rSlave.TranscievePDU() )
+        return -1;
+    const uint8_t* pbTX = rLoop.TXFrame();
+    if( rLoop.TXSize() != 7 || CRC16( pbTX, 7 ) != 0 )
+        return -1;
+    return ( pbTX[3] << 8 ) | pbTX[4];
+}
+
+int
+main()
+{
+    LoopbackTransport transLoop( 0 );
+    MBRTUAdapter rtu( &transLoop );
+    BenchSlave slave( &rtu, 42 );
+    MBFrameEntry arrFrames[2];
+    MBFrameCache frames( arrFrames, 2 );
+    frames.TrackChanges( true );
+    slave.SetFrameCache( &frames );
+
+    uint8_t arrbFrame[ nPDU + 2 ];
+    transLoop.Load( arrbFrame, BenchRequest( arrbFrame, 42, MBUSDevice::fcReadMultipleHoldingRegisters, 1000, 1 ) );
+
+    slave.m_arruBlock[0] = 0x1111;
+    Expect( Poll( slave, transLoop ) == 0x1111, "the first read is served" );
+    slave.m_arruBlock[0] = 0x2222;
+    Expect( Poll( slave, transLoop ) == 0x1111, "the kept frame goes out until Changed()" );
+    frames.Changed();
+    Expect( Poll( slave, transLoop ) == 0x2222, "the change goes out after Changed()" );
+
+    // a full round of the version: the kept frame's version comes up again
+    slave.m_arruBlock[0] = 0x3333;
+    for( uint32_t cChange = 0; cChange < 0x10000; cChange ++ )
+        frames.Changed();
+    Expect( Poll( slave, transLoop ) == 0x3333, "a wrapped version does not match the kept frame" );
+    Expect( Poll( slave, transLoop ) == 0x3333, "the frame is kept again after the wrap" );
+    Expect( frames.Unchanged() == 2, "the kept frames went out as they were" );
+
+    printf( "test_frame_cache: %zu failures\n", g_nFailures );
+    return g_nFailures != 0;
+}
@@ -0,0 +1,72 @@
+/*
+* test_ranges - input and holding register span callbacks that report more
+* registers done than they were asked for: reads and writes fail with
+* exSlaveDeviceFailure instead of running past the request or the response.
+*
+* usage: test_ranges
+*/
+
+#include <MBusTiny.h>
+#include <MBClient.h>
+#include "BenchUtil.h"
+
+/*! @brief a device whose span callbacks serve the span and then claim one register more */
+class OverclaimingRanges : public MBUSTiny
+{
+public:
+    OverclaimingRanges() : MBUSTiny( NULL, 1 ) {}
+
+protected:
+    virtual exCode DIRegistersRange( int nIndex, int nCount, uint8_t* pbValue, int& rnDone )
+    {
+        for( int cElem = 0; cElem < nCount; cElem ++ )
+            BenchPut16( pbValue + 2 * cElem, (uint16_t)( nIndex + cElem ) );
+        rnDone = nCount + 1;
+        return exOK;
+    }
+    virtual exCode DIOHoldingRegsRange( int nIndex, int nCount, uint8_t* pbValue, eDataDir dirData, int& rnDone )
+    {
+        if( dirData == eDataDir::dataRead )
+            for( int cElem = 0; cElem < nCount; cElem ++ )
+                BenchPut16( pbValue + 2 * cElem, (uint16_t)( nIndex + cElem ) );
+        rnDone = nCount + 1;
+        return exOK;
+    }
+};
+
+// serves the request in pbPDU and tells whether it failed with exSlaveDeviceFailure
+static bool
+Fails( MBUSDevice& rDevice, uint8_t* pbPDU )
+{
+    uint8_t uFC = pbPDU[1];
+    size_t nResponse = rDevice.ServePDU( pbPDU );
+    return nResponse == 3 && pbPDU[1] == ( uFC | 0x80 ) && pbPDU[2] == MBUSDevice::exSlaveDeviceFailure;
+}
+
+// a read of uCount at 0
+static bool
+ReadFails( MBUSDevice& rDevice, uint8_t uFC, uint16_t uCount )
+{
+    uint8_t arrbPDU[nPDU];
+    MBClient::EncodeRead( arrbPDU, 1, uFC, 0, uCount );
+    return Fails( rDevice, arrbPDU );
+}
+
+int
+main()
+{
+    OverclaimingRanges dev;
+    Expect( ReadFails( dev, MBUSDevice::fcReadInputRegisters, 4 ), "FC4 with an overclaimed span fails" );
+    Expect( ReadFails( dev, MBUSDevice::fcReadInputRegisters, 125 ), "FC4 x125 with an overclaimed span fails" );
+    Expect( ReadFails( dev, MBUSDevice::fcReadMultipleHoldingRegisters, 4 ), "FC3 with an overclaimed span fails" );
+
+    uint16_t arruValues[4] = { 1, 2, 3, 4 };
+    uint8_t arrbPDU[nPDU];
+    MBClient::EncodeWriteRegisters( arrbPDU, 1, 0, 4, arruValues );
+    Expect( Fails( dev, arrbPDU ), "FC16 with an overclaimed span fails" );
+    MBClient::EncodeReadWriteRegisters( arrbPDU, 1, 0, 4, 10, 4, arruValues );
+    Expect( Fails( dev, arrbPDU ), "FC23 with an overclaimed span fails" );
+
+    printf( "test_ranges: %zu failures\n", g_nFailures );
+    return g_nFailures != 0;
+}
@@ -0,0 +1,125 @@
+/*
+* test_rtu_async - MBRTUAsyncAdapter framing from byte arrival times, as a UART
+* ISR would push them: a frame ends on t3.5 silence, seen by Poll() or by the
+* next byte; a t1.5 gap inside a frame drops it; a frame ready for processing
+* ignores the bytes after it, which do not delay its turnaround. The times start
+* just short of the micros() wrap.
+*
+* usage: test_rtu_async
+*/
+
+#include <MBusTiny.h>
+#include <MBRTUAsyncAdapter.h>
+#include "BenchUtil.h"
+
+/*! @brief a transport that never receives: the bytes come through PushByte() */
+class PushedTransport : public IRTUTransport
+{
+    uint16_t m_uCharUS;
+public:
+    PushedTransport( uint16_t uCharUS ) : m_uCharUS( uCharUS ) {}
+    virtual bool AvailableIn() { return false; }
+    virtual bool ReceiveBuffer( uint8_t* /* pbBuffer */, size_t /* nBuffer */ ) { return false; }
+    virtual bool TransmitBuffer( const uint8_t* /* pbBuffer */, size_t /* nBuffer */ ) { return true; }
+    virtual uint16_t CharUS() { return m_uCharUS; }
+};
+
+/* pushes an FC3 request to device 1 with its CRC, one character time apart from ruNowUS on,
+*  the byte at nGapAt nGapUS later instead; ruNowUS ends at the last byte */
+static void
+PushRequest( MBRTUAsyncAdapter& rAdapter, uint32_t& ruNowUS, uint32_t uCharUS, size_t nGapAt = 0, uint32_t nGapUS = 0, bool bBadCRC = false )
+{
+    uint8_t arrbFrame[8] = { 1, MBUSDevice::fcReadMultipleHoldingRegisters, 0, 10, 0, 2 };
+    BenchAppendCRC( arrbFrame, 6 );
+    if( bBadCRC )
+        arrbFrame[7] ^= 1;
+    for( size_t cByte = 0; cByte < sizeof( arrbFrame ); cByte ++ )
+    {
+        if( cByte > 0 )
+            ruNowUS += cByte == nGapAt ? nGapUS : uCharUS;
+        rAdapter.PushByte( arrbFrame[ cByte ], ruNowUS );
+    }
+}
+
+static bool
+Ready( MBRTUAsyncAdapter& rAdapter, uint8_t* pbPDU, size_t& rnPDU )
+{
+    return rAdapter.ReceivePDU( 1, pbPDU, nPDU, rnPDU );
+}
+
+int
+main()
+{
+    const uint32_t uCharUS = 1146; // 9600 bps: t1.5 1719 us, t3.5 4011 us
+    PushedTransport trans( uCharUS );
+    MBRTUAsyncAdapter rtu( &trans, 1 );
+    uint32_t uT15US = rtu.T15US();
+    uint32_t uT35US = rtu.T35US();
+    uint8_t arrbPDU[nPDU];
+    size_t nPDUOut = 0;
+
+    uint32_t uNowUS = 0xFFFFFFFFUL - 3 * uCharUS; // the frame straddles the wrap
+    rtu.Poll( uNowUS ); // the silence since construction
+    PushRequest( rtu, uNowUS, uCharUS );
+    rtu.Poll( uNowUS + uT35US - 1 );
+    Expect( ! Ready( rtu, arrbPDU, nPDUOut ), "no frame before t3.5" );
+    rtu.Poll( uNowUS + uT35US );
+    Expect( Ready( rtu, arrbPDU, nPDUOut ) && nPDUOut == 6 && arrbPDU[1] == 3 && arrbPDU[3] == 10, "frame after t3.5 silence" );
+    Expect( rtu.FrameErrors() == 0, "no frame errors" );
+
+    // a t1.5 violation inside the frame drops it
+    uNowUS += 2 * uT35US;
+    PushRequest( rtu, uNowUS, uCharUS, 4, uT15US + 1 );
+    rtu.Poll( uNowUS + uT35US );
+    Expect( ! Ready( rtu, arrbPDU, nPDUOut ), "a frame with a t1.5 gap is dropped" );
+    Expect( rtu.FrameErrors() == 1, "the t1.5 gap is a frame error" );
+
+    // a gap of exactly t1.5 still belongs to the frame
+    uNowUS += 2 * uT35US;
+    PushRequest( rtu, uNowUS, uCharUS, 4, uT15US );
+    rtu.Poll( uNowUS + uT35US );
+    Expect( Ready( rtu, arrbPDU, nPDUOut ) && nPDUOut == 6, "a t1.5 gap is allowed" );
+
+    // nobody polls: the first byte of the next frame, t3.5 later, ends the previous one
+    uNowUS += 2 * uT35US;
+    PushRequest( rtu, uNowUS, uCharUS );
+    uNowUS += uT35US;
+    PushRequest( rtu, uNowUS, uCharUS );
+    Expect( Ready( rtu, arrbPDU, nPDUOut ) && nPDUOut == 6, "the next byte ends the frame" );
+    Expect( rtu.Overruns() == 8, "a ready frame ignores the next one" );
+
+    // the CRC is checked at the end of the frame
+    uNowUS += 2 * uT35US;
+    rtu.Poll( uNowUS );
+    PushRequest( rtu, uNowUS, uCharUS, 0, 0, true );
+    rtu.Poll( uNowUS + uT35US );
+    Expect( ! Ready( rtu, arrbPDU, nPDUOut ), "a bad CRC drops the frame" );
+    Expect( rtu.FrameErrors() == 2, "the bad CRC is a frame error" );
+
+    // a gap between t1.5 and t3.5 drops the frame, and the rest up to the silence with it
+    uNowUS += 2 * uT35US;
+    PushRequest( rtu, uNowUS, uCharUS, 2, ( uT15US + uT35US ) / 2 );
+    rtu.Poll( uNowUS + uT35US );
+    Expect( ! Ready( rtu, arrbPDU, nPDUOut ), "a gap short of t3.5 does not split the frame" );
+    uNowUS += 2 * uT35US;
+    PushRequest( rtu, uNowUS, uCharUS );
+    rtu.Poll( uNowUS + uT35US );
+    Expect( Ready( rtu, arrbPDU, nPDUOut ) && nPDUOut == 6, "framing recovers after the dropped frames" );
+
+    // traffic while a frame waits is an overrun, and the turnaround still runs from the frame's last byte
+    uNowUS += 2 * uT35US;
+    PushRequest( rtu, uNowUS, uCharUS );
+    uint32_t uFrameEndUS = uNowUS;
+    rtu.Poll( uFrameEndUS + uT35US );
+    uint32_t uTurnaroundUS = 36 * uCharUS / 10;
+    Expect( ! rtu.TurnaroundReady( uFrameEndUS + uTurnaroundUS - 1 ), "no reply before the turnaround" );
+    uint32_t uOverrunUS = uFrameEndUS + uT35US;
+    for( uint32_t cByte = 0; cByte < 3; cByte ++, uOverrunUS += uCharUS )
+        rtu.PushByte( 0xAA, uOverrunUS );
+    Expect( rtu.Overruns() == 8 + 3, "bytes pushed while a frame waits are overruns" );
+    Expect( rtu.TurnaroundReady( uOverrunUS ), "the overrun does not push the turnaround back" );
+    Expect( Ready( rtu, arrbPDU, nPDUOut ) && nPDUOut == 6, "the waiting frame is intact after the overrun" );
+
+    printf( "test_rtu_async: %zu failures\n", g_nFailures );
+    return g_nFailures != 0;
+}
@@ -0,0 +1,124 @@
+/*
+* test_rtu_client - MBRTUClient against a slave that answers just after the
+* timeout: the late response must be dropped, and the next transaction must get
+* its own answer, not the stale one still on the line.
+*
+* usage: test_rtu_client
+*/
+
+#include <MBusTiny.h>
+#include <MBClient.h>
+#include <MBRTUClient.h>
+#include "BenchBus.h"
+
+/*! @brief a bus whose responses queue up behind each other, each ready at its own time; a new
+*   request does not clear the line, as it does not on a real one */
+class LateBusTransport : public IRTUTransport
+{
+protected:
+    SimDevice* m_pDevice;
+    uint16_t   m_uCharUS;
+    uint8_t    m_arrbLine[1024];
+    uint64_t   m_arruReadyUS[1024];   // when each byte is complete
+    size_t     m_nLine;
+    size_t     m_nLinePos;
+public:
+    uint32_t   m_uLateUS;             //!< added to the turnaround of the next response
+
+    LateBusTransport( SimDevice* pDevice, uint16_t uCharUS )
+        : m_pDevice( pDevice ), m_uCharUS( uCharUS ), m_nLine( 0 ), m_nLinePos( 0 ), m_uLateUS( 0 ) {}
+
+    virtual bool AvailableIn()
+    {
+        return m_nLinePos < m_nLine && BenchNowNS() / 1000 >= m_arruReadyUS[ m_nLinePos ];
+    }
+    virtual bool ReceiveBuffer( uint8_t* pbBuffer, size_t nBuffer )
+    {
+        if( nBuffer > m_nLine - m_nLinePos )
+            return false;
+        while( BenchNowNS() / 1000 < m_arruReadyUS[ m_nLinePos + nBuffer - 1 ] )
+            ;
+        memcpy( pbBuffer, m_arrbLine + m_nLinePos, nBuffer );
+        m_nLinePos += nBuffer;
+        return true;
+    }
+    virtual bool TransmitBuffer( const uint8_t* pbBuffer, size_t nBuffer )
+    {
+        MBSegment seg = { pbBuffer, nBuffer };
+        return TransmitSegments( &seg, 1 );
+    }
+    virtual bool TransmitSegments( const MBSegment* pSegments, size_t nSegments )
+    {
+        uint8_t arrbFrame[nPDU + 2];
+        size_t nFrame = 0;
+        for( size_t cSeg = 0; cSeg < nSegments; cSeg ++ )
+        {
+            memcpy( arrbFrame + nFrame, pSegments[cSeg].pbData, pSegments[cSeg].nData );
+            nFrame += pSegments[cSeg].nData;
+        }
+        if( nFrame < 4 || CRC16Fsm( arrbFrame, nFrame ) != 0 || arrbFrame[0] != m_pDevice->m_uDeviceID )
+            return true;
+        size_t nResponse = BenchAppendCRC( arrbFrame, m_pDevice->ServePDU( arrbFrame ) );
+        if( m_nLine + nResponse > sizeof( m_arrbLine ) )
+            return false;
+        uint64_t uReadyUS = BenchNowNS() / 1000 + ( nFrame + 1 ) * m_uCharUS + 36 * m_uCharUS / 10 + m_uLateUS;
+        for( size_t cByte = 0; cByte < nResponse; cByte ++, uReadyUS += m_uCharUS )
+        {
+            m_arrbLine[ m_nLine ] = arrbFrame[ cByte ];
+            m_arruReadyUS[ m_nLine ++ ] = uReadyUS;
+        }
+        m_uLateUS = 0;
+        return true;
+    }
+    virtual uint16_t CharUS() { return m_uCharUS; }
+};
+
+// FC3 x1 at uAddress; the value read, or -1
+static int
+ReadHolding( MBRTUClient& rRTU, uint16_t uAddress, uint32_t uTimeoutUS, MBClient::eStatus& rstRV )
+{
+    uint8_t arrbRequest[8];
+    size_t nRequest = MBClient::EncodeRead( arrbRequest, 1, MBUSDevice::fcReadMultipleHoldingRegisters, uAddress, 1 );
+    MBResponse resp;
+    rstRV = rRTU.Transact( arrbRequest, nRequest, resp, uTimeoutUS );
+    if( rstRV != MBClient::stOK )
+        return -1;
+    uint16_t uValue = 0;
+    resp.Regs().Load( &uValue );
+    return uValue;
+}
+
+int
+main()
+{
+    const uint16_t uCharUS = 1146; // 9600 bps, so a scheduler hiccup does not move a response out of its window
+    const uint32_t uTimeoutUS = 20000;
+    SimDevice dev;
+    dev.m_uDeviceID = 1;
+    LateBusTransport bus( &dev, uCharUS );
+    MBRTUClient rtu( &bus );
+
+    MBClient::eStatus stRV;
+    Expect( ReadHolding( rtu, 10, uTimeoutUS, stRV ) == SimDevice::Expected( 1, 3, 10 ), "a timely response is read" );
+
+    uint32_t nLate = 0;
+    for( int cRound = 0; cRound < 20; cRound ++ )
+    {
+        // starts a character or two after the timeout, and is still coming in when the next request would be due
+        bus.m_uLateUS = uTimeoutUS - 3 * uCharUS;
+        int nValue = ReadHolding( rtu, 20, uTimeoutUS, stRV );
+        // a master preempted past the deadline may find the response there, and it is the right one
+        if( stRV == MBClient::stTimeout )
+            nLate ++;
+        else
+            Expect( stRV == MBClient::stOK && nValue == SimDevice::Expected( 1, 3, 20 ), "the late response times out or is its own" );
+        nValue = ReadHolding( rtu, 30, uTimeoutUS, stRV );
+        Expect( stRV == MBClient::stOK, "the next transaction is answered" );
+        Expect( nValue == SimDevice::Expected( 1, 3, 30 ), "the next transaction reads its own value" );
+    }
+    Expect( nLate > 0, "late responses time out" );
+    Expect( rtu.Dropped() == nLate * 7, "each late response is dropped whole" );
+
+    printf( "test_rtu_client: %zu failures\n", g_nFailures );
+    return g_nFailures != 0;
+}
@@ -0,0 +1,114 @@
+/*
+* test_tcp_defer - a connection whose request MBTCPAdapter::Defer() set aside
+* keeps pipelining: its socket must not wake the poll until TransmitDeferred(),
+* and the requests that waited meanwhile are all served after it.
+*
+* usage: test_tcp_defer
+*/
+
+#include <MBusTiny.h>
+#include "MBTCPAdapter.h"
+#include "BenchSlave.h"
+#include "BenchUtil.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+static int
+ConnectLocal( uint16_t uPort )
+{
+    int fd = socket( AF_INET, SOCK_STREAM, 0 );
+    struct sockaddr_in sa;
+    memset( &sa, 0, sizeof( sa ) );
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons( uPort );
+    sa.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    if( connect( fd, (struct sockaddr*)&sa, sizeof( sa ) ) < 0 )
+    {
+        close( fd );
+        return -1;
+    }
+    return fd;
+}
+
+/* sends nRequests FC3 requests back to back, more than the adapter's receive buffer holds */
+static bool
+SendReads( int fd, size_t nRequests )
+{
+    for( size_t cReq = 0; cReq < nRequests; cReq ++ )
+    {
+        uint8_t arrbFrame[] = { (uint8_t)( cReq >> 8 ), (uint8_t)cReq, 0, 0, 0, 6,
+                                1, MBUSDevice::fcReadMultipleHoldingRegisters, 0, 0, 0, 1 };
+        if( send( fd, arrbFrame, sizeof( arrbFrame ), 0 ) != (ssize_t)sizeof( arrbFrame ) )
+            return false;
+    }
+    return true;
+}
+
+int
+main()
+{
+    const size_t nPipelined = 200;
+    const int nTimeoutMS = 20;
+    MBTCPAdapter tcp( 4 );
+    if( ! tcp.Listen( 0, "127.0.0.1" ) )
+    {
+        printf( "test_tcp_defer: cannot listen\n" );
+        return 1;
+    }
+    tcp.SetPollTimeout( nTimeoutMS );
+    BenchSlave slave( &tcp, 1 );
+    int fd = ConnectLocal( tcp.Port() );
+    if( fd < 0 )
+    {
+        printf( "test_tcp_defer: cannot connect\n" );
+        return 1;
+    }
+
+    Expect( SendReads( fd, 1 ), "the first request sent" );
+    uint8_t arrbPDU[ nPDU ];
+    size_t nRequest = 0;
+    uint32_t uTicket = 0;
+    for( int cTry = 0; cTry < 100 && ! tcp.AvailableIn(); cTry ++ )
+        ;
+    Expect( tcp.ReceivePDU( 1, arrbPDU, sizeof( arrbPDU ), nRequest ) && tcp.Defer( uTicket ), "the first request deferred" );
+
+    // the pipelined requests fill the receive buffer; the poll has to wait them out, not spin on them
+    Expect( SendReads( fd, nPipelined ), "the pipelined requests sent" );
+    const int nPolls = 5;
+    uint64_t uStart = BenchNowNS();
+    for( int cPoll = 0; cPoll < nPolls; cPoll ++ )
+        Expect( ! tcp.AvailableIn(), "nothing served while a reply is deferred" );
+    uint64_t uWaitedMS = ( BenchNowNS() - uStart ) / 1000000;
+    Expect( uWaitedMS >= (uint64_t)( nPolls * nTimeoutMS / 2 ), "the poll blocks while a reply is deferred" );
+
+    const uint8_t arrbReply[] = { 1, MBUSDevice::fcReadMultipleHoldingRegisters, 2, 0x12, 0x34 };
+    MBSegment segReply = { arrbReply, sizeof( arrbReply ) };
+    Expect( tcp.TransmitDeferred( uTicket, &segReply, 1 ), "the deferred reply sent" );
+
+    // every reply is 6 MBAP bytes + 5 PDU bytes
+    const size_t nReplyFrame = 11;
+    size_t nReplies = 0;
+    uint8_t arrbIn[ 4096 ];
+    size_t nIn = 0;
+    for( int cTry = 0; cTry < 10000 && nReplies < nPipelined + 1; cTry ++ )
+    {
+        slave.TranscievePDU();
+        ssize_t nRead = recv( fd, arrbIn + nIn, sizeof( arrbIn ) - nIn, MSG_DONTWAIT );
+        if( nRead > 0 )
+            nIn += nRead;
+        size_t nWhole = nIn - nIn % nReplyFrame;
+        nReplies += nWhole / nReplyFrame;
+        memmove( arrbIn, arrbIn + nWhole, nIn - nWhole );
+        nIn -= nWhole;
+    }
+    Expect( nReplies == nPipelined + 1, "the deferred and the pipelined requests all answered" );
+    Expect( tcp.Connections() == 1, "the connection survives the deferral" );
+
+    close( fd );
+    printf( "test_tcp_defer: %zu failures\n", g_nFailures );
+    return g_nFailures != 0;
+}
@@ -0,0 +1,116 @@
+/*
+* test_tcp_sizes - requests whose MBAP length disagrees with the function code
+* are answered with exIllegalDataValue by MBTCPAdapter, well-formed ones are
+* served, and the connection stays usable in between.
+*
+* usage: test_tcp_sizes
+*/
+
+#include <MBusTiny.h>
+#include "MBTCPAdapter.h"
+#include "BenchSlave.h"
+#include "BenchUtil.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+static int
+ConnectLocal( uint16_t uPort )
+{
+    int fd = socket( AF_INET, SOCK_STREAM, 0 );
+    struct sockaddr_in sa;
+    memset( &sa, 0, sizeof( sa ) );
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons( uPort );
+    sa.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    if( connect( fd, (struct sockaddr*)&sa, sizeof( sa ) ) < 0 )
+    {
+        close( fd );
+        return -1;
+    }
+    return fd;
+}
+
+/* sends the unit PDU behind an MBAP header whose length covers it, serves until the reply
+*  arrives and returns the reply's unit PDU size, 0 on no reply */
+static size_t
+Exchange( BenchSlave& rSlave, int fd, const uint8_t* pbPDU, size_t nPDU, uint8_t* pbReply )
+{
+    uint8_t arrbFrame[ 300 ] = { 0x12, 0x34, 0, 0, (uint8_t)( nPDU >> 8 ), (uint8_t)nPDU };
+    memcpy( arrbFrame + 6, pbPDU, nPDU );
+    if( send( fd, arrbFrame, 6 + nPDU, 0 ) != (ssize_t)( 6 + nPDU ) )
+        return 0;
+    size_t nReply = 0;
+    for( int cTry = 0; cTry < 1000; cTry ++ )
+    {
+        rSlave.TranscievePDU();
+        ssize_t nRead = recv( fd, arrbFrame + nReply, sizeof( arrbFrame ) - nReply, MSG_DONTWAIT );
+        if( nRead > 0 )
+            nReply += nRead;
+        if( nReply >= 6 && nReply >= 6 + (size_t)( ( arrbFrame[4] << 8 ) | arrbFrame[5] ) )
+        {
+            Expect( arrbFrame[0] == 0x12 && arrbFrame[1] == 0x34, "transaction identifier echoed" );
+            memcpy( pbReply, arrbFrame + 6, nReply - 6 );
+            return nReply - 6;
+        }
+    }
+    return 0;
+}
+
+static void
+ExpectRefused( BenchSlave& rSlave, int fd, const uint8_t* pbPDU, size_t nPDU, const char* pszWhat )
+{
+    uint8_t arrbReply[ 300 ];
+    size_t nReply = Exchange( rSlave, fd, pbPDU, nPDU, arrbReply );
+    Expect( nReply == 3 && arrbReply[1] == ( pbPDU[1] | 0x80 ) && arrbReply[2] == MBUSDevice::exIllegalDataValue, pszWhat );
+}
+
+int
+main()
+{
+    MBTCPAdapter tcp( 4 );
+    if( ! tcp.Listen( 0, "127.0.0.1" ) )
+    {
+        printf( "test_tcp_sizes: cannot listen\n" );
+        return 1;
+    }
+    tcp.SetPollTimeout( 1 );
+    BenchSlave slave( &tcp, 1 );
+    int fd = ConnectLocal( tcp.Port() );
+    if( fd < 0 )
+    {
+        printf( "test_tcp_sizes: cannot connect\n" );
+        return 1;
+    }
+
+    uint8_t arrbReply[ 300 ];
+    const uint8_t arrbRead[] = { 1, MBUSDevice::fcReadMultipleHoldingRegisters, 0, 0, 0, 2 };
+    Expect( Exchange( slave, fd, arrbRead, sizeof( arrbRead ), arrbReply ) == 7 && arrbReply[1] == 3, "FC3 served" );
+
+    const uint8_t arrbLongRead[] = { 1, MBUSDevice::fcReadMultipleHoldingRegisters, 0, 0, 0, 2, 0 };
+    ExpectRefused( slave, fd, arrbLongRead, sizeof( arrbLongRead ), "FC3 with a trailing byte refused" );
+    const uint8_t arrbShortWrite[] = { 1, MBUSDevice::fcWriteSingleHoldingRegister, 0, 1, 0 };
+    ExpectRefused( slave, fd, arrbShortWrite, sizeof( arrbShortWrite ), "short FC6 refused" );
+    // FC16 announcing four data bytes and carrying two
+    const uint8_t arrbShortMulti[] = { 1, MBUSDevice::fcWriteMultipleHoldingRegisters, 0, 0, 0, 2, 4, 0xAB, 0xCD };
+    ExpectRefused( slave, fd, arrbShortMulti, sizeof( arrbShortMulti ), "FC16 shorter than its byte count refused" );
+    const uint8_t arrbLongMulti[] = { 1, MBUSDevice::fcWriteMultipleHoldingRegisters, 0, 0, 0, 1, 2, 0xAB, 0xCD, 0xEF };
+    ExpectRefused( slave, fd, arrbLongMulti, sizeof( arrbLongMulti ), "FC16 longer than its byte count refused" );
+    const uint8_t arrbShortRW[] = { 1, MBUSDevice::fcReadWriteMultipleRegisters, 0, 0, 0, 1, 0, 0, 0, 1, 2, 0xAB };
+    ExpectRefused( slave, fd, arrbShortRW, sizeof( arrbShortRW ), "FC23 shorter than its byte count refused" );
+    Expect( slave.m_arruRegs[0] == 0x1000, "refused writes leave the registers alone" );
+    Expect( tcp.BadSizes() == 5, "refusals counted" );
+
+    const uint8_t arrbMulti[] = { 1, MBUSDevice::fcWriteMultipleHoldingRegisters, 0, 0, 0, 1, 2, 0xAB, 0xCD };
+    Expect( Exchange( slave, fd, arrbMulti, sizeof( arrbMulti ), arrbReply ) == 6 && arrbReply[1] == 16, "FC16 served" );
+    Expect( slave.m_arruRegs[0] == 0xABCD, "FC16 written" );
+    Expect( tcp.Connections() == 1, "the connection survives the refusals" );
+
+    close( fd );
+    printf( "test_tcp_sizes: %zu failures\n", g_nFailures );
+    return g_nFailures != 0;
+}